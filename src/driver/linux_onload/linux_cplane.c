@@ -995,12 +995,14 @@ cicpos_mac_read(struct seq_file *seq, void *s)
 
         /* user-visible args */
         seq_printf(seq, "#%04x: llap %02d %4s ip "CI_IP_PRINTF_FORMAT
-                   " mac "CI_MAC_PRINTF_FORMAT" on %3d%s%s",
+                   " mac "CI_MAC_PRINTF_FORMAT" tag %02x%s%s",
                    mac_index, row->ifindex,
                    _cicp_llap_get_name(control_plane, row->ifindex),
                    CI_IP_PRINTF_ARGS(&row->ip_addr),
                    CI_MAC_PRINTF_ARGS(&row->mac_addr),
-                   cicp_mac_row_usecount(row),
+                   cicp_mac_bucket(umact, mac_index >>
+                                   CICP_MAC_BUCKET_ROWS_LN2)->
+                     tag[mac_index & (CICP_MAC_BUCKET_ROWS - 1)],
                    cicp_mac_row_enter_requested(row) ? " !service!": "",
                    row->need_update == CICP_MAC_ROW_NEED_UPDATE_STALE ?
                         " STALE" :
@@ -30,12 +30,13 @@
 #include <onload/debug.h>
 #include <onload/shmbuf.h>
 
-int ci_shmbuf_alloc(ci_shmbuf_t* b, unsigned bytes)
+int ci_shmbuf_alloc(ci_shmbuf_t* b, unsigned bytes, int numa_node)
 {
   unsigned i;
 
   ci_assert(b);
   
+  b->numa_node = numa_node;
   b->n_pages = CI_ROUND_UP(bytes, CI_PAGE_SIZE) >> CI_PAGE_SHIFT;
   b->pages = ci_alloc(b->n_pages * sizeof(b->pages[0]));
   if( b->pages == 0 )  return -ENOMEM;
@@ -69,7 +70,7 @@ int ci_shmbuf_demand_page(ci_shmbuf_t* b, unsigned page_i,
 
   if( ! efhw_page_is_valid(&b->pages[page_i]) ) {
     struct efhw_page p;
-    if( efhw_page_alloc_zeroed(&p) == 0 ) {
+    if( efhw_page_alloc_zeroed_node(&p, b->numa_node) == 0 ) {
       ci_irqlock_state_t lock_flags;
       ci_irqlock_lock(lock, &lock_flags);
       if( ! efhw_page_is_valid(&b->pages[page_i]) ) {
@@ -285,6 +285,9 @@ typedef int (*ci_waiter_on_wakeup_fn)(ci_waiter_t*, void*, void*, int rc,
   do{ wake_up_interruptible(&(w)->wq); }while(0)
 #define ci_waitable_wakeup_all(w)			\
   do{ wake_up_interruptible_all(&(w)->wq); }while(0)
+/* Wakes all non-exclusive waiters and up to [nr] exclusive ones. */
+#define ci_waitable_wakeup_nr(w, nr)			\
+  do{ wake_up_interruptible_nr(&(w)->wq, (nr)); }while(0)
 
 #if HZ > 2000
 # error HZ is too big for ci_waitq_init_timeout
@@ -485,6 +488,17 @@ ci_inline int ci_contig_shmbuf_alloc(ci_contig_shmbuf_t* kus, unsigned bytes) {
   return kus->p ? 0 : -ENOMEM;
 }
 
+/* As ci_contig_shmbuf_alloc(), but prefer memory on [numa_node] (which may
+ * be -1 for no preference). */
+ci_inline int ci_contig_shmbuf_alloc_node(ci_contig_shmbuf_t* kus,
+                                          unsigned bytes, int numa_node) {
+  ci_assert(bytes > 0);
+  kus->bytes = CI_ROUND_UP(bytes, CI_PAGE_SIZE);
+  ci_assert(! ci_in_atomic());
+  kus->p = vmalloc_node(kus->bytes, numa_node);
+  return kus->p ? 0 : -ENOMEM;
+}
+
 ci_inline void ci_contig_shmbuf_free(ci_contig_shmbuf_t* kus) {
   ci_assert(! ci_in_atomic());
   ci_assert(kus);  ci_assert(kus->p);
@@ -62,6 +62,11 @@ ci_inline int ci_contig_shmbuf_alloc(ci_contig_shmbuf_t* kus, unsigned bytes) {
   return kus->p ? 0 : -ENOMEM;
 }
 
+ci_inline int ci_contig_shmbuf_alloc_node(ci_contig_shmbuf_t* kus,
+                                          unsigned bytes, int numa_node) {
+  return ci_contig_shmbuf_alloc(kus, bytes);
+}
+
 ci_inline void ci_contig_shmbuf_free(ci_contig_shmbuf_t* kus) {
   ci_assert(kus);  ci_assert(kus->p);
   ci_free(kus->p);
@@ -69,6 +69,7 @@ ci_inline void ci_waitable_wakeup_one(ci_waitable_t* wq) {
   pthread_cond_broadcast(&wq->cv); 
 }
 #define ci_waitable_wakeup_all	ci_waitable_wakeup_one
+#define ci_waitable_wakeup_nr(wq, nr)  ci_waitable_wakeup_one(wq)
 
 #define ci_waiter_pre(waiter, wq)		\
   do {						\
@@ -102,6 +102,15 @@ static inline int efhw_page_alloc_zeroed(struct efhw_page *p)
 	return p->kva ? 0 : -ENOMEM;
 }
 
+static inline int efhw_page_alloc_zeroed_node(struct efhw_page *p, int node)
+{
+	struct page *page;
+	page = alloc_pages_node(node, (in_interrupt() ? GFP_ATOMIC : GFP_KERNEL)
+				| __GFP_ZERO, 0);
+	p->kva = page ? (unsigned long)page_address(page) : 0;
+	return p->kva ? 0 : -ENOMEM;
+}
+
 static inline void efhw_page_free(struct efhw_page *p)
 {
 	free_page(p->kva);
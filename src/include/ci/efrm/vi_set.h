@@ -81,6 +81,19 @@ efrm_vi_set_get_base(struct efrm_vi_set *);
 extern int
 efrm_vi_set_get_rss_context(struct efrm_vi_set *, unsigned rss_id);
 
+/* These values are defined by hardware. */
+#define EFRM_RSS_KEY_LEN   40
+#define EFRM_RSS_TABLE_LEN 128
+
+/* Copies out the Toeplitz key and indirection table of an RSS context
+ * that was allocated for the set.  Returns the EFRM_RSS_MODE_* that the
+ * context hashes with, or -ENOENT if the set has no context whose key we
+ * chose (in which case spreading is up to the net driver or firmware).
+ */
+extern int
+efrm_vi_set_get_rss_config(struct efrm_vi_set *, unsigned rss_id,
+			   uint8_t *key, uint8_t *indir_table);
+
 extern struct efrm_resource *
 efrm_vi_set_to_resource(struct efrm_vi_set *);
 
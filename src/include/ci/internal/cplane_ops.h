@@ -961,6 +961,31 @@ cicp_user_is_valid(const cicp_ul_mibs_t *user,
 
 
 
+/*! Validate that the route found by a forwarding table lookup is current
+ *
+ * \param fwdt            the forwarding table
+ * \param handle          the integrity handle
+ *
+ * \return                0 iff the route may no longer be the right one
+ *
+ * The handle's row index is the route's stamp id.  A handle with row index
+ * CICP_FWD_ROWID_BAD records that no route was found, and remains valid
+ * until a route is added.
+ */
+ci_inline int /* bool */
+cicp_fwd_is_valid(const cicp_fwdinfo_t *fwdt,
+                  const cicp_fwd_verinfo_t *handle)
+{
+  ci_assert_ge(handle->row_index, CICP_FWD_ROWID_BAD);
+  ci_assert_lt(handle->row_index, (int) fwdt->rows_max);
+
+  if (handle->row_index == CICP_FWD_ROWID_BAD)
+    return fwdt->noroute_version == handle->row_version;
+  return cicp_fwd_stamps(fwdt)[handle->row_index] == handle->row_version;
+}
+
+
+
 /*!
  * Establish forwarding information.
  *
@@ -997,6 +1022,7 @@ cicp_user_retrieve(ci_netif*                    ni,
  * include:
  *
  * - mac_integrity
+ * - fwd_integrity
  * - freshness (invalidated)
  * - ip_saddr_be32
  * - status
@@ -1014,12 +1040,17 @@ cicp_ip_cache_update_from(ci_netif* ni, ci_ip_cached_hdrs* ipcache,
 
 
 /*! Check the ip cache is currently valid
+ *
+ * Only a change to the MAC table row or route row that the cache was made
+ * from invalidates it, so churn elsewhere in the tables does not send every
+ * socket back through cicp_user_retrieve().
  */
 ci_inline int /* bool */
 cicp_ip_cache_is_valid(cicp_handle_t *cicp_handle,  ci_ip_cached_hdrs *ipcache)
 {
-    return cicp_user_is_valid(&CICP_MIBS(cicp_handle)->user,
-			      &ipcache->mac_integrity);
+    const cicp_ul_mibs_t *user = &CICP_MIBS(cicp_handle)->user;
+    return cicp_user_is_valid(user, &ipcache->mac_integrity) &&
+           cicp_fwd_is_valid(user->fwdinfo_utable, &ipcache->fwd_integrity);
 }
 
 
@@ -1249,6 +1280,28 @@ _cicpos_route_find(const cicp_fwdinfo_t   *routet,
 extern cicp_fwd_row_t *
 _cicpos_fwd_find_free(cicp_fwdinfo_t *fwdt);
 
+extern const cicp_fwd_row_t *
+_cicp_fwd_find_ip(const cicp_fwdinfo_t *fwdt, ci_ip_addr_t ip_dest,
+                  ci_ifid_t dest_ifindex);
+
+/*! Rebuild the route index from the allocated rows of path[]
+ *
+ *  This function requires the table's version lock to be held for writing.
+ */
+extern void
+cicp_fwd_index_build(cicp_fwdinfo_t *fwdt);
+
+/*! Give new stamps to the rows that a route to [dest_ip]/[dest_set] could
+ *  take traffic from, and to lookups that found no route, so that cached
+ *  forwarding information that might now be wrong is looked up again.
+ *
+ *  Call this when a route is added, changed or removed.  This function
+ *  requires the table's version lock to be held for writing.
+ */
+extern void
+cicp_fwd_route_changed(cicp_fwdinfo_t *fwdt, ci_ip_addr_t dest_ip,
+                       ci_ip_addrset_t dest_set);
+
 
  
 
@@ -139,25 +139,6 @@ cicp_mac_row_enter_request(cicp_mac_row_t *row, int /* bool */see_me)
 }
 
 
-ci_inline ci_uint16
-cicp_mac_row_usecount(const cicp_mac_row_t *row)
-{   return row->use_enter & 0x7FFF;
-}
-
-
-ci_inline void
-cicp_mac_row_usecount_inc(cicp_mac_row_t *row)
-{   if ((row->use_enter & 0x7FFF) != 0x7FFF)
-        row->use_enter++;
-}
-
-
-ci_inline void
-cicp_mac_row_usecount_dec(cicp_mac_row_t *row)
-{   row->use_enter--; /* must not be called when count is zero */
-}
-
-
 /*! the following should not be used unless a write lock has been
  *  obtained and no rows are being updated.
  */
@@ -173,9 +154,32 @@ cicp_mac_mib_rows(const cicp_mac_mib_t *mact)
 }
 
 
-/* constant-preserving macro for determining size of kernel MAC MIB */ 
+ci_inline int
+cicp_mac_mib_buckets(const cicp_mac_mib_t *mact)
+{   return (1 << (mact->rows_ln2 - CICP_MAC_BUCKET_ROWS_LN2));
+}
+
+
+ci_inline const cicp_mac_bucket_t *
+cicp_mac_bucket(const cicp_mac_mib_t *mact, unsigned bucket)
+{   return (const cicp_mac_bucket_t *)((const char *)mact + mact->tags_ofs) +
+           bucket;
+}
+
+
+ci_inline ci_uint8 *
+cicp_mac_row_tag(cicp_mac_mib_t *mact, cicp_mac_rowid_t rowid)
+{   return (ci_uint8 *)mact + mact->tags_ofs + rowid;
+}
+
+
+/* constant-preserving macros for determining size of kernel MAC MIB, which
+ * has a tag byte for each row after the rows */
+#define CICP_MAC_MIB_TAGS_OFS(_mact, _n)                                \
+        CI_ROUND_UP(sizeof(*(_mact))+((_n)-1)*sizeof((_mact)->ipmac[0]), \
+                    CI_CACHE_LINE_SIZE)
 #define CICP_MAC_MIB_SIZE(_mact, _n) \
-        (sizeof(*(_mact))+((_n)-1)*sizeof((_mact)->ipmac[0]))
+        (CICP_MAC_MIB_TAGS_OFS(_mact, _n) + (_n))
 
 
 ci_inline int /* bool */
@@ -191,12 +195,76 @@ cicp_fwd_row_free(cicp_fwd_row_t *row)
 }
 
 
+ci_inline ci_verlock_value_t *
+cicp_fwd_stamps(const cicp_fwdinfo_t *fwdt)
+{   return (ci_verlock_value_t *)((char *)fwdt + fwdt->stamps_ofs);
+}
+
+
+/*! Return a stamp that has not been given out before (wrapping aside) */
+ci_inline ci_verlock_value_t
+cicp_fwd_stamp_next(cicp_fwdinfo_t *fwdt)
+{   if (++fwdt->stamp_last == CI_VERLOCK_BAD)
+        ++fwdt->stamp_last;
+    return fwdt->stamp_last;
+}
+
+
+/*! Invalidate forwarding information cached from this row's route */
+ci_inline void
+cicp_fwd_row_stamp(cicp_fwdinfo_t *fwdt, const cicp_fwd_row_t *row)
+{   cicp_fwd_stamps(fwdt)[row->stamp_id] = cicp_fwd_stamp_next(fwdt);
+}
+
+
+/*! Give a new route a stamp entry that no other route is using */
+ci_inline void
+cicp_fwd_row_stamp_new(cicp_fwdinfo_t *fwdt, cicp_fwd_row_t *row)
+{   ci_verlock_value_t *stamps = cicp_fwd_stamps(fwdt);
+    int id = 0;
+    while (stamps[id] != CI_VERLOCK_BAD)
+        ++id;
+    ci_assert_lt(id, fwdt->rows_max);
+    row->stamp_id = id;
+    cicp_fwd_row_stamp(fwdt, row);
+}
+
+
+/*! Free a route's row and its stamp entry: unlike cicp_fwd_row_free() this
+ *  is for a route being removed, not a row being moved from.
+ */
+ci_inline void
+cicp_fwd_row_remove(cicp_fwdinfo_t *fwdt, cicp_fwd_row_t *row)
+{   cicp_fwd_stamps(fwdt)[row->stamp_id] = CI_VERLOCK_BAD;
+    cicp_fwd_row_free(row);
+}
+
+
 ci_inline int /* bool */
 cicp_fwd_row_allocated(const cicp_fwd_row_t *row)
 {   return (row->destnet_ipset != CI_IP_ADDRSET_BAD);
 }
 
 
+ci_inline cicp_fwd_index_t *
+cicp_fwd_index(const cicp_fwdinfo_t *fwdt)
+{   return fwdt->index_ofs == 0 ? NULL :
+           (cicp_fwd_index_t *)((char *)fwdt + fwdt->index_ofs);
+}
+
+
+/*! Stop using the route index until cicp_fwd_index_build() is next called:
+ *  needed when rows are added, removed or moved without rebuilding it.
+ *  Requires the table's version lock to be held for writing.
+ */
+ci_inline void
+cicp_fwd_index_invalidate(cicp_fwdinfo_t *fwdt)
+{   cicp_fwd_index_t *idx = cicp_fwd_index(fwdt);
+    if (idx != NULL)
+        idx->valid = 0;
+}
+
+
 ci_inline ci_ifid_t
 cicp_fwd_hwport_to_base_ifindex(const cicp_ul_mibs_t* user,
                                 ci_hwport_id_t hwport)
@@ -350,7 +350,7 @@ typedef struct
     ci_mac_addr_t mac_addr;  /*< the ip address's MAC address */
     ci_uint16     rc;        /*< permanent return code associated with entry */
     ci_ifid_t     ifindex;   /*< access point on which the MAC addr is valid */
-    ci_uint16     use_enter; /*< hash chain use count + enter kernel flag */
+    ci_uint16     use_enter; /*< enter kernel flag (top bit) */
     ci_uint8      need_update; /*< ARP entry should be updated (STALE).
                                    This field is changed without
                                    version change */
@@ -362,6 +362,9 @@ typedef struct
 struct cicp_mac_mib_s
 {   
   ci_uint32 rows_ln2;             /*< power of two, NB: can only increase */
+  ci_uint32 tags_ofs;             /*< offset of bucket tags from the start */
+  ci_uint32 deleted_rows;         /*< rows whose tag is marked deleted */
+  ci_uint32 deleted_max;          /*< compact the tags beyond this many */
   cicp_mac_row_t mostly_valid_row;  /*< special row -- mostly valid */
   /* This must be last in the structure, as we allocate extra trailing
    * space for the correct number of rows 
@@ -380,22 +383,44 @@ struct cicp_mac_mib_s
 typedef struct cicp_mac_mib_s cicp_mac_mib_t;
 
 
-/* The MAC MIB is a table indexed by IP address.
-   
-   This is achieved by performing an initial hash dependent on the ARP table
-   size and IP address and then rehashing dependent on the previous hash and
-   the IP address.  The number of rehashes is limited.  Because entries can be
-   deleted a lookup must incorporate at least this number of accesses before
-   concluding that an IP address is not present.
-   
-   \todo: Implement:
-   If the rehash limit is reached while locating a row for a new entry a table
-   twice as large will be allocated and each existing entry will be hashed
-   into the new table.
-   
-   Thus the limit defines both the maximum amount of work done while accessing
-   the table and the rate at which the table will grow.
+/* The MAC MIB is a hash table indexed by IP address and ifindex.
+
+   The rows are grouped into buckets of CICP_MAC_BUCKET_ROWS consecutive
+   rows.  Each bucket has a byte of tag for each of its rows, and the tags
+   of a bucket are packed together (four buckets to a cache line) so that a
+   lookup can compare them all at once and only visit rows whose tag
+   matches.  An entry's hash selects its home bucket and its tag.  If the
+   home bucket is full the entry goes in the next bucket with room, up to
+   CICP_MAC_BUCKET_PROBES buckets on.
+
+   A lookup can stop at the first bucket with an empty row, because
+   nothing was put beyond a bucket that was not full.  So when an entry is
+   deleted from a full bucket its tag is marked deleted rather than empty:
+   later lookups keep going past it, and later insertions reuse it in
+   preference to an empty row.
+
+   Deleted tags would otherwise build up until lookups for absent entries
+   went through every bucket they may.  So once an eighth of the rows
+   (CICP_MAC_DELETED_COMPACT_LN2) have been marked deleted since the last
+   time, the tags are compacted: a bucket that no entry goes past has its
+   deleted tags made empty again.  Entries are not moved, because callers
+   hold on to rowids.
+
+   Readers do not lock the table.  A tag only tells them which rows to look
+   at, and they check a row's version as before.
 */
+typedef struct {
+  ci_uint8 tag[16];
+} cicp_mac_bucket_t;
+
+#define CICP_MAC_BUCKET_ROWS_LN2  4
+#define CICP_MAC_BUCKET_ROWS      (1 << CICP_MAC_BUCKET_ROWS_LN2)
+#define CICP_MAC_BUCKET_PROBES    8
+#define CICP_MAC_DELETED_COMPACT_LN2  3  /*< compact after 1/8 of the rows */
+
+#define CICP_MAC_TAG_EMPTY        0x00u  /*< never used since emptied */
+#define CICP_MAC_TAG_DELETED      0x01u  /*< free, but lookups continue */
+#define CICP_MAC_TAG_FULL         0x80u  /*< | 7 bits of hash */
 
 /*! Type used to represent the continued validity of an address resolution */
 typedef cicp_mib_verinfo_t cicp_mac_verinfo_t;
@@ -464,6 +489,7 @@ typedef struct
     ci_int16         bond_rowid;   /*< rowid in bond table */
     ci_uint32        flags;
 #define CICP_FLAG_ROUTE_MTU 0x1
+    ci_uint16        stamp_id;     /*< this route's entry in the stamps */
 } cicp_fwd_row_t;
 
 
@@ -477,9 +503,23 @@ struct cicp_fwdinfo_s
    */
   ci_ifid_t      hwport_to_base_ifindex[CI_CFG_MAX_REGISTER_INTERFACES];
   ci_uint16      rows_max;
+  /*! Offset in bytes of the route index (cicp_fwd_index_t) from the start
+   * of this table, or 0 if there is none.
+   */
+  ci_uint32      index_ofs;
+  /*! Offset in bytes of the route stamps (ci_verlock_value_t[rows_max])
+   * from the start of this table.
+   */
+  ci_uint32      stamps_ofs;
+  /*! Stamp for forwarding information that found no route row: new
+   * whenever a route is added.
+   */
+  ci_verlock_value_t noroute_version;
+  /*! The last stamp given out. */
+  ci_verlock_value_t stamp_last;
 
   /* This must be last in the structure, as we allocate extra trailing
-   * space for the correct number of rows 
+   * space for the correct number of rows
    */
   cicp_fwd_row_t path[1];
 } /* cicp_fwdinfo_t */;
@@ -490,6 +530,57 @@ struct cicp_fwdinfo_s
  * destnet_set, destnet_ip, or "allocated" (i.e. insertion or deletion).
  */
 
+/* Each route has an entry in the stamps array, given by its row's
+ * [stamp_id], which does not change when the rows are sorted or compressed.
+ * Forwarding information cached from a route records the stamp id and the
+ * stamp, and remains valid for as long as that entry has that stamp.  A
+ * route gets a new stamp when it is changed, and when a route is added or
+ * removed that could take traffic from it.  Stamps are never reused
+ * (wrapping aside) and entries not in use are CI_VERLOCK_BAD.
+ */
+
+/*! Type used to represent the continued validity of a route lookup */
+typedef cicp_mib_verinfo_t cicp_fwd_verinfo_t;
+
+
+/* Longest-prefix-match index over path[], so that looking up a destination
+ * does not have to scan the whole table.  It is a multibit trie with a
+ * 16-bit root stride and two 8-bit strides below that: each entry holds
+ * either the rowid of the first row of path[] matching all addresses under
+ * it, CICP_FWD_INDEX_MISS, or CICP_FWD_INDEX_NODE | n to refer to node[n]
+ * at the next level down.
+ *
+ * The index is rebuilt by the kernel whenever rows are added, removed or
+ * reordered, under the table's version lock.  [valid] is cleared while
+ * path[] and the index disagree (e.g. during a bulk import, or if there are
+ * not enough nodes) and lookups then fall back to scanning path[].
+ */
+typedef ci_uint16 cicp_fwd_index_entry_t;
+
+#define CICP_FWD_INDEX_ROOT_BITS  16
+#define CICP_FWD_INDEX_NODE_BITS  8
+#define CICP_FWD_INDEX_NODE       0x8000u
+#define CICP_FWD_INDEX_MISS       0x7fffu
+
+typedef struct {
+  ci_uint32              valid;       /*< index agrees with path[] */
+  ci_uint16              nodes_max;   /*< number of node[] allocated */
+  ci_uint16              nodes_used;  /*< number of node[] in use */
+  cicp_fwd_index_entry_t root[1u << CICP_FWD_INDEX_ROOT_BITS];
+  /* This must be last in the structure: there are [nodes_max] of them. */
+  cicp_fwd_index_entry_t node[1][1u << CICP_FWD_INDEX_NODE_BITS];
+} cicp_fwd_index_t;
+
+/* A prefix of at most 16 bits needs no nodes, and a longer one needs at
+ * most one at each of the two levels below the root.  We cannot index
+ * more rows than fit in an entry.
+ */
+#define CICP_FWD_INDEX_NODES(rows_max)  CI_MIN(2 * (rows_max), 0x7fff)
+#define CICP_FWD_INDEX_SIZE(nodes_max)                                  \
+  (sizeof(cicp_fwd_index_t) +                                           \
+   ((nodes_max) - 1) * sizeof(((cicp_fwd_index_t*) 0)->node[0]))
+#define CICP_FWD_INDEX_ROWS_MAX   CICP_FWD_INDEX_MISS
+
 /*----------------------------------------------------------------------------
  * oo_timesync state (user-visible)
  *---------------------------------------------------------------------------*/
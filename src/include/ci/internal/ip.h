@@ -224,6 +224,13 @@ extern void __ci_ip_timer_set(ci_netif*, ci_ip_timer* ts, ci_iptime_t t) CI_HF;
 */
 extern void ci_ip_timer_poll(ci_netif* netif) CI_HF;
 
+/*! Find when the earliest pending timer is due.  The stack must be locked.
+**  \param netif  A pointer to the netif structure
+**  \param t_out  Set to the expiry time of the earliest pending timer
+**  \return       Zero if no timers are pending, else non-zero
+*/
+extern int ci_ip_timer_next_expiry(ci_netif* netif, ci_iptime_t* t_out) CI_HF;
+
 /*! Initialise the ip timer management structure shared state in netif,
 **  includes calibration and wheel setup.
 **  \param netif  A pointer to the netif to initialise
@@ -309,6 +316,8 @@ do {                                                            \
   (ipcache)->status = retrrc_noroute;                           \
   (ipcache)->mac_integrity.row_index = 0;                       \
   (ipcache)->mac_integrity.row_version = CI_VERLOCK_BAD;        \
+  (ipcache)->fwd_integrity.row_index = CICP_FWD_ROWID_BAD;      \
+  (ipcache)->fwd_integrity.row_version = CI_VERLOCK_BAD;        \
   (ipcache)->intf_i = -1;                                       \
   (ipcache)->hwport = CI_HWPORT_ID_BAD;                         \
   (ipcache)->ether_type = CI_ETHERTYPE_IP;                      \
@@ -454,6 +463,10 @@ extern int  ci_netif_ctor(ci_netif**, const ci_netif_config_opts*,
 extern int  ci_netif_ctor(ci_netif*, ef_driver_handle, const char* name,
                           unsigned flags) CI_HF;
 extern void ci_netif_cluster_prefault(ci_netif* ni) CI_HF;
+/* Fault in the stack's shared state, rings and packet buffers.  Returns
+ * the number of pages touched. */
+extern int ci_netif_warm(ci_netif* ni) CI_HF;
+extern int ci_netif_touch_pages(const void* p, size_t len) CI_HF;
 #endif
 extern int  ci_netif_restore_id(ci_netif*, unsigned stack_id) CI_HF;
 extern int citp_netif_by_id(ci_uint32 stack_id, ci_netif** out_ni, int locked) CI_HF;
@@ -599,6 +612,7 @@ CI_DEBUG(extern void ci_netif_verify_freepkts(ci_netif *, const char *, int);)
 
 
 extern int ci_netif_pktset_best(ci_netif* ni) CI_HF;
+extern int ci_netif_pktset_best_for_intf(ci_netif* ni, int intf_i) CI_HF;
 extern void ci_netif_pkt_free(ci_netif* ni, ci_ip_pkt_fmt* pkt
                               CI_KERNEL_ARG(int* p_netif_is_locked)) CI_HF;
 
@@ -610,6 +624,36 @@ extern void ci_netif_try_to_reap(ci_netif* ni, int stop_once_freed_n) CI_HF;
 extern void ci_netif_rxq_low_on_recv(ci_netif*, ci_sock_cmn*,
                                      int bytes_freed) CI_HF;
 
+/* Sockets holding more than this many receive buffers are the first to
+ * have buffers reclaimed (see EF_RX_PKT_QUOTA).
+ */
+ci_inline int ci_netif_rx_pkt_quota(ci_netif* ni)
+{
+  return NI_OPTS(ni).rx_pkt_quota != 0 ?
+    NI_OPTS(ni).rx_pkt_quota : NI_OPTS(ni).max_rx_packets / 8;
+}
+
+/* Should a socket holding [n_pkts] receive buffers drop newly received
+ * data?  Only when the stack is under memory pressure.
+ */
+ci_inline int ci_netif_rx_pkt_quota_exceeded(ci_netif* ni, int n_pkts)
+{
+  return ni->state->mem_pressure != 0 && NI_OPTS(ni).rx_pkt_quota != 0 &&
+         n_pkts >= NI_OPTS(ni).rx_pkt_quota;
+}
+
+/* Is the receive path under memory pressure?  Low pressure only matters
+ * when EF_RX_PKT_QUOTA is set, as otherwise nothing is done differently
+ * until pressure is critical.
+ */
+ci_inline int ci_netif_rx_mem_pressure(ci_netif* ni)
+{
+  return ni->state->mem_pressure &
+    (NI_OPTS(ni).rx_pkt_quota != 0 ? (OO_MEM_PRESSURE_LOW |
+                                      OO_MEM_PRESSURE_CRITICAL) :
+                                     OO_MEM_PRESSURE_CRITICAL);
+}
+
 /*! Allocate a packet buffer, blocking if necessary.  If can_block=FALSE
  * this function returns 0 or -ENOBUFS.  At userlevel this
  * function will never fail if can_block=TRUE.  In the kernel this
@@ -922,6 +966,10 @@ ci_tcp_ds_fill_headers(ci_netif* ni, ci_tcp_state* ts, unsigned flags,
                        int* tcp_seq_offset_out, int* ip_len_offset_out);
 extern int ci_tcp_ds_done(ci_netif* ni, ci_tcp_state* ts,
                           const ci_iovec *iov, int iovlen, int flags);
+/* Look up the route and wait briefly for the MAC of a connected socket's
+ * next hop, provoking an ARP request if needed.  Returns true if the
+ * socket's ipcache is then onloadable.  Call with the stack locked. */
+extern int ci_tcp_resolve_arp(ci_netif* ni, ci_tcp_state* ts);
 
 extern int
 ci_netif_raw_send(ci_netif* ni, int intf_i,
@@ -1301,10 +1349,9 @@ extern void ci_tcp_rcvbuf_unabuse(ci_netif* ni, ci_tcp_state* ts,
 extern void
 ci_tcp_syncookie_syn(ci_netif* netif, ci_tcp_socket_listen* tls,
                      ci_tcp_state_synrecv* tsr);
-extern void
+extern int
 ci_tcp_syncookie_ack(ci_netif* netif, ci_tcp_socket_listen* tls,
-                     ciip_tcp_rx_pkt* rxp,
-                     ci_tcp_state_synrecv **tsr_p);
+                     ciip_tcp_rx_pkt* rxp, ci_tcp_state_synrecv* tsr);
 
 extern void ci_tcp_set_sndbuf(ci_netif* ni, ci_tcp_state* ts);
 extern void ci_tcp_set_sndbuf_from_sndbuf_pkts(ci_netif* ni, ci_tcp_state* ts);
@@ -1358,6 +1405,214 @@ extern void citp_waitable_dump_to_logger(ci_netif* ni, citp_waitable* w,
 extern void citp_waitable_print(citp_waitable*) CI_HF;
 
 
+/*********************************************************************
+************************* Latency histograms *************************
+*********************************************************************/
+
+extern void ci_lat_hist_attach(ci_netif* ni, citp_waitable* w) CI_HF;
+extern void ci_lat_hist_release(ci_netif* ni, citp_waitable* w) CI_HF;
+extern unsigned ci_lat_hist_bucket(ci_uint64 cycles) CI_HF;
+extern ci_uint64 ci_lat_hist_bucket_lo(unsigned bucket) CI_HF;
+extern void ci_lat_hist_stage_add(ci_lat_hist_stage* st,
+                                  ci_uint64 cycles) CI_HF;
+extern void __ci_lat_hist_record(ci_netif* ni, citp_waitable* w, int stage,
+                                 ci_uint64 start) CI_HF;
+#ifndef __KERNEL__
+extern void ci_lat_hist_stage_dump(ci_netif* ni, const ci_lat_hist_stage* st,
+                                   const char* name, int verbose,
+                                   const char* pf, oo_dump_log_fn_t logger,
+                                   void* log_arg) CI_HF;
+extern void ci_lat_hist_dump(ci_netif* ni, const ci_lat_hist* lh,
+                             int verbose, const char* pf,
+                             oo_dump_log_fn_t logger, void* log_arg) CI_HF;
+#endif
+
+/* True if latency histograms are being recorded for [w].  This is the
+ * only test made at each measurement point.
+ */
+#if CI_CFG_LAT_HIST
+# define CI_LAT_HIST_ON(w)  CI_UNLIKELY(OO_SP_NOT_NULL((w)->lat_hist))
+#else
+# define CI_LAT_HIST_ON(w)  0
+#endif
+
+ci_inline ci_lat_hist* ci_lat_hist_get(ci_netif* ni, citp_waitable* w)
+{
+  ci_assert(OO_SP_NOT_NULL(w->lat_hist));
+  return (ci_lat_hist*) ((char*) SP_TO_WAITABLE_OBJ(ni, w->lat_hist) +
+                         CI_AUX_MEM_SIZE);
+}
+
+/* Take a start time for a later ci_lat_hist_record(). */
+ci_inline void ci_lat_hist_stamp(citp_waitable* w, ci_uint64* start)
+{
+  if( CI_LAT_HIST_ON(w) )
+    ci_frc64(start);
+}
+
+/* Record the time since [start] against [stage] (CI_LAT_HIST_*). */
+ci_inline void ci_lat_hist_record(ci_netif* ni, citp_waitable* w, int stage,
+                                  ci_uint64 start)
+{
+  if( CI_LAT_HIST_ON(w) )
+    __ci_lat_hist_record(ni, w, stage, start);
+}
+
+
+/*********************************************************************
+************************** Flight recorder ***************************
+*********************************************************************/
+
+#if CI_CFG_TRACE
+
+#ifdef __KERNEL__
+extern void ci_netif_trace_init(ci_netif* ni) CI_HF;
+#endif
+extern void __ci_netif_trace(ci_netif* ni, unsigned type, ci_int32 sock,
+                             ci_uint32 a0, ci_uint32 a1, ci_uint32 a2) CI_HF;
+extern void ci_netif_trace_freeze(ci_netif* ni, unsigned reason,
+                                  ci_uint64 cycles) CI_HF;
+extern void __ci_netif_trace_latency(ci_netif* ni, unsigned type,
+                                     ci_uint32 a0, ci_uint64 start) CI_HF;
+#ifndef __KERNEL__
+extern const char* ci_netif_trace_type_str(unsigned type) CI_HF;
+#endif
+
+# define CI_NETIF_TRACE_ON(ni)  CI_UNLIKELY((ni)->state->trace.enabled)
+
+/* Record an event (CI_TRACE_*) in the stack's flight recorder. */
+# define ci_netif_trace(ni, type, sock, a0, a1, a2)                     \
+  do {                                                                  \
+    if( CI_NETIF_TRACE_ON(ni) )                                         \
+      __ci_netif_trace((ni), (type), (sock), (a0), (a1), (a2));         \
+  } while( 0 )
+
+/* Record an event that ends a period that began at [start], and freeze
+ * the recorder if the period exceeded EF_TRACE_FREEZE_USEC.  [start] is 0
+ * if the recorder was off when the period began.
+ */
+# define ci_netif_trace_latency(ni, type, a0, start)                    \
+  do {                                                                  \
+    if(CI_UNLIKELY( (start) != 0 ))                                     \
+      __ci_netif_trace_latency((ni), (type), (a0), (start));            \
+  } while( 0 )
+
+ci_inline ci_uint64 ci_netif_trace_stamp(ci_netif* ni)
+{
+  ci_uint64 frc = 0;
+  if( CI_NETIF_TRACE_ON(ni) )
+    ci_frc64(&frc);
+  return frc;
+}
+
+#else
+
+# define CI_NETIF_TRACE_ON(ni)                              0
+# define ci_netif_trace(ni, type, sock, a0, a1, a2)         do{}while(0)
+# define ci_netif_trace_latency(ni, type, a0, start)        do{}while(0)
+# define ci_netif_trace_stamp(ni)                           0
+
+#endif
+
+
+/*********************************************************************
+************************** Cluster steering **************************
+*********************************************************************/
+
+#ifndef __KERNEL__
+
+/* A TCP/IPv4 flow as seen from this host, in network byte order. */
+typedef struct {
+  ci_uint32  laddr_be32;
+  ci_uint32  raddr_be32;
+  ci_uint16  lport_be16;
+  ci_uint16  rport_be16;
+} ci_rss_tuple;
+
+/* Returns the interface whose RSS spreading ci_netif_rss_queues() uses,
+ * or -1 if the stack is not in a cluster or the spreading is unknown.
+ */
+extern int ci_netif_rss_intf(ci_netif* ni) CI_HF;
+
+/* Sets [queues][i] to the index of the cluster member that receives the
+ * packets of flow [tuples][i].  [active] selects the hash used for the
+ * return traffic of connections opened from the stack.  Returns 0, or
+ * -ENOENT if ci_netif_rss_intf() fails, or -ENOMEM.
+ */
+extern int ci_netif_rss_queues(ci_netif* ni, int active,
+                               const ci_rss_tuple* tuples, int n,
+                               int* queues) CI_HF;
+
+extern void ci_netif_rss_dtor(ci_netif* ni) CI_HF;
+
+#endif
+
+
+/*********************************************************************
+************************* Stack lock profile *************************
+*********************************************************************/
+
+#ifdef __KERNEL__
+extern void ci_netif_lock_prof_init(ci_netif* ni) CI_HF;
+#endif
+extern void __ci_netif_lock_prof_release(ci_netif* ni) CI_HF;
+extern void __ci_netif_lock_prof_wait(ci_netif* ni, unsigned site,
+                                      ci_uint64 start) CI_HF;
+extern void __ci_netif_lock_prof_section(ci_netif* ni, unsigned site,
+                                         ci_uint64 start) CI_HF;
+#ifndef __KERNEL__
+extern const char* ci_netif_lock_site_name(unsigned site) CI_HF;
+#endif
+
+/* Tag the current hold of the stack lock as taken by [site]
+ * (CI_NETIF_LOCK_SITE_*).  The first tag in a hold wins.  When profiling
+ * is off [site] is CI_NETIF_LOCK_SITE_NONE, so this is a single test.
+ */
+ci_inline void ci_netif_lock_prof_site(ci_netif* ni, unsigned site)
+{
+#if CI_CFG_LOCK_PROFILE
+  if(CI_UNLIKELY( ni->state->lock_prof.site == CI_NETIF_LOCK_SITE_OTHER ))
+    ni->state->lock_prof.site = site;
+#endif
+}
+
+/* The site that a thread waiting for the lock now is waiting on. */
+ci_inline unsigned ci_netif_lock_prof_blocker(ci_netif* ni)
+{
+  const ci_netif_lock_prof* lp = &ni->state->lock_prof;
+  return lp->section != CI_NETIF_LOCK_SITE_OTHER ? lp->section : lp->site;
+}
+
+/* Mark the start of a TIMER or POST_POLL section.  Returns a start time
+ * to pass to ci_netif_lock_prof_section_leave() if this hold is sampled.
+ */
+ci_inline ci_uint64 ci_netif_lock_prof_section_enter(ci_netif* ni,
+                                                     unsigned site)
+{
+  ci_uint64 start = 0;
+#if CI_CFG_LOCK_PROFILE
+  if(CI_UNLIKELY( ni->state->lock_prof.sample_n != 0 )) {
+    ni->state->lock_prof.section = site;
+    if( ni->flags & CI_NETIF_FLAG_LOCK_SAMPLED )
+      ci_frc64(&start);
+  }
+#endif
+  return start;
+}
+
+ci_inline void ci_netif_lock_prof_section_leave(ci_netif* ni, unsigned site,
+                                                ci_uint64 start)
+{
+#if CI_CFG_LOCK_PROFILE
+  if(CI_UNLIKELY( ni->state->lock_prof.sample_n != 0 )) {
+    ni->state->lock_prof.section = CI_NETIF_LOCK_SITE_OTHER;
+    if( start != 0 )
+      __ci_netif_lock_prof_section(ni, site, start);
+  }
+#endif
+}
+
+
 /*********************************************************************
 *********************************************************************/
 
@@ -1376,7 +1631,12 @@ extern int ci_tcp_listenq_drop_all(ci_netif*, ci_tcp_socket_listen*) CI_HF;
 extern int ci_tcp_listenq_try_promote(ci_netif*, ci_tcp_socket_listen*,
                                       ci_tcp_state_synrecv*,
                                       ci_ip_cached_hdrs*,
+                                      struct ci_netif_poll_state*,
                                       ci_tcp_state**) CI_HF;
+#ifndef __KERNEL__
+extern void ci_tcp_listenq_promote_flush(ci_netif*,
+                                         struct ci_netif_poll_state*) CI_HF;
+#endif
 
 
 extern const char* ci_tcp_state_num_str(int state) CI_HF;
@@ -3620,6 +3880,35 @@ ci_inline void ci_tcp_tx_pkt_set_end(ci_tcp_state* ts, ci_ip_pkt_fmt* pkt) {
 ci_inline int ci_tcp_listenq_max(ci_netif* ni)
 { return NI_OPTS(ni).tcp_backlog_max; }
 
+ci_inline int ci_tcp_syncookies_enabled(ci_netif* ni)
+{ return NI_OPTS(ni).tcp_syncookies || NI_OPTS(ni).tcp_syncookies_pressure; }
+
+/* Whether a new SYN to [tls] should be answered with a syncookie rather
+ * than by allocating synrecv state, because its listenq is long.  Turns on
+ * when the listenq reaches EF_TCP_SYNCOOKIES_PRESSURE percent of its
+ * maximum and off once it has drained to half that, so that a flood is
+ * answered statelessly throughout rather than as slots free up.
+ */
+ci_inline int ci_tcp_listenq_syncookie_pressure(ci_netif* ni,
+                                                ci_tcp_socket_listen* tls)
+{
+  ci_uint64 limit = (ci_uint64) ci_tcp_listenq_max(ni) *
+                    NI_OPTS(ni).tcp_syncookies_pressure;
+  ci_uint64 n = (ci_uint64) tls->n_listenq * 100;
+
+  if( limit == 0 )
+    return 0;
+  if( tls->syncookie_pressure ) {
+    if( n * 2 <= limit )
+      tls->syncookie_pressure = 0;
+  }
+  else if( n >= limit ) {
+    tls->syncookie_pressure = 1;
+    CITP_STATS_TCP_LISTEN(++tls->stats.n_syncookie_pressure);
+  }
+  return tls->syncookie_pressure;
+}
+
 
 /**********************************************************************
 ************************** Per-socket locks ***************************
@@ -3670,88 +3959,204 @@ ci_inline int  ci_sock_is_locked(ci_netif* ni, citp_waitable* w)
 ************************** TCP accept queue **************************
 *********************************************************************/
 
-/* Use this if you don't own the [get] lock. */
-#define ci_tcp_acceptq_n(tls)			\
-  ((tls)->acceptq_n_in - (tls)->acceptq_n_out)
+/* The accept queue is split into [acceptq_n_shards] shards.  The stack
+ * pushes new connections onto a shard's [put] list with the netif lock
+ * held, and accept() pops them from [get] holding only that shard's lock,
+ * so threads accepting from different shards do not contend.
+ */
+
+/* Use this if you don't own the [get] locks. */
+ci_inline ci_uint32 ci_tcp_acceptq_n(ci_tcp_socket_listen* tls)
+{
+  ci_uint32 n_out = 0;
+  unsigned i;
+  for( i = 0; i < tls->acceptq_n_shards; ++i )
+    n_out += tls->acceptq[i].n_out;
+  return tls->acceptq_n_in - n_out;
+}
+
+#define ci_tcp_acceptq_shard_not_empty(sh)                      \
+  (((sh)->put >= 0) | OO_SP_NOT_NULL((sh)->get))
 
-/* Use this if you do own the [get] lock. */
-#define ci_tcp_acceptq_not_empty(tls)                                   \
-  (((tls)->acceptq_put >= 0) | OO_SP_NOT_NULL((tls)->acceptq_get))
+/* Use this if you do own the [get] locks. */
+ci_inline int ci_tcp_acceptq_not_empty(ci_tcp_socket_listen* tls)
+{
+  unsigned i;
+  for( i = 0; i < tls->acceptq_n_shards; ++i )
+    if( ci_tcp_acceptq_shard_not_empty(&tls->acceptq[i]) )
+      return 1;
+  return 0;
+}
+
+
+/* The shard lock lives in shared memory that the application can write,
+ * so the kernel must not spin on it for ever: it gives up after a bounded
+ * number of attempts and returns -EAGAIN.  At user level this always
+ * succeeds.
+ */
+#ifdef __KERNEL__
+# define CI_TCP_ACCEPTQ_SHARD_LOCK_SPINS  1000
+#endif
+
+ci_inline int ci_tcp_acceptq_shard_lock(ci_tcp_acceptq_shard* sh)
+{
+#ifdef __KERNEL__
+  int i;
+  for( i = 0; i < CI_TCP_ACCEPTQ_SHARD_LOCK_SPINS; ++i ) {
+    if( sh->lock == 0 && ci_cas32u_succeed(&sh->lock, 0, 1) )
+      return 0;
+    ci_spinloop_pause();
+  }
+  return -EAGAIN;
+#else
+  while( sh->lock != 0 || ! ci_cas32u_succeed(&sh->lock, 0, 1) )
+    ci_spinloop_pause();
+  return 0;
+#endif
+}
+
+ci_inline void ci_tcp_acceptq_shard_unlock(ci_tcp_acceptq_shard* sh)
+{
+  ci_assert(sh->lock);
+  ci_wmb();
+  sh->lock = 0;
+}
+
+
+/* Returns the CPU we're running on, for EF_TCP_ACCEPTQ_SHARD_MODE=cpu. */
+extern unsigned ci_tcp_acceptq_cpu(void) CI_HF;
+
+ci_inline unsigned ci_tcp_acceptq_put_shard(ci_netif* ni,
+                                            ci_tcp_socket_listen* tls)
+{
+  if( tls->acceptq_n_shards == 1 )
+    return 0;
+  if( NI_OPTS(ni).tcp_acceptq_shard_mode == CITP_TCP_ACCEPTQ_SHARD_CPU )
+    return ci_tcp_acceptq_cpu() % tls->acceptq_n_shards;
+  return tls->acceptq_put_rr++ % tls->acceptq_n_shards;
+}
 
 
 ci_inline void ci_tcp_acceptq_put(ci_netif* ni,
                                   ci_tcp_socket_listen* tls,
 				  citp_waitable* w) {
+  ci_tcp_acceptq_shard* sh;
   ci_assert(OO_SP_IS_NULL(w->wt_next));
   ci_assert(ci_netif_is_locked(ni));
+  sh = &tls->acceptq[ci_tcp_acceptq_put_shard(ni, tls)];
   do
-    w->wt_next = OO_SP_FROM_INT(ni, tls->acceptq_put);
-  while( ci_cas32_fail(&tls->acceptq_put,
-                       OO_SP_TO_INT(w->wt_next), W_ID(w)) );
+    w->wt_next = OO_SP_FROM_INT(ni, sh->put);
+  while( ci_cas32_fail(&sh->put, OO_SP_TO_INT(w->wt_next), W_ID(w)) );
   ++tls->acceptq_n_in;
 }
 
-/* Should not be called directly, use ci_tcp_acceptq_get() and
- * ci_tcp_acceptq_peek(). */
+/* Should not be called directly, use ci_tcp_acceptq_shard_get(). */
 ci_inline void ci_tcp_acceptq_get_swizzle(ci_netif* ni,
-					  ci_tcp_socket_listen* tls) {
+					  ci_tcp_acceptq_shard* sh) {
   ci_int32 from;
   oo_sp from_sp;
   ci_tcp_state* ts;
   /* Atomically grab the contents of the [put] list. */
   do
-    from = tls->acceptq_put;
-  while( ci_cas32_fail(&tls->acceptq_put, from, CI_ILL_END) );
+    from = sh->put;
+  while( ci_cas32_fail(&sh->put, from, CI_ILL_END) );
   /* Reverse the list onto [get]. */
   ci_assert(from >= 0);
-  ci_assert(OO_SP_IS_NULL(tls->acceptq_get));
+  ci_assert(OO_SP_IS_NULL(sh->get));
   from_sp = OO_SP_FROM_INT(ni, from);
   do {
     ts = SP_TO_TCP(ni, from_sp);
     from_sp = ts->s.b.wt_next;
-    ts->s.b.wt_next = tls->acceptq_get;
-    tls->acceptq_get = S_SP(ts);
+    ts->s.b.wt_next = sh->get;
+    sh->get = S_SP(ts);
   } while( OO_SP_NOT_NULL(from_sp) );
 }
 
 
-/* Only call this if ci_tcp_acceptq_not_empty() is true. */
-ci_inline citp_waitable* ci_tcp_acceptq_get(ci_netif* ni,
-					   ci_tcp_socket_listen* tls) {
+/* Pops the oldest connection from [sh], or returns NULL if it is empty.
+ * The caller must own [sh->get]. */
+ci_inline citp_waitable* ci_tcp_acceptq_shard_get(ci_netif* ni,
+                                                  ci_tcp_acceptq_shard* sh) {
   citp_waitable* w;
-  ci_assert(ci_sock_is_locked(ni, &tls->s.b) ||
-            (tls->s.b.sb_aflags & CI_SB_AFLAG_ORPHAN));
-  ++tls->acceptq_n_out;
-  if( OO_SP_IS_NULL(tls->acceptq_get) )  ci_tcp_acceptq_get_swizzle(ni, tls);
-  ci_assert(OO_SP_NOT_NULL(tls->acceptq_get));
-  w = SP_TO_WAITABLE(ni, tls->acceptq_get);
-  tls->acceptq_get = w->wt_next;
+  if( OO_SP_IS_NULL(sh->get) ) {
+    if( sh->put < 0 )
+      return NULL;
+    ci_tcp_acceptq_get_swizzle(ni, sh);
+  }
+  ++sh->n_out;
+  w = SP_TO_WAITABLE(ni, sh->get);
+  sh->get = w->wt_next;
   CI_DEBUG(w->wt_next = OO_SP_NULL);
   return w;
 }
 
 
-#ifndef __ci_driver__
-/* Only call this if ci_tcp_acceptq_not_empty() is true. */
-ci_inline ci_tcp_state* ci_tcp_acceptq_peek(ci_netif* ni,
-					    ci_tcp_socket_listen* tls) {
-  ci_assert(ci_sock_is_locked(ni, &tls->s.b));
-  if( OO_SP_IS_NULL(tls->acceptq_get) )  ci_tcp_acceptq_get_swizzle(ni, tls);
-  ci_assert(OO_SP_NOT_NULL(tls->acceptq_get));
-  return SP_TO_TCP(ni, tls->acceptq_get);
+/* Pops a connection for a thread whose own shard is [home] (modulo the
+ * number of shards), trying that shard first and then the others.  Sets
+ * [*p_shard] to the shard used, for ci_tcp_acceptq_put_back().  Returns
+ * NULL if all shards are empty, or (in the kernel) if the shards that are
+ * not empty could not be locked.
+ */
+ci_inline citp_waitable* ci_tcp_acceptq_get_from(ci_netif* ni,
+                                                 ci_tcp_socket_listen* tls,
+                                                 unsigned home,
+                                                 unsigned* p_shard) {
+  ci_tcp_acceptq_shard* sh;
+  citp_waitable* w;
+  unsigned i, shard;
+  for( i = 0; i < tls->acceptq_n_shards; ++i ) {
+    shard = (home + i) % tls->acceptq_n_shards;
+    sh = &tls->acceptq[shard];
+    if( ! ci_tcp_acceptq_shard_not_empty(sh) ||
+        ci_tcp_acceptq_shard_lock(sh) != 0 )
+      continue;
+    w = ci_tcp_acceptq_shard_get(ni, sh);
+    ci_tcp_acceptq_shard_unlock(sh);
+    if( w != NULL ) {
+      *p_shard = shard;
+      return w;
+    }
+  }
+  return NULL;
 }
-#endif
 
 
-/* Must hold the sock lock. */
+/* Returns NULL if there is nothing to accept.  That can happen even after
+ * ci_tcp_acceptq_not_empty() was true, as accept() takes connections from
+ * the shards without the listener's sock lock.
+ */
+ci_inline citp_waitable* ci_tcp_acceptq_get(ci_netif* ni,
+					   ci_tcp_socket_listen* tls) {
+  citp_waitable* w = NULL;
+  unsigned i;
+  ci_assert(ci_sock_is_locked(ni, &tls->s.b) ||
+            (tls->s.b.sb_aflags & CI_SB_AFLAG_ORPHAN));
+  /* Nobody can be accepting from an orphan, and it may be that the owner
+   * of a shard lock has gone away. */
+  if( tls->s.b.sb_aflags & CI_SB_AFLAG_ORPHAN ) {
+    for( i = 0; w == NULL && i < tls->acceptq_n_shards; ++i )
+      w = ci_tcp_acceptq_shard_get(ni, &tls->acceptq[i]);
+  }
+  else {
+    w = ci_tcp_acceptq_get_from(ni, tls, 0, &i);
+  }
+  return w;
+}
+
+
+#ifndef __KERNEL__
+/* Returns [w] to the head of the shard it was taken from. */
 ci_inline void ci_tcp_acceptq_put_back(ci_netif* ni, ci_tcp_socket_listen* tls,
-                                       citp_waitable* w) {
-  ci_assert(ci_sock_is_locked(ni, &tls->s.b));
+                                       unsigned shard, citp_waitable* w) {
+  ci_tcp_acceptq_shard* sh = &tls->acceptq[shard];
   ci_assert(w->sb_aflags & CI_SB_AFLAG_TCP_IN_ACCEPTQ);
-  --tls->acceptq_n_out;
-  w->wt_next = tls->acceptq_get;
-  tls->acceptq_get = W_SP(w);
+  ci_tcp_acceptq_shard_lock(sh);
+  --sh->n_out;
+  w->wt_next = sh->get;
+  sh->get = W_SP(w);
+  ci_tcp_acceptq_shard_unlock(sh);
 }
+#endif
 
 
 /*********************************************************************
@@ -4268,5 +4673,82 @@ ci_inline ci_uint64 __oo_usec_to_cycles64(ci_uint32 khz, unsigned usec)
     __oo_usec_to_cycles64(IPTIMER_STATE(ni)->khz, usec)
 
 
+/* EF_SPIN_ADAPTIVE: is it worth spinning before blocking, given what we
+ * have learned about how long waits last?  Spinning pays off when a useful
+ * share of waits end within the cost of a wakeup, so we compare the low end
+ * of the distribution (mean less mean deviation) with that cost.  With no
+ * history we spin.
+ *
+ * Every CI_CFG_SPIN_ADAPT_PROBE'th wait spins even so.  Otherwise, once we
+ * block, the only waits we see are those that ran until a wakeup, and the
+ * estimate has nothing to tell it that the traffic has picked up.
+ */
+ci_inline int ci_spin_adapt_should_spin(ci_spin_adapt* sa,
+                                        unsigned wake_cost_usec)
+{
+  unsigned avg = sa->avg >> 3;
+  unsigned dev = sa->dev >> 2;
+  if( avg > dev && avg - dev >= wake_cost_usec &&
+      ++sa->n_blocked < CI_CFG_SPIN_ADAPT_PROBE )
+    return 0;
+  sa->n_blocked = 0;
+  return 1;
+}
+
+
+/* Record that a wait lasted [wait_usec].  If the caller blocked, the wait
+ * includes the [wake_cost_usec] that it took to wake up, which spinning
+ * would not have paid, so we leave that out.
+ */
+ci_inline void ci_spin_adapt_update(ci_spin_adapt* sa, unsigned wait_usec,
+                                    unsigned wake_cost_usec)
+{
+  ci_uint32 avg = sa->avg, dev = sa->dev;
+  ci_int32 err;
+
+  wait_usec -= CI_MIN(wait_usec, wake_cost_usec);
+  /* Long waits all look the same to us, and this keeps avg from
+   * overflowing. */
+  wait_usec = CI_MIN(wait_usec, 1u << 24);
+  err = (ci_int32) wait_usec - (ci_int32) (avg >> 3);
+  avg += err;
+  if( err < 0 )
+    err = -err;
+  dev += err - (dev >> 2);
+  sa->avg = avg;
+  sa->dev = dev;
+}
+
+
+/* Record a wait on [w] that began at [start_frc] and has just ended,
+ * having [blocked] or not.
+ */
+ci_inline void ci_waitable_spin_adapt_update(ci_netif* ni, citp_waitable* w,
+                                             ci_uint64 start_frc, int blocked)
+{
+  ci_uint64 now_frc;
+  ci_frc64(&now_frc);
+  ci_spin_adapt_update(&w->spin_adapt,
+                       oo_cycles64_to_usec(ni, now_frc - start_frc),
+                       blocked ? NI_OPTS(ni).spin_wake_cost_usec : 0);
+}
+
+
+/* Decide whether a caller about to wait on [w] should spin first, and
+ * count the decision.
+ */
+ci_inline int ci_waitable_spin_adapt_should_spin(ci_netif* ni,
+                                                 citp_waitable* w)
+{
+  if( ci_spin_adapt_should_spin(&w->spin_adapt,
+                                NI_OPTS(ni).spin_wake_cost_usec) ) {
+    CITP_STATS_NETIF_INC(ni, spin_adapt_spin);
+    return 1;
+  }
+  CITP_STATS_NETIF_INC(ni, spin_adapt_block);
+  return 0;
+}
+
+
 #endif  /* __CI_INTERNAL_IP_H__ */
 /*! \cidoxg_end */
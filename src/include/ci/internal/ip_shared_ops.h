@@ -56,12 +56,37 @@ extern void ci_netif_unlock(ci_netif*) CI_HF;
  * called at userlevel, this is the only possible outcome.  In the kernel,
  * they return -EINTR if interrupted by a signal.
  */
-#define ci_netif_lock(ni)        ef_eplock_lock(ni)
+#if CI_CFG_LOCK_PROFILE
+
+extern void __ci_netif_lock_prof_grant(ci_netif*) CI_HF;
+
+ci_inline int __ci_netif_lock(ci_netif* ni) OO_MUST_CHECK_RET_IN_KERNEL;
+ci_inline int __ci_netif_lock(ci_netif* ni) {
+  int rc = ef_eplock_lock(ni);
+  if(CI_UNLIKELY( ni->state->lock_prof.sample_n != 0 ) && rc == 0 )
+    __ci_netif_lock_prof_grant(ni);
+  return rc;
+}
+
+ci_inline int __ci_netif_trylock(ci_netif* ni) {
+  if( ! ef_eplock_trylock(&ni->state->lock) )
+    return 0;
+  if(CI_UNLIKELY( ni->state->lock_prof.sample_n != 0 ))
+    __ci_netif_lock_prof_grant(ni);
+  return 1;
+}
+
+# define ci_netif_lock(ni)        __ci_netif_lock(ni)
+# define ci_netif_lock_id(ni,id)  __ci_netif_lock(ni)
+# define ci_netif_trylock(ni)     __ci_netif_trylock(ni)
+#else
+# define ci_netif_lock(ni)        ef_eplock_lock(ni)
+# define ci_netif_lock_id(ni,id)  ef_eplock_lock(ni)
+# define ci_netif_trylock(ni)     ef_eplock_trylock(&(ni)->state->lock)
+#endif
 #ifdef __KERNEL__
 #define ci_netif_lock_maybe_wedged(ni) ef_eplock_lock_maybe_wedged(ni)
 #endif
-#define ci_netif_lock_id(ni,id)  ef_eplock_lock(ni)
-#define ci_netif_trylock(ni)     ef_eplock_trylock(&(ni)->state->lock)
 
 #define ci_netif_lock_fdi(epi)   ci_netif_lock_id((epi)->sock.netif,    \
                                                   SC_SP((epi)->sock.s))
@@ -246,6 +246,8 @@ typedef union {
     ci_int32          tx_length;
     oo_sp             tx_sock_id; /* The socket this pkt is tx'd on:  
                                    * used for tx completion action */
+    ci_uint64         tx_stamp CI_ALIGN(8); /* When handed to the NIC
+                                             * (EF_LAT_HIST only) */
   } udp;
 #ifdef CI_CFG_USERSPACE_PIPE
   struct {
@@ -685,7 +687,10 @@ typedef struct {
   ci_int32              n_free; /**< Number of buffers in free list */
 #if defined(CI_CFG_PKTS_AS_HUGE_PAGES)
   CI_ULCONST ci_int32   shm_id; /**< shared memory id for huge page  */
+  CI_ULCONST ci_int32   shm_offset; /**< offset of this set in shm_id */
 #endif
+  CI_ULCONST ci_int32   numa_node; /**< Node of the memory, or -1 */
+  CI_ULCONST ci_int32   page_shift; /**< log2 of the backing page size */
 } oo_pktbuf_set;
 
 typedef struct {
@@ -753,8 +758,10 @@ typedef struct {
 # define CI_EPLOCK_NETIF_NEED_PKT_SET      0x0800000000000000ULL
   /* need to purge defunct TXQs */
 # define CI_EPLOCK_NETIF_PURGE_TXQS        0x0010000000000000ULL
+  /* need to re-arm the periodic timer for an earlier timer */
+# define CI_EPLOCK_NETIF_PERIODIC_REARM    0x0020000000000000ULL
   /* mask for the above flags that must be handled before dropping lock */
-# define CI_EPLOCK_NETIF_UNLOCK_FLAGS      0xff10000000000000ULL
+# define CI_EPLOCK_NETIF_UNLOCK_FLAGS      0xff30000000000000ULL
 } ci_eplock_t;
 
 
@@ -765,6 +772,13 @@ typedef struct {
 ************************* Global netif state *************************
 *********************************************************************/
 
+/* RSS hash parameters, as defined by hardware (see ci_netif_rss_queue()). */
+#define CI_RSS_KEY_LEN      40
+#define CI_RSS_TABLE_LEN    128
+/* Which half of a received packet's 4-tuple the hash covers. */
+#define CI_RSS_HASH_SRC     0x1
+#define CI_RSS_HASH_DST     0x2
+
 #define OO_VI_FLAGS_PIO_EN 0x1
 #define OO_VI_FLAGS_RX_HW_TS_EN 0x2
 #define OO_VI_FLAGS_TX_HW_LOOPBACK_EN 0x4
@@ -805,6 +819,21 @@ typedef struct {
   CI_ULCONST ci_uint8   vi_revision;
   CI_ULCONST ci_uint8   vi_channel;
   CI_ULCONST char       pci_dev[20];
+  /* NUMA node of the NIC, or -1 if not known. */
+  CI_ULCONST ci_int32   numa_node;
+  /* How the cluster this stack belongs to spreads flows over its members:
+   * [rss_queue] is this stack's index within the cluster.  [rss_n_queues]
+   * is zero if the stack is not clustered, or if the NIC's hash is not
+   * known.  [rss_hash_passive] applies to flows matching the cluster's
+   * listen filters, and [rss_hash_active] to the return traffic of
+   * connections opened from the stack.
+   */
+  CI_ULCONST ci_uint16  rss_queue;
+  CI_ULCONST ci_uint16  rss_n_queues;
+  CI_ULCONST ci_uint8   rss_hash_passive;
+  CI_ULCONST ci_uint8   rss_hash_active;
+  CI_ULCONST ci_uint8   rss_key[CI_RSS_KEY_LEN];
+  CI_ULCONST ci_uint8   rss_indir_table[CI_RSS_TABLE_LEN];
   /* Transmit overflow queue.  Packets here are ready to send. */
   oo_pktq               dmaq;
   /* Counts bytes of packet payload into and out of the TX descriptor ring. */
@@ -830,6 +859,108 @@ typedef struct {
 } ci_netif_state_nic_t;
 
 
+/*!
+** ci_lat_hist_stage
+**
+** A histogram of samples in cycles.  Buckets are log-linear: values below
+** 4 have a bucket each, and each power of two above that is split into two
+** (see ci_lat_hist_bucket()).
+*/
+#define CI_LAT_HIST_N_BUCKETS   48
+
+typedef struct {
+  ci_uint64             n;       /**< Number of samples */
+  ci_uint64             sum;     /**< Sum of samples */
+  ci_uint64             max;     /**< Largest sample */
+  ci_uint32             bucket[CI_LAT_HIST_N_BUCKETS];
+} ci_lat_hist_stage;
+
+
+/*!
+** ci_netif_lock_prof
+**
+** Stack lock profile, enabled with EF_LOCK_PROFILE.  Hold times are
+** sampled and attributed to the site that took the lock.  Wait times are
+** recorded for every contended acquisition, and attributed to the site
+** that was holding the lock when the waiter arrived.  The TIMER and
+** POST_POLL sites are sections within a hold: their hold histograms give
+** the time spent in that section of a sampled hold.
+*/
+#define CI_NETIF_LOCK_SITE_OTHER      0
+#define CI_NETIF_LOCK_SITE_POLL       1
+#define CI_NETIF_LOCK_SITE_SENDMSG    2
+#define CI_NETIF_LOCK_SITE_RECVMSG    3
+#define CI_NETIF_LOCK_SITE_TIMER      4
+#define CI_NETIF_LOCK_SITE_POST_POLL  5
+#define CI_NETIF_LOCK_N_SITES         6
+/* Value of [site] when profiling is off. */
+#define CI_NETIF_LOCK_SITE_NONE       0xffffffffu
+
+typedef struct {
+  ci_uint64             grant_frc;  /**< Grant time of the current hold if
+                                     * it is sampled, else 0 */
+  CI_ULCONST ci_uint32  sample_n;   /**< Sample one hold in this many, or
+                                     * 0 if profiling is off */
+  ci_uint32             sample_i;   /**< Holds until the next sample */
+  ci_uint32             site;       /**< Site that took the lock */
+  ci_uint32             section;    /**< TIMER or POST_POLL while in one of
+                                     * those sections, else OTHER */
+  ci_lat_hist_stage     hold[CI_NETIF_LOCK_N_SITES];
+  ci_lat_hist_stage     wait[CI_NETIF_LOCK_N_SITES];
+} ci_netif_lock_prof;
+
+
+#if CI_CFG_TRACE
+/*!
+** ci_netif_trace
+**
+** Flight recorder, enabled with EF_TRACE.  A ring of fixed-size records
+** written without locks: a writer claims a sequence number with a
+** compare-and-swap on [head], fills in the record and then stores the
+** sequence number in it.  Readers skip records whose [seq] does not match
+** the slot they expect, as those are being (over)written.
+**
+** When a freeze trigger fires the recorder stops, leaving the history up
+** to the trigger in the ring.
+**
+** The ring itself follows the rest of the shared state at [rec_ofs], and
+** is only allocated when EF_TRACE is set at stack creation.
+*/
+#define CI_TRACE_POLL_START      1
+#define CI_TRACE_POLL_END        2  /* a0=events a1=cycles */
+#define CI_TRACE_RX_DELIVER      3  /* sock a0=bytes */
+#define CI_TRACE_TIMER           4  /* sock a0=timer type */
+#define CI_TRACE_LOCK_WAIT       5  /* a0=cycles waited */
+#define CI_TRACE_LOCK_DEFER      6  /* sock */
+#define CI_TRACE_WAKE            7  /* sock a0=CI_SB_FLAG_WAKE_* */
+#define CI_TRACE_MEM_PRESSURE    8  /* a0=1 enter, 0 exit */
+#define CI_TRACE_FREEZE          9  /* a0=CI_TRACE_FREEZE_* a1=cycles */
+#define CI_TRACE_N_TYPES         10
+
+#define CI_TRACE_FREEZE_POLL          1
+#define CI_TRACE_FREEZE_LOCK_WAIT     2
+#define CI_TRACE_FREEZE_MEM_PRESSURE  3
+
+typedef struct {
+  ci_uint64             frc;
+  ci_uint32             seq;     /**< Sequence number + 1, 0 if unused */
+  ci_uint16             type;    /**< CI_TRACE_* */
+  ci_uint16             pad;
+  ci_int32              sock;    /**< Socket id, or -1 */
+  ci_uint32             a[3];
+} ci_trace_rec;
+
+typedef struct {
+  ci_uint32             enabled;    /**< Non-zero while recording */
+  ci_uint32             head;       /**< Next sequence number */
+  ci_uint32             frozen;     /**< CI_TRACE_FREEZE_* if frozen */
+  ci_uint32             freeze_mem_pressure;
+  ci_uint64             freeze_cycles; /**< Latency trigger, or 0 */
+  CI_ULCONST ci_uint32  rec_ofs;    /**< Offset of the ring, 0 if none */
+} ci_netif_trace;
+#endif
+
+
 struct ci_netif_state_s {
 
   ci_netif_state_nic_t  nic[CI_CFG_MAX_INTERFACES];
@@ -837,6 +968,11 @@ struct ci_netif_state_s {
 
   ci_uint64             evq_last_prime CI_ALIGN(8);
 
+  /* Setting a timer that is due before this re-arms the kernel's periodic
+   * timer (EF_PERIODIC_TIMER_MAX_MSEC).
+   */
+  ci_iptime_t           periodic_rearm_ticks;
+
   CI_ULCONST cicp_ns_mmap_info_t control_mmap CI_ALIGN(8);
 
   CI_ULCONST ci_uint32  stack_id; /* FIXME equal to thr->id */
@@ -981,6 +1117,9 @@ struct ci_netif_state_s {
   oo_sp                 free_eps_head;   /**< Endpoints free list */
   ci_int32              deferred_free_eps_head; /**< Endpoints that could be 
                                                    freed (atomic) */
+  ci_int32              lat_hist_free_head; /**< Free latency histogram
+                                               bufs (atomic) */
+  ci_uint32             n_lat_hist_bufs; /**< Latency histogram bufs */
 
   /* Max number of ep bufs is CI_CFG_NETIF_MAX_ENDPOINTS_MAX */
   ci_uint32  max_ep_bufs;                /**< Upper limit of end points */
@@ -1065,6 +1204,8 @@ struct ci_netif_state_s {
 
   CI_ULCONST ci_int32   creation_numa_node;
   CI_ULCONST ci_int32   load_numa_node;
+  CI_ULCONST ci_int32   mem_numa_node;   /* chosen by EF_NUMA_NODE or -1 */
+  CI_ULCONST ci_int32   state_numa_node; /* where this state was put */
   CI_ULCONST ci_uint32  packet_alloc_numa_nodes;
   CI_ULCONST ci_uint32  sock_alloc_numa_nodes;
   CI_ULCONST ci_uint32  interrupt_numa_nodes;
@@ -1074,6 +1215,15 @@ struct ci_netif_state_s {
   ci_uint32             active_cache_avail_stack;
 #endif
 
+  ci_netif_lock_prof    lock_prof CI_ALIGN(8);
+
+  /* Time from an interrupt to a thread it woke returning from its sleep. */
+  ci_lat_hist_stage     wake_lat CI_ALIGN(8);
+
+#if CI_CFG_TRACE
+  ci_netif_trace        trace CI_ALIGN(8);
+#endif
+
   /* Followed by:
   **
   **   vi_state  (for each nic)
@@ -1120,6 +1270,21 @@ struct oo_ep_header {
   ci_uint32             state;
 };
 
+
+/* Learned distribution of the time that callers wait for an object to
+ * become ready, used by EF_SPIN_ADAPTIVE to decide whether to spin or to
+ * block.  In microseconds, fixed point: [avg] is scaled by 8 and [dev] (the
+ * mean deviation) by 4, as for TCP's srtt and rttvar.  [n_blocked] counts
+ * decisions to block since we last spun.  Updated without locks, so
+ * concurrent waiters may lose samples.
+ */
+typedef struct {
+  ci_uint32             avg;
+  ci_uint32             dev;
+  ci_uint32             n_blocked;
+} ci_spin_adapt;
+
+
 /*!
 ** citp_waitable
 **
@@ -1151,6 +1316,10 @@ typedef struct {
   /* Per-socket SO_BUSY_POLL settings */
   ci_uint64             spin_cycles CI_ALIGN(8);
 
+  /* How long callers have waited for this socket to become ready
+   * (EF_SPIN_ADAPTIVE). */
+  ci_spin_adapt         spin_adapt;
+
   /* These bits are set when someone wants to be woken (or other action
   ** associated with things happening). */
   ci_uint32             wake_request;
@@ -1275,6 +1444,12 @@ typedef struct {
   ci_uint32             moved_to_stack_id;
 #define OO_STACK_ID_INVALID ((ci_uint32)(-1))
   oo_sp                 moved_to_sock_id;
+
+  /* Latency histograms (see ci_lat_hist), or OO_SP_NULL.  Allocated when
+   * a socket is initialised in a stack with EF_LAT_HIST set, and released
+   * when the endpoint is freed.
+   */
+  oo_sp                 lat_hist;
 } citp_waitable;
 
 
@@ -1294,6 +1469,7 @@ typedef struct {
 
 typedef struct {
   cicp_mac_verinfo_t  mac_integrity; /*!< MAC table version number handle   */
+  cicp_fwd_verinfo_t  fwd_integrity; /*!< route table row stamp handle     */
 
   /* This field receives the source address that should be used.
    *
@@ -1601,9 +1777,21 @@ typedef struct {
   ci_uint32 n_tx_msg_confirm; /* onload send with MSG_CONFIRM          */
   ci_uint32 n_tx_os_late;     /* sent via OS, after copying            */
   ci_uint32 n_tx_unconnect_late; /* concurrent send and unconnect      */
+  ci_uint32 n_rx_filter_drop; /* datagrams dropped by SO_ATTACH_FILTER */
 } ci_udp_socket_stats;
 
 
+/* One classic BPF instruction.  Same layout as Linux's struct sock_filter
+ * so that programs passed to SO_ATTACH_FILTER can be copied verbatim.
+ */
+typedef struct {
+  ci_uint16 code;
+  ci_uint8  jt;
+  ci_uint8  jf;
+  ci_uint32 k;
+} ci_udp_filter_insn;
+
+
 struct  ci_udp_state_s {
   ci_sock_cmn           s;
 
@@ -1625,6 +1813,7 @@ struct  ci_udp_state_s {
 #define CI_UDPF_SO_TIMESTAMP    0x00004000  /*!< SO_TIMESTAMP */
 #define CI_UDPF_MCAST_JOIN      0x00008000  /*!< done IP_ADD_MEMBERSHIP */
 #define CI_UDPF_MCAST_FILTER    0x00010000  /*!< mcast filter added */
+#define CI_UDPF_RX_FILTER       0x00020000  /*!< SO_ATTACH_FILTER  */
 
   ci_udp_recv_q recv_q;
 
@@ -1658,6 +1847,15 @@ struct  ci_udp_state_s {
 
   ci_udp_socket_stats stats;
 
+  /*! Classic BPF program attached with SO_ATTACH_FILTER.  It is run on
+   * each datagram before it is queued on [recv_q].  It was validated by
+   * ci_udp_filter_check() when attached, but the application can change it
+   * since, so ci_udp_filter_run() bounds every access.  Only valid when
+   * CI_UDPF_RX_FILTER is set in [udpflags].
+   */
+  ci_uint32 rx_filter_len;
+  ci_udp_filter_insn rx_filter[CI_CFG_UDP_RX_FILTER_MAX_INSNS];
+
 };
 
 
@@ -2161,24 +2359,37 @@ typedef struct {
   ci_uint32            n_syncookie_ack_ts_rej;
   ci_uint32            n_syncookie_ack_hash_rej;
   ci_uint32            n_syncookie_ack_answ;
+  ci_uint32            n_syncookie_pressure;
 #if CI_CFG_FD_CACHING
   ci_uint32            n_sockcache_hit;
 #endif
 } ci_tcp_socket_listen_stats;
 
 
+/* One sub-queue of a listening socket's accept queue.  The stack pushes
+ * onto [put] without locks; [get] belongs to whoever holds [lock].
+ */
+typedef struct {
+  ci_int32             put;
+  oo_sp                get;
+  ci_uint32            n_out;
+  ci_uint32            lock;
+} ci_tcp_acceptq_shard;
+
+
 struct ci_tcp_socket_listen_s {
   ci_sock_cmn          s;
   ci_tcp_socket_cmn    c;
 
-  /* Accept queue of established connections.  This is a concurrent fifo
-  ** (ie. reader and writer need not synchronise).
+  /* Accept queue of established connections.  This is a set of concurrent
+  ** fifos (ie. reader and writer need not synchronise), one per shard; see
+  ** EF_TCP_ACCEPTQ_SHARDS.
   */
   ci_uint32            acceptq_max;
-  ci_int32             acceptq_put;
   ci_uint32            acceptq_n_in;
-  oo_sp                acceptq_get;
-  ci_uint32            acceptq_n_out;
+  ci_uint32            acceptq_n_shards;
+  ci_uint32            acceptq_put_rr;  /* next shard for round-robin puts */
+  ci_tcp_acceptq_shard acceptq[CI_CFG_TCP_ACCEPTQ_SHARDS_MAX];
 
   /* For each listening socket we have a list of SYNRECV buffs, one for each
    * SYN we've received for which there hasn't yet been an ACK.  i.e. on
@@ -2188,6 +2399,9 @@ struct ci_tcp_socket_listen_s {
    */
   ci_int32             n_listenq;
   ci_int32             n_listenq_new; /* length of listenq[0] */
+  /* Non-zero while new SYNs are answered with syncookies because the
+   * listenq is long; see EF_TCP_SYNCOOKIES_PRESSURE. */
+  ci_int32             syncookie_pressure;
   ci_ni_dllist_t       listenq[CI_CFG_TCP_SYNACK_RETRANS_MAX + 1];
   /* index is the number of retransmit. */
 
@@ -2222,6 +2436,28 @@ struct ci_tcp_socket_listen_s {
 
 
 
+/*!
+** ci_lat_hist
+**
+** Per-socket latency histograms, enabled with EF_LAT_HIST.  Each one lives
+** in an endpoint buffer marked CI_TCP_STATE_AUXBUF, at offset
+** CI_AUX_MEM_SIZE so that the endpoint header is left intact.  Samples are
+** in cycles, and are recorded without locks, so counts are approximate if
+** several threads use the socket at once.  See ci_lat_hist_stage.
+*/
+#define CI_LAT_HIST_RX_STACK    0  /* poll -> queued on socket */
+#define CI_LAT_HIST_RX_APP      1  /* poll -> returned by recv() */
+#define CI_LAT_HIST_TX_SEND     2  /* send() entry -> return */
+#define CI_LAT_HIST_TX_DONE     3  /* handed to NIC -> TX complete */
+#define CI_LAT_HIST_N_STAGES    4
+
+typedef struct {
+  oo_sp                 owner;     /**< Socket, or OO_SP_NULL when free */
+  ci_int32              next_id;   /**< Link for lat_hist_free_head */
+  ci_lat_hist_stage     stage[CI_LAT_HIST_N_STAGES];
+} ci_lat_hist;
+
+
 /*!
 ** citp_waitable_obj
 **
@@ -160,6 +160,11 @@ struct ci_netif_s {
    * about packet sets */
   ci_pkt_bufs*          pkt_bufs;
 
+#if CI_CFG_TRACE
+  /* EF_TRACE ring at ci_netif_trace::rec_ofs, or NULL if there is none */
+  ci_trace_rec*         trace_rec;
+#endif
+
 #ifndef __ci_driver__
   /* for table of active UL netifs (unix/netif_init.c) */
   ci_dllink            link;
@@ -181,6 +186,10 @@ struct ci_netif_s {
    * tcp_helper_resource_rm_alloc_proxy function through ioctl.
    */
 # define CI_NETIF_FLAG_DO_ALLOCATE_SCALABLE_FILTERS_RSS 0x2
+  /* This mapping took the stack lock with a hold sampled by
+   * EF_LOCK_PROFILE, and has not yet released it.
+   */
+# define CI_NETIF_FLAG_LOCK_SAMPLED      0x4
 
 #ifndef __KERNEL__
 
@@ -204,6 +213,8 @@ struct ci_netif_s {
 #if CI_CFG_PKTS_AS_HUGE_PAGES
   /* Huge pages packet allocation have failed */
 #define CI_NETIF_FLAG_HUGE_PAGES_FAILED  0x2000
+  /* 1GB huge page allocation has failed */
+#define CI_NETIF_FLAG_HUGE_PAGES_1G_FAILED 0x8000
 #endif
   /* Shared state wedged */
 #define CI_NETIF_FLAG_WEDGED             0x4000
@@ -212,6 +223,8 @@ struct ci_netif_s {
 
 #ifndef __KERNEL__
   double    ci_ip_time_tick2ms;     /* time for 1 tick in ms */
+  /* Lookup tables for the cluster's RSS hash; see ci_netif_rss_queues(). */
+  ci_toeplitz_cache* rss_hash_cache;
 #endif
 
 #ifdef __KERNEL__
@@ -296,6 +309,13 @@ struct ci_netif_poll_state {
   oo_pkt_p  tx_pkt_free_list;
   oo_pkt_p* tx_pkt_free_list_insert;
   int       tx_pkt_free_list_n;
+#ifndef __KERNEL__
+  /* Connections promoted from a listen queue whose filters will be set
+   * together by ci_tcp_listenq_promote_flush(), and their listeners. */
+  int       filter_pending_n;
+  oo_sp     filter_pending_ts[CI_CFG_TCP_FILTER_SET_BATCH];
+  oo_sp     filter_pending_tls[CI_CFG_TCP_FILTER_SET_BATCH];
+#endif
 };
 
 
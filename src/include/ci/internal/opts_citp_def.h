@@ -491,6 +491,22 @@ CI_CFG_OPT("EF_SPIN_USEC", ul_spin_usec, ci_uint32,
 OO_SPIN_BLURB,
            , , 0, MIN, MAX, time:usec)
 
+CI_CFG_OPT("EF_SPIN_ADAPTIVE", ul_spin_adaptive, ci_uint32,
+"Learn how long each socket (or epoll set) typically waits to become ready, "
+"and only spin before blocking when that wait is expected to be shorter than "
+"the cost of blocking and being woken (EF_SPIN_WAKE_COST_USEC).  Otherwise "
+"block straight away, though every 16th wait in a row still spins so that "
+"a return to short waits is noticed.  Spinning must still be enabled for "
+"the API in question, and is still limited by EF_SPIN_USEC.  Applies to TCP "
+"and UDP receive calls and to epoll_wait().",
+           1, , 0, 0, 1, yesno)
+
+CI_CFG_OPT("EF_SPIN_WAKE_COST_USEC", ul_spin_wake_cost_usec, ci_uint32,
+"The cost in microseconds of blocking and being woken up, as used by "
+"EF_SPIN_ADAPTIVE.  Waits that are expected to be longer than this are not "
+"spun for, and it is taken off waits that ended with a wakeup.",
+           , , 10, MIN, MAX, time:usec)
+
 CI_CFG_OPT("EF_POLL_FAST_USEC", ul_poll_fast_usec, ci_uint32,
 "When spinning in a poll() call, causes accelerated sockets to be polled for N "
 "usecs before unaccelerated sockets are polled.  This reduces "
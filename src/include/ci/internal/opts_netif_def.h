@@ -179,6 +179,21 @@ CI_CFG_OPT("EF_INT_REPRIME", int_reprime, ci_uint32,
 "Enable interrupts more aggressively than the default.",
            1, , 0, 0, 1, yesno)
 
+CI_CFG_OPT("EF_INT_WAKE_BATCH", int_wake_batch, ci_uint32,
+"When non-zero, an interrupt polls the stack this many network events at a "
+"time, waking any threads that are waiting for them after each batch, and "
+"stops polling once it has woken a thread.  That thread then handles the "
+"remaining events itself.  This reduces the time from an interrupt to a "
+"blocked thread running when an interrupt finds many events.  When zero, an "
+"interrupt polls up to its full NAPI budget before waking any threads.",
+           8, , 0, 0, MAX, count)
+
+CI_CFG_OPT("EF_ACCEPT_WAKE_EXCLUSIVE", accept_wake_exclusive, ci_uint32,
+"When several threads are blocked in accept() on the same listening socket, "
+"wake only as many of them as there are connections waiting to be accepted, "
+"rather than all of them.",
+           1, , 0, 0, 1, yesno)
+
 #if CI_CFG_UDP
 #define MULTICAST_LIMITATIONS_NOTE                                      \
     "\nSee the OpenOnload manual for further details on multicast operation."
@@ -353,6 +368,53 @@ CI_CFG_OPT("EF_TX_TIMESTAMPING", tx_timestamping, ci_uint32,
 " does not succeed;\n",
            2, , 0, 0, 3, count)
 
+CI_CFG_OPT("EF_LAT_HIST", lat_hist, ci_uint32,
+"Record per-socket latency histograms for TCP and UDP sockets.  The time "
+"from polling a received packet to queuing it on the socket and to "
+"returning it from a receive call, the time spent in send calls and (for "
+"UDP) the time from handing a packet to the adapter to its transmit "
+"completion are recorded.  The histograms can be viewed with "
+"\"onload_stackdump lat_hist\" and \"onload_stackdump watch_lat_hist\".  "
+"Each socket's histograms take a whole endpoint buffer of their own, so "
+"with this option set a stack can hold only half as many sockets for a "
+"given EF_MAX_ENDPOINTS.  "
+"This option is disabled by default.",
+           1, , 0, 0, 1, yesno)
+
+CI_CFG_OPT("EF_LOCK_PROFILE", lock_profile, ci_uint32,
+"Profile the stack lock.  When set to N, one in every N holds of the lock "
+"is timed and the hold time recorded against the code path that took the "
+"lock (polling, send calls, receive calls or other).  The time spent "
+"running timers and the post-poll list within a sampled hold is recorded "
+"too.  Every contended acquisition of the lock records the time spent "
+"waiting against the code path that was holding the lock.  The results "
+"can be viewed with \"onload_stackdump lock_profile\".  This option is "
+"disabled (0) by default.",
+           , , 0, MIN, MAX, count)
+
+CI_CFG_OPT("EF_TRACE", trace, ci_uint32,
+"Record a trace of stack events in a ring in the stack's shared state: "
+"polls, delivery of received data to sockets, timers, contended stack "
+"lock acquisitions and deferred work, wakeups and memory pressure.  The "
+"trace can be viewed with \"onload_stackdump trace\".  The ring takes "
+"32KB, and is only allocated when this is set.  See also "
+"EF_TRACE_FREEZE_USEC and EF_TRACE_FREEZE_MEM_PRESSURE.",
+           1, , 0, 0, 1, yesno)
+
+CI_CFG_OPT("EF_TRACE_FREEZE_USEC", trace_freeze_usec, ci_uint32,
+"When EF_TRACE is set, stop recording when a poll of the stack takes "
+"longer than this many microseconds, or a thread waits longer than this "
+"for the stack lock, so that the trace shows what led up to the stall.  "
+"Recording is restarted with \"onload_stackdump trace_unfreeze\".  0 (the "
+"default) disables this trigger.",
+           , , 0, MIN, MAX, count)
+
+CI_CFG_OPT("EF_TRACE_FREEZE_MEM_PRESSURE", trace_freeze_mem_pressure,
+           ci_uint32,
+"When EF_TRACE is set, stop recording when the stack enters critical "
+"memory pressure.",
+           1, , 0, 0, 1, yesno)
+
 CI_CFG_OPT("EF_CLUSTER_IGNORE", cluster_ignore, ci_uint32,
 "When set, this option instructs Onload to ignore attempts to use clusters and "
 "effectively ignore attempts to set SO_REUSEPORT.",
@@ -469,6 +531,16 @@ CI_CFG_OPT("EF_TCP_SYNCOOKIES", tcp_syncookies, ci_uint32,
 "Use TCP syncookies to protect from SYN flood attack",
            1, , 0, 0, 1, yesno)
 
+CI_CFG_OPT("EF_TCP_SYNCOOKIES_PRESSURE", tcp_syncookies_pressure, ci_uint32,
+"When non-zero, a listening socket whose listen queue reaches this percentage "
+"of EF_TCP_BACKLOG_MAX answers new SYNs with syncookies instead of allocating "
+"state for them, and carries on doing so until its listen queue drains to "
+"half that level.  Connections are then created only on receipt of the final "
+"ACK of the handshake.  Syncookies cannot carry all TCP options, so this is "
+"off by default.  EF_TCP_SYNCOOKIES enables syncookies only once the listen "
+"queue is full.",
+           8, , 0, 0, 100, count)
+
 CI_CFG_OPT("EF_TCP_SEND_NONBLOCK_NO_PACKETS_MODE", 
            tcp_nonblock_no_pkts_mode, ci_uint32,
            "This option controls how a non-blocking TCP send() call should "
@@ -622,6 +694,15 @@ CI_CFG_OPT("EF_USE_HUGE_PAGES", huge_pages, ci_uint32,
 "any warning in syslog for both mode 1 and 2 even if the system has "
 "free huge pages.",
            2, , 1, 0, 2, oneof:no;try;always)
+
+CI_CFG_OPT("EF_USE_1G_HUGE_PAGES", huge_pages_1g, ci_uint32,
+"When huge pages are used for packet buffers (see EF_USE_HUGE_PAGES), "
+"allocate them from 1GB huge pages where possible.  Each 1GB page holds "
+"512 packet sets, so one is only allocated when the stack may still grow "
+"by that many sets (see EF_MAX_PACKETS).  Otherwise, or if no 1GB pages "
+"are available, 2MB huge pages are used.  Use \"onload_stackdump "
+"netif_extra\" to see which page sizes are in use.",
+           1, , 0, 0, 1, yesno)
 #endif
 
 CI_CFG_OPT("EF_COMPOUND_PAGES_MODE", compound_pages, ci_uint32,
@@ -632,6 +713,18 @@ CI_CFG_OPT("EF_COMPOUND_PAGES_MODE", compound_pages, ci_uint32,
 "  2 - do not use compound pages at all.\n",
           2, , 0, 0, 2, oneof:always;small;never)
 
+CI_CFG_OPT("EF_NUMA_NODE", numa_node, ci_int32,
+"NUMA node on which to allocate packet buffers, socket state and the "
+"stack's shared state:\n"
+"  -1 - the node of the first network interface (default);\n"
+"  -2 - the node of the CPU that allocates the memory;\n"
+"  other values - the given node.\n"
+"If memory is not available on the chosen node, it is allocated "
+"elsewhere.  Huge pages come from the kernel's huge page pool and are not "
+"placed by this option.  Use \"onload_stackdump netif_extra\" to see where "
+"memory has been allocated.",
+           , , -1, -2, 1023, count)
+
 #if CI_CFG_PIO
 CI_CFG_OPT("EF_PIO", pio, ci_uint32,
 "Control of whether Programmed I/O is used instead of DMA for small packets:\n"
@@ -875,6 +968,31 @@ CI_CFG_OPT("EF_ACCEPTQ_MIN_BACKLOG", acceptq_min_backlog, ci_uint16,
 "call.  If the application requests a smaller value, use this value instead.",
            , , 1, MIN, MAX, count)
 
+CI_CFG_OPT("EF_TCP_ACCEPTQ_SHARDS", tcp_acceptq_shards, ci_uint32,
+"Split the accept queue of each listening socket into this many sub-queues.  "
+"Threads calling accept() on the same listening socket take connections from "
+"their own sub-queue first, and only look at the others when it is empty, so "
+"that they do not all contend for a single queue.  The order in which "
+"connections are accepted is then only preserved within a sub-queue.  See "
+"also EF_TCP_ACCEPTQ_SHARD_MODE.",
+           8, , 1, 1, CI_CFG_TCP_ACCEPTQ_SHARDS_MAX, count)
+
+#define CITP_TCP_ACCEPTQ_SHARD_RR       0
+#define CITP_TCP_ACCEPTQ_SHARD_CPU      1
+
+CI_CFG_OPT("EF_TCP_ACCEPTQ_SHARD_MODE", tcp_acceptq_shard_mode, ci_uint32,
+"Selects how new connections and accepting threads are assigned to the "
+"sub-queues of a listening socket when EF_TCP_ACCEPTQ_SHARDS is greater "
+"than 1:\n"
+"  0  -  connections are spread round-robin, and each thread has its own "
+"sub-queue (default);\n"
+"  1  -  connections go to the sub-queue of the CPU that processed them, and "
+"threads take from the sub-queue of the CPU they are running on.  This "
+"keeps new connections on the CPU that will accept them when accepting "
+"threads are pinned and poll the stack themselves.",
+           1, , CITP_TCP_ACCEPTQ_SHARD_RR, 0, CITP_TCP_ACCEPTQ_SHARD_CPU,
+           oneof:rr;cpu)
+
 CI_CFG_OPT("EF_NONAGLE_INFLIGHT_MAX", nonagle_inflight_max, ci_uint16,
 "This option affects the behaviour of TCP sockets with the TCP_NODELAY socket "
 "option.  Nagle's algorithm is enabled when the number of packets in-flight "
@@ -954,6 +1072,14 @@ CI_CFG_OPT("EF_SPIN_USEC", spin_usec, ci_uint32,
            "" /* documented in opts_citp_def.h */,
            ,  poll_cycles, 0, MIN, MAX, time:usec)
 
+CI_CFG_OPT("EF_SPIN_ADAPTIVE", spin_adaptive, ci_uint32,
+           "" /* documented in opts_citp_def.h */,
+           1, poll_cycles, 0, 0, 1, yesno)
+
+CI_CFG_OPT("EF_SPIN_WAKE_COST_USEC", spin_wake_cost_usec, ci_uint32,
+           "" /* documented in opts_citp_def.h */,
+           ,  poll_cycles, 10, MIN, MAX, time:usec)
+
 CI_CFG_OPT("EF_BUZZ_USEC", buzz_usec, ci_uint32,
 "Sets the timeout in microseconds for lock buzzing options.  Set to zero to "
 "disable lock buzzing (spinning).  Will buzz forever if set to -1.  Also set "
@@ -970,6 +1096,18 @@ CI_CFG_OPT("EF_HELPER_USEC", timer_usec, ci_uint32,
 "default for stacks that are interrupt driven.",
            ,  helper_timer, 500, MIN, MAX, time:usec)
 
+CI_CFG_OPT("EF_PERIODIC_TIMER_MAX_MSEC", periodic_timer_max_msec, ci_uint32,
+"By default each stack is polled by a periodic timer about ten times a "
+"second, to run protocol timers that fall due while the application is not "
+"calling into the stack.  When this option is non-zero, the periodic timer "
+"of an idle stack is instead armed for the earliest pending protocol timer, "
+"and this option gives the longest interval in milliseconds between runs.  "
+"This saves waking stacks that have nothing to do.  It only takes effect "
+"when network events raise interrupts (EF_INT_DRIVEN or EF_HELPER_USEC).  "
+"The most allowed is 2000.",
+           ,  helper_timer, 0, MIN, CI_CFG_PERIODIC_TIMER_MAX_MSEC_MAX,
+           time:msec)
+
 CI_CFG_OPT("EF_HELPER_PRIME_USEC", timer_prime_usec, ci_uint32,
 "Sets the frequency with which software should reset the count-down timer.  "
 "Usually set to a value that is significantly smaller than EF_HELPER_USEC "
@@ -998,6 +1136,17 @@ CI_CFG_OPT("EF_MAX_RX_PACKETS", max_rx_packets, ci_int32,
 "transmit path.",
            , , 24576, 0, 1000000000, count)
 
+CI_CFG_OPT("EF_RX_PKT_QUOTA", rx_pkt_quota, ci_int32,
+"Soft limit on the number of packet buffers that a single socket may hold "
+"in its receive queues while the stack is short of packet buffers.  Under "
+"memory pressure, further data received by a socket over its quota is "
+"dropped (TCP peers retransmit it once the application catches up), so "
+"that one slow reader cannot use up the buffers needed by every other "
+"socket in the stack.  Sockets over the quota are also the first to have "
+"buffers reclaimed.  0 disables dropping; reclamation then favours sockets "
+"holding more than an eighth of EF_MAX_RX_PACKETS.",
+           , , 0, 0, 1000000000, count)
+
 CI_CFG_OPT("EF_MAX_TX_PACKETS", max_tx_packets, ci_int32,
 "The maximum number of packet buffers in a stack that can be used by the "
 "transmit data path.  This should be set to a value smaller than "
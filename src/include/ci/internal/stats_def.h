@@ -40,8 +40,12 @@ OO_STAT("Number of times periodic timer has polled for events.",
         ci_uint32, periodic_polls, count)
 OO_STAT("Number of network events handled by periodic timer.",
         ci_uint32, periodic_evs, count)
+OO_STAT("Number of times periodic timer has run.",
+        ci_uint32, periodic_wakeups, count)
 OO_STAT("Number of times periodic timer could not get the stack lock.",
         ci_uint32, periodic_lock_contends, count)
+OO_STAT("Number of times periodic timer was re-armed for an earlier timer.",
+        ci_uint32, periodic_rearms, count)
 OO_STAT("Number of interrupts.",
         ci_uint32, interrupts, count)
 OO_STAT("Number of times an interrupt polled for network events.",
@@ -58,6 +62,9 @@ OO_STAT("Number of times an interrupt could not lock the stack.",
         ci_uint32, interrupt_lock_contends, count)
 OO_STAT("Number of times an interrupt handler was limited by NAPI budget.",
         ci_uint32, interrupt_budget_limited, count)
+OO_STAT("Number of times an interrupt stopped polling early having woken a "
+        "thread (EF_INT_WAKE_BATCH).",
+        ci_uint32, interrupt_batch_stops, count)
 OO_STAT("Number of times poll has been deferred to lock holder.",
         ci_uint32, deferred_polls, count)
 OO_STAT("Number of timeout interrupts.",
@@ -88,6 +95,8 @@ OO_STAT("Times OS has woken threads waiting on an Onload socket for transmit.",
         ci_uint32, sock_wakes_tx_os, count)
 OO_STAT("Times Onload has potentially sent a signal due to O_ASYNC.",
         ci_uint32, sock_wakes_signal, count)
+OO_STAT("Times Onload has woken threads that blocked on a different CPU.",
+        ci_uint32, sock_wakes_remote_cpu, count)
 #if CI_CFG_PKTS_AS_HUGE_PAGES
 OO_STAT("Number of huge pages allocated for packet sets.",
         ci_uint32, pkt_huge_pages, count)
@@ -240,6 +249,12 @@ OO_STAT("Number of times accept() returned EAGAIN.",
         ci_uint32, accept_eagain, count)
 OO_STAT("Times TCP_DEFER_ACCEPT has kicked-in.",
         ci_uint32, accepts_deferred, count)
+OO_STAT("Number of calls into the driver to set the filters of a batch of "
+        "passively opened TCP connections.",
+        ci_uint32, tcp_filter_set_batches, count)
+OO_STAT("Number of passively opened TCP connections whose filters were set "
+        "in a batch.",
+        ci_uint32, tcp_filter_set_batched, count)
 OO_STAT("Number of TCP ACKs sent.",
         ci_uint32, acks_sent, count)
 OO_STAT("Number of TCP window updates sent.",
@@ -301,8 +316,28 @@ OO_STAT("Number of times stack has exited 'memory pressure' state via recv.",
         ci_uint32, memory_pressure_exit_recv, count)
 OO_STAT("Number of packets dropped due to 'memory pressure'.",
         ci_uint32, memory_pressure_drops, count)
+OO_STAT("Number of packets dropped under 'memory pressure' because the "
+        "socket was over EF_RX_PKT_QUOTA.",
+        ci_uint32, rx_pkt_quota_drops, count)
+OO_STAT("Number of packet buffers reclaimed from sockets over "
+        "EF_RX_PKT_QUOTA.",
+        ci_uint32, rx_pkt_quota_reclaimed, count)
+OO_STAT("Number of packet sets requested on entering low memory pressure.",
+        ci_uint32, mem_pressure_pkt_set_requests, count)
+OO_STAT("Number of times RX refill switched to a packet set on the NIC's "
+        "NUMA node.",
+        ci_uint32, rx_refill_numa_local, count)
+OO_STAT("Number of calls to onload_stack_warm().",
+        ci_uint32, warm_calls, count)
+OO_STAT("Number of page faults taken by onload_stack_warm(), rather than "
+        "on the fast path later.",
+        ci_uint32, warm_faults, count)
 OO_STAT("Number of UDP packets dropped because no socket matched.",
         ci_uint32, udp_rx_no_match_drops, count)
+OO_STAT("Number of UDP packets dropped because the socket's SO_ATTACH_FILTER "
+        "program was changed after it was attached to hold an instruction "
+        "that is not allowed.",
+        ci_uint32, udp_rx_filter_bad_insn, count)
 OO_STAT("Number of UDP sockets which were closed while TX queue is active.",
         ci_uint32, udp_free_with_tx_active, count)
 OO_STAT("Number times inserting filter into software table failed.",
@@ -355,6 +390,14 @@ OO_STAT("Number of loops x sockets spent in epoll_wait() busy-waiting, "
         "with EF_UL_EPOLL=2",
         ci_uint64, spin_epoll_kernel, count)
 #endif
+OO_STAT("Number of times EF_SPIN_ADAPTIVE chose to spin before blocking",
+        ci_uint32, spin_adapt_spin, count)
+OO_STAT("Number of times EF_SPIN_ADAPTIVE chose to block without spinning",
+        ci_uint32, spin_adapt_block, count)
+OO_STAT("Number of adaptive spins that ended with the socket ready",
+        ci_uint32, spin_adapt_hit, count)
+OO_STAT("Number of adaptive spins that timed out and went on to block",
+        ci_uint32, spin_adapt_miss, count)
 #if CI_CFG_FD_CACHING
 OO_STAT("Number of sockets cached over lifetime of the stack",
         ci_uint32, sockcache_cached, count)
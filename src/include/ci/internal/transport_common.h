@@ -107,6 +107,10 @@ extern ci_netif* citp_find_ul_netif(int id, int locked) CI_HF;
   return it  */
 extern int citp_netif_alloc_and_init(ef_driver_handle*, ci_netif**) CI_HF;
 
+/*! Find or create the calling thread's stack in the process's cluster */
+extern int citp_netif_cluster_alloc_and_init(ef_driver_handle*, ci_netif**,
+                                             int* stack_id) CI_HF;
+
 /* Recreate a netif for a 'probed' user-level endpoint */
 extern int citp_netif_recreate_probed(ci_fd_t caller_fd,
                                       ef_driver_handle* fd,
@@ -337,6 +337,23 @@
 #define CI_CFG_UDP_SNDBUF_MIN	        CI_SOCK_MIN_SNDBUF
 #define CI_CFG_UDP_RCVBUF_MIN		CI_SOCK_MIN_RCVBUF
 
+/* Maximum length (in instructions) of a classic BPF program attached to a
+** UDP socket with SO_ATTACH_FILTER.  The program lives in the socket's
+** shared state, so this is limited by the size of citp_waitable_obj.
+*/
+#define CI_CFG_UDP_RX_FILTER_MAX_INSNS  32
+
+/* Maximum number of passively opened TCP connections whose filters are
+** set with a single call into the driver at the end of a poll.  See
+** ci_tcp_listenq_try_promote().
+*/
+#define CI_CFG_TCP_FILTER_SET_BATCH  32
+
+/* With EF_SPIN_ADAPTIVE, a caller that has blocked this many times in a row
+** spins anyway, so that the estimate sees waits that ended while spinning.
+*/
+#define CI_CFG_SPIN_ADAPT_PROBE  16
+
 /* TCP sndbuf */
 #define CI_CFG_TCP_SNDBUF_MIN	        CI_SOCK_MIN_SNDBUF
 # define CI_CFG_TCP_SNDBUF_DEFAULT	65535
@@ -552,6 +569,26 @@
 #define CI_CFG_SPIN_STATS 1
 #endif
 
+/* Per-socket latency histograms (EF_LAT_HIST).  When compiled in but not
+ * enabled at runtime the cost is one well-predicted branch at each
+ * measurement point.  When enabled, each socket uses a second endpoint
+ * buffer for its histograms.
+ */
+#define CI_CFG_LAT_HIST                 1
+
+/* Stack lock hold and wait time profiling (EF_LOCK_PROFILE).  When
+ * compiled in but not enabled at runtime the cost is one well-predicted
+ * branch each time the lock is taken or dropped.
+ */
+#define CI_CFG_LOCK_PROFILE             1
+
+/* Per-stack flight recorder (EF_TRACE).  CI_CFG_TRACE_LEN records of 32
+ * bytes each are added to the shared state of stacks created with EF_TRACE
+ * set; it must be a power of two.
+ */
+#define CI_CFG_TRACE                    1
+#define CI_CFG_TRACE_LEN                1024
+
 /*
  * install broadcast hardware filters for UDP
  * - not needed currently as all such sockets get passed to OS
@@ -576,6 +613,17 @@
 /* Maximum number of retransmit for SYN-ACKs */
 #define CI_CFG_TCP_SYNACK_RETRANS_MAX 10
 
+/* Maximum number of sub-queues in a listening socket's accept queue
+ * (EF_TCP_ACCEPTQ_SHARDS).  Limited by space in the endpoint buffer. */
+#define CI_CFG_TCP_ACCEPTQ_SHARDS_MAX 16
+
+/* Upper limit on EF_PERIODIC_TIMER_MAX_MSEC.  The periodic timers of the
+ * stacks also keep the kernel's clock calibration (oo_timesync) up to
+ * date, and that resets its smoothing after a gap of more than 10s, so
+ * this is kept well under that.
+ */
+#define CI_CFG_PERIODIC_TIMER_MAX_MSEC_MAX 2000
+
 #ifndef CI_CFG_REF_WIN32_FO
 #define CI_CFG_REF_WIN32_FO 1 /* keep ref to file object to
 				 stop it disappearing too soon */
@@ -38,6 +38,19 @@
 /*! Comment? */
 extern int ci_cpu_features_check(int verbose);
 
+/* Instruction set extensions reported by ci_cpu_features().  A feature is
+ * only reported if the OS also saves the register state it needs.
+ */
+#define CI_CPU_FEAT_SSE2	0x1
+#define CI_CPU_FEAT_SSE42	0x2
+#define CI_CPU_FEAT_AVX2	0x4
+#define CI_CPU_FEAT_AVX512F	0x8
+
+/*! Returns the set of CI_CPU_FEAT_* flags supported by the CPU we're
+ * running on.
+ */
+extern unsigned ci_cpu_features(void);
+
 #endif  /* __CI_TOOLS_CPU_FEATURES_H__ */
 
 /*! \cidoxg_end */
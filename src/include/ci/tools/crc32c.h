@@ -34,6 +34,13 @@ extern ci_uint32 ci_crc32c_partial(const ci_uint8 *buf, ci_uint32 buflen,
 extern ci_uint32 ci_crc32c_partial_copy(ci_uint8 *dest, const ci_uint8 *buf,
                                         ci_uint32 buflen, ci_uint32 crc);
 
+/* Table-driven implementation of ci_crc32c_partial().  This is what
+ * ci_crc32c_partial() uses on CPUs without SSE4.2, and is provided for
+ * cross-checking the hardware implementation.
+ */
+extern ci_uint32 ci_crc32c_partial_sw(const ci_uint8 *buf, ci_uint32 buflen,
+                                      ci_uint32 crc);
+
 ci_inline ci_uint32 ci_crc32c(const ci_uint8 *buf, ci_uint32 buflen)
 {
   return ~ci_crc32c_partial(buf, buflen, 0xffffffff);
@@ -118,10 +118,33 @@ ci_inline unsigned ci_icmp_csum_finish(unsigned csum)
 /****************************************************************************
  * Defines to point at C/ASM routines
  ***************************************************************************/
+
+/* At user-level on x86-64 the aligned routines use SIMD implementations
+ * chosen at run time (see ci_ip_csum_select()).  The kernel would have to
+ * save the vector registers to use them, so it always uses the C code.
+ */
+#if defined(__x86_64__) && defined(__GNUC__) && ! defined(__KERNEL__)
+# define CI_IP_CSUM_VEC  1
+#else
+# define CI_IP_CSUM_VEC  0
+#endif
+
 #define ci_ip_csum              ci_ip_csum_c
 #define ci_ip_csum_copy         ci_ip_csum_copy_c
-#define ci_ip_csum_aligned      ci_ip_csum_aligned_c
-#define ci_ip_csum_copy_aligned ci_ip_csum_copy_aligned_c
+#if CI_IP_CSUM_VEC
+# define ci_ip_csum_aligned      ci_ip_csum_aligned_vec
+# define ci_ip_csum_copy_aligned ci_ip_csum_copy_aligned_vec
+#else
+# define ci_ip_csum_aligned      ci_ip_csum_aligned_c
+# define ci_ip_csum_copy_aligned ci_ip_csum_copy_aligned_c
+#endif
+
+#if CI_IP_CSUM_VEC
+extern unsigned ci_ip_csum_aligned_vec(const void* data, size_t n,
+                                       unsigned csum) CI_HF;
+extern unsigned ci_ip_csum_copy_aligned_vec(void* dest, const void* src,
+                                            int n, unsigned sum) CI_HF;
+#endif
 
 ci_inline unsigned int
 ci_ip_csum_c(const void *data, size_t n, int start_not_aligned,
@@ -246,7 +269,7 @@ ci_ip_csum_c(const void *data, size_t n, int start_not_aligned,
     data = ((const ci_uint8 *)data) + 1;
     --n;
   }
-  return ci_ip_csum_aligned_c(data, n, csum);
+  return ci_ip_csum_aligned(data, n, csum);
 }
 
 
@@ -266,7 +289,7 @@ ci_ip_csum_copy_c(void *dst, const void *src, size_t n, int start_not_aligned,
     src = ((const ci_uint8 *)src) + 1;
     --n;
   }
-  return ci_ip_csum_copy_aligned_c(dst, src, n, csum);
+  return ci_ip_csum_copy_aligned(dst, src, n, csum);
 }
 
 
@@ -314,5 +337,34 @@ extern int ci_ip_csum_copy_to_iovec(ci_iovec_ptr* dest, const void* src,
 				    int src_len, unsigned* sum) CI_HF;
 
 
+/****************************************************************************
+ * Run-time selection of checksum routines
+ ***************************************************************************/
+
+#define CI_IP_CSUM_IMPL_AUTO    (-1)
+#define CI_IP_CSUM_IMPL_C       0
+#define CI_IP_CSUM_IMPL_SSE2    1
+#define CI_IP_CSUM_IMPL_AVX2    2
+#define CI_IP_CSUM_IMPL_AVX512  3
+#define CI_IP_CSUM_IMPL_N       4
+
+  /*! Select the implementation (CI_IP_CSUM_IMPL_*) used by
+  ** ci_ip_csum_aligned() and ci_ip_csum_copy_aligned(), and hence by
+  ** ci_ip_csum_partial() and the copy-and-checksum routines.  If the CPU
+  ** does not support the requested implementation, the best one it does
+  ** support is used.  Returns the implementation selected.
+  **
+  ** CI_IP_CSUM_IMPL_AUTO, which is what is used if this is never called,
+  ** does not select AVX-512, because using it can lower the clock speed of
+  ** the core.
+  **
+  ** Builds without CI_IP_CSUM_VEC always use CI_IP_CSUM_IMPL_C.
+  */
+extern int ci_ip_csum_select(int impl) CI_HF;
+
+  /*! Returns the name of a CI_IP_CSUM_IMPL_* implementation. */
+extern const char* ci_ip_csum_impl_name(int impl) CI_HF;
+
+
 #endif  /* __CI_TOOLS_IPCSUM_H__ */
 /*! \cidoxg_end */
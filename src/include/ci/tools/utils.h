@@ -56,6 +56,14 @@ ci_inline ci_uint64 ci_frc64_get(void) {
   ci_frc64(&now);
   return now;
 }
+
+/* Cycles from [start] to now.  [start] may have been taken on another
+** core, whose counter can be slightly ahead, so this saturates at zero.
+*/
+ci_inline ci_uint64 ci_frc64_since(ci_uint64 start) {
+  ci_uint64 now = ci_frc64_get();
+  return (ci_int64) (now - start) > 0 ? now - start : 0;
+}
 #endif
 #ifdef CI_HAVE_FRC32
 ci_inline ci_uint32 ci_frc32_get(void) {
@@ -165,6 +173,39 @@ extern ci_uint32 ci_toeplitz_hash(const ci_uint8 *key, const ci_uint8 *input,
                                   int n);
   /*!< Toeplitz hash */
 
+#define CI_TOEPLITZ_CACHE_MAX_INPUT  12
+
+typedef struct {
+  ci_uint32 table[CI_TOEPLITZ_CACHE_MAX_INPUT][256];
+} ci_toeplitz_cache;
+  /*!< Per-key lookup tables for Toeplitz hashing of inputs of up to
+   * CI_TOEPLITZ_CACHE_MAX_INPUT bytes (an IPv4 4-tuple).  Entry [i][v] is
+   * the hash contribution of byte value [v] at offset [i] of the input. */
+
+extern void ci_toeplitz_cache_init(ci_toeplitz_cache* cache,
+                                   const ci_uint8 *key);
+  /*!< Fill in [cache] for [key], which must be at least
+   * CI_TOEPLITZ_CACHE_MAX_INPUT + 4 bytes long. */
+
+ci_inline ci_uint32 ci_toeplitz_hash_cached(const ci_toeplitz_cache* cache,
+                                            const ci_uint8 *input, int n)
+{
+  ci_uint32 result = 0;
+  int i;
+  for( i = 0; i < n; ++i )
+    result ^= cache->table[i][input[i]];
+  return result;
+}
+  /*!< Toeplitz hash using lookup tables.  Gives the same result as
+   * ci_toeplitz_hash() with the key [cache] was initialised with.  [n]
+   * must not exceed CI_TOEPLITZ_CACHE_MAX_INPUT. */
+
+extern void ci_toeplitz_hash_batch(const ci_toeplitz_cache* cache,
+                                   const ci_uint8 *input, int n,
+                                   int n_inputs, ci_uint32* hashes);
+  /*!< Toeplitz hash [n_inputs] inputs of [n] bytes each, stored
+   * contiguously at [input], into [hashes]. */
+
 /**********************************************************************
  * system info
  **********************************************************************/ 
@@ -498,6 +498,8 @@ typedef struct {
   uint16_t  rx_ps_pkt_count;                    /* ef10 only */
   /** Credit for packed stream handling (7000-series only) */
   uint16_t  rx_ps_credit_avail;                 /* ef10 only */
+  /** Credits to accumulate before returning them (7000-series only) */
+  uint16_t  rx_ps_credit_batch;                 /* ef10 only */
 } ef_vi_rxq_state;
 
 /*! \brief State of event queue
@@ -0,0 +1,191 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of version 2.1 of the GNU Lesser General Public
+** License as published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+*/
+
+/**************************************************************************\
+*//*! \file
+** \author    Solarflare Communications, Inc.
+** \brief     Flow plans: steering sets of flows to virtual interfaces.
+** \date      2016/10/18
+** \copyright Copyright &copy; 2016 Solarflare Communications, Inc. All
+**            rights reserved. Solarflare, OpenOnload and EnterpriseOnload
+**            are trademarks of Solarflare Communications, Inc.
+*//*
+\**************************************************************************/
+
+#ifndef __EFAB_FLOWPLAN_H__
+#define __EFAB_FLOWPLAN_H__
+
+#include <etherfabric/base.h>
+#include <etherfabric/vi.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*! \brief Target for a flow that should be placed by the flow-plan
+** compiler, and may later be moved by ef_flow_plan_rebalance(). */
+#define EF_FLOW_PLAN_VI_AUTO    -1
+/*! \brief Target for a flow that should be spread by RSS over all of the
+** virtual interfaces in the set. */
+#define EF_FLOW_PLAN_VI_SET     -2
+/*! \brief Value of fpfl_installed_vi for a filter that is not installed. */
+#define EF_FLOW_PLAN_VI_NONE    -3
+
+
+/*! \brief A flow in a flow plan
+**
+** If fpf_raddr_be32 and fpf_rport_be16 are both zero the flow matches on
+** local address and port only (see ef_filter_spec_set_ip4_local()).
+** Otherwise it is a full match (see ef_filter_spec_set_ip4_full()).
+*/
+typedef struct {
+  /** IPPROTO_UDP or IPPROTO_TCP. */
+  int       fpf_protocol;
+  /** Local address, big-endian. */
+  unsigned  fpf_laddr_be32;
+  /** Local port, big-endian. */
+  int       fpf_lport_be16;
+  /** Remote address, big-endian, or 0. */
+  unsigned  fpf_raddr_be32;
+  /** Remote port, big-endian, or 0. */
+  int       fpf_rport_be16;
+  /** VLAN to match, or EF_FILTER_VLAN_ID_ANY. */
+  int       fpf_vlan_id;
+  /** Index of target VI, EF_FLOW_PLAN_VI_AUTO or EF_FLOW_PLAN_VI_SET. */
+  int       fpf_vi;
+  /** Expected relative load of this flow.  Used to place flows with
+   * target EF_FLOW_PLAN_VI_AUTO.  Zero is treated as one. */
+  unsigned  fpf_weight;
+} ef_flow_plan_flow;
+
+
+/*! \brief A filter produced by the flow-plan compiler
+**
+** The fields other than fpfl_spec and fpfl_vi are maintained by the
+** library, and should not be modified by the application.
+*/
+typedef struct {
+  /** The filter. */
+  ef_filter_spec   fpfl_spec;
+  /** Index of target VI, or EF_FLOW_PLAN_VI_SET. */
+  int              fpfl_vi;
+  /** Sum of the weights of the flows carried by this filter. */
+  unsigned         fpfl_weight;
+  /** Non-zero if the filter may be moved by ef_flow_plan_rebalance(). */
+  int              fpfl_movable;
+  /** Where the filter is currently installed, or EF_FLOW_PLAN_VI_NONE. */
+  int              fpfl_installed_vi;
+  /** Cookie for the installed filter. */
+  ef_filter_cookie fpfl_cookie;
+} ef_flow_plan_filter;
+
+
+/*! \brief Compile a flow plan into a set of filters
+**
+** \param flows       The flows to steer.
+** \param n_flows     The number of flows.
+** \param n_vis       The number of virtual interfaces flows can be steered
+**                    to.
+** \param filters_out Array that is updated on return with the filters.
+** \param max_filters Size of the filters_out array.
+**
+** \return The number of filters written to filters_out, or a negative
+**         error code:\n
+**         -EINVAL if a flow is malformed, or two identical flows have
+**         different targets.\n
+**         -ENOSPC if filters_out is too small.
+**
+** Identical flows are merged, and full-match flows that would be
+** delivered to the same VI by a local-match flow in the plan are dropped.
+** Flows with target EF_FLOW_PLAN_VI_AUTO are placed so as to balance the
+** total weight on each VI; a full-match flow is placed on the same VI as
+** a local-match flow that covers it.
+**
+** This function does not talk to the adapter, so it can be used to check
+** a plan offline.  The filters are installed with ef_flow_plan_apply().
+*/
+extern int ef_flow_plan_compile(const ef_flow_plan_flow* flows, int n_flows,
+                                int n_vis, ef_flow_plan_filter* filters_out,
+                                int max_filters);
+
+
+/*! \brief Install filters, or move them to their new targets
+**
+** \param filters   The filters, from ef_flow_plan_compile().
+** \param n_filters The number of filters.
+** \param vis       Array of the virtual interfaces that the plan refers
+**                  to, indexed by fpfl_vi.
+** \param vi_dh     The ef_driver_handle for the virtual interfaces.
+** \param vi_set    The virtual interface set, or NULL if no filter has
+**                  target EF_FLOW_PLAN_VI_SET.
+** \param vi_set_dh The ef_driver_handle for the virtual interface set.
+**
+** \return 0 on success, or a negative error code.
+**
+** Each filter that is not installed, or is installed on a different VI
+** from fpfl_vi, is (re)installed.  If any step fails then all of the
+** changes made by this call are undone before returning, so that the
+** filters are left as they were.
+*/
+extern int ef_flow_plan_apply(ef_flow_plan_filter* filters, int n_filters,
+                              ef_vi** vis, ef_driver_handle vi_dh,
+                              ef_vi_set* vi_set, ef_driver_handle vi_set_dh);
+
+
+/*! \brief Remove installed filters
+**
+** \param filters   The filters.
+** \param n_filters The number of filters.
+** \param vis       As passed to ef_flow_plan_apply().
+** \param vi_dh     As passed to ef_flow_plan_apply().
+** \param vi_set    As passed to ef_flow_plan_apply().
+** \param vi_set_dh As passed to ef_flow_plan_apply().
+**
+** \return 0 on success, or the first error seen.  All filters are marked
+**         as not installed in either case.
+*/
+extern int ef_flow_plan_remove(ef_flow_plan_filter* filters, int n_filters,
+                               ef_vi** vis, ef_driver_handle vi_dh,
+                               ef_vi_set* vi_set, ef_driver_handle vi_set_dh);
+
+
+/*! \brief Move filters to even out the load on virtual interfaces
+**
+** \param filters   The filters.
+** \param n_filters The number of filters.
+** \param n_vis     The number of virtual interfaces.
+** \param vi_load   Load measured on each VI over some interval, such as
+**                  the number of packets received.
+** \param skew_pct  How far above the mean the busiest VI may be, in
+**                  percent, before filters are moved.
+**
+** \return The number of moves made.
+**
+** The load on each VI is shared between the movable filters it carries in
+** proportion to their weights, and filters are moved from the busiest VI
+** to the least busy while that reduces the maximum.  Only fpfl_vi is
+** changed; call ef_flow_plan_apply() to move the filters.
+*/
+extern int ef_flow_plan_rebalance(ef_flow_plan_filter* filters, int n_filters,
+                                  int n_vis, const uint64_t* vi_load,
+                                  int skew_pct);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __EFAB_FLOWPLAN_H__ */
@@ -227,6 +227,249 @@ ef_packed_stream_packet_payload(ef_packed_stream_packet* ps_pkt)
 }
 
 
+/*! \brief Set how many credits are accumulated before they are returned
+**
+** \param vi        The virtual interface to modify.
+** \param n_credits The number of consumed credits to accumulate before
+**                  returning them to the adapter, or 0 to return them
+**                  as soon as they are consumed (the default).
+**
+** \return 0 on success, or a negative error code:\n
+**         -EINVAL if the virtual interface is not in packed-stream mode.
+**
+** ef_vi_packed_stream_unbundle() returns credits to the adapter whenever
+** the adapter crosses a credit boundary, at the cost of a doorbell write
+** each time.  Setting a batch size defers the doorbell until at least
+** \p n_credits credits are outstanding, or until the adapter has none
+** left.  The value is capped at the maximum number of credits the
+** virtual interface can hold.
+*/
+extern int ef_vi_packed_stream_set_credit_batch(ef_vi* vi, int n_credits);
+
+
+/**********************************************************************
+ * Packed-stream demultiplexing.
+ */
+
+/*! \brief Identifies a flow for ef_packed_stream_demux_add()
+**
+** All fields are in network byte order.  A field that is zero matches
+** any value.
+*/
+typedef struct {
+  /** IPv4 source address. */
+  uint32_t  psfk_saddr_be32;
+  /** IPv4 destination address. */
+  uint32_t  psfk_daddr_be32;
+  /** TCP or UDP source port. */
+  uint16_t  psfk_sport_be16;
+  /** TCP or UDP destination port. */
+  uint16_t  psfk_dport_be16;
+  /** IP protocol (IPPROTO_TCP or IPPROTO_UDP). */
+  uint8_t   psfk_protocol;
+} ef_packed_stream_flow_key;
+
+
+/*! \brief Handler invoked for each packet that matches a flow
+**
+** \param arg     The argument given when the flow was added.
+** \param flow_id The identifier of the matching flow, or -1 for packets
+**                passed to the default handler.
+** \param ps_pkt  The packet.  It remains valid until its buffer is
+**                reposted to the virtual interface.
+*/
+typedef void ef_packed_stream_flow_fn(void* arg, int flow_id,
+                                      ef_packed_stream_packet* ps_pkt);
+
+
+/*! \brief Per-flow state in an ef_packed_stream_demux
+**
+** Users should not access this structure.
+*/
+typedef struct {
+  ef_packed_stream_flow_key  psf_key;
+  ef_packed_stream_flow_fn*  psf_fn;
+  void*                      psf_arg;
+  uint64_t                   psf_n_pkts;
+  uint64_t                   psf_n_bytes;
+} ef_packed_stream_flow;
+
+
+/*! \brief A table that classifies packets into flows
+**
+** Flows that specify all of the fields of their key are found with a
+** single hash lookup.  Flows with wildcards are tried in the order they
+** were added when the hash lookup misses.
+**
+** Users should not access this structure.
+*/
+typedef struct {
+  ef_packed_stream_flow*     psd_flows;
+  int32_t*                   psd_hash;
+  int32_t*                   psd_wild;
+  unsigned                   psd_hash_mask;
+  int                        psd_max_flows;
+  int                        psd_n_flows;
+  int                        psd_n_wild;
+  ef_packed_stream_flow      psd_default;
+} ef_packed_stream_demux;
+
+
+/*! \brief Calculate the memory needed by an ef_packed_stream_demux
+**
+** \param max_flows The maximum number of flows the table will hold.
+**
+** \return The number of bytes to pass to ef_packed_stream_demux_init().
+*/
+extern int ef_packed_stream_demux_calc_bytes(int max_flows);
+
+
+/*! \brief Initialise an ef_packed_stream_demux
+**
+** \param demux     The table to initialise.
+** \param mem       Memory for the table, of at least
+**                  ef_packed_stream_demux_calc_bytes(max_flows) bytes,
+**                  aligned to 8 bytes.
+** \param max_flows The maximum number of flows the table will hold.
+** \param default_fn Handler for packets that match no flow, or NULL to
+**                  drop them.
+** \param default_arg Argument passed to \p default_fn.
+**
+** \return 0 on success, or a negative error code.
+*/
+extern int ef_packed_stream_demux_init(ef_packed_stream_demux* demux,
+                                       void* mem, int max_flows,
+                                       ef_packed_stream_flow_fn* default_fn,
+                                       void* default_arg);
+
+
+/*! \brief Add a flow to an ef_packed_stream_demux
+**
+** \param demux The table to add the flow to.
+** \param key   The flow to match.
+** \param fn    Handler invoked for each matching packet.
+** \param arg   Argument passed to \p fn.
+**
+** \return The flow id (>= 0) on success, or a negative error code:\n
+**         -ENOSPC if the table is full.\n
+**         -EEXIST if a flow with the same key has already been added.
+*/
+extern int ef_packed_stream_demux_add(ef_packed_stream_demux* demux,
+                                      const ef_packed_stream_flow_key* key,
+                                      ef_packed_stream_flow_fn* fn,
+                                      void* arg);
+
+
+/*! \brief Find the flow that a packet belongs to
+**
+** \param demux  The table to search.
+** \param ps_pkt The packet to classify.
+**
+** \return The flow id, or -1 if no flow matches.
+*/
+extern int ef_packed_stream_demux_classify(ef_packed_stream_demux* demux,
+                                           ef_packed_stream_packet* ps_pkt);
+
+
+/*! \brief Dispatch a run of packets to their flow handlers
+**
+** \param demux  The table to dispatch with.
+** \param ps_pkt The first packet of the run.
+** \param n_pkts The number of packets in the run.
+**
+** \return A pointer to the packet following the run.
+**
+** Walks \p n_pkts packets starting at \p ps_pkt, as laid out by
+** ef_vi_packed_stream_unbundle(), prefetching the following packet while
+** the current one is classified and handed to its flow handler.  Does not
+** touch the virtual interface, so can be used with buffers built in
+** memory.
+*/
+extern ef_packed_stream_packet*
+ef_packed_stream_demux_dispatch(ef_packed_stream_demux* demux,
+                                ef_packed_stream_packet* ps_pkt, int n_pkts);
+
+
+/*! \brief Get the packet and byte counts for a flow
+**
+** \param demux       The table to query.
+** \param flow_id     The flow id, or -1 for the default handler.
+** \param n_pkts_out  Updated with the number of packets dispatched.
+** \param n_bytes_out Updated with the number of bytes dispatched.
+**
+** \return 0 on success, or -EINVAL if \p flow_id is not valid.
+*/
+extern int ef_packed_stream_demux_get_stats(ef_packed_stream_demux* demux,
+                                            int flow_id,
+                                            uint64_t* n_pkts_out,
+                                            uint64_t* n_bytes_out);
+
+
+/**********************************************************************
+ * Packed-stream iteration.
+ */
+
+/*! \brief Consumes packed-stream events for one virtual interface
+**
+** Users should not access this structure.
+*/
+typedef struct {
+  ef_vi*                     psi_vi;
+  ef_packed_stream_demux*    psi_demux;
+  char*                      psi_bufs;
+  struct ef_memreg*          psi_memreg;
+  size_t                     psi_memreg_offset;
+  int                        psi_buf_size;
+  int                        psi_n_bufs;
+  int                        psi_current;
+  int                        psi_start_offset;
+  ef_packed_stream_packet*   psi_pkt_iter;
+  uint64_t                   psi_n_pkts;
+  uint64_t                   psi_n_bytes;
+} ef_packed_stream_iter;
+
+
+/*! \brief Initialise an ef_packed_stream_iter and post its buffers
+**
+** \param iter          The iterator to initialise.
+** \param vi            A virtual interface in packed-stream mode.
+** \param demux         Table used to dispatch received packets.
+** \param bufs          Start of \p n_bufs contiguous packed-stream
+**                      buffers, aligned as required by
+**                      ef_vi_packed_stream_get_params().
+** \param memreg        Registered memory containing the buffers.
+** \param memreg_offset Offset of \p bufs within \p memreg.
+** \param n_bufs        Number of buffers.
+** \param credit_batch  Passed to ef_vi_packed_stream_set_credit_batch().
+**
+** \return 0 on success, or a negative error code.
+**
+** Every buffer is posted to the virtual interface.  Each buffer is
+** reposted as soon as the adapter moves on to the next one, so handlers
+** must not retain pointers to packets after they return.
+*/
+extern int ef_packed_stream_iter_init(ef_packed_stream_iter* iter,
+                                      ef_vi* vi,
+                                      ef_packed_stream_demux* demux,
+                                      void* bufs, struct ef_memreg* memreg,
+                                      size_t memreg_offset, int n_bufs,
+                                      int credit_batch);
+
+
+/*! \brief Handle an event of type EF_EVENT_TYPE_RX_PACKED_STREAM
+**
+** \param iter The iterator for the virtual interface that raised the event.
+** \param ev   The event.
+**
+** \return The number of packets dispatched, or a negative error code.
+**
+** Moves to the next buffer if the event says so, unbundles the packets
+** and dispatches them through the iterator's demux table.
+*/
+extern int ef_packed_stream_iter_event(ef_packed_stream_iter* iter,
+                                       const ef_event* ev);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -137,6 +137,13 @@ typedef struct {
   ci_ifid_t         bindto_ifindex;
 } oo_tcp_filter_set_t;
 
+typedef struct {
+  ci_user_ptr_t     ops;    /* oo_tcp_filter_set_t[n_ops] */
+  ci_user_ptr_t     rcs;    /* ci_int32[n_ops] OUT: result of each op */
+  ci_int32          n_ops;  /* at most OO_TCP_FILTER_SET_BATCH_MAX */
+} oo_tcp_filter_set_batch_t;
+#define OO_TCP_FILTER_SET_BATCH_MAX  256
+
 typedef struct {
   char      cluster_name[CI_CFG_CLUSTER_NAME_LEN + 1];
   ci_int32  cluster_size;
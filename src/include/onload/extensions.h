@@ -59,6 +59,7 @@
 
 #include <sys/types.h>
 #include <stdint.h>
+#include <netinet/in.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -602,6 +603,118 @@ extern int
 onload_get_tcp_info(int fd, struct onload_tcp_info* info, int* len_in_out);
 
 
+/**********************************************************************
+ * Cluster steering
+ *
+ * The stacks of an application cluster (EF_CLUSTER_NAME) share listen
+ * filters, and the NIC spreads the flows matching them across the stacks
+ * with its RSS hash.  These calls compute the same hash, with the same key
+ * and indirection table, so that an application can tell in advance which
+ * stack (and so which thread) a flow will land on.  Stacks are identified
+ * by their index within the cluster, from 0 to the cluster size less one.
+ *
+ * Each call takes an accelerated socket [fd] in a clustered stack, and
+ * returns -1 with errno=EINVAL if [fd] is not an accelerated socket, or
+ * ENOENT if its stack is not clustered or the NIC's hash is not known
+ * (for example if the NIC had no RSS context to spare for the cluster).
+ */
+
+struct onload_cluster_tuple {
+  struct in_addr laddr;
+  struct in_addr raddr;
+  in_port_t      lport;   /* network byte order */
+  in_port_t      rport;   /* network byte order */
+};
+
+/* Returns the index of [fd]'s stack within its cluster, and stores the
+ * size of the cluster at [cluster_size_out] if it is not NULL.
+ */
+extern int
+onload_cluster_stack_index(int fd, int* cluster_size_out);
+
+/* The tuples passed to onload_cluster_tuple_index() are of connections
+ * opened with connect() rather than accepted.  This makes a difference
+ * only to clusters using EF_SCALABLE_FILTERS=rss:transparent_active, which
+ * spread the two differently.
+ */
+#define ONLOAD_CLUSTER_TUPLE_ACTIVE  0x1
+
+/* Stores at [indices_out][i] the index of the cluster stack that receives
+ * the packets of TCP/IPv4 flow [tuples][i], for each of [n_tuples] flows.
+ * Returns 0 on success.
+ */
+extern int
+onload_cluster_tuple_index(int fd, const struct onload_cluster_tuple* tuples,
+                           int n_tuples, int* indices_out, unsigned flags);
+
+/* Binds the unbound TCP socket [fd] to the address of [laddr] and to an
+ * ephemeral port chosen so that the replies to a connection to [raddr]
+ * are received by [fd]'s own stack.  Call it before connect().  The
+ * address of [laddr] must not be INADDR_ANY, and its port is ignored.
+ *
+ * A new socket is not yet in a clustered stack.  If EF_CLUSTER_SIZE is at
+ * least 2, it is first moved into the calling thread's stack in the
+ * cluster named by EF_CLUSTER_NAME, which is created if needed.
+ *
+ * Returns 0 on success, or -1 with errno=EADDRNOTAVAIL if no suitable
+ * port is free, or any error that bind() can give.
+ */
+extern int
+onload_cluster_bind_for_connect(int fd, const struct sockaddr_in* laddr,
+                                const struct sockaddr_in* raddr);
+
+
+/**********************************************************************
+ * onload_stack_warm: Prepare a socket's fast paths before first use
+ *
+ * The first send or receive on a socket can be much slower than later
+ * ones: the pages of the socket, the stack's shared state and its packet
+ * buffers are faulted in on first touch, and the control plane lookup for
+ * the destination is done then.  This call does that work up front.
+ *
+ * [fd] is an accelerated socket, normally connected, or an epoll set.
+ * [flags] selects what to warm:
+ *
+ *   ONLOAD_WARM_STACK   fault in the stack's shared state, rings and
+ *                       packet buffers, and the socket's own state;
+ *   ONLOAD_WARM_SEND    run the send path without sending: TCP uses
+ *                       ONLOAD_MSG_WARM, and UDP builds a packet from the
+ *                       socket's cached headers;
+ *   ONLOAD_WARM_RECV    run the receive path with MSG_PEEK | MSG_DONTWAIT,
+ *                       which consumes no data;
+ *   ONLOAD_WARM_EPOLL   fault in the socket's epoll state, or when [fd] is
+ *                       an epoll set, the set and all of its members;
+ *   ONLOAD_WARM_CPLANE  look up the route to the peer, and for TCP wait
+ *                       briefly for the next hop's MAC address, sending
+ *                       an ACK to provoke ARP if need be.
+ *
+ * None of these change what the application will later see from [fd].
+ * Warming a TCP send path requires an empty send queue, so warm before
+ * sending the first message.
+ *
+ * Returns 0 on success, or -1 with errno=EINVAL if [fd] is not accelerated.
+ * If [stats] is not NULL it is filled in, and the page faults taken are
+ * also added to the stack's warm_faults counter.
+ */
+
+#define ONLOAD_WARM_STACK   0x1
+#define ONLOAD_WARM_SEND    0x2
+#define ONLOAD_WARM_RECV    0x4
+#define ONLOAD_WARM_EPOLL   0x8
+#define ONLOAD_WARM_CPLANE  0x10
+#define ONLOAD_WARM_ALL     0x1f
+
+struct onload_warm_stats {
+  uint32_t pages_touched;  /* pages of shared memory read */
+  uint32_t faults;         /* page faults taken, and so avoided later */
+  uint32_t cplane_lookups; /* route lookups made */
+  int32_t  route_ok;       /* 1 if sends can then be accelerated */
+};
+
+extern int
+onload_stack_warm(int fd, unsigned flags, struct onload_warm_stats* stats);
+
+
 #ifdef __cplusplus
 }
 #endif
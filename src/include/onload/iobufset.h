@@ -69,7 +69,18 @@
 #define OO_HAVE_COMPOUND_PAGES
 #endif
 
+/* 1GB huge pages can be requested from shmget() since linux-3.8. */
+#ifdef OO_DO_HUGE_PAGES
+#include <linux/shm.h>
+#endif
+#if defined(OO_DO_HUGE_PAGES) && defined(SHM_HUGE_SHIFT)
+#define OO_DO_HUGE_PAGES_1G
+#define OO_SHM_HUGE_1GB       (30 << SHM_HUGE_SHIFT)
+#define OO_HUGE_SEG_SHIFT     30
+#endif
+
 struct efrm_pd;
+struct oo_huge_segment;
 
 /*
  * For all these structures, users should not access the structure fields
@@ -81,13 +92,29 @@ struct efrm_pd;
  */
 
 
+#ifdef OO_DO_HUGE_PAGES_1G
+/*! A 1GB huge page, carved into 2MB slices for packet sets.  Each slice
+ * holds a reference. */
+struct oo_huge_segment {
+  int shmid;
+  struct page *page;        /*!< first page, pinned */
+  int n_slices;             /*!< slices handed out so far */
+  oo_atomic_t ref_count;
+};
+#endif
+
 /*! Continuous memorry allocation structure.
  * All pages MUST have the same order. */
 struct oo_buffer_pages {
   int n_bufs;               /*!< number of entries in pages array */
+  int order;                /*!< OS page order of each entry */
   oo_atomic_t ref_count;
 #ifdef OO_DO_HUGE_PAGES
   int shmid;
+#endif
+#ifdef OO_DO_HUGE_PAGES_1G
+  struct oo_huge_segment *seg; /*!< segment this is a slice of, or NULL */
+  int shm_offset;              /*!< offset of the slice in the segment */
 #endif
   struct page **pages;     /*!< array of Linux compound pages */
 };
@@ -109,12 +136,38 @@ ci_inline int oo_iobufset_get_shmid(struct oo_buffer_pages *pages)
 {
   return pages->shmid;
 }
+
+/*! Offset of the memory within the shared memory segment. */
+ci_inline int oo_iobufset_get_shm_offset(struct oo_buffer_pages *pages)
+{
+#ifdef OO_DO_HUGE_PAGES_1G
+  return pages->shm_offset;
+#else
+  return 0;
+#endif
+}
 #endif
 
+/*! log2 of the size of the pages backing the memory. */
+ci_inline int oo_iobufset_page_shift(struct oo_buffer_pages *pages)
+{
+#ifdef OO_DO_HUGE_PAGES_1G
+  if( pages->seg != NULL )
+    return OO_HUGE_SEG_SHIFT;
+#endif
+  return PAGE_SHIFT + pages->order;
+}
+
+/*! NUMA node of the memory. */
+ci_inline int oo_iobufset_numa_node(struct oo_buffer_pages *pages)
+{
+  return page_to_nid(pages->pages[0]);
+}
+
 /*! Find memory address in buffer offset. */
 ci_inline void *oo_iobufset_ptr(struct oo_buffer_pages *pages, int offset)
 {
-  int order = compound_order(pages->pages[0]);
+  int order = pages->order;
   return page_address(pages->pages[offset >> PAGE_SHIFT >> order]) +
       (offset & ((PAGE_SIZE << order) - 1));
 }
@@ -122,7 +175,7 @@ ci_inline void *oo_iobufset_ptr(struct oo_buffer_pages *pages, int offset)
 /*! Find pfn of the given page in the buffer. */
 ci_inline unsigned long oo_iobufset_pfn(struct oo_buffer_pages *pages, int offset)
 {
-  int order = compound_order(pages->pages[0]);
+  int order = pages->order;
 
   /* This function is used from nopage handler.  Huge pages should not be
    * mmaped in this way. */
@@ -153,6 +206,8 @@ ci_inline void o_iobufset_resource_ref(struct oo_iobufset *iobrs)
 #define OO_IOBUFSET_FLAG_HUGE_PAGE_TRY    0x1 /* EF_USE_HUGE_PAGES=1 */
 #define OO_IOBUFSET_FLAG_HUGE_PAGE_FORCE  0x2 /* EF_USE_HUGE_PAGES=2 */
 #define OO_IOBUFSET_FLAG_HUGE_PAGE_FAILED 0x4
+#define OO_IOBUFSET_FLAG_HUGE_PAGE_1G     0x40 /* EF_USE_1G_HUGE_PAGES */
+#define OO_IOBUFSET_FLAG_HUGE_PAGE_1G_FAILED 0x80
 #endif
 #define OO_IOBUFSET_FLAG_COMPOUND_PAGE_LIMIT 0x10 /* EF_COMPOUND_PAGES_MODE=1 */
 #define OO_IOBUFSET_FLAG_COMPOUND_PAGE_NONE  0x20 /* EF_COMPOUND_PAGES_MODE=2 */
@@ -163,7 +218,11 @@ ci_inline void o_iobufset_resource_ref(struct oo_iobufset *iobrs)
  * Allocate oo_buffer_pagess.
  *
  * \param order      page order to allocate
+ * \param numa_node  node to allocate on, or -1 for the current node
  * \param flags      see OO_IOBUFSET_FLAG_*, in/out
+ * \param seg        in/out: the 1GB huge page to carve from when
+ *                   OO_IOBUFSET_FLAG_HUGE_PAGE_1G is set; a new one is
+ *                   allocated if it is NULL or used up.  May be NULL.
  * \param pages_out  pointer to return the allocated pages
  *
  * \return           status code; if non-zero, pages_out is unchanged
@@ -173,10 +232,21 @@ ci_inline void o_iobufset_resource_ref(struct oo_iobufset *iobrs)
  * EFHW_NIC_PAGE_SIZE != PAGE_SIZE, as on PPC.
  */
 extern int
-oo_iobufset_pages_alloc(int nic_order, int *flags,
+oo_iobufset_pages_alloc(int nic_order, int numa_node, int *flags,
+                        struct oo_huge_segment **seg,
                         struct oo_buffer_pages **pages_out);
 extern void oo_iobufset_pages_release(struct oo_buffer_pages *);
 
+#ifdef OO_DO_HUGE_PAGES_1G
+/*! Number of slices not yet handed out from a 1GB huge page. */
+ci_inline int oo_huge_segment_n_free(struct oo_huge_segment *seg)
+{
+  return (1 << (OO_HUGE_SEG_SHIFT - HPAGE_SHIFT)) - seg->n_slices;
+}
+
+extern void oo_huge_segment_release(struct oo_huge_segment *seg);
+#endif
+
 /*!
  * Map oo_buffer_pages to protection domain and create iobufset resource.
  *
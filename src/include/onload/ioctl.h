@@ -307,6 +307,10 @@ enum {
   OO_OP_GET_CPU_KHZ,
 #define OO_IOC_GET_CPU_KHZ        OO_IOC_R(GET_CPU_KHZ, ci_uint32)
 
+  OO_OP_EP_FILTER_SET_BATCH,
+#define OO_IOC_EP_FILTER_SET_BATCH  OO_IOC_W(EP_FILTER_SET_BATCH,       \
+                                             oo_tcp_filter_set_batch_t)
+
   OO_OP_END  /* This had better be last! */
 };
 
@@ -60,6 +60,14 @@ struct oof_socket {
    */
   ci_dllink sf_lp_link;
 
+  /* The list [sf_lp_link] is on. */
+  ci_dllist* sf_lp_list;
+
+  /* Link for [oof_manager::fm_wild_socks] or [oof_manager::fm_full_socks],
+   * which index sockets on the local port lists by list and stack.
+   */
+  ci_dllink sf_hash_link;
+
 };
 
 #endif  /* __ONLOAD_OOF_SOCKET_H__ */
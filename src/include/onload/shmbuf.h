@@ -46,10 +46,11 @@
 typedef struct {
   struct efhw_page*	pages;
   unsigned		n_pages;
+  int			numa_node;	/* preferred node, or -1 */
 } ci_shmbuf_t;
 
 
-extern int  ci_shmbuf_alloc(ci_shmbuf_t* b, unsigned bytes);
+extern int  ci_shmbuf_alloc(ci_shmbuf_t* b, unsigned bytes, int numa_node);
 extern void ci_shmbuf_free(ci_shmbuf_t* b);
 
 ci_inline unsigned ci_shmbuf_size(ci_shmbuf_t* b)
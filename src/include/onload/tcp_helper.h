@@ -55,6 +55,10 @@ struct tcp_helper_nic {
   struct efrm_pio*     thn_pio_rs;
   unsigned             thn_pio_io_mmap_bytes;
 #endif
+  /* Arrival time of the interrupt on this interface being handled, or 0.
+   * Written only by this interface's handler.
+   */
+  ci_uint64            thn_interrupt_frc;
 };
 
 
@@ -242,6 +246,13 @@ typedef struct tcp_helper_resource_s {
 
   /* Used to block threads that are waiting for free pkt buffers. */
   ci_waitq_t            pkt_waitq;
+
+  /* NUMA node for the stack's memory (see EF_NUMA_NODE), or -1 */
+  int                   numa_node;
+#ifdef OO_DO_HUGE_PAGES_1G
+  /* 1GB huge page that packet sets are being carved from, or NULL */
+  struct oo_huge_segment* pkt_huge_seg;
+#endif
   
   struct tcp_helper_nic      nic[CI_CFG_MAX_INTERFACES];
 
@@ -261,6 +272,12 @@ typedef struct tcp_helper_resource_s {
   ci_dllist             os_ready_lists[CI_CFG_N_READY_LISTS];
   spinlock_t            os_ready_list_lock;
 
+  /* Arrival time of the interrupt whose handler is polling the stack, or
+   * 0.  Set from the interface's [thn_interrupt_frc] only while the stack
+   * lock is held.  Endpoints woken by the poll take a copy.
+   */
+  ci_uint64             interrupt_frc;
+
 } tcp_helper_resource_t;
 
 
@@ -320,6 +337,14 @@ struct tcp_helper_endpoint_s {
   /*! Head of the waitqueue */
   ci_waitable_t waitq;			
 
+  /*! CPU of the last thread to sleep on [waitq].  Read by wakers without
+   * synchronisation, so only a hint. */
+  int sleep_cpu;
+
+  /*! [interrupt_frc] of the interrupt that last woke [waitq], or 0.  Taken
+   * by the woken thread with a compare-and-swap, so each is counted once. */
+  ci_uint64 wake_frc;
+
   /* IRQ lock to protect os_socket.
    * It is not ci_irqlock_t, because ci_irqlock_t is BH lock, but we need
    * IRQ lock here.  This lock is used from Linux wake up callback, and
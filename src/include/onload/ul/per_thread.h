@@ -41,6 +41,9 @@ struct oo_per_thread {
   struct oo_timesync         timesync;
   unsigned                   spinstate; 
   int                        in_vfork_child;
+  unsigned                   accept_shard; /* 1 + home acceptq shard, or 0 */
+  int                        cluster_stack; /* 1 + id of cluster stack
+                                             * joined, or 0 */
 };
 
 
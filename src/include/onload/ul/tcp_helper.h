@@ -25,6 +25,8 @@
 #ifndef __CI_UL_TCP_HELPER_H__
 #define __CI_UL_TCP_HELPER_H__
 
+#include <onload/common.h>
+
 
 /*! Comment? */
 extern int ci_tcp_helper_more_socks(struct ci_netif_s*) CI_HF;
@@ -110,6 +112,12 @@ ci_tcp_helper_ep_set_filters(ci_fd_t           fd,
                              ci_ifid_t         bindto_ifindex,
                              oo_sp             from_tcp_id) CI_HF;
 
+extern int
+ci_tcp_helper_ep_set_filters_batch(ci_fd_t                    fd,
+                                   const oo_tcp_filter_set_t* ops,
+                                   ci_int32*                  rcs,
+                                   int                        n_ops) CI_HF;
+
 extern int
 ci_tcp_helper_ep_reuseport_bind(ci_fd_t           fd,
                                 const char*       cluster_name,
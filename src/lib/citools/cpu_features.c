@@ -193,4 +193,68 @@ extern int ci_cpu_features_check(int verbose)
 
 #endif
 
+
+/*****************************************************************************
+ *
+ * Instruction set extensions
+ *
+ *****************************************************************************/
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+ci_inline void
+get_cpuid_count(int op, int count, int *eax, int *ebx, int *ecx, int *edx)
+{
+  __asm__ __volatile__ ("cpuid"
+			: "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+			: "a" (op), "c" (count));
+}
+
+ci_inline ci_uint64 get_xcr0(void)
+{
+  ci_uint32 eax, edx;
+  __asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+  return ((ci_uint64) edx << 32) | eax;
+}
+
+unsigned ci_cpu_features(void)
+{
+  int eax, ebx, ecx, edx, max_op;
+  unsigned features = 0;
+  ci_uint64 xcr0 = 0;
+
+  get_cpuid_count(0, 0, &max_op, &ebx, &ecx, &edx);
+  if( max_op < 1 )
+    return 0;
+
+  get_cpuid_count(1, 0, &eax, &ebx, &ecx, &edx);
+  if( edx & (1 << 26) )
+    features |= CI_CPU_FEAT_SSE2;
+  if( ecx & (1 << 20) )
+    features |= CI_CPU_FEAT_SSE42;
+  /* OSXSAVE: the OS manages the extended register state. */
+  if( ecx & (1 << 27) )
+    xcr0 = get_xcr0();
+
+  if( max_op < 7 || (xcr0 & 0x6) != 0x6 )  /* SSE and AVX state */
+    return features;
+
+  get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+  if( ebx & (1 << 5) )
+    features |= CI_CPU_FEAT_AVX2;
+  if( (ebx & (1 << 16)) && (xcr0 & 0xe0) == 0xe0 )  /* opmask and ZMM */
+    features |= CI_CPU_FEAT_AVX512F;
+
+  return features;
+}
+
+#else
+
+unsigned ci_cpu_features(void)
+{
+  return 0;
+}
+
+#endif
+
 /*! \cidoxg_end */
@@ -38,6 +38,10 @@ typedef union {
 /* Length must be a multiple of half-words */
 unsigned ci_ip_csum_copy2(void* dest, const void* src, int n, unsigned sum)
 {
+#if CI_IP_CSUM_VEC
+  ci_assert(CI_OFFSET(n, 2) == 0);
+  return ci_ip_csum_copy_aligned_vec(dest, src, n, sum);
+#else
   ci_uint32* d4 = (ci_uint32*) dest;
   const ci_uint32 *es4, *s4 = (const ci_uint32*) src;
   ci_uint32 v;
@@ -61,6 +65,7 @@ unsigned ci_ip_csum_copy2(void* dest, const void* src, int n, unsigned sum)
   }
 
   return sum;
+#endif
 }
 
 /*! \cidoxg_end */
@@ -38,6 +38,11 @@ unsigned ci_ip_csum_partial(unsigned sum, const volatile void* in_buf,
   ci_assert(in_buf || bytes == 0);
   ci_assert(bytes >= 0);
 
+#if CI_IP_CSUM_VEC
+  if( bytes >= 64 )
+    return ci_ip_csum_aligned_vec((const void*) in_buf, bytes, sum);
+#endif
+
   while( bytes > 1 ) {
     sum += *buf++;
     bytes -= 2;
@@ -0,0 +1,373 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  SIMD Internet checksum and copy-with-checksum.
+**   \date  2016/10/18
+**    \cop  (c) Solarflare Communications Inc.
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_citools */
+
+#include "citools_internal.h"
+
+
+static const char* const csum_impl_names[CI_IP_CSUM_IMPL_N] = {
+  "c", "sse2", "avx2", "avx512",
+};
+
+
+const char* ci_ip_csum_impl_name(int impl)
+{
+  if( impl < 0 || impl >= CI_IP_CSUM_IMPL_N )
+    return "?";
+  return csum_impl_names[impl];
+}
+
+
+#if CI_IP_CSUM_VEC
+
+#include <immintrin.h>
+
+/* The ones' complement sum of a buffer is congruent, modulo 0xffff, to the
+ * ordinary sum of its 16-bit words.  It is also congruent to the sum of its
+ * 32-bit words, because 0x10000 == 1 modulo 0xffff.  So the kernels below
+ * split each 64-bit lane into two 32-bit halves and add those into 64-bit
+ * accumulators.  Carries never need propagating, the accumulators cannot
+ * overflow for any buffer that an int can describe, and the result folds
+ * to the same 16 bits as the C code's.  The sum is only zero if the data
+ * is all zero, as with ci_add_carry32().
+ *
+ * Buffers shorter than CSUM_VEC_MIN bytes aren't worth the indirect call.
+ */
+#define CSUM_VEC_MIN  64
+
+
+ci_inline unsigned csum_fold64(ci_uint64 sum)
+{
+  sum = (sum & 0xffffffffu) + (sum >> 32u);
+  sum = (sum & 0xffffffffu) + (sum >> 32u);
+  sum = (sum & 0xffffu) + (sum >> 16u);
+  sum = (sum & 0xffffu) + (sum >> 16u);
+  return (unsigned) sum;
+}
+
+
+/* Sum the last few bytes that don't fill a vector. */
+ci_inline unsigned csum_tail(ci_uint64 sum, const char* p, size_t n)
+{
+  ci_uint64 w;
+  ci_uint32 v;
+  ci_uint16 h;
+
+  for( ; n >= 8; n -= 8, p += 8 ) {
+    memcpy(&w, p, 8);
+    sum += (w & 0xffffffffu) + (w >> 32u);
+  }
+  if( n >= 4 ) {
+    memcpy(&v, p, 4);
+    sum += v;
+    p += 4;
+    n -= 4;
+  }
+  if( n >= 2 ) {
+    memcpy(&h, p, 2);
+    sum += h;
+    p += 2;
+    n -= 2;
+  }
+  /* If there's a lone final byte, it needs to be treated as if it was
+   * padded by an extra zero byte.  Casting to ci_uint8* introduces an
+   * implicit CI_BSWAP_LE16 which needs to be reversed. */
+  if( n )
+    sum += CI_BSWAP_LE16(*(const ci_uint8*) p);
+  return csum_fold64(sum);
+}
+
+
+/**********************************************************************
+ * C
+ */
+
+static unsigned csum_c(const void* src, size_t n, unsigned sum)
+{
+  return ci_ip_csum_aligned_c(src, n, sum);
+}
+
+
+static unsigned csum_copy_c(void* dest, const void* src, size_t n,
+                            unsigned sum)
+{
+  return ci_ip_csum_copy_aligned_c(dest, src, (int) n, sum);
+}
+
+
+/**********************************************************************
+ * SSE2 (always present on x86-64)
+ */
+
+ci_inline ci_uint64 csum_hsum_sse2(__m128i acc)
+{
+  return (ci_uint64) _mm_cvtsi128_si64(acc) +
+         (ci_uint64) _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+}
+
+
+static unsigned csum_sse2(const void* src, size_t n, unsigned sum)
+{
+  const char* s = src;
+  const __m128i lo = _mm_set1_epi64x(0xffffffff);
+  __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+
+  for( ; n >= 32; n -= 32, s += 32 ) {
+    __m128i a = _mm_loadu_si128((const __m128i*) s);
+    __m128i b = _mm_loadu_si128((const __m128i*) (s + 16));
+    acc0 = _mm_add_epi64(acc0, _mm_and_si128(a, lo));
+    acc1 = _mm_add_epi64(acc1, _mm_srli_epi64(a, 32));
+    acc0 = _mm_add_epi64(acc0, _mm_and_si128(b, lo));
+    acc1 = _mm_add_epi64(acc1, _mm_srli_epi64(b, 32));
+  }
+  return csum_tail(sum + csum_hsum_sse2(_mm_add_epi64(acc0, acc1)), s, n);
+}
+
+
+static unsigned csum_copy_sse2(void* dest, const void* src, size_t n,
+                               unsigned sum)
+{
+  const char* s = src;
+  char* d = dest;
+  const __m128i lo = _mm_set1_epi64x(0xffffffff);
+  __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+
+  for( ; n >= 32; n -= 32, s += 32, d += 32 ) {
+    __m128i a = _mm_loadu_si128((const __m128i*) s);
+    __m128i b = _mm_loadu_si128((const __m128i*) (s + 16));
+    _mm_storeu_si128((__m128i*) d, a);
+    _mm_storeu_si128((__m128i*) (d + 16), b);
+    acc0 = _mm_add_epi64(acc0, _mm_and_si128(a, lo));
+    acc1 = _mm_add_epi64(acc1, _mm_srli_epi64(a, 32));
+    acc0 = _mm_add_epi64(acc0, _mm_and_si128(b, lo));
+    acc1 = _mm_add_epi64(acc1, _mm_srli_epi64(b, 32));
+  }
+  memcpy(d, s, n);
+  return csum_tail(sum + csum_hsum_sse2(_mm_add_epi64(acc0, acc1)), s, n);
+}
+
+
+/**********************************************************************
+ * AVX2
+ */
+
+__attribute__((target("avx2")))
+static ci_uint64 csum_hsum_avx2(__m256i acc)
+{
+  return csum_hsum_sse2(_mm_add_epi64(_mm256_castsi256_si128(acc),
+                                      _mm256_extracti128_si256(acc, 1)));
+}
+
+
+__attribute__((target("avx2")))
+static unsigned csum_avx2(const void* src, size_t n, unsigned sum)
+{
+  const char* s = src;
+  const __m256i lo = _mm256_set1_epi64x(0xffffffff);
+  __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+
+  for( ; n >= 64; n -= 64, s += 64 ) {
+    __m256i a = _mm256_loadu_si256((const __m256i*) s);
+    __m256i b = _mm256_loadu_si256((const __m256i*) (s + 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_and_si256(a, lo));
+    acc1 = _mm256_add_epi64(acc1, _mm256_srli_epi64(a, 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_and_si256(b, lo));
+    acc1 = _mm256_add_epi64(acc1, _mm256_srli_epi64(b, 32));
+  }
+  return csum_tail(sum + csum_hsum_avx2(_mm256_add_epi64(acc0, acc1)), s, n);
+}
+
+
+__attribute__((target("avx2")))
+static unsigned csum_copy_avx2(void* dest, const void* src, size_t n,
+                               unsigned sum)
+{
+  const char* s = src;
+  char* d = dest;
+  const __m256i lo = _mm256_set1_epi64x(0xffffffff);
+  __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+
+  for( ; n >= 64; n -= 64, s += 64, d += 64 ) {
+    __m256i a = _mm256_loadu_si256((const __m256i*) s);
+    __m256i b = _mm256_loadu_si256((const __m256i*) (s + 32));
+    _mm256_storeu_si256((__m256i*) d, a);
+    _mm256_storeu_si256((__m256i*) (d + 32), b);
+    acc0 = _mm256_add_epi64(acc0, _mm256_and_si256(a, lo));
+    acc1 = _mm256_add_epi64(acc1, _mm256_srli_epi64(a, 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_and_si256(b, lo));
+    acc1 = _mm256_add_epi64(acc1, _mm256_srli_epi64(b, 32));
+  }
+  memcpy(d, s, n);
+  return csum_tail(sum + csum_hsum_avx2(_mm256_add_epi64(acc0, acc1)), s, n);
+}
+
+
+/**********************************************************************
+ * AVX-512
+ */
+
+__attribute__((target("avx512f")))
+static unsigned csum_avx512(const void* src, size_t n, unsigned sum)
+{
+  const char* s = src;
+  const __m512i lo = _mm512_set1_epi64(0xffffffff);
+  __m512i acc0 = _mm512_setzero_si512(), acc1 = _mm512_setzero_si512();
+
+  for( ; n >= 128; n -= 128, s += 128 ) {
+    __m512i a = _mm512_loadu_si512(s);
+    __m512i b = _mm512_loadu_si512(s + 64);
+    acc0 = _mm512_add_epi64(acc0, _mm512_and_si512(a, lo));
+    acc1 = _mm512_add_epi64(acc1, _mm512_srli_epi64(a, 32));
+    acc0 = _mm512_add_epi64(acc0, _mm512_and_si512(b, lo));
+    acc1 = _mm512_add_epi64(acc1, _mm512_srli_epi64(b, 32));
+  }
+  return csum_tail(sum + (ci_uint64)
+                   _mm512_reduce_add_epi64(_mm512_add_epi64(acc0, acc1)),
+                   s, n);
+}
+
+
+__attribute__((target("avx512f")))
+static unsigned csum_copy_avx512(void* dest, const void* src, size_t n,
+                                 unsigned sum)
+{
+  const char* s = src;
+  char* d = dest;
+  const __m512i lo = _mm512_set1_epi64(0xffffffff);
+  __m512i acc0 = _mm512_setzero_si512(), acc1 = _mm512_setzero_si512();
+
+  for( ; n >= 128; n -= 128, s += 128, d += 128 ) {
+    __m512i a = _mm512_loadu_si512(s);
+    __m512i b = _mm512_loadu_si512(s + 64);
+    _mm512_storeu_si512(d, a);
+    _mm512_storeu_si512(d + 64, b);
+    acc0 = _mm512_add_epi64(acc0, _mm512_and_si512(a, lo));
+    acc1 = _mm512_add_epi64(acc1, _mm512_srli_epi64(a, 32));
+    acc0 = _mm512_add_epi64(acc0, _mm512_and_si512(b, lo));
+    acc1 = _mm512_add_epi64(acc1, _mm512_srli_epi64(b, 32));
+  }
+  memcpy(d, s, n);
+  return csum_tail(sum + (ci_uint64)
+                   _mm512_reduce_add_epi64(_mm512_add_epi64(acc0, acc1)),
+                   s, n);
+}
+
+
+/**********************************************************************
+ * Dispatch
+ */
+
+typedef unsigned (*csum_fn_t)(const void* src, size_t n, unsigned sum);
+typedef unsigned (*csum_copy_fn_t)(void* dest, const void* src, size_t n,
+                                   unsigned sum);
+
+static const struct {
+  unsigned        cpu_features;
+  csum_fn_t       csum;
+  csum_copy_fn_t  csum_copy;
+} csum_impls[CI_IP_CSUM_IMPL_N] = {
+  { 0,                    csum_c,      csum_copy_c      },
+  { CI_CPU_FEAT_SSE2,     csum_sse2,   csum_copy_sse2   },
+  { CI_CPU_FEAT_AVX2,     csum_avx2,   csum_copy_avx2   },
+  { CI_CPU_FEAT_AVX512F,  csum_avx512, csum_copy_avx512 },
+};
+
+
+/* Until the first call of ci_ip_csum_select() these point at functions
+ * that make that call and then forward.  The selection is idempotent, so
+ * it doesn't matter if threads race to do it.
+ */
+static unsigned csum_resolve(const void* src, size_t n, unsigned sum);
+static unsigned csum_copy_resolve(void* dest, const void* src, size_t n,
+                                  unsigned sum);
+
+static csum_fn_t      csum_fn      = csum_resolve;
+static csum_copy_fn_t csum_copy_fn = csum_copy_resolve;
+
+
+int ci_ip_csum_select(int impl)
+{
+  unsigned features = ci_cpu_features();
+
+  if( impl == CI_IP_CSUM_IMPL_AUTO )
+    impl = CI_IP_CSUM_IMPL_AVX2;
+  else if( impl < 0 || impl >= CI_IP_CSUM_IMPL_N )
+    impl = CI_IP_CSUM_IMPL_N - 1;
+  while( impl > CI_IP_CSUM_IMPL_C &&
+         (csum_impls[impl].cpu_features & ~features) )
+    --impl;
+
+  csum_fn = csum_impls[impl].csum;
+  csum_copy_fn = csum_impls[impl].csum_copy;
+  return impl;
+}
+
+
+static unsigned csum_resolve(const void* src, size_t n, unsigned sum)
+{
+  ci_ip_csum_select(CI_IP_CSUM_IMPL_AUTO);
+  return csum_fn(src, n, sum);
+}
+
+
+static unsigned csum_copy_resolve(void* dest, const void* src, size_t n,
+                                  unsigned sum)
+{
+  ci_ip_csum_select(CI_IP_CSUM_IMPL_AUTO);
+  return csum_copy_fn(dest, src, n, sum);
+}
+
+
+unsigned ci_ip_csum_aligned_vec(const void* data, size_t n, unsigned csum)
+{
+  ci_assert(data || n == 0);
+  if( n < CSUM_VEC_MIN )
+    return ci_ip_csum_aligned_c(data, n, csum);
+  return csum_fn(data, n, csum);
+}
+
+
+unsigned ci_ip_csum_copy_aligned_vec(void* dest, const void* src, int n,
+                                     unsigned sum)
+{
+  ci_assert(dest || n == 0);
+  ci_assert(src  || n == 0);
+  ci_assert(n >= 0);
+  if( n < CSUM_VEC_MIN )
+    return ci_ip_csum_copy_aligned_c(dest, src, n, sum);
+  return csum_copy_fn(dest, src, n, sum);
+}
+
+#else
+
+int ci_ip_csum_select(int impl)
+{
+  return CI_IP_CSUM_IMPL_C;
+}
+
+#endif
+
+/*! \cidoxg_end */
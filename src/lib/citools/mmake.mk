@@ -8,6 +8,7 @@ LIB_SRCS	:= \
 		bufrange.c \
 		crc16.c \
 		crc32.c \
+		crc32c.c \
 		toeplitz.c \
 		cpu_features.c \
 		dllist.c \
@@ -18,6 +19,7 @@ LIB_SRCS	:= \
 		hex_dump_to_raw.c \
 		ipcsum.c \
 		ip_csum_partial.c \
+		ip_csum_vec.c \
 		memchk.c \
 		tcp_checksum.c \
 		udp_checksum.c \
@@ -54,4 +54,55 @@ ci_uint32 ci_toeplitz_hash(const ci_uint8 *key, const ci_uint8 *input, int n)
 }
 
 
+void ci_toeplitz_cache_init(ci_toeplitz_cache* cache, const ci_uint8 *key)
+{
+  ci_uint64 key_bits;
+  ci_uint32 window[8];
+  int i, s, v;
+
+  for( i = 0; i < CI_TOEPLITZ_CACHE_MAX_INPUT; ++i ) {
+    /* The 40 key bits that the 32-bit windows for this byte come from. */
+    key_bits = ((ci_uint64) key[i] << 32) | ((ci_uint64) key[i + 1] << 24) |
+               (key[i + 2] << 16) | (key[i + 3] << 8) | key[i + 4];
+    /* window[s] is what input bit (0x80 >> s) contributes. */
+    for( s = 0; s < 8; ++s )
+      window[s] = (ci_uint32) (key_bits >> (8 - s));
+    for( v = 0; v < 256; ++v ) {
+      ci_uint32 h = 0;
+      for( s = 0; s < 8; ++s )
+        if( v & (0x80 >> s) )
+          h ^= window[s];
+      cache->table[i][v] = h;
+    }
+  }
+}
+
+
+void ci_toeplitz_hash_batch(const ci_toeplitz_cache* cache,
+                            const ci_uint8 *input, int n,
+                            int n_inputs, ci_uint32* hashes)
+{
+  int i;
+
+  ci_assert_le(n, CI_TOEPLITZ_CACHE_MAX_INPUT);
+
+  /* Four at a time so that the lookups for different inputs overlap. */
+  for( ; n_inputs >= 4; n_inputs -= 4, input += 4 * n, hashes += 4 ) {
+    ci_uint32 h0 = 0, h1 = 0, h2 = 0, h3 = 0;
+    for( i = 0; i < n; ++i ) {
+      h0 ^= cache->table[i][input[i]];
+      h1 ^= cache->table[i][input[n + i]];
+      h2 ^= cache->table[i][input[2 * n + i]];
+      h3 ^= cache->table[i][input[3 * n + i]];
+    }
+    hashes[0] = h0;
+    hashes[1] = h1;
+    hashes[2] = h2;
+    hashes[3] = h3;
+  }
+  for( ; n_inputs > 0; --n_inputs, input += n )
+    *hashes++ = ci_toeplitz_hash_cached(cache, input, n);
+}
+
+
 /*! \cidoxg_end */
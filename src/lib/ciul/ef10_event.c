@@ -735,7 +735,24 @@ ef_vi_inline void ef10_packed_stream_update_credit(ef_vi* vi,
   EF_VI_ASSERT( vi->ep_state->rxq.rx_ps_credit_avail >= credits_consumed);
   vi->ep_state->rxq.rx_ps_credit_avail -= credits_consumed;
 
-  ef_vi_packed_stream_update_credit(vi);
+  /* Defer the doorbell until a batch of credits is outstanding, but never
+   * leave the adapter without any.
+   */
+  if( vi->ep_state->rxq.rx_ps_credit_avail == 0 ||
+      ef_ps_max_credits(vi) - vi->ep_state->rxq.rx_ps_credit_avail >=
+      vi->ep_state->rxq.rx_ps_credit_batch )
+    ef_vi_packed_stream_update_credit(vi);
+}
+
+
+int ef_vi_packed_stream_set_credit_batch(ef_vi* vi, int n_credits)
+{
+  if( ! vi->vi_is_packed_stream || n_credits < 0 )
+    return -EINVAL;
+  if( n_credits > ef_ps_max_credits(vi) )
+    n_credits = ef_ps_max_credits(vi);
+  vi->ep_state->rxq.rx_ps_credit_batch = n_credits;
+  return 0;
 }
 
 
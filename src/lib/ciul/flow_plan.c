@@ -0,0 +1,414 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of version 2.1 of the GNU Lesser General Public
+** License as published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+*/
+
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  Flow plans: compile flows to filters, apply and rebalance.
+**    \cop  (c) Solarflare Communications, Inc.
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+#include <etherfabric/vi.h>
+#include <etherfabric/flowplan.h>
+#include "ef_vi_internal.h"
+#include "logging.h"
+
+
+#define FP_IPPROTO_TCP       6
+#define FP_IPPROTO_UDP       17
+
+/* Internal value of fpfl_vi for a filter merged into another. */
+#define FP_VI_MERGED         -4
+
+
+static unsigned fp_weight(const ef_flow_plan_flow* f)
+{
+  return f->fpf_weight ? f->fpf_weight : 1;
+}
+
+
+static int fp_is_local(const ef_flow_plan_flow* f)
+{
+  return f->fpf_raddr_be32 == 0 && f->fpf_rport_be16 == 0;
+}
+
+
+static int fp_same_match(const ef_flow_plan_flow* a,
+                         const ef_flow_plan_flow* b)
+{
+  return a->fpf_protocol == b->fpf_protocol &&
+         a->fpf_laddr_be32 == b->fpf_laddr_be32 &&
+         a->fpf_lport_be16 == b->fpf_lport_be16 &&
+         a->fpf_raddr_be32 == b->fpf_raddr_be32 &&
+         a->fpf_rport_be16 == b->fpf_rport_be16 &&
+         a->fpf_vlan_id == b->fpf_vlan_id;
+}
+
+
+/* Does local-match flow [l] receive everything full-match flow [f] would? */
+static int fp_covers(const ef_flow_plan_flow* l, const ef_flow_plan_flow* f)
+{
+  return l->fpf_protocol == f->fpf_protocol &&
+         l->fpf_laddr_be32 == f->fpf_laddr_be32 &&
+         l->fpf_lport_be16 == f->fpf_lport_be16 &&
+         l->fpf_vlan_id == f->fpf_vlan_id;
+}
+
+
+/* Place automatic filters heaviest first, each on the VI with least
+ * weight so far.  If [local_only] then only local-match filters are
+ * placed.
+ */
+static void fp_place(ef_flow_plan_filter* fl, const int* flow_of, int n,
+                     const ef_flow_plan_flow* flows, int local_only,
+                     int n_vis, uint64_t* vi_weight)
+{
+  int i, best, vi;
+
+  while( 1 ) {
+    best = -1;
+    for( i = 0; i < n; ++i )
+      if( fl[i].fpfl_vi == EF_FLOW_PLAN_VI_AUTO &&
+          (! local_only || fp_is_local(&flows[flow_of[i]])) &&
+          (best < 0 || fl[i].fpfl_weight > fl[best].fpfl_weight) )
+        best = i;
+    if( best < 0 )
+      break;
+    vi = 0;
+    for( i = 1; i < n_vis; ++i )
+      if( vi_weight[i] < vi_weight[vi] )
+        vi = i;
+    fl[best].fpfl_vi = vi;
+    fl[best].fpfl_movable = 1;
+    vi_weight[vi] += fl[best].fpfl_weight;
+  }
+}
+
+
+static int fp_make_spec(ef_filter_spec* fs, const ef_flow_plan_flow* f)
+{
+  int rc;
+
+  ef_filter_spec_init(fs, EF_FILTER_FLAG_NONE);
+  if( fp_is_local(f) )
+    rc = ef_filter_spec_set_ip4_local(fs, f->fpf_protocol, f->fpf_laddr_be32,
+                                      f->fpf_lport_be16);
+  else
+    rc = ef_filter_spec_set_ip4_full(fs, f->fpf_protocol, f->fpf_laddr_be32,
+                                     f->fpf_lport_be16, f->fpf_raddr_be32,
+                                     f->fpf_rport_be16);
+  if( rc == 0 && f->fpf_vlan_id != EF_FILTER_VLAN_ID_ANY )
+    rc = ef_filter_spec_set_vlan(fs, f->fpf_vlan_id);
+  return rc;
+}
+
+
+int ef_flow_plan_compile(const ef_flow_plan_flow* flows, int n_flows,
+                         int n_vis, ef_flow_plan_filter* filters_out,
+                         int max_filters)
+{
+  ef_flow_plan_filter* fl = NULL;
+  uint64_t* vi_weight = NULL;
+  int* flow_of = NULL;
+  int i, j, n = 0, n_out = 0, rc;
+
+  if( n_flows < 0 || n_vis < 0 )
+    return -EINVAL;
+  for( i = 0; i < n_flows; ++i ) {
+    const ef_flow_plan_flow* f = &flows[i];
+    if( (f->fpf_protocol != FP_IPPROTO_TCP &&
+         f->fpf_protocol != FP_IPPROTO_UDP) ||
+        f->fpf_vi >= n_vis || f->fpf_vi < EF_FLOW_PLAN_VI_SET ||
+        (f->fpf_vi == EF_FLOW_PLAN_VI_AUTO && n_vis == 0) ) {
+      ef_log("%s: ERROR: bad flow %d (protocol=%d vi=%d n_vis=%d)",
+             __FUNCTION__, i, f->fpf_protocol, f->fpf_vi, n_vis);
+      return -EINVAL;
+    }
+  }
+  if( n_flows == 0 )
+    return 0;
+
+  fl = calloc(n_flows, sizeof(*fl));
+  flow_of = calloc(n_flows, sizeof(*flow_of));
+  vi_weight = calloc(n_vis + 1, sizeof(*vi_weight));
+  if( fl == NULL || flow_of == NULL || vi_weight == NULL ) {
+    rc = -ENOMEM;
+    goto out;
+  }
+
+  /* Merge identical flows.  An explicit target wins over automatic
+   * placement, but two different explicit targets is an error.
+   */
+  for( i = 0; i < n_flows; ++i ) {
+    for( j = 0; j < n; ++j )
+      if( fp_same_match(&flows[flow_of[j]], &flows[i]) )
+        break;
+    if( j == n ) {
+      flow_of[n] = i;
+      fl[n].fpfl_vi = flows[i].fpf_vi;
+      fl[n].fpfl_weight = fp_weight(&flows[i]);
+      ++n;
+    }
+    else if( flows[i].fpf_vi == EF_FLOW_PLAN_VI_AUTO ||
+             flows[i].fpf_vi == fl[j].fpfl_vi ) {
+      fl[j].fpfl_weight += fp_weight(&flows[i]);
+    }
+    else if( fl[j].fpfl_vi == EF_FLOW_PLAN_VI_AUTO ) {
+      fl[j].fpfl_vi = flows[i].fpf_vi;
+      fl[j].fpfl_weight += fp_weight(&flows[i]);
+    }
+    else {
+      ef_log("%s: ERROR: flows %d and %d match the same packets but have "
+             "different targets (%d, %d)", __FUNCTION__, flow_of[j], i,
+             fl[j].fpfl_vi, flows[i].fpf_vi);
+      rc = -EINVAL;
+      goto out;
+    }
+  }
+
+  for( j = 0; j < n; ++j )
+    if( fl[j].fpfl_vi >= 0 )
+      vi_weight[fl[j].fpfl_vi] += fl[j].fpfl_weight;
+
+  /* Local-match filters are placed first so that full-match filters they
+   * cover can follow them.
+   */
+  fp_place(fl, flow_of, n, flows, 1, n_vis, vi_weight);
+
+  for( j = 0; j < n; ++j ) {
+    const ef_flow_plan_flow* f = &flows[flow_of[j]];
+    if( fp_is_local(f) )
+      continue;
+    for( i = 0; i < n; ++i ) {
+      const ef_flow_plan_flow* l = &flows[flow_of[i]];
+      if( fp_is_local(l) && fp_covers(l, f) &&
+          (fl[j].fpfl_vi == EF_FLOW_PLAN_VI_AUTO ||
+           fl[j].fpfl_vi == fl[i].fpfl_vi) ) {
+        if( fl[j].fpfl_vi == EF_FLOW_PLAN_VI_AUTO && fl[i].fpfl_vi >= 0 )
+          vi_weight[fl[i].fpfl_vi] += fl[j].fpfl_weight;
+        else
+          /* An explicitly placed flow now depends on this filter. */
+          fl[i].fpfl_movable = 0;
+        fl[i].fpfl_weight += fl[j].fpfl_weight;
+        fl[j].fpfl_vi = FP_VI_MERGED;
+        break;
+      }
+    }
+  }
+
+  fp_place(fl, flow_of, n, flows, 0, n_vis, vi_weight);
+
+  for( j = 0; j < n; ++j ) {
+    if( fl[j].fpfl_vi == FP_VI_MERGED )
+      continue;
+    if( n_out == max_filters ) {
+      rc = -ENOSPC;
+      goto out;
+    }
+    rc = fp_make_spec(&fl[j].fpfl_spec, &flows[flow_of[j]]);
+    if( rc < 0 )
+      goto out;
+    fl[j].fpfl_installed_vi = EF_FLOW_PLAN_VI_NONE;
+    filters_out[n_out++] = fl[j];
+  }
+  rc = n_out;
+
+ out:
+  free(fl);
+  free(flow_of);
+  free(vi_weight);
+  return rc;
+}
+
+
+static int fp_add(ef_flow_plan_filter* f, int vi, ef_vi** vis,
+                  ef_driver_handle vi_dh, ef_vi_set* vi_set,
+                  ef_driver_handle vi_set_dh)
+{
+  if( vi == EF_FLOW_PLAN_VI_SET ) {
+    if( vi_set == NULL )
+      return -EINVAL;
+    return ef_vi_set_filter_add(vi_set, vi_set_dh, &f->fpfl_spec,
+                                &f->fpfl_cookie);
+  }
+  return ef_vi_filter_add(vis[vi], vi_dh, &f->fpfl_spec, &f->fpfl_cookie);
+}
+
+
+static int fp_del(ef_flow_plan_filter* f, int vi, ef_vi** vis,
+                  ef_driver_handle vi_dh, ef_vi_set* vi_set,
+                  ef_driver_handle vi_set_dh)
+{
+  if( vi == EF_FLOW_PLAN_VI_SET )
+    return ef_vi_set_filter_del(vi_set, vi_set_dh, &f->fpfl_cookie);
+  return ef_vi_filter_del(vis[vi], vi_dh, &f->fpfl_cookie);
+}
+
+
+/* Move [f] from wherever it is installed to [vi], which may be
+ * EF_FLOW_PLAN_VI_NONE.  On failure [f] is left as it was if possible.
+ */
+static int fp_move(ef_flow_plan_filter* f, int vi, ef_vi** vis,
+                   ef_driver_handle vi_dh, ef_vi_set* vi_set,
+                   ef_driver_handle vi_set_dh)
+{
+  int old_vi = f->fpfl_installed_vi;
+  int rc;
+
+  if( old_vi != EF_FLOW_PLAN_VI_NONE ) {
+    rc = fp_del(f, old_vi, vis, vi_dh, vi_set, vi_set_dh);
+    if( rc < 0 )
+      return rc;
+    f->fpfl_installed_vi = EF_FLOW_PLAN_VI_NONE;
+  }
+  if( vi != EF_FLOW_PLAN_VI_NONE ) {
+    rc = fp_add(f, vi, vis, vi_dh, vi_set, vi_set_dh);
+    if( rc < 0 ) {
+      if( old_vi != EF_FLOW_PLAN_VI_NONE &&
+          fp_add(f, old_vi, vis, vi_dh, vi_set, vi_set_dh) == 0 )
+        f->fpfl_installed_vi = old_vi;
+      return rc;
+    }
+    f->fpfl_installed_vi = vi;
+  }
+  return 0;
+}
+
+
+int ef_flow_plan_apply(ef_flow_plan_filter* filters, int n_filters,
+                       ef_vi** vis, ef_driver_handle vi_dh,
+                       ef_vi_set* vi_set, ef_driver_handle vi_set_dh)
+{
+  int* prev;
+  int i, rc = 0;
+
+  if( n_filters <= 0 )
+    return 0;
+  if( (prev = malloc(n_filters * sizeof(*prev))) == NULL )
+    return -ENOMEM;
+
+  for( i = 0; i < n_filters; ++i ) {
+    ef_flow_plan_filter* f = &filters[i];
+    prev[i] = f->fpfl_installed_vi;
+    if( f->fpfl_installed_vi == f->fpfl_vi )
+      continue;
+    rc = fp_move(f, f->fpfl_vi, vis, vi_dh, vi_set, vi_set_dh);
+    if( rc < 0 ) {
+      ef_log("%s: ERROR: failed to steer filter %d to %d (rc=%d)",
+             __FUNCTION__, i, f->fpfl_vi, rc);
+      break;
+    }
+  }
+
+  if( rc < 0 ) {
+    /* Put back everything we've changed, newest first. */
+    while( --i >= 0 )
+      if( filters[i].fpfl_installed_vi != prev[i] &&
+          fp_move(&filters[i], prev[i], vis, vi_dh, vi_set, vi_set_dh) < 0 )
+        ef_log("%s: ERROR: failed to restore filter %d to %d",
+               __FUNCTION__, i, prev[i]);
+  }
+
+  free(prev);
+  return rc;
+}
+
+
+int ef_flow_plan_remove(ef_flow_plan_filter* filters, int n_filters,
+                        ef_vi** vis, ef_driver_handle vi_dh,
+                        ef_vi_set* vi_set, ef_driver_handle vi_set_dh)
+{
+  int i, rc, first_rc = 0;
+
+  for( i = 0; i < n_filters; ++i ) {
+    ef_flow_plan_filter* f = &filters[i];
+    if( f->fpfl_installed_vi == EF_FLOW_PLAN_VI_NONE )
+      continue;
+    rc = fp_del(f, f->fpfl_installed_vi, vis, vi_dh, vi_set, vi_set_dh);
+    if( rc < 0 && first_rc == 0 )
+      first_rc = rc;
+    f->fpfl_installed_vi = EF_FLOW_PLAN_VI_NONE;
+  }
+  return first_rc;
+}
+
+
+int ef_flow_plan_rebalance(ef_flow_plan_filter* filters, int n_filters,
+                           int n_vis, const uint64_t* vi_load, int skew_pct)
+{
+  uint64_t* vi_weight;
+  uint64_t* load;
+  uint64_t* est;
+  uint64_t total = 0, limit;
+  int i, vi, vi_max, vi_min, best, n_moves = 0;
+
+  if( n_vis < 2 || n_filters <= 0 )
+    return 0;
+  vi_weight = calloc(2 * n_vis + n_filters, sizeof(*vi_weight));
+  if( vi_weight == NULL )
+    return 0;
+  load = vi_weight + n_vis;
+  est = load + n_vis;
+
+  for( vi = 0; vi < n_vis; ++vi ) {
+    load[vi] = vi_load[vi];
+    total += vi_load[vi];
+  }
+  for( i = 0; i < n_filters; ++i )
+    if( filters[i].fpfl_vi >= 0 && filters[i].fpfl_vi < n_vis )
+      vi_weight[filters[i].fpfl_vi] += filters[i].fpfl_weight;
+  for( i = 0; i < n_filters; ++i ) {
+    vi = filters[i].fpfl_vi;
+    if( vi >= 0 && vi < n_vis && vi_weight[vi] )
+      est[i] = vi_load[vi] * filters[i].fpfl_weight / vi_weight[vi];
+  }
+  limit = total / n_vis * (100 + skew_pct) / 100;
+
+  /* Each move strictly reduces the load on the busiest VI it is taken
+   * from, but bound the number of moves anyway.
+   */
+  for( ; n_moves < n_filters; ++n_moves ) {
+    vi_max = vi_min = 0;
+    for( vi = 1; vi < n_vis; ++vi ) {
+      if( load[vi] > load[vi_max] )
+        vi_max = vi;
+      if( load[vi] < load[vi_min] )
+        vi_min = vi;
+    }
+    if( load[vi_max] <= limit )
+      break;
+
+    /* Choose the filter that carries the most load that we can move
+     * without making [vi_min] as busy as [vi_max] was.
+     */
+    best = -1;
+    for( i = 0; i < n_filters; ++i )
+      if( filters[i].fpfl_vi == vi_max && filters[i].fpfl_movable &&
+          est[i] > 0 && est[i] < load[vi_max] - load[vi_min] &&
+          (best < 0 || est[i] > est[best]) )
+        best = i;
+    if( best < 0 )
+      break;
+
+    filters[best].fpfl_vi = vi_min;
+    load[vi_max] -= est[best];
+    load[vi_min] += est[best];
+  }
+
+  free(vi_weight);
+  return n_moves;
+}
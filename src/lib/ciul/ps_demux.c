@@ -0,0 +1,366 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of version 2.1 of the GNU Lesser General Public
+** License as published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+*/
+
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  Packed-stream iteration and per-flow demultiplexing.
+**    \cop  (c) Solarflare Communications, Inc.
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+#include <etherfabric/vi.h>
+#include <etherfabric/memreg.h>
+#include <etherfabric/packedstream.h>
+#include "ef_vi_internal.h"
+#include "logging.h"
+
+
+#define PS_ETHERTYPE_IP      0x0800
+#define PS_ETHERTYPE_8021Q   0x8100
+#define PS_IPPROTO_TCP       6
+#define PS_IPPROTO_UDP       17
+
+#if defined(__GNUC__)
+# define ps_prefetch(p)      __builtin_prefetch(p)
+#else
+# define ps_prefetch(p)      do{}while(0)
+#endif
+
+
+static unsigned ps_hash_size(int max_flows)
+{
+  unsigned size = 1;
+  while( size < (unsigned) max_flows * 2 )
+    size <<= 1;
+  return size;
+}
+
+
+ef_vi_inline unsigned ps_flow_hash(const ef_packed_stream_flow_key* k)
+{
+  uint32_t h;
+  h = k->psfk_saddr_be32 * 0x9e3779b1u;
+  h ^= k->psfk_daddr_be32 + 0x7f4a7c15u + (h << 6) + (h >> 2);
+  h ^= ((uint32_t) k->psfk_sport_be16 << 16 | k->psfk_dport_be16) +
+    0x7f4a7c15u + (h << 6) + (h >> 2);
+  h ^= k->psfk_protocol;
+  return h ^ (h >> 16);
+}
+
+
+ef_vi_inline int ps_key_is_exact(const ef_packed_stream_flow_key* k)
+{
+  return k->psfk_saddr_be32 != 0 && k->psfk_daddr_be32 != 0 &&
+    k->psfk_sport_be16 != 0 && k->psfk_dport_be16 != 0 &&
+    k->psfk_protocol != 0;
+}
+
+
+ef_vi_inline int ps_key_equal(const ef_packed_stream_flow_key* a,
+                              const ef_packed_stream_flow_key* b)
+{
+  return a->psfk_saddr_be32 == b->psfk_saddr_be32 &&
+    a->psfk_daddr_be32 == b->psfk_daddr_be32 &&
+    a->psfk_sport_be16 == b->psfk_sport_be16 &&
+    a->psfk_dport_be16 == b->psfk_dport_be16 &&
+    a->psfk_protocol == b->psfk_protocol;
+}
+
+
+ef_vi_inline int ps_key_match(const ef_packed_stream_flow_key* wild,
+                              const ef_packed_stream_flow_key* k)
+{
+  return (wild->psfk_saddr_be32 == 0 ||
+          wild->psfk_saddr_be32 == k->psfk_saddr_be32) &&
+    (wild->psfk_daddr_be32 == 0 ||
+     wild->psfk_daddr_be32 == k->psfk_daddr_be32) &&
+    (wild->psfk_sport_be16 == 0 ||
+     wild->psfk_sport_be16 == k->psfk_sport_be16) &&
+    (wild->psfk_dport_be16 == 0 ||
+     wild->psfk_dport_be16 == k->psfk_dport_be16) &&
+    (wild->psfk_protocol == 0 ||
+     wild->psfk_protocol == k->psfk_protocol);
+}
+
+
+/* Extract the flow key from an Ethernet frame.  Returns 0 on success, or
+ * -1 if the frame is not IPv4, has a bad header length, or is too short
+ * to tell.
+ */
+ef_vi_inline int ps_pkt_key(ef_packed_stream_packet* ps_pkt,
+                            ef_packed_stream_flow_key* k)
+{
+  const uint8_t* p = ef_packed_stream_packet_payload(ps_pkt);
+  int len = ps_pkt->ps_cap_len;
+  int off = 14, ihl;
+  unsigned ethertype;
+
+  if( len < off + 20 )
+    return -1;
+  ethertype = (unsigned) p[12] << 8 | p[13];
+  if( ethertype == PS_ETHERTYPE_8021Q ) {
+    ethertype = (unsigned) p[16] << 8 | p[17];
+    off += 4;
+    if( len < off + 20 )
+      return -1;
+  }
+  if( ethertype != PS_ETHERTYPE_IP || (p[off] >> 4) != 4 )
+    return -1;
+  p += off;
+  ihl = (p[0] & 0xf) * 4;
+  if( ihl < 20 )
+    return -1;
+  k->psfk_protocol = p[9];
+  memcpy(&k->psfk_saddr_be32, p + 12, 4);
+  memcpy(&k->psfk_daddr_be32, p + 16, 4);
+  /* Ports are only present in the first fragment. */
+  if( (k->psfk_protocol == PS_IPPROTO_TCP ||
+       k->psfk_protocol == PS_IPPROTO_UDP) &&
+      ((p[6] & 0x1f) | p[7]) == 0 && len >= off + ihl + 4 ) {
+    memcpy(&k->psfk_sport_be16, p + ihl, 2);
+    memcpy(&k->psfk_dport_be16, p + ihl + 2, 2);
+  }
+  else {
+    k->psfk_sport_be16 = 0;
+    k->psfk_dport_be16 = 0;
+  }
+  return 0;
+}
+
+
+int ef_packed_stream_demux_calc_bytes(int max_flows)
+{
+  if( max_flows <= 0 )
+    return -EINVAL;
+  return max_flows * sizeof(ef_packed_stream_flow) +
+    ps_hash_size(max_flows) * sizeof(int32_t) +
+    max_flows * sizeof(int32_t);
+}
+
+
+int ef_packed_stream_demux_init(ef_packed_stream_demux* demux,
+                                void* mem, int max_flows,
+                                ef_packed_stream_flow_fn* default_fn,
+                                void* default_arg)
+{
+  unsigned i, hash_size;
+
+  if( max_flows <= 0 || ((uintptr_t) mem & 7) != 0 )
+    return -EINVAL;
+  hash_size = ps_hash_size(max_flows);
+
+  memset(demux, 0, sizeof(*demux));
+  demux->psd_flows = mem;
+  demux->psd_hash = (int32_t*) (demux->psd_flows + max_flows);
+  demux->psd_wild = demux->psd_hash + hash_size;
+  demux->psd_hash_mask = hash_size - 1;
+  demux->psd_max_flows = max_flows;
+  for( i = 0; i < hash_size; ++i )
+    demux->psd_hash[i] = -1;
+  demux->psd_default.psf_fn = default_fn;
+  demux->psd_default.psf_arg = default_arg;
+  return 0;
+}
+
+
+int ef_packed_stream_demux_add(ef_packed_stream_demux* demux,
+                               const ef_packed_stream_flow_key* key,
+                               ef_packed_stream_flow_fn* fn, void* arg)
+{
+  ef_packed_stream_flow* flow;
+  int i, flow_id;
+  unsigned h;
+
+  for( i = 0; i < demux->psd_n_flows; ++i )
+    if( ps_key_equal(&demux->psd_flows[i].psf_key, key) )
+      return -EEXIST;
+  if( demux->psd_n_flows == demux->psd_max_flows )
+    return -ENOSPC;
+
+  flow_id = demux->psd_n_flows++;
+  flow = &demux->psd_flows[flow_id];
+  memset(flow, 0, sizeof(*flow));
+  flow->psf_key = *key;
+  flow->psf_fn = fn;
+  flow->psf_arg = arg;
+
+  if( ps_key_is_exact(key) ) {
+    /* Linear probing.  The table is at least twice the maximum number of
+     * flows, so there is always a free slot.
+     */
+    for( h = ps_flow_hash(key); ; ++h )
+      if( demux->psd_hash[h & demux->psd_hash_mask] < 0 ) {
+        demux->psd_hash[h & demux->psd_hash_mask] = flow_id;
+        break;
+      }
+  }
+  else {
+    demux->psd_wild[demux->psd_n_wild++] = flow_id;
+  }
+  return flow_id;
+}
+
+
+int ef_packed_stream_demux_classify(ef_packed_stream_demux* demux,
+                                    ef_packed_stream_packet* ps_pkt)
+{
+  ef_packed_stream_flow_key k;
+  int32_t flow_id;
+  unsigned h;
+  int i;
+
+  if( ps_pkt_key(ps_pkt, &k) < 0 )
+    return -1;
+
+  for( h = ps_flow_hash(&k);
+       (flow_id = demux->psd_hash[h & demux->psd_hash_mask]) >= 0; ++h )
+    if( ps_key_equal(&demux->psd_flows[flow_id].psf_key, &k) )
+      return flow_id;
+
+  for( i = 0; i < demux->psd_n_wild; ++i ) {
+    flow_id = demux->psd_wild[i];
+    if( ps_key_match(&demux->psd_flows[flow_id].psf_key, &k) )
+      return flow_id;
+  }
+  return -1;
+}
+
+
+ef_packed_stream_packet*
+ef_packed_stream_demux_dispatch(ef_packed_stream_demux* demux,
+                                ef_packed_stream_packet* ps_pkt, int n_pkts)
+{
+  ef_packed_stream_packet* next;
+  ef_packed_stream_flow* flow;
+  int flow_id;
+
+  for( ; n_pkts > 0; --n_pkts, ps_pkt = next ) {
+    next = ef_packed_stream_packet_next(ps_pkt);
+    if( n_pkts > 1 ) {
+      /* Metadata and the start of the headers of the next packet. */
+      ps_prefetch(next);
+      ps_prefetch((char*) next + EF_VI_PS_ALIGNMENT);
+    }
+    flow_id = ef_packed_stream_demux_classify(demux, ps_pkt);
+    flow = flow_id >= 0 ? &demux->psd_flows[flow_id] : &demux->psd_default;
+    ++flow->psf_n_pkts;
+    flow->psf_n_bytes += ps_pkt->ps_cap_len;
+    if( flow->psf_fn != NULL )
+      flow->psf_fn(flow->psf_arg, flow_id, ps_pkt);
+  }
+  return ps_pkt;
+}
+
+
+int ef_packed_stream_demux_get_stats(ef_packed_stream_demux* demux,
+                                     int flow_id, uint64_t* n_pkts_out,
+                                     uint64_t* n_bytes_out)
+{
+  ef_packed_stream_flow* flow;
+
+  if( flow_id == -1 )
+    flow = &demux->psd_default;
+  else if( flow_id >= 0 && flow_id < demux->psd_n_flows )
+    flow = &demux->psd_flows[flow_id];
+  else
+    return -EINVAL;
+  *n_pkts_out = flow->psf_n_pkts;
+  *n_bytes_out = flow->psf_n_bytes;
+  return 0;
+}
+
+
+ef_vi_inline ef_addr ps_iter_buf_addr(ef_packed_stream_iter* iter, int i)
+{
+  return ef_memreg_dma_addr(iter->psi_memreg, iter->psi_memreg_offset +
+                            (size_t) i * iter->psi_buf_size);
+}
+
+
+int ef_packed_stream_iter_init(ef_packed_stream_iter* iter, ef_vi* vi,
+                               ef_packed_stream_demux* demux,
+                               void* bufs, struct ef_memreg* memreg,
+                               size_t memreg_offset, int n_bufs,
+                               int credit_batch)
+{
+  ef_packed_stream_params psp;
+  int i, rc;
+
+  if( (rc = ef_vi_packed_stream_get_params(vi, &psp)) < 0 )
+    return rc;
+  if( n_bufs <= 0 ||
+      ((uintptr_t) bufs & (psp.psp_buffer_align - 1)) != 0 ) {
+    LOG(ef_log("%s: ERROR: bad buffers n_bufs=%d bufs=%p", __FUNCTION__,
+               n_bufs, bufs));
+    return -EINVAL;
+  }
+  if( (rc = ef_vi_packed_stream_set_credit_batch(vi, credit_batch)) < 0 )
+    return rc;
+
+  memset(iter, 0, sizeof(*iter));
+  iter->psi_vi = vi;
+  iter->psi_demux = demux;
+  iter->psi_bufs = bufs;
+  iter->psi_memreg = memreg;
+  iter->psi_memreg_offset = memreg_offset;
+  iter->psi_buf_size = psp.psp_buffer_size;
+  iter->psi_n_bufs = n_bufs;
+  iter->psi_current = -1;
+  iter->psi_start_offset = psp.psp_start_offset;
+
+  for( i = 0; i < n_bufs; ++i )
+    if( (rc = ef_vi_receive_post(vi, ps_iter_buf_addr(iter, i), 0)) < 0 )
+      return rc;
+  return 0;
+}
+
+
+int ef_packed_stream_iter_event(ef_packed_stream_iter* iter,
+                                const ef_event* ev)
+{
+  ef_packed_stream_packet* ps_pkt;
+  int n_pkts, n_bytes, rc;
+
+  EF_VI_ASSERT(EF_EVENT_TYPE(*ev) == EF_EVENT_TYPE_RX_PACKED_STREAM);
+
+  if( EF_EVENT_RX_PS_NEXT_BUFFER(*ev) ) {
+    /* The adapter fills buffers in the order they were posted, so the
+     * buffer it has finished with goes to the back of the queue.
+     */
+    if( iter->psi_current >= 0 ) {
+      rc = ef_vi_receive_post(iter->psi_vi,
+                              ps_iter_buf_addr(iter, iter->psi_current), 0);
+      if( rc < 0 )
+        return rc;
+    }
+    iter->psi_current = (iter->psi_current + 1) % iter->psi_n_bufs;
+    iter->psi_pkt_iter = ef_packed_stream_packet_first(
+        iter->psi_bufs + (size_t) iter->psi_current * iter->psi_buf_size,
+        iter->psi_start_offset);
+  }
+
+  /* The return code only reports the timestamp sync state, which is also
+   * recorded in ps_flags of each packet.
+   */
+  ps_pkt = iter->psi_pkt_iter;
+  ef_vi_packed_stream_unbundle(iter->psi_vi, ev, &iter->psi_pkt_iter,
+                               &n_pkts, &n_bytes);
+  iter->psi_n_pkts += n_pkts;
+  iter->psi_n_bytes += n_bytes;
+  ef_packed_stream_demux_dispatch(iter->psi_demux, ps_pkt, n_pkts);
+  return n_pkts;
+}
@@ -344,6 +344,7 @@ void ef_vi_reset_rxq(struct ef_vi* vi)
   qs->bytes_acc = 0;
   qs->rx_ps_pkt_count = 0xF;
   qs->rx_ps_credit_avail = 1;
+  qs->rx_ps_credit_batch = 0;
   if( vi->vi_rxq.mask ) {
     int i;
     for( i = 0; i <= vi->vi_rxq.mask; ++i )
@@ -58,31 +58,43 @@
 #define efrm_vi_set(rs1)  container_of((rs1), struct efrm_vi_set, rs)
 
 
-/* These values are defined by hardware. */
-#define RSS_KEY_LEN 40
-#define RSS_TABLE_LEN 128
+#define RSS_KEY_LEN EFRM_RSS_KEY_LEN
+#define RSS_TABLE_LEN EFRM_RSS_TABLE_LEN
+
+
+/* Copied from efx_rss_fixed_key from linux_net/efx.c.
+ * FIXME: maintain consistency with net driver. */
+static const uint8_t rx_hash_key[RSS_KEY_LEN] = {
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+};
+
+
+static void efrm_rss_fill_table(uint8_t *rx_indir_table, int num_qs)
+{
+	int index;
+
+	/* Stripe evenly(ish) across VIs.
+	 * FIXME: maintain consistency with net driver */
+	for (index = 0; index < RSS_TABLE_LEN; index++)
+		rx_indir_table[index] = index % num_qs;
+}
 
 
 static int efrm_rss_context_alloc(struct efrm_pd *pd,
 				  struct efrm_client *client,
 				  int num_qs,
 				  int rss_mode,
-				  unsigned *rss_context_out)
+				  unsigned *rss_context_out,
+				  int *rss_mode_out)
 {
 	int rc;
 	int shared = 0;
-	int index;
 	unsigned rss_flags;
 	unsigned rss_context;
-	/* Copied from efx_rss_fixed_key from linux_net/efx.c.
-	 * FIXME: maintain consistency with net driver. */
-	static const uint8_t rx_hash_key[RSS_KEY_LEN] = {
-		0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
-		0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
-		0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
-		0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
-		0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
-	};
 	uint8_t rx_indir_table[RSS_TABLE_LEN];
 
 	if (num_qs > 1 && rss_mode != EFRM_RSS_MODE_DEFAULT &&
@@ -146,10 +158,8 @@ static int efrm_rss_context_alloc(struct efrm_pd *pd,
 	if (rc < 0)
 		goto fail;
 
-	/* Set up the indirection table to stripe evenly(ish) across VIs.
-	 * FIXME: maintain consistency with net driver */
-	for (index = 0; index < RSS_TABLE_LEN; index++)
-		rx_indir_table[index] = index % num_qs;
+	/* Set up the indirection table to stripe evenly(ish) across VIs. */
+	efrm_rss_fill_table(rx_indir_table, num_qs);
 
 	rc = efhw_nic_rss_context_set_table(client->nic, rss_context,
 					    rx_indir_table);
@@ -180,6 +190,8 @@ static int efrm_rss_context_alloc(struct efrm_pd *pd,
 	}
 
 	*rss_context_out = rss_context;
+	/* We chose the key and table, so spreading can be predicted. */
+	*rss_mode_out = rss_mode;
 	return rc;
 
 fail:
@@ -216,8 +228,10 @@ int efrm_vi_set_alloc(struct efrm_pd *pd, int n_vis, unsigned vi_props,
 	rss_limited =
 		efrm_client_get_nic(client)->flags & NIC_FLAG_RX_RSS_LIMITED;
 
-	for (i = 0; i <= EFRM_RSS_MODE_ID_MAX; ++i)
+	for (i = 0; i <= EFRM_RSS_MODE_ID_MAX; ++i) {
 		vi_set->rss_context[i] = -1;
+		vi_set->rss_mode[i] = 0;
+	}
 
 	if (!(n_vis > 1 || rss_limited)) {
 		/* Don't bother allocating a context of size 1, just use
@@ -231,7 +245,8 @@ int efrm_vi_set_alloc(struct efrm_pd *pd, int n_vis, unsigned vi_props,
 		rss_modes &= ~rss_mode;
 		rc = efrm_rss_context_alloc(pd, client, n_vis,
 					    rss_mode,
-					    &vi_set->rss_context[j]);
+					    &vi_set->rss_context[j],
+					    &vi_set->rss_mode[j]);
 		/* If we failed to allocate an RSS context fall back to
 		* using the netdriver's default context.
 		*
@@ -340,6 +355,19 @@ int efrm_vi_set_get_rss_context(struct efrm_vi_set *vi_set, unsigned rss_id)
 EXPORT_SYMBOL(efrm_vi_set_get_rss_context);
 
 
+int efrm_vi_set_get_rss_config(struct efrm_vi_set *vi_set, unsigned rss_id,
+			       uint8_t *key, uint8_t *indir_table)
+{
+	EFRM_ASSERT(rss_id <= EFRM_RSS_MODE_ID_MAX);
+	if (vi_set->rss_mode[rss_id] == 0)
+		return -ENOENT;
+	memcpy(key, rx_hash_key, RSS_KEY_LEN);
+	efrm_rss_fill_table(indir_table, vi_set->n_vis);
+	return vi_set->rss_mode[rss_id];
+}
+EXPORT_SYMBOL(efrm_vi_set_get_rss_config);
+
+
 struct efrm_resource * efrm_vi_set_to_resource(struct efrm_vi_set *vi_set)
 {
 	return &vi_set->rs;
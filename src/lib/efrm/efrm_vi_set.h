@@ -63,6 +63,7 @@ struct efrm_vi_set {
 	struct completion         allocation_completion;
 	uint64_t                  free;
 	int                       rss_context[EFRM_RSS_MODE_ID_MAX + 1];
+	int                       rss_mode[EFRM_RSS_MODE_ID_MAX + 1];
 	int                       n_vis;
 	int                       n_vis_flushing;
 	int                       n_flushing_waiters;
@@ -2573,6 +2573,10 @@ cicp_mac_mib_ctor(cicp_mibs_kern_t *mibs, int mac_rows_ln2)
 
 	mact = umibs->mac_utable;
 	mact->rows_ln2 = mac_rows_ln2;
+	mact->tags_ofs = CICP_MAC_MIB_TAGS_OFS(mact, rows);
+	memset(cicp_mac_row_tag(mact, 0), CICP_MAC_TAG_EMPTY, rows);
+	mact->deleted_rows = 0;
+	mact->deleted_max = rows >> CICP_MAC_DELETED_COMPACT_LN2;
 
         /* Mark all entries as free and set seq_num to a valid number. */
 	for (i=CICP_MAC_MIB_ROW_MOSTLY_VALID; i < rows; i++)
@@ -2584,7 +2588,7 @@ cicp_mac_mib_ctor(cicp_mibs_kern_t *mibs, int mac_rows_ln2)
 	    memset(&row->ip_addr, 0xEE, sizeof(row->ip_addr));
 	    cicp_mac_row_free(row); /* NB: alters version to invalid */
 	    row->rc = 0;
-	    row->use_enter = 0; /* set use-count to zero */
+	    row->use_enter = 0;
 	}
         mact->ipmac[CICP_MAC_MIB_ROW_MOSTLY_VALID].version =
           CI_VERLOCK_INIT_VALID;
@@ -3225,17 +3229,27 @@ cicp_fwdinfo_ctor(cicp_mibs_kern_t *mibs, int rows_max)
 {
   cicp_fwdinfo_t *fwdinfot;
   cicp_ul_mibs_t *umibs = &mibs->user;
-  int i, rc;
+  cicp_fwd_index_t *idx;
+  size_t bytes, stamps_ofs, index_ofs = 0;
+  int i, rc, nodes_max = CICP_FWD_INDEX_NODES(rows_max);
     
   OO_DEBUG_FWD(DPRINTF(CODEID ": constructing user Forwarding "
                        "Information table"););
     
   ci_assert(NULL != mibs);
     
-  /* allocate enough space for the correct number of rows */
+  /* allocate enough space for the correct number of rows and their stamps,
+   * followed by the route index if the rows can be indexed */
+  bytes = sizeof(*umibs->fwdinfo_utable) +
+          (rows_max-1) * sizeof(cicp_fwd_row_t);
+  stamps_ofs = CI_ROUND_UP(bytes, sizeof(ci_verlock_value_t));
+  bytes = stamps_ofs + rows_max * sizeof(ci_verlock_value_t);
+  if( rows_max <= CICP_FWD_INDEX_ROWS_MAX ) {
+    index_ofs = CI_ROUND_UP(bytes, CI_CACHE_LINE_SIZE);
+    bytes = index_ofs + CICP_FWD_INDEX_SIZE(nodes_max);
+  }
   umibs->fwdinfo_utable = (cicp_fwdinfo_t *)cicp_shared_alloc
-    (sizeof(*umibs->fwdinfo_utable) + (rows_max-1) * sizeof(cicp_fwd_row_t),
-     &umibs->fwdinfo_mmap_len, &mibs->fwdinfo_shared, &rc);
+    (bytes, &umibs->fwdinfo_mmap_len, &mibs->fwdinfo_shared, &rc);
 
   if( umibs->fwdinfo_utable == NULL )
     return -ENOMEM;
@@ -3244,6 +3258,12 @@ cicp_fwdinfo_ctor(cicp_mibs_kern_t *mibs, int rows_max)
   fwdinfot = umibs->fwdinfo_utable;
   fwdinfot->version = CI_VERLOCK_INIT_VALID;
   fwdinfot->rows_max = rows_max;
+  fwdinfot->index_ofs = index_ofs;
+  fwdinfot->stamps_ofs = stamps_ofs;
+  fwdinfot->stamp_last = CI_VERLOCK_BAD;
+  fwdinfot->noroute_version = cicp_fwd_stamp_next(fwdinfot);
+  if( (idx = cicp_fwd_index(fwdinfot)) != NULL )
+    idx->nodes_max = nodes_max;
 
   for( i = 0; i < CI_CFG_MAX_REGISTER_INTERFACES; ++i )
     fwdinfot->hwport_to_base_ifindex[i] = CI_IFID_BAD;
@@ -3254,7 +3274,9 @@ cicp_fwdinfo_ctor(cicp_mibs_kern_t *mibs, int rows_max)
     /* set info to all 0xEE; for debugging */
     memset(row, 0xEE, sizeof(*row));
     cicp_fwd_row_free(row);
+    cicp_fwd_stamps(fwdinfot)[i] = CI_VERLOCK_BAD;
   }
+  cicp_fwd_index_build(fwdinfot);
   return 0;
 }
 
@@ -4098,12 +4120,13 @@ cicpos_mac_set(cicp_handle_t *control_plane,
 				    (because of the write lock) it will never 
 				    be seen by this function
 			     */
-			    ci_assert_equal(rowid,
-					    _cicp_mac_find_ipaloc(mact,
-								  ifindex,
-								  nexthop_ip));
+			    cicp_mac_rowid_t hashedrowid =
+				_cicp_mac_find_ipaloc(mact, ifindex,
+						      nexthop_ip);
 			    /* we should find the same hash for
 			       the same IP addr */
+			    ci_assert_equal(rowid, hashedrowid);
+			    (void) hashedrowid;
 
 			    cicp_mac_row_free(row);
 			    DEBUGMIBMAC(what = do_reject;);
@@ -4586,6 +4609,8 @@ cicpos_fwdinfo_hwport_update(cicp_handle_t *control_plane,
  *    in the new
  *
  *  - Re-evaluation all MAC table entries
+ *
+ *  - Invalidate the users of the routes that the route could affect
  */
 ci_inline int /* rc */
 cicpos_fwdinfo_route_import(cicp_handle_t *control_plane,
@@ -4599,17 +4624,17 @@ cicpos_fwdinfo_route_import(cicp_handle_t *control_plane,
        but we do have to do something about the users who ought to notice
        the effect of the altered route on their destination.
        
-       We could try to see which MAC addresses might have been affected by
-       looking at those that might have been interested in the old route and
-       those that will be interested in the new route - but rather than that
-       we use a sledgehammer - simply invalidating all MAC addresses!!
+       Users record the route row they used, so rather than invalidating
+       all MAC addresses we give new stamps to just the rows whose traffic
+       this route could take (and to "no route"): other users carry on.
     */
     cicp_mibs_kern_t *mibs = control_plane;
-    cicp_mac_mib_t *mact = mibs->user.mac_utable;
+    cicp_fwdinfo_t *fwdt = mibs->user.fwdinfo_utable;
     (void)ref_next_hop_ip; /* unused */
     (void)ref_pref_source; /* unused */
 
-    _cicpos_mac_invalidate_all(mact);
+    CI_VERLOCK_WRITE(fwdt->version,
+		     cicp_fwd_route_changed(fwdt, dest_ip, dest_ipset));
     return 0;
 }
 
@@ -4761,9 +4786,8 @@ cicpos_mac_purge_unseen(cicp_handle_t *control_plane)
 		!cicpos_mac_row_recent(&krow->sync))
 	    {   cicp_mac_rowid_t hashedrowid;
 
-		/* The following function decrements usecounts on the rehash
-		   path to the given IP-MAC entry, if the entry were not
-		   allocated it would decrement a usecount that it should not!
+		/* The following function releases the entry's tag, which
+		   must only be done for an allocated entry
 		*/
 		hashedrowid = _cicp_mac_find_ipaloc(mact, row->ifindex,
 						    row->ip_addr);
@@ -4986,9 +5010,12 @@ cicpos_route_retrack(cicp_fwdinfo_t *routet,
 		     row->dest_ifindex = CI_IFID_BAD;
 		 }
 
-		 if (orig_ifindex != row->dest_ifindex && !changed)
-		 {   ci_verlock_write_start(ref_read_lock);
-		     changed = TRUE;
+		 if (orig_ifindex != row->dest_ifindex)
+		 {   if (!changed)
+		     {   ci_verlock_write_start(ref_read_lock);
+			 changed = TRUE;
+		     }
+		     cicp_fwd_row_stamp(routet, row);
 		 }
 	     } 
 	     /* else - we have asked for tracking but there is no (i.e. a zero)
@@ -5063,6 +5090,7 @@ cicpos_route_add(cicp_handle_t      *control_plane,
 	    /* fill in other fwdinfo entries for the route */
 	    CI_IP_ADDR_SET_SUBNET(&newrow->destnet_ip, &dest_ip, dest_set);
 	    newrow->destnet_ipset = dest_set; /* sets the entry to allocated */
+	    cicp_fwd_row_stamp_new(routet, newrow);
 	    CI_IP_ADDR_SET(&newrow->first_hop, &next_hop_ip);
 	    newrow->scope = scope;
 	    newrow->tos = tos;
@@ -5086,9 +5114,14 @@ cicpos_route_add(cicp_handle_t      *control_plane,
 					   /*changed*/TRUE);
             }
 
-	    /* sort this new entry in to position */
-            if (!nosort)
+	    /* sort this new entry in to position - when importing many
+	       routes, leave sorting and indexing them until the end */
+            if (!nosort) {
                 (void)cicp_route_sort(routet, kroutet, /*changed*/TRUE);
+                cicp_fwd_index_build(routet);
+            }
+            else
+                cicp_fwd_index_invalidate(routet);
 	    
 	CI_VERLOCK_WRITE_END(routet->version)
 	    
@@ -5234,6 +5267,7 @@ cicpos_route_update(cicp_handle_t      *control_plane,
 				     &routet->version, changed);
 	/* do any necesary retracking */
 	(void)cicpos_route_retrack(routet, ipift, &routet->version, changed);
+	cicp_fwd_row_stamp(routet, row);
         ci_verlock_write_stop(&routet->version);
     }
     return changed;
@@ -5492,9 +5526,10 @@ cicpos_route_delete(cicp_handle_t     *control_plane,
                                    dest_ifindex);
 	if (CICP_ROUTE_ROWID_BAD != rowid)
 	{   CI_VERLOCK_WRITE(routet->version,
-			     cicp_fwd_row_free(&routet->path[rowid]);
+			     cicp_fwd_row_remove(routet, &routet->path[rowid]);
 			    (void)cicpos_route_compress(routet, kroutet,
 							 /*changed*/ TRUE);
+			    cicp_fwd_index_build(routet);
 		             )
 	    cicpos_fwdinfo_route_import(control_plane, dest_ipset,
                                         dest_ip, /* next hop */NULL,
@@ -7517,7 +7552,9 @@ cicpos_route_post_poll(cicpos_parse_state_t *session)
   const cicp_mibs_kern_t *mibs = CICP_MIBS(session->control_plane);
   cicp_fwdinfo_t *routet = mibs->user.fwdinfo_utable;
   cicp_route_kmib_t *kroutet = mibs->route_table;
+  const cicp_fwd_index_t *idx = cicp_fwd_index(routet);
   cicp_route_rowid_t rowid;
+  int /* bool */ freed = FALSE;
 
   CICP_LOCK_BEGIN(session->control_plane);
 
@@ -7534,12 +7571,16 @@ cicpos_route_post_poll(cicpos_parse_state_t *session)
        cicp_fwd_row_allocated(&routet->path[rowid]); 
        rowid++) {
     if (!ci_bitset_in(CI_BITSET_REF(session->imported_route), rowid)) {
-      cicp_fwd_row_free(&routet->path[rowid]);
+      cicp_fwd_row_remove(routet, &routet->path[rowid]);
+      freed = TRUE;
     }
   }
   (void)cicpos_route_compress(routet, kroutet, /*changed*/TRUE);
 sort:
   (void)cicp_route_sort(routet, kroutet, /*changed*/TRUE);
+  /* Routes imported with nosort left the index invalid. */
+  if (freed || (idx != NULL && !idx->valid))
+    CI_VERLOCK_WRITE(routet->version, cicp_fwd_index_build(routet));
   CICP_LOCK_END;
 }
 
@@ -77,7 +77,13 @@ static void oo_iobufset_kfree(struct oo_buffer_pages *pages)
 #define OO_SHM_KEY_ID_MASK 0xffff
 #define OO_SHM_NEXT_ID(id) ((id + 1) & OO_SHM_KEY_ID_MASK)
 
-static int oo_bufpage_huge_alloc(struct oo_buffer_pages *p, int *flags)
+/* Create a SysV shared memory segment of [size] bytes backed by a huge
+ * page, and pin its first page.  Sets [failed_flag] in [flags] if the
+ * system is out of huge pages.
+ */
+static int oo_shm_huge_alloc(size_t size, int shm_flags, int *shmid_out,
+                             struct page **page_out, int *flags,
+                             int failed_flag)
 {
   int shmid = -1;
   long uaddr;
@@ -163,14 +169,14 @@ static int oo_bufpage_huge_alloc(struct oo_buffer_pages *p, int *flags)
   for (id = OO_SHM_NEXT_ID(start_key_id);
        id != start_key_id;
        id = OO_SHM_NEXT_ID(id)) {
-    shmid = efab_linux_sys_shmget(OO_SHM_KEY(id), HPAGE_SIZE,
+    shmid = efab_linux_sys_shmget(OO_SHM_KEY(id), size,
                                   SHM_HUGETLB | IPC_CREAT | IPC_EXCL |
-                                  SHM_R | SHM_W);
+                                  SHM_R | SHM_W | shm_flags);
     if (shmid == -EEXIST)
       continue; /* try another id */
     if (shmid < 0) {
-      if (shmid == -ENOMEM && !(*flags & OO_IOBUFSET_FLAG_HUGE_PAGE_FAILED) )
-        *flags |= OO_IOBUFSET_FLAG_HUGE_PAGE_FAILED;
+      if (shmid == -ENOMEM && !(*flags & failed_flag) )
+        *flags |= failed_flag;
       rc = shmid;
       goto out;
     }
@@ -194,7 +200,7 @@ static int oo_bufpage_huge_alloc(struct oo_buffer_pages *p, int *flags)
 
   down_read(&current->mm->mmap_sem);
   rc = get_user_pages(current, current->mm, (unsigned long)uaddr, 1,
-                      1/*write*/, 0/*force*/, &(p->pages[0]), NULL);
+                      1/*write*/, 0/*force*/, page_out, NULL);
   up_read(&current->mm->mmap_sem);
   if (rc < 0)
     goto fail2;
@@ -202,12 +208,12 @@ static int oo_bufpage_huge_alloc(struct oo_buffer_pages *p, int *flags)
   if (rc < 0)
     goto fail1;
 
-  p->shmid = shmid;
+  *shmid_out = shmid;
   rc = 0;
   goto out;
 
 fail1:
-  put_page(p->pages[0]);
+  put_page(*page_out);
 fail2:
   efab_linux_sys_shmdt((char __user *)uaddr);
 fail3:
@@ -232,6 +238,12 @@ out:
   return rc;
 }
 
+static int oo_bufpage_huge_alloc(struct oo_buffer_pages *p, int *flags)
+{
+  return oo_shm_huge_alloc(HPAGE_SIZE, 0, &p->shmid, &p->pages[0], flags,
+                           OO_IOBUFSET_FLAG_HUGE_PAGE_FAILED);
+}
+
 static void oo_bufpage_huge_free(struct oo_buffer_pages *p)
 {
   ci_assert(p->shmid >= 0);
@@ -242,12 +254,92 @@ static void oo_bufpage_huge_free(struct oo_buffer_pages *p)
   oo_iobufset_kfree(p);
 }
 #endif
+
+#ifdef OO_DO_HUGE_PAGES_1G
+
+#define OO_HUGE_SEG_SLICES (1 << (OO_HUGE_SEG_SHIFT - HPAGE_SHIFT))
+
+void oo_huge_segment_release(struct oo_huge_segment *seg)
+{
+  if( ! oo_atomic_dec_and_test(&seg->ref_count) )
+    return;
+  put_page(seg->page);
+  efab_linux_sys_shmctl(seg->shmid, IPC_RMID, NULL);
+  kfree(seg);
+}
+
+static int oo_huge_segment_alloc(struct oo_huge_segment **seg_out,
+                                 int *flags)
+{
+  struct oo_huge_segment *seg;
+  int rc;
+
+  seg = kmalloc(sizeof(*seg), GFP_KERNEL);
+  if( seg == NULL )
+    return -ENOMEM;
+  /* If there are no 1GB pages to be had, oo_shm_huge_alloc() sets
+   * OO_IOBUFSET_FLAG_HUGE_PAGE_1G_FAILED so that this stack does not try
+   * again.  Other failures may be transient, so leave the flag alone.
+   */
+  rc = oo_shm_huge_alloc(1ul << OO_HUGE_SEG_SHIFT, OO_SHM_HUGE_1GB,
+                         &seg->shmid, &seg->page, flags,
+                         OO_IOBUFSET_FLAG_HUGE_PAGE_1G_FAILED);
+  if( rc < 0 ) {
+    kfree(seg);
+    return rc;
+  }
+  seg->n_slices = 0;
+  oo_atomic_set(&seg->ref_count, 1);
+  *seg_out = seg;
+  return 0;
+}
+
+/* Hand out the next 2MB slice of *[seg_p], replacing it with a new 1GB
+ * huge page if it is used up.  The caller's reference to a used-up
+ * segment is dropped; the slices carved from it keep it alive.
+ */
+static int oo_bufpage_huge_slice(struct oo_buffer_pages *p,
+                                 struct oo_huge_segment **seg_p, int *flags)
+{
+  struct oo_huge_segment *seg = *seg_p;
+  int rc;
+
+  if( seg != NULL && seg->n_slices == OO_HUGE_SEG_SLICES ) {
+    oo_huge_segment_release(seg);
+    *seg_p = seg = NULL;
+  }
+  if( seg == NULL ) {
+    if( (rc = oo_huge_segment_alloc(&seg, flags)) < 0 )
+      return rc;
+    *seg_p = seg;
+  }
+
+  /* The segment is physically contiguous, so each slice is a run of
+   * (1 << order) pages starting at a 2MB boundary.
+   */
+  p->shmid = seg->shmid;
+  p->shm_offset = seg->n_slices << HPAGE_SHIFT;
+  p->pages[0] = nth_page(seg->page, seg->n_slices << p->order);
+  p->seg = seg;
+  ++seg->n_slices;
+  oo_atomic_inc(&seg->ref_count);
+  return 0;
+}
+
+#endif
  
 
 /************** Alloc/free page set ****************/
 
 static void oo_iobufset_free_pages(struct oo_buffer_pages *pages)
 {
+#ifdef OO_DO_HUGE_PAGES_1G
+  if( pages->seg != NULL ) {
+    oo_huge_segment_release(pages->seg);
+    oo_iobufset_kfree(pages);
+  }
+  else
+#endif
 #ifdef OO_DO_HUGE_PAGES
   if( pages->shmid >= 0 )
     oo_bufpage_huge_free(pages);
@@ -257,14 +349,15 @@ static void oo_iobufset_free_pages(struct oo_buffer_pages *pages)
     int i;
 
     for (i = 0; i < pages->n_bufs; ++i)
-      __free_pages(pages->pages[i], compound_order(pages->pages[i]));
+      __free_pages(pages->pages[i], pages->order);
     oo_iobufset_kfree(pages);
   }
 }
 
 static int oo_bufpage_alloc(struct oo_buffer_pages **pages_out,
-                            int user_order, int low_order,
-                            int *flags, int gfp_flag)
+                            int user_order, int low_order, int numa_node,
+                            int *flags, struct oo_huge_segment **seg,
+                            int gfp_flag)
 {
   int i;
   struct oo_buffer_pages *pages;
@@ -291,7 +384,21 @@ static int oo_bufpage_alloc(struct oo_buffer_pages **pages_out,
   }
 
   pages->n_bufs = n_bufs;
+  pages->order = low_order;
   oo_atomic_set(&pages->ref_count, 1);
+#ifdef OO_DO_HUGE_PAGES_1G
+  pages->seg = NULL;
+  pages->shm_offset = 0;
+  if( seg != NULL && (*flags & OO_IOBUFSET_FLAG_HUGE_PAGE_1G) &&
+      ! (*flags & OO_IOBUFSET_FLAG_HUGE_PAGE_1G_FAILED) &&
+      gfp_flag == GFP_KERNEL &&
+      low_order == HPAGE_SHIFT - PAGE_SHIFT ) {
+    if( oo_bufpage_huge_slice(pages, seg, flags) == 0 ) {
+      *pages_out = pages;
+      return 0;
+    }
+  }
+#endif
 
 #ifdef OO_DO_HUGE_PAGES
   if( (*flags & (OO_IOBUFSET_FLAG_HUGE_PAGE_TRY |
@@ -322,7 +429,7 @@ static int oo_bufpage_alloc(struct oo_buffer_pages **pages_out,
   }
 
   for( i = 0; i < n_bufs; ++i ) {
-    pages->pages[i] = alloc_pages_node(numa_node_id(), gfp_flag, low_order);
+    pages->pages[i] = alloc_pages_node(numa_node, gfp_flag, low_order);
     if( pages->pages[i] == NULL ) {
       OO_DEBUG_VERB(ci_log("%s: failed to allocate page (i=%u) "
                            "user_order=%d page_order=%d",
@@ -347,7 +454,8 @@ void oo_iobufset_pages_release(struct oo_buffer_pages *pages)
 }
 
 int
-oo_iobufset_pages_alloc(int nic_order, int *flags,
+oo_iobufset_pages_alloc(int nic_order, int numa_node, int *flags,
+                        struct oo_huge_segment **seg,
                         struct oo_buffer_pages **pages_out)
 {
   int rc;
@@ -359,7 +467,8 @@ oo_iobufset_pages_alloc(int nic_order, int *flags,
 #if CI_CFG_PKTS_AS_HUGE_PAGES
   if( *flags & OO_IOBUFSET_FLAG_HUGE_PAGE_FORCE ) {
 # ifdef OO_DO_HUGE_PAGES
-    rc = oo_bufpage_alloc(pages_out, order, order, flags, gfp_flag);
+    rc = oo_bufpage_alloc(pages_out, order, order, numa_node, flags, seg,
+                          gfp_flag);
 # else
     rc = -ENOMEM;
 # endif
@@ -386,7 +495,8 @@ oo_iobufset_pages_alloc(int nic_order, int *flags,
        * x86: 9(hugepage),8,4,0
        * ppc: 4(max,=9nic),3(=8nic),0(=5nic)
        */
-      rc = oo_bufpage_alloc(pages_out, order, low_order, flags, gfp_flag);
+      rc = oo_bufpage_alloc(pages_out, order, low_order, numa_node, flags,
+                            seg, gfp_flag);
       if( rc == 0 || low_order == 0 )
         break;
       low_order -= 3;
@@ -397,11 +507,14 @@ oo_iobufset_pages_alloc(int nic_order, int *flags,
     rc = -ENOMEM;
     if( *flags & (OO_IOBUFSET_FLAG_HUGE_PAGE_TRY |
                  OO_IOBUFSET_FLAG_HUGE_PAGE_FORCE) )
-      rc = oo_bufpage_alloc(pages_out, order, order, flags, gfp_flag);
+      rc = oo_bufpage_alloc(pages_out, order, order, numa_node, flags, seg,
+                            gfp_flag);
     if( rc != 0 )
-      rc = oo_bufpage_alloc(pages_out, order, 0, flags, gfp_flag);
+      rc = oo_bufpage_alloc(pages_out, order, 0, numa_node, flags, seg,
+                            gfp_flag);
 #else
-    rc = oo_bufpage_alloc(pages_out, order, 0, flags, gfp_flag);
+    rc = oo_bufpage_alloc(pages_out, order, 0, numa_node, flags, seg,
+                          gfp_flag);
 #endif
   }
 
@@ -423,8 +536,7 @@ static void
 oo_iobufset_resource_free(struct oo_iobufset *rs, int reset_pending)
 {
   efrm_pd_dma_unmap(rs->pd, rs->pages->n_bufs,
-                    EFHW_GFP_ORDER_TO_NIC_ORDER(
-                                    compound_order(rs->pages->pages[0])),
+                    EFHW_GFP_ORDER_TO_NIC_ORDER(rs->pages->order),
                     &rs->dma_addrs[0], sizeof(rs->dma_addrs[0]),
                     &rs->buf_tbl_alloc, reset_pending);
 
@@ -488,7 +600,7 @@ oo_iobufset_resource_alloc(struct oo_buffer_pages * pages, struct efrm_pd *pd,
   iobrs->pd = pd;
   iobrs->pages = pages;
 
-  nic_order = EFHW_GFP_ORDER_TO_NIC_ORDER(compound_order(pages->pages[0]));
+  nic_order = EFHW_GFP_ORDER_TO_NIC_ORDER(pages->order);
 
   ci_assert_le(sizeof(void *) * pages->n_bufs, PAGE_SIZE);
   addrs = kmalloc(sizeof(void *) * pages->n_bufs, gfp_flag);
@@ -530,7 +642,7 @@ fail:
 int oo_iobufset_resource_remap_bt(struct oo_iobufset *iobrs, uint64_t *hw_addrs)
 {
   return efrm_pd_dma_remap_bt(iobrs->pd, iobrs->pages->n_bufs,
-                              compound_order(iobrs->pages->pages[0]),
+                              iobrs->pages->order,
                               &iobrs->dma_addrs[0], sizeof(iobrs->dma_addrs[0]),
                               hw_addrs, sizeof(hw_addrs[0]),
                               put_user_fake,
@@ -595,6 +595,7 @@ oof_socket_ctor(struct oof_socket* skf)
   oo_hw_filter_init(&skf->sf_full_match_filter);
   ci_dllist_init(&skf->sf_mcast_memberships);
   ci_dllink_mark_free(&skf->sf_lp_link);
+  ci_dllink_mark_free(&skf->sf_hash_link);
 }
 
 
@@ -605,6 +606,36 @@ oof_socket_dtor(struct oof_socket* skf)
   ci_assert(oo_hw_filter_is_empty(&skf->sf_full_match_filter));
   ci_assert(ci_dllist_is_empty(&skf->sf_mcast_memberships));
   ci_assert(ci_dllink_is_free(&skf->sf_lp_link));
+  ci_assert(ci_dllink_is_free(&skf->sf_hash_link));
+}
+
+
+static unsigned
+oof_socket_hash(ci_dllist* list, struct tcp_helper_resource_s* stack)
+{
+  ci_uint64 key = (ci_uintptr_t) list ^ ((ci_uint64) (ci_uintptr_t) stack << 17);
+  return (unsigned) ((key * 0x9e3779b97f4a7c15ull) >> (64 - OOF_SOCKET_TBL_LN2));
+}
+
+
+/* Add [skf] at the head of [list], which is one of the lists described at
+ * [oof_socket::sf_lp_link].  [index] is the hash table the list's sockets
+ * are indexed in, or NULL if they are not.
+ *
+ * Sockets with the same list and stack are in the same bucket, and in the
+ * same order there as on [list], so oof_socket_list_find_matching_stack()
+ * finds the same socket a walk of [list] would.
+ */
+static void
+oof_socket_list_push(ci_dllist* index, ci_dllist* list, struct oof_socket* skf)
+{
+  ci_assert(ci_dllink_is_free(&skf->sf_lp_link));
+  ci_assert(ci_dllink_is_free(&skf->sf_hash_link));
+  ci_dllist_push(list, &skf->sf_lp_link);
+  skf->sf_lp_list = list;
+  if( index != NULL )
+    ci_dllist_push(&index[oof_socket_hash(list, oof_socket_stack_safe(skf))],
+                   &skf->sf_hash_link);
 }
 
 
@@ -614,6 +645,10 @@ oof_socket_remove_from_list(struct oof_socket* skf)
   ci_assert(! ci_dllink_is_free(&skf->sf_lp_link));
   ci_dllist_remove(&skf->sf_lp_link);
   ci_dllink_mark_free(&skf->sf_lp_link);
+  if( ! ci_dllink_is_free(&skf->sf_hash_link) ) {
+    ci_dllist_remove(&skf->sf_hash_link);
+    ci_dllink_mark_free(&skf->sf_hash_link);
+  }
 }
 
 
@@ -629,14 +664,34 @@ oof_socket_at_head(ci_dllist* list, int no_flags, int want_flags)
 }
 
 
+/* A wild or semi-wild list holds either only clustered sockets (all in the
+ * same cluster) or only unclustered ones, as oof_socket_insert_probe()
+ * does not let the two mix.  So the socket at the head tells us which.
+ *
+ * (oof_udp_connect() clears OOF_SOCKET_CLUSTERED on a socket before taking
+ * it off the list, but does so holding [fm_outer_lock], which all callers
+ * of this hold.)
+ */
+static int
+oof_socket_list_is_clustered(ci_dllist* list)
+{
+  return ci_dllist_not_empty(list) &&
+         oof_socket_is_clustered(CI_CONTAINER(struct oof_socket, sf_lp_link,
+                                              ci_dllist_head(list)));
+}
+
+
+/* Find the first socket in [stack] on wild or semi-wild [list]. */
 static struct oof_socket*
-oof_socket_list_find_matching_stack(ci_dllist* list,
+oof_socket_list_find_matching_stack(struct oof_manager* fm, ci_dllist* list,
                                     struct tcp_helper_resource_s* stack,
                                     int allow_dummy)
 {
   struct oof_socket* skf;
-  CI_DLLIST_FOR_EACH2(struct oof_socket, skf, sf_lp_link, list)
-    if( ! oof_socket_is_stackless(skf) &&
+  CI_DLLIST_FOR_EACH2(struct oof_socket, skf, sf_hash_link,
+                      &fm->fm_wild_socks[oof_socket_hash(list, stack)])
+    if( skf->sf_lp_list == list &&
+        ! oof_socket_is_stackless(skf) &&
         (allow_dummy || ! oof_socket_is_dummy(skf)) &&
         oof_cb_socket_stack(skf) == stack )
       return skf;
@@ -646,14 +701,15 @@ oof_socket_list_find_matching_stack(ci_dllist* list,
 
 /* Tells whether this socket deserves a filter */
 static int
-oof_socket_is_first_in_same_stack(ci_dllist* list, struct oof_socket* skf)
+oof_socket_is_first_in_same_stack(struct oof_manager* fm, ci_dllist* list,
+                                  struct oof_socket* skf)
 {
   /* Return true if [skf] is non-dummy and  is the first socket in the list,
    * considering only sockets in the same stack as [skf]. */
   if( oof_socket_is_dummy(skf) )
     return 0;
-  return skf ==
-         oof_socket_list_find_matching_stack(list, oof_cb_socket_stack(skf), 0);
+  return skf == oof_socket_list_find_matching_stack(fm, list,
+                                                    oof_cb_socket_stack(skf), 0);
 }
 
 
@@ -715,7 +771,8 @@ oof_socket_has_cluster_sibling(ci_dllist* list, struct oof_socket* skf)
  * Note insertion of second socket from the same stack is not allowed.
  */
 static int
-oof_socket_insert_probe(ci_dllist* list, struct oof_socket* skf,
+oof_socket_insert_probe(struct oof_manager* fm, ci_dllist* list,
+                        struct oof_socket* skf,
                         struct tcp_helper_cluster_s** thc_out)
 {
   int has_stack = (skf->sf_flags & OOF_SOCKET_NO_STACK) == 0;
@@ -725,11 +782,14 @@ oof_socket_insert_probe(ci_dllist* list, struct oof_socket* skf,
     return 0;
   /* if skf is not clustered any clustered socket blocks its insertion*/
   if( ! oof_socket_is_clustered(skf) )
-    return oof_socket_at_head(list, 0, OOF_SOCKET_CLUSTERED) != NULL ?
-           -EADDRINUSE : 0;
+    return oof_socket_list_is_clustered(list) ? -EADDRINUSE : 0;
+  /* and if it is, any unclustered one does */
+  if( ! oof_socket_list_is_clustered(list) )
+    return -EADDRINUSE;
   if( has_stack ) {
     /* is there a duplicate socket in our stack. */
-    skf2 = oof_socket_list_find_matching_stack(list, oof_cb_socket_stack(skf), 1);
+    skf2 = oof_socket_list_find_matching_stack(fm, list,
+                                               oof_cb_socket_stack(skf), 1);
     if( skf2 != NULL )
       return -EADDRINUSE;
     /* Foot in the door check: whether our cluster is already allowed */
@@ -743,10 +803,7 @@ oof_socket_insert_probe(ci_dllist* list, struct oof_socket* skf,
 
   /* To uphold foot in the door principle, we try to locate cluster first */
   skf2 = oof_socket_at_head(list, 0, OOF_SOCKET_CLUSTERED);
-  if( skf2 == NULL ) {
-    /* An existing non clustered socket blocks the insertion */
-    return -EADDRINUSE;
-  }
+  ci_assert(skf2 != NULL);
 
   /* We should not have a clustered socked without a stack */
   ci_assert_nflags(skf2->sf_flags, OOF_SOCKET_NO_STACK);
@@ -778,7 +835,8 @@ oof_socket_insert_probe(ci_dllist* list, struct oof_socket* skf,
 static int
 lp_hash(int protocol, int lport)
 {
-  return (protocol + lport) & OOF_LOCAL_PORT_TBL_MASK;
+  ci_uint32 key = ((ci_uint32) protocol << 16) | (ci_uint16) lport;
+  return (key * 0x9e3779b1u) >> (32 - OOF_LOCAL_PORT_TBL_LN2);
 }
 
 
@@ -795,7 +853,19 @@ oof_manager_alloc(unsigned local_addr_max, void* owner_private)
   if( fm == NULL )
     return NULL;
   fm->fm_local_addrs = CI_ALLOC_ARRAY(struct oof_local_addr, local_addr_max);
-  if( fm->fm_local_addrs == NULL ) {
+  fm->fm_local_ports = CI_VMALLOC_ARRAY(ci_dllist, OOF_LOCAL_PORT_TBL_SIZE);
+  fm->fm_wild_socks = CI_VMALLOC_ARRAY(ci_dllist, OOF_SOCKET_TBL_SIZE);
+  fm->fm_full_socks = CI_VMALLOC_ARRAY(ci_dllist, OOF_SOCKET_TBL_SIZE);
+  if( fm->fm_local_addrs == NULL || fm->fm_local_ports == NULL ||
+      fm->fm_wild_socks == NULL || fm->fm_full_socks == NULL ) {
+    if( fm->fm_full_socks != NULL )
+      ci_vfree(fm->fm_full_socks);
+    if( fm->fm_wild_socks != NULL )
+      ci_vfree(fm->fm_wild_socks);
+    if( fm->fm_local_ports != NULL )
+      ci_vfree(fm->fm_local_ports);
+    if( fm->fm_local_addrs != NULL )
+      ci_free(fm->fm_local_addrs);
     ci_free(fm);
     return NULL;
   }
@@ -808,6 +878,10 @@ oof_manager_alloc(unsigned local_addr_max, void* owner_private)
   fm->fm_local_addr_max = local_addr_max;
   for( hash = 0; hash < OOF_LOCAL_PORT_TBL_SIZE; ++hash )
     ci_dllist_init(&fm->fm_local_ports[hash]);
+  for( hash = 0; hash < OOF_SOCKET_TBL_SIZE; ++hash ) {
+    ci_dllist_init(&fm->fm_wild_socks[hash]);
+    ci_dllist_init(&fm->fm_full_socks[hash]);
+  }
   ci_dllist_init(&fm->fm_mcast_laddr_socks);
   ci_dllist_init(&fm->fm_tproxies);
   for( i = 0; i < OOF_TPROXY_GLOBAL_FILTER_COUNT; ++i )
@@ -838,7 +912,14 @@ oof_manager_free(struct oof_manager* fm)
   the_manager = NULL;
   for( hash = 0; hash < OOF_LOCAL_PORT_TBL_SIZE; ++hash )
     ci_assert(ci_dllist_is_empty(&fm->fm_local_ports[hash]));
+  for( hash = 0; hash < OOF_SOCKET_TBL_SIZE; ++hash ) {
+    ci_assert(ci_dllist_is_empty(&fm->fm_wild_socks[hash]));
+    ci_assert(ci_dllist_is_empty(&fm->fm_full_socks[hash]));
+  }
   mutex_destroy(&fm->fm_outer_lock);
+  ci_vfree(fm->fm_full_socks);
+  ci_vfree(fm->fm_wild_socks);
+  ci_vfree(fm->fm_local_ports);
   ci_free(fm->fm_local_addrs);
   ci_free(fm);
 }
@@ -1044,7 +1125,8 @@ __oof_manager_addr_add(struct oof_manager* fm, unsigned laddr, unsigned ifindex)
       /* Add s/w filters for wild sockets. */
       CI_DLLIST_FOR_EACH2(struct oof_socket, skf, sf_lp_link,
                           &lp->lp_wild_socks)
-        if( oof_socket_is_first_in_same_stack(&lp->lp_wild_socks, skf) ) {
+        if( oof_socket_is_first_in_same_stack(fm, &lp->lp_wild_socks,
+                                              skf) ) {
           int rc = oof_cb_sw_filter_insert(skf, laddr, lp->lp_lport, 0, 0,
                                            lp->lp_protocol, 0);
           if( rc != 0 ) {
@@ -1141,7 +1223,7 @@ __oof_manager_addr_del(struct oof_manager* fm, unsigned laddr, unsigned ifindex)
       /* Remove s/w filters for wild sockets. */
       CI_DLLIST_FOR_EACH2(struct oof_socket, skf, sf_lp_link,
                           &lp->lp_wild_socks)
-        if( oof_socket_is_first_in_same_stack(&lp->lp_wild_socks, skf) )
+        if( oof_socket_is_first_in_same_stack(fm, &lp->lp_wild_socks, skf) )
           oof_cb_sw_filter_remove(skf, laddr, lp->lp_lport, 0, 0,
                                   lp->lp_protocol, 0);
     }
@@ -1487,18 +1569,51 @@ oof_local_port_get(struct oof_manager* fm, int protocol, int lport)
 
 /* This is for fixing sw filters, hence cluster is ignored */
 static struct oof_socket*
-oof_wild_socket_matching_stack(struct oof_local_port* lp,
+oof_wild_socket_matching_stack(struct oof_manager* fm,
+                               struct oof_local_port* lp,
                                struct oof_local_port_addr* lpa,
                                struct tcp_helper_resource_s* stack)
 {
   struct oof_socket* skf;
-  skf = oof_socket_list_find_matching_stack(&lpa->lpa_semi_wild_socks, stack, 0);
+  skf = oof_socket_list_find_matching_stack(fm, &lpa->lpa_semi_wild_socks,
+                                            stack, 0);
   if( skf == NULL )
-    skf = oof_socket_list_find_matching_stack(&lp->lp_wild_socks, stack, 0);
+    skf = oof_socket_list_find_matching_stack(fm, &lp->lp_wild_socks,
+                                              stack, 0);
   return skf;
 }
 
 
+/* Returns the full-match socket on [lpa] after [skf] (or the first if [skf]
+ * is NULL) that might share [lpa_filter].  When the filter points at a
+ * stack only the sockets in that stack can, so we look only at those.
+ */
+static struct oof_socket*
+oof_full_socks_next_sharer(struct oof_manager* fm,
+                           struct oof_local_port_addr* lpa,
+                           struct oof_socket* skf)
+{
+  ci_dllist* list = &lpa->lpa_full_socks;
+  ci_dllist* bucket;
+  ci_dllink* link;
+
+  if( lpa->lpa_filter.trs == NULL ) {
+    link = skf == NULL ? ci_dllist_start(list) : skf->sf_lp_link.next;
+    return link == ci_dllist_end(list) ? NULL :
+           CI_CONTAINER(struct oof_socket, sf_lp_link, link);
+  }
+
+  bucket = &fm->fm_full_socks[oof_socket_hash(list, lpa->lpa_filter.trs)];
+  for( link = skf == NULL ? ci_dllist_start(bucket) : skf->sf_hash_link.next;
+       link != ci_dllist_end(bucket); link = link->next ) {
+    skf = CI_CONTAINER(struct oof_socket, sf_hash_link, link);
+    if( skf->sf_lp_list == list )
+      return skf;
+  }
+  return NULL;
+}
+
+
 static void
 oof_full_socks_del_hw_filters(struct oof_manager* fm,
                               struct oof_local_port* lp,
@@ -1509,8 +1624,8 @@ oof_full_socks_del_hw_filters(struct oof_manager* fm,
   ci_assert(spin_is_locked(&fm->fm_inner_lock));
   ci_assert(mutex_is_locked(&fm->fm_outer_lock));
 
-  CI_DLLIST_FOR_EACH2(struct oof_socket, skf, sf_lp_link,
-                      &lpa->lpa_full_socks) {
+  for( skf = oof_full_socks_next_sharer(fm, lpa, NULL); skf != NULL;
+       skf = oof_full_socks_next_sharer(fm, lpa, skf) ) {
     if( oo_hw_filter_is_empty(&skf->sf_full_match_filter) )
       continue;
     if( ! oof_socket_can_share_hw_filter(skf, &lpa->lpa_filter) )
@@ -1551,8 +1666,8 @@ oof_full_socks_add_hw_filters(struct oof_manager* fm,
    * before dropping the lock. This will prevent oof_socket_del_sw()
    * from full removal of the socket.
    */
-  CI_DLLIST_FOR_EACH2(struct oof_socket, skf, sf_lp_link,
-                      &lpa->lpa_full_socks) {
+  for( skf = oof_full_socks_next_sharer(fm, lpa, NULL); skf != NULL;
+       skf = oof_full_socks_next_sharer(fm, lpa, skf) ) {
     if( ! oo_hw_filter_is_empty(&skf->sf_full_match_filter) )
       continue;
     if( ! oof_socket_can_share_hw_filter(skf, &lpa->lpa_filter) )
@@ -1821,7 +1936,8 @@ __oof_socket_add_wild(struct oof_manager* fm, struct oof_socket* skf,
 
   ci_assert(! oof_socket_is_dummy(skf));
 
-  other_skf = oof_wild_socket_matching_stack(lp, lpa, oof_cb_socket_stack(skf));
+  other_skf = oof_wild_socket_matching_stack(fm, lp, lpa,
+                                             oof_cb_socket_stack(skf));
   if( other_skf != NULL )
     /* Hide sw filter of other socket on the same stack
      *  (likely the wilder one) */
@@ -1882,7 +1998,7 @@ oof_socket_steal_or_add_wild(struct oof_manager* fm, struct oof_socket* skf)
       /* Entry invalid or address disabled. */
       continue;
     lpa = &lp->lp_addr[la_i];
-    if( oof_socket_list_find_matching_stack(&lpa->lpa_semi_wild_socks,
+    if( oof_socket_list_find_matching_stack(fm, &lpa->lpa_semi_wild_socks,
                                             skf_stack, 0) == NULL ) {
       rc = __oof_socket_add_wild(fm, skf, lpa, la->la_laddr);
       if( rc == 0 && ! has_ok )
@@ -1905,9 +2021,13 @@ oof_socket_steal_or_add_wild(struct oof_manager* fm, struct oof_socket* skf)
 
 static int oof_are_cluster_compatible(ci_dllist* list, struct oof_socket* skf)
 {
-  return oof_socket_is_clustered(skf) ?
-         oof_socket_at_head(list, OOF_SOCKET_CLUSTERED |
-                                  OOF_SOCKET_DUMMY, 0) == NULL :
+  /* Dummy sockets are always clustered, so a clustered socket is only
+   * incompatible with a list of unclustered ones, and an unclustered socket
+   * with a clustered list that has a non-dummy socket.
+   */
+  if( oof_socket_is_clustered(skf) )
+    return ci_dllist_is_empty(list) || oof_socket_list_is_clustered(list);
+  return ! oof_socket_list_is_clustered(list) ||
          oof_socket_at_head(list, OOF_SOCKET_DUMMY, OOF_SOCKET_CLUSTERED) == NULL;
 }
 
@@ -1957,7 +2077,7 @@ __oof_socket_add(struct oof_manager* fm, struct oof_socket* skf, int do_arm_only
          */
         IPF_LOG(FSK_FMT IP_FMT" multicast -- not filtered",
                 FSK_PRI_ARGS(skf), IP_ARG(skf->sf_laddr));
-        ci_dllist_push(&fm->fm_mcast_laddr_socks, &skf->sf_lp_link);
+        oof_socket_list_push(NULL, &fm->fm_mcast_laddr_socks, skf);
         return 0;
       }
       ERR_LOG(FSK_FMT "ERROR: laddr="IP_FMT" not local",
@@ -1977,7 +2097,7 @@ __oof_socket_add(struct oof_manager* fm, struct oof_socket* skf, int do_arm_only
         oof_socket_del_full_sw(skf, 1);
         return rc;
       }
-      ci_dllist_push(&lpa->lpa_full_socks, &skf->sf_lp_link);
+      oof_socket_list_push(fm->fm_full_socks, &lpa->lpa_full_socks, skf);
     }
     else {
       if( do_arm ) {
@@ -1985,7 +2105,8 @@ __oof_socket_add(struct oof_manager* fm, struct oof_socket* skf, int do_arm_only
           return -EADDRINUSE;
       }
       if( do_insert ) {
-        rc = oof_socket_insert_probe(&lpa->lpa_semi_wild_socks, skf, thc_out);
+        rc = oof_socket_insert_probe(fm, &lpa->lpa_semi_wild_socks, skf,
+                                     thc_out);
         if( rc < 0 )
           return rc;
       }
@@ -1993,7 +2114,7 @@ __oof_socket_add(struct oof_manager* fm, struct oof_socket* skf, int do_arm_only
         rc = __oof_socket_add_wild(fm, skf, lpa, skf->sf_laddr);
       if( rc < 0 )
         return rc;
-      ci_dllist_push(&lpa->lpa_semi_wild_socks, &skf->sf_lp_link);
+      oof_socket_list_push(fm->fm_wild_socks, &lpa->lpa_semi_wild_socks, skf);
       if( do_arm )
         oof_local_port_addr_fixup_wild(fm, lp, lpa, skf->sf_laddr,
                                        fuw_add_wild);
@@ -2007,7 +2128,7 @@ __oof_socket_add(struct oof_manager* fm, struct oof_socket* skf, int do_arm_only
         return -EADDRINUSE;
     }
     if( do_insert ) {
-      rc = oof_socket_insert_probe(&lp->lp_wild_socks, skf, thc_out);
+      rc = oof_socket_insert_probe(fm, &lp->lp_wild_socks, skf, thc_out);
       if( rc < 0 )
         return rc;
     }
@@ -2015,7 +2136,7 @@ __oof_socket_add(struct oof_manager* fm, struct oof_socket* skf, int do_arm_only
       rc = oof_socket_steal_or_add_wild(fm, skf);
     if( rc < 0 && rc != -EFILTERSSOME )
       return rc;
-    ci_dllist_push(&lp->lp_wild_socks, &skf->sf_lp_link);
+    oof_socket_list_push(fm->fm_wild_socks, &lp->lp_wild_socks, skf);
     if( do_arm )
       oof_local_port_fixup_wild(fm, lp, fuw_add_wild);
   }
@@ -2035,6 +2156,8 @@ __oof_socket_add(struct oof_manager* fm, struct oof_socket* skf, int do_arm_only
 int oof_socket_replace(struct oof_manager* fm,
                        struct oof_socket* old_skf, struct oof_socket* skf)
 {
+  unsigned hash;
+
   mutex_lock(&fm->fm_outer_lock);
   spin_lock_bh(&fm->fm_inner_lock);
 
@@ -2056,8 +2179,14 @@ int oof_socket_replace(struct oof_manager* fm,
   skf->sf_local_port = old_skf->sf_local_port;
   skf->sf_flags = old_skf->sf_flags & ~OOF_SOCKET_NO_STACK;
 
-  /* Do the swap in port/portaddr list */
+  /* Do the swap in port/portaddr list.  [skf] is the only socket in its
+   * stack on the list (see oof_socket_can_update_stack()), so it can go
+   * anywhere in its hash bucket.
+   */
   ci_dllist_insert_after(&old_skf->sf_lp_link, &skf->sf_lp_link);
+  skf->sf_lp_list = old_skf->sf_lp_list;
+  hash = oof_socket_hash(skf->sf_lp_list, oof_cb_socket_stack(skf));
+  ci_dllist_push(&fm->fm_wild_socks[hash], &skf->sf_hash_link);
   oof_socket_remove_from_list(old_skf);
 
   /* mark old socket as empty */
@@ -2101,7 +2230,7 @@ int oof_socket_can_update_stack(struct oof_manager* fm, struct oof_socket* skf,
   }
 
   /* no socket of the same stack, even dummy one */
-  can_add = oof_socket_list_find_matching_stack(list, thr, 1) == NULL;
+  can_add = oof_socket_list_find_matching_stack(fm, list, thr, 1) == NULL;
 
   /* FIXME we could add some assertions to check
    *  * there is no other conflicting socket on list
@@ -2161,6 +2290,7 @@ oof_socket_add(struct oof_manager* fm, struct oof_socket* skf,
 
   ci_assert_equal(lp == NULL, ci_dllink_is_free(&skf->sf_lp_link));
   ci_assert(! dummy || ! do_arm_only);
+  ci_assert(! dummy || clustered);
   ci_assert(lp == NULL || oof_socket_is_dummy(skf));
   ci_assert(dummy || ! no_stack);
 
@@ -2339,7 +2469,7 @@ __oof_socket_share(struct oof_manager* fm, struct oof_socket* skf,
     return rc;
   }
   ++lp->lp_refs;
-  ci_dllist_push(&lpa->lpa_full_socks, &skf->sf_lp_link);
+  oof_socket_list_push(fm->fm_full_socks, &lpa->lpa_full_socks, skf);
   ++la->la_sockets;
   ++lpa->lpa_n_full_sharers;
   return 0;
@@ -2379,7 +2509,7 @@ oof_socket_share(struct oof_manager* fm, struct oof_socket* skf,
 
 
 static void
-__oof_socket_del_wild(struct oof_socket* skf,
+__oof_socket_del_wild(struct oof_manager* fm, struct oof_socket* skf,
                       struct tcp_helper_resource_s* skf_stack,
                       struct oof_local_port_addr* lpa, unsigned laddr)
 {
@@ -2389,7 +2519,7 @@ __oof_socket_del_wild(struct oof_socket* skf,
   ci_assert(! oof_socket_is_dummy(skf));
 
   oof_socket_del_wild_sw(skf, laddr);
-  other_skf = oof_wild_socket_matching_stack(lp, lpa, skf_stack);
+  other_skf = oof_wild_socket_matching_stack(fm, lp, lpa, skf_stack);
   if( other_skf != NULL ) {
     /* Unhide hidden socket on the same stack */
     int rc = oof_cb_sw_filter_insert(other_skf, laddr, lp->lp_lport,
@@ -2406,12 +2536,13 @@ oof_socket_del_semi_wild(struct oof_manager* fm, struct oof_socket* skf,
 {
   int hidden;
 
-  hidden = ! oof_socket_is_first_in_same_stack(&lpa->lpa_semi_wild_socks,
-                                               skf);
+  hidden = ! oof_socket_is_first_in_same_stack(fm,
+                                               &lpa->lpa_semi_wild_socks, skf);
 
   oof_socket_remove_from_list(skf);
   if( ! hidden ) {
-    __oof_socket_del_wild(skf, oof_cb_socket_stack(skf), lpa, skf->sf_laddr);
+    __oof_socket_del_wild(fm, skf, oof_cb_socket_stack(skf), lpa,
+                          skf->sf_laddr);
     oof_local_port_addr_fixup_wild(fm, skf->sf_local_port, lpa,
                                    skf->sf_laddr, fuw_del_wild);
   }
@@ -2427,7 +2558,7 @@ oof_socket_del_wild(struct oof_manager* fm, struct oof_socket* skf)
   struct oof_local_addr* la;
   int hidden, la_i;
 
-  hidden = ! oof_socket_is_first_in_same_stack(&lp->lp_wild_socks, skf);
+  hidden = ! oof_socket_is_first_in_same_stack(fm, &lp->lp_wild_socks, skf);
 
   oof_socket_remove_from_list(skf);
   if( hidden )
@@ -2440,9 +2571,9 @@ oof_socket_del_wild(struct oof_manager* fm, struct oof_socket* skf)
       /* Entry invalid or address disabled. */
       continue;
     lpa = &lp->lp_addr[la_i];
-    if( oof_socket_list_find_matching_stack(&lpa->lpa_semi_wild_socks,
+    if( oof_socket_list_find_matching_stack(fm, &lpa->lpa_semi_wild_socks,
                                             skf_stack, 0) == NULL )
-      __oof_socket_del_wild(skf, skf_stack, lpa, la->la_laddr);
+      __oof_socket_del_wild(fm, skf, skf_stack, lpa, la->la_laddr);
   }
 }
 
@@ -2817,11 +2948,13 @@ oof_udp_connect(struct oof_manager* fm, struct oof_socket* skf,
     la_i_old = oof_manager_addr_find(fm, laddr_old);
     ci_assert(la_i_old >= 0 && la_i_old < fm->fm_local_addr_n);
     lpa = &lp->lp_addr[la_i_old];
-    hidden = ! oof_socket_is_first_in_same_stack(&lpa->lpa_semi_wild_socks,
+    hidden = ! oof_socket_is_first_in_same_stack(fm,
+                                                 &lpa->lpa_semi_wild_socks,
                                                  skf);
     oof_socket_remove_from_list(skf);
     if( ! hidden )
-      __oof_socket_del_wild(skf, oof_cb_socket_stack(skf), lpa, laddr_old);
+      __oof_socket_del_wild(fm, skf, oof_cb_socket_stack(skf), lpa,
+                            laddr_old);
   }
   else {
     oof_socket_del_wild(fm, skf);
@@ -2843,7 +2976,8 @@ oof_udp_connect(struct oof_manager* fm, struct oof_socket* skf,
     oof_hw_filter_clear_full(fm, skf);
     goto unlock_out;
   }
-  ci_dllist_push(&lp->lp_addr[la_i_new].lpa_full_socks, &skf->sf_lp_link);
+  oof_socket_list_push(fm->fm_full_socks,
+                       &lp->lp_addr[la_i_new].lpa_full_socks, skf);
   ++fm->fm_local_addrs[la_i_new].la_sockets;
 
   /* Sort out of the h/w filter(s).  This step may insert a new full-match
@@ -21,8 +21,11 @@
 #include <onload/oof_hw_filter.h>
 
 
-#define OOF_LOCAL_PORT_TBL_SIZE      16
-#define OOF_LOCAL_PORT_TBL_MASK      (OOF_LOCAL_PORT_TBL_SIZE - 1)
+#define OOF_LOCAL_PORT_TBL_LN2       14
+#define OOF_LOCAL_PORT_TBL_SIZE      (1 << OOF_LOCAL_PORT_TBL_LN2)
+
+#define OOF_SOCKET_TBL_LN2           13
+#define OOF_SOCKET_TBL_SIZE          (1 << OOF_SOCKET_TBL_LN2)
 
 struct tcp_helper_resource_s;
 struct oo_hw_filter;
@@ -181,7 +184,18 @@ struct oof_manager {
   /* Size of fm_local_addrs array */
   int          fm_local_addr_max;
 
-  ci_dllist    fm_local_ports[OOF_LOCAL_PORT_TBL_SIZE];
+  /* Hash table of [oof_local_port]s, indexed by lp_hash(). */
+  ci_dllist*   fm_local_ports;
+
+  /* Hash tables of the sockets on [oof_local_port::lp_wild_socks] and
+   * [oof_local_port_addr::lpa_semi_wild_socks], and on
+   * [oof_local_port_addr::lpa_full_socks] respectively, indexed by
+   * oof_socket_hash().  They let us find the sockets on a list that are in
+   * a given stack without walking the whole list, which matters when there
+   * are many sockets using the same local port.
+   */
+  ci_dllist*   fm_wild_socks;
+  ci_dllist*   fm_full_socks;
 
   struct oof_local_addr* fm_local_addrs;
 
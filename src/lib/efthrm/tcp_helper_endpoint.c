@@ -55,6 +55,7 @@ tcp_helper_endpoint_ctor(tcp_helper_endpoint_t *ep,
   ep->n_pinned_pages = 0;
 
   ci_waitable_ctor(&ep->waitq);
+  ep->sleep_cpu = -1;
 
   ep->os_port_keeper = NULL;
   ep->os_socket = NULL;
@@ -397,6 +397,53 @@ efab_ep_filter_set(ci_private_t *priv, void *arg)
   return tcp_helper_endpoint_set_filters(ep, op->bindto_ifindex,
                                          op->from_tcp_id);
 }
+
+
+/*--------------------------------------------------------------------
+ *!
+ * As efab_ep_filter_set(), but for many endpoints in one call, so that a
+ * burst of connects or accepts costs one kernel entry rather than one per
+ * socket.  The ops are copied in and their results out a chunk at a time,
+ * and we reschedule between chunks, as inserting filters can be slow.
+ *
+ * \return  0 if every op was attempted, with each op's result in [rcs],
+ *          else a standard error code for the batch as a whole
+ *
+ *--------------------------------------------------------------------*/
+
+#define FILTER_SET_BATCH_CHUNK  16
+
+static int
+efab_ep_filter_set_batch(ci_private_t *priv, void *arg)
+{
+  oo_tcp_filter_set_batch_t *op = arg;
+  const oo_tcp_filter_set_t __user* u_ops = CI_USER_PTR_GET(op->ops);
+  ci_int32 __user* u_rcs = CI_USER_PTR_GET(op->rcs);
+  oo_tcp_filter_set_t ops[FILTER_SET_BATCH_CHUNK];
+  ci_int32 rcs[FILTER_SET_BATCH_CHUNK];
+  tcp_helper_endpoint_t* ep;
+  int i, n, done;
+
+  if( op->n_ops < 0 || op->n_ops > OO_TCP_FILTER_SET_BATCH_MAX )
+    return -EINVAL;
+
+  for( done = 0; done < op->n_ops; done += n ) {
+    if( done != 0 )
+      cond_resched();
+    n = CI_MIN(op->n_ops - done, FILTER_SET_BATCH_CHUNK);
+    if( copy_from_user(ops, u_ops + done, n * sizeof(ops[0])) )
+      return -EFAULT;
+    for( i = 0; i < n; ++i ) {
+      rcs[i] = efab_ioctl_get_ep(priv, ops[i].tcp_id, &ep);
+      if( rcs[i] == 0 )
+        rcs[i] = tcp_helper_endpoint_set_filters(ep, ops[i].bindto_ifindex,
+                                                 ops[i].from_tcp_id);
+    }
+    if( copy_to_user(u_rcs + done, rcs, n * sizeof(rcs[0])) )
+      return -EFAULT;
+  }
+  return 0;
+}
 static int
 efab_ep_filter_clear(ci_private_t *priv, void *arg)
 {
@@ -1446,5 +1493,6 @@ oo_operations_table_t oo_operations[] = {
   op(OO_IOC_OFE_CONFIG_DONE,    efab_ofe_config_done),
   op(OO_IOC_OFE_GET_LAST_ERROR, efab_ofe_get_last_error),
   op(OO_IOC_GET_CPU_KHZ, oo_get_cpu_khz_rsop),
+  op(OO_IOC_EP_FILTER_SET_BATCH, efab_ep_filter_set_batch),
 #undef op
 };
@@ -1282,6 +1282,38 @@ static void initialise_vi(ci_netif* ni, struct ef_vi* vi, struct efrm_vi* vi_rs,
 }
 
 
+/* Record how a cluster spreads flows across its members, so that
+ * user-level can work out which stack a given flow will land on.
+ */
+static void
+init_nic_rss_state(ci_netif_state_nic_t* nsn, struct efrm_vi_set* vi_set)
+{
+  int mode;
+
+  CI_BUILD_ASSERT(CI_RSS_KEY_LEN == EFRM_RSS_KEY_LEN);
+  CI_BUILD_ASSERT(CI_RSS_TABLE_LEN == EFRM_RSS_TABLE_LEN);
+
+  nsn->rss_n_queues = 0;
+  if( vi_set == NULL )
+    return;
+  mode = efrm_vi_set_get_rss_config(vi_set, EFRM_RSS_MODE_ID_DEFAULT,
+                                    nsn->rss_key, nsn->rss_indir_table);
+  if( mode < 0 )
+    return;
+  /* With transparent proxy the default context hashes on source only,
+   * and connections opened from the stack use a second context that
+   * hashes on destination.  The key and table are the same in each.
+   */
+  nsn->rss_hash_passive = mode == EFRM_RSS_MODE_SRC ?
+    CI_RSS_HASH_SRC : CI_RSS_HASH_SRC | CI_RSS_HASH_DST;
+  nsn->rss_hash_active = nsn->rss_hash_passive;
+  if( efrm_vi_set_get_rss_context(vi_set, EFRM_RSS_MODE_ID_DST) >= 0 )
+    nsn->rss_hash_active = CI_RSS_HASH_DST;
+  nsn->rss_queue = nsn->vi_instance - efrm_vi_set_get_base(vi_set);
+  nsn->rss_n_queues = efrm_vi_set_num_vis(vi_set);
+}
+
+
 static int allocate_vis(tcp_helper_resource_t* trs,
                         ci_resource_onload_alloc_t* alloc,
                         void* vi_state, tcp_helper_cluster_t* thc)
@@ -1393,11 +1425,13 @@ static int allocate_vis(tcp_helper_resource_t* trs,
     nsn->vi_io_mmap_bytes = alloc_info.vi_io_mmap_bytes;
     dev = efrm_vi_get_pci_dev(trs_nic->thn_vi_rs);
     pci_dev_name = pci_name(dev);
+    nsn->numa_node = dev_to_node(&dev->dev);
     pci_dev_put(dev);
     strncpy(nsn->pci_dev, pci_dev_name, sizeof(nsn->pci_dev));
     nsn->pci_dev[sizeof(nsn->pci_dev) - 1] = '\0';
     nsn->vi_instance =
       (ci_uint16) EFAB_VI_RESOURCE_INSTANCE(trs_nic->thn_vi_rs);
+    init_nic_rss_state(nsn, alloc_info.vi_set);
     nsn->vi_arch = (ci_uint8) nic->devtype.arch;
     nsn->vi_variant = (ci_uint8) nic->devtype.variant;
     nsn->vi_revision = (ci_uint8) nic->devtype.revision;
@@ -1529,6 +1563,12 @@ static void release_pkts_pages(struct work_struct *data)
 
   for (i = 0; i < ni->pkt_sets_n; i++)
     oo_iobufset_pages_release(ni->pkt_bufs[i]);
+#ifdef OO_DO_HUGE_PAGES_1G
+  if( trs->pkt_huge_seg != NULL ) {
+    oo_huge_segment_release(trs->pkt_huge_seg);
+    trs->pkt_huge_seg = NULL;
+  }
+#endif
 
   complete(&trs->complete);
 }
@@ -1700,6 +1740,9 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
 #if CI_CFG_PIO
   unsigned pio_bufs_ofs = 0;
 #endif
+#if CI_CFG_TRACE
+  unsigned trace_rec_ofs = 0;
+#endif
 
   OO_DEBUG_SHM(ci_log("%s:", __func__));
 
@@ -1754,9 +1797,17 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   }
 #endif
 
+#if CI_CFG_TRACE
+  /* The flight recorder's ring is only needed if it can be turned on. */
+  if( NI_OPTS(ni).trace ) {
+    trace_rec_ofs = sz = CI_ROUND_UP(sz, CI_CACHE_LINE_SIZE);
+    sz += sizeof(ci_trace_rec) * CI_CFG_TRACE_LEN;
+  }
+#endif
+
   sz = CI_ROUND_UP(sz, CI_PAGE_SIZE);
 
-  rc = ci_contig_shmbuf_alloc(&ni->state_buf, sz);
+  rc = ci_contig_shmbuf_alloc_node(&ni->state_buf, sz, trs->numa_node);
   if( rc < 0 ) {
     OO_DEBUG_ERR(ci_log("tcp_helper_alloc: failed to alloc state_buf (%d)", rc));
     goto fail1;
@@ -1767,7 +1818,7 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
 #ifdef CI_HAVE_OS_NOPAGE
   i = (NI_OPTS(ni).max_ep_bufs + EP_BUF_PER_PAGE - 1) / EP_BUF_PER_PAGE *
     CI_PAGE_SIZE;
-  rc = ci_shmbuf_alloc(&ni->pages_buf, i);
+  rc = ci_shmbuf_alloc(&ni->pages_buf, i, trs->numa_node);
   if( rc < 0 ) {
     OO_DEBUG_ERR(ci_log("tcp_helper_alloc: failed to alloc pages buf (%d)", rc));
     goto fail2;
@@ -1800,9 +1851,15 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   ns->ep_ofs = ni->ep_ofs = sz;
 #if CI_CFG_PIO
   ns->pio_bufs_ofs = pio_bufs_ofs;
+#endif
+#if CI_CFG_TRACE
+  ns->trace.rec_ofs = trace_rec_ofs;
+  ni->trace_rec = trace_rec_ofs ? (void*) ((char*) ns + trace_rec_ofs) : NULL;
 #endif
   ns->n_ep_bufs = 0;
   ns->nic_n = trs->netif.nic_n;
+  ns->mem_numa_node = trs->numa_node;
+  ns->state_numa_node = page_to_nid(vmalloc_to_page(ns));
 
   /* An entry in intf_i_to_hwport should not be touched if the intf does
    * not exist.  Belt-and-braces: initialise to 0.
@@ -1864,6 +1921,7 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
     ci_waitable_ctor(&trs->ready_list_waitqs[i]);
   }
   spin_lock_init(&trs->os_ready_list_lock);
+  trs->interrupt_frc = 0;
 
   return 0;
 
@@ -2435,6 +2493,41 @@ int tcp_helper_rm_alloc_proxy(ci_resource_onload_alloc_t* alloc,
 }
 
 
+/* Choose the NUMA node for a new stack's memory.  By default that is the
+ * node of the first NIC, since the NIC DMAs to and from packet buffers
+ * and reads the descriptor rings on every packet.
+ */
+static int tcp_helper_numa_node(tcp_helper_resource_t* trs)
+{
+  ci_netif* ni = &trs->netif;
+  struct pci_dev* dev;
+  int intf_i, node;
+
+  if( NI_OPTS(ni).numa_node >= 0 ) {
+    if( NI_OPTS(ni).numa_node < MAX_NUMNODES &&
+        node_online(NI_OPTS(ni).numa_node) )
+      return NI_OPTS(ni).numa_node;
+    ci_log("%s: EF_NUMA_NODE=%d is not online; using local node",
+           __FUNCTION__, NI_OPTS(ni).numa_node);
+    return numa_node_id();
+  }
+  if( NI_OPTS(ni).numa_node == -2 )
+    return numa_node_id();
+
+  OO_STACK_FOR_EACH_INTF_I(ni, intf_i) {
+    dev = efhw_nic_get_pci_dev(
+            efrm_client_get_nic(trs->nic[intf_i].thn_oo_nic->efrm_client));
+    if( dev == NULL )
+      continue;
+    node = dev_to_node(&dev->dev);
+    pci_dev_put(dev);
+    if( node >= 0 )
+      return node;
+  }
+  return numa_node_id();
+}
+
+
 int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
                         const ci_netif_config_opts* opts,
                         int ifindices_len, tcp_helper_cluster_t* thc,
@@ -2505,6 +2598,10 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
   ci_netif_config_opts_rangecheck(&ni->opts);
   spin_lock_init(&ni->swf_update_lock);
   ni->swf_update_last =  ni->swf_update_first = NULL;
+  rs->numa_node = tcp_helper_numa_node(rs);
+#ifdef OO_DO_HUGE_PAGES_1G
+  rs->pkt_huge_seg = NULL;
+#endif
 
   /* Allocate buffers for shared state, etc. */
   rc = allocate_netif_resources(alloc, rs);
@@ -4154,8 +4251,29 @@ efab_tcp_helper_iobufset_alloc(tcp_helper_resource_t* trs,
       flags |= NI_OPTS(ni).huge_pages;
 #endif
   }
+#ifdef OO_DO_HUGE_PAGES_1G
+  /* A 1GB page is only worth taking if we can use most of it: either the
+   * current one has slices left, or there is room for all of a new one.
+   */
+  if( ni->flags & CI_NETIF_FLAG_HUGE_PAGES_1G_FAILED )
+    flags |= OO_IOBUFSET_FLAG_HUGE_PAGE_1G_FAILED;
+  else if( NI_OPTS(ni).huge_pages_1g &&
+           (flags & (OO_IOBUFSET_FLAG_HUGE_PAGE_TRY |
+                     OO_IOBUFSET_FLAG_HUGE_PAGE_FORCE)) &&
+           ((trs->pkt_huge_seg != NULL &&
+             oo_huge_segment_n_free(trs->pkt_huge_seg) > 0) ||
+            ni->pkt_sets_max - ni->pkt_sets_n >=
+            (1 << (OO_HUGE_SEG_SHIFT - HPAGE_SHIFT))) )
+    flags |= OO_IOBUFSET_FLAG_HUGE_PAGE_1G;
+#endif
+#endif
+  rc = oo_iobufset_pages_alloc(HW_PAGES_PER_SET_S, trs->numa_node, &flags,
+#ifdef OO_DO_HUGE_PAGES_1G
+                               &trs->pkt_huge_seg,
+#else
+                               NULL,
 #endif
-  rc = oo_iobufset_pages_alloc(HW_PAGES_PER_SET_S, &flags, &pages);
+                               &pages);
   if( rc != 0 )
     return rc;
 #if CI_CFG_PKTS_AS_HUGE_PAGES
@@ -4167,6 +4285,15 @@ efab_tcp_helper_iobufset_alloc(tcp_helper_resource_t* trs,
       ni->flags |= CI_NETIF_FLAG_HUGE_PAGES_FAILED;
     }
 #endif
+#ifdef OO_DO_HUGE_PAGES_1G
+    if( (flags & OO_IOBUFSET_FLAG_HUGE_PAGE_1G_FAILED) &&
+        !(ni->flags & CI_NETIF_FLAG_HUGE_PAGES_1G_FAILED) ) {
+      NI_LOG(ni, RESOURCE_WARNINGS,
+             "[%s]: unable to allocate 1GB huge page, using 2MB pages instead",
+             ni->state->pretty_name);
+      ni->flags |= CI_NETIF_FLAG_HUGE_PAGES_1G_FAILED;
+    }
+#endif
 
   OO_STACK_FOR_EACH_INTF_I(ni, intf_i) {
     struct efrm_pd *pd = efrm_vi_get_pd(trs->nic[intf_i].thn_vi_rs);
@@ -4310,9 +4437,12 @@ efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
   ni->packets->set[bufset_id].n_free = PKTS_PER_SET;
 #ifdef OO_DO_HUGE_PAGES
   ni->packets->set[bufset_id].shm_id = oo_iobufset_get_shmid(pages);
+  ni->packets->set[bufset_id].shm_offset = oo_iobufset_get_shm_offset(pages);
 #else
   ni->packets->set[bufset_id].shm_id = -1;
 #endif
+  ni->packets->set[bufset_id].page_shift = oo_iobufset_page_shift(pages);
+  ni->packets->set[bufset_id].numa_node = oo_iobufset_numa_node(pages);
   ni->packets->n_free += PKTS_PER_SET;
 
   /* Initialise the new buffers. */
@@ -4551,10 +4681,64 @@ tcp_helper_rm_dump(int fd_type, oo_sp sock_id,
  *
  *--------------------------------------------------------------------*/
 
+/* Poll the stack from an interrupt on [intf_i], with the stack locked.
+ * With EF_INT_WAKE_BATCH the poll is done in batches, so that threads
+ * waiting for the first events are woken without waiting for the rest to
+ * be processed, and we stop once a thread has been woken because that
+ * thread will poll the rest.  [*stopped] is set if we stopped with events
+ * left, in which case the caller must prime the interfaces that have them
+ * in case the woken thread does not get to them.
+ */
+static int tcp_helper_interrupt_poll(tcp_helper_resource_t* trs, int intf_i,
+                                     int budget, int* stopped)
+{
+  ci_netif* ni = &trs->netif;
+  int batch = NI_OPTS(ni).int_wake_batch;
+  int n = 0, n_batch;
+
+  *stopped = 0;
+  trs->interrupt_frc = trs->nic[intf_i].thn_interrupt_frc;
+  if( batch == 0 || batch >= budget ) {
+    n = ci_netif_poll_n(ni, budget);
+  }
+  else {
+    do {
+      n_batch = ci_netif_poll_n(ni, CI_MIN(batch, budget - n));
+      n += n_batch;
+      if( ni->state->poll_did_wake ) {
+        if( n < budget && ci_netif_has_event(ni) ) {
+          CITP_STATS_NETIF_INC(ni, interrupt_batch_stops);
+          *stopped = 1;
+        }
+        break;
+      }
+    } while( n_batch > 0 && n < budget );
+  }
+  trs->interrupt_frc = 0;
+  return n;
+}
+
+
+/* Prime the interfaces that still have events after
+ * tcp_helper_interrupt_poll() stopped early.
+ */
+static void tcp_helper_prime_stopped(tcp_helper_resource_t* trs)
+{
+  int intf_i;
+  OO_STACK_FOR_EACH_INTF_I(&trs->netif, intf_i)
+    if( ci_netif_intf_has_event(&trs->netif, intf_i) ) {
+      if( NI_OPTS_TRS(trs).int_driven )
+        tcp_helper_request_wakeup_nic(trs, intf_i);
+      else
+        tcp_helper_request_wakeup_nic_if_needed(trs, intf_i);
+    }
+}
+
+
 static int tcp_helper_wakeup(tcp_helper_resource_t* trs, int intf_i, int budget)
 {
   ci_netif* ni = &trs->netif;
-  int n = 0, prime_async;
+  int n = 0, prime_async, stopped = 0;
 
   TCP_HELPER_RESOURCE_ASSERT_VALID(trs, -1);
   OO_DEBUG_RES(ci_log(FN_FMT, FN_PRI_ARGS(ni)));
@@ -4570,7 +4754,7 @@ static int tcp_helper_wakeup(tcp_helper_resource_t* trs, int intf_i, int budget)
     if( efab_tcp_helper_netif_try_lock(trs, 1) ) {
       CITP_STATS_NETIF(++ni->state->stats.interrupt_polls);
       ni->state->poll_did_wake = 0;
-      n = ci_netif_poll_n(ni, budget);
+      n = tcp_helper_interrupt_poll(trs, intf_i, budget, &stopped);
       CITP_STATS_NETIF_ADD(ni, interrupt_evs, n);
       trs->netif.state->interrupt_numa_nodes |= 1 << numa_node_id();
 
@@ -4586,8 +4770,12 @@ static int tcp_helper_wakeup(tcp_helper_resource_t* trs, int intf_i, int budget)
         return n;
       }
 
+      /* A woken thread will poll the stack, so there is no need to
+       * reprime, unless we stopped early and left events for it.
+       */
       if( ni->state->poll_did_wake ) {
-        prime_async = 0;
+        if( ! stopped )
+          prime_async = 0;
         CITP_STATS_NETIF_INC(ni, interrupt_wakes);
       }
       efab_tcp_helper_netif_unlock(trs, 1);
@@ -4608,6 +4796,8 @@ static int tcp_helper_wakeup(tcp_helper_resource_t* trs, int intf_i, int budget)
 
   if( prime_async && tcp_helper_reprime_is_needed(ni) ) {
     tcp_helper_request_wakeup_nic_if_needed(trs, intf_i);
+    if( stopped )
+      tcp_helper_prime_stopped(trs);
     CITP_STATS_NETIF_INC(ni, interrupt_primes);
   }
 
@@ -4672,6 +4862,7 @@ static int oo_handle_wakeup_or_timeout(void* context, int is_timeout,
 {
   struct tcp_helper_nic* tcph_nic = context;
   tcp_helper_resource_t* trs;
+  int n;
   trs = CI_CONTAINER(tcp_helper_resource_t, nic[tcph_nic->thn_intf_i],
                      tcph_nic);
   if( trs->trs_aflags & OO_THR_AFLAG_POLL_AND_PRIME ) {
@@ -4681,34 +4872,25 @@ static int oo_handle_wakeup_or_timeout(void* context, int is_timeout,
     return 0;
   }
 
-  if( ! CI_CFG_HW_TIMER || ! is_timeout )
-    return tcp_helper_wakeup(trs, tcph_nic->thn_intf_i, budget);
+  if( ! CI_CFG_HW_TIMER || ! is_timeout ) {
+    ci_frc64(&tcph_nic->thn_interrupt_frc);
+    n = tcp_helper_wakeup(trs, tcph_nic->thn_intf_i, budget);
+    tcph_nic->thn_interrupt_frc = 0;
+    return n;
+  }
   else
     return tcp_helper_timeout(trs, tcph_nic->thn_intf_i, budget);
 }
 
 
 
-static int oo_handle_wakeup_int_driven(void* context, int is_timeout,
-                                        struct efhw_nic* nic_, int budget)
+static int __oo_handle_wakeup_int_driven(tcp_helper_resource_t* trs,
+                                         struct tcp_helper_nic* tcph_nic,
+                                         int budget)
 {
-  struct tcp_helper_nic* tcph_nic = context;
-  tcp_helper_resource_t* trs;
-  ci_netif* ni;
-  int n = 0;
-
-  trs = CI_CONTAINER(tcp_helper_resource_t, nic[tcph_nic->thn_intf_i],
-                     tcph_nic);
-  if( trs->trs_aflags & OO_THR_AFLAG_POLL_AND_PRIME ) {
-    /* OO_THR_AFLAG_POLL_AND_PRIME is set - i.e. in some sense the
-     * previous interrupt handler is already running.
-     * Workqueue will handle new events if any and will prime if needed. */
-    return 0;
-  }
-
-  ni = &trs->netif;
+  ci_netif* ni = &trs->netif;
+  int n = 0, stopped;
 
-  ci_assert( ! is_timeout );
   TCP_HELPER_RESOURCE_ASSERT_VALID(trs, -1);
   CITP_STATS_NETIF_INC(ni, interrupts);
 
@@ -4721,7 +4903,8 @@ static int oo_handle_wakeup_int_driven(void* context, int is_timeout,
         CITP_STATS_NETIF(++ni->state->stats.interrupt_polls);
         ci_assert( ni->flags & CI_NETIF_FLAG_IN_DL_CONTEXT);
         ni->state->poll_did_wake = 0;
-        n = ci_netif_poll_n(ni, budget);
+        n = tcp_helper_interrupt_poll(trs, tcph_nic->thn_intf_i, budget,
+                                      &stopped);
         CITP_STATS_NETIF_ADD(ni, interrupt_evs, n);
         if( ni->state->poll_did_wake )
           CITP_STATS_NETIF_INC(ni, interrupt_wakes);
@@ -4736,6 +4919,8 @@ static int oo_handle_wakeup_int_driven(void* context, int is_timeout,
           return n;
         }
         tcp_helper_request_wakeup_nic(trs, tcph_nic->thn_intf_i);
+        if( stopped )
+          tcp_helper_prime_stopped(trs);
         efab_tcp_helper_netif_unlock(trs, 1);
         break;
       }
@@ -4785,6 +4970,30 @@ static int oo_handle_wakeup_int_driven(void* context, int is_timeout,
 }
 
 
+static int oo_handle_wakeup_int_driven(void* context, int is_timeout,
+                                        struct efhw_nic* nic_, int budget)
+{
+  struct tcp_helper_nic* tcph_nic = context;
+  tcp_helper_resource_t* trs;
+  int n;
+
+  trs = CI_CONTAINER(tcp_helper_resource_t, nic[tcph_nic->thn_intf_i],
+                     tcph_nic);
+  if( trs->trs_aflags & OO_THR_AFLAG_POLL_AND_PRIME ) {
+    /* OO_THR_AFLAG_POLL_AND_PRIME is set - i.e. in some sense the
+     * previous interrupt handler is already running.
+     * Workqueue will handle new events if any and will prime if needed. */
+    return 0;
+  }
+
+  ci_assert( ! is_timeout );
+  ci_frc64(&tcph_nic->thn_interrupt_frc);
+  n = __oo_handle_wakeup_int_driven(trs, tcph_nic, budget);
+  tcph_nic->thn_interrupt_frc = 0;
+  return n;
+}
+
+
 /*--------------------------------------------------------------------
  *!
  * TCP helper timer implementation 
@@ -4795,25 +5004,87 @@ static int oo_handle_wakeup_int_driven(void* context, int is_timeout,
 
 
 static void
-linux_set_periodic_timer_restart(tcp_helper_resource_t* rs) 
+linux_set_periodic_timer_restart(tcp_helper_resource_t* rs, unsigned long t)
 {
-  unsigned long t = ci_net_random() % CI_TCP_HELPER_PERIODIC_FLOAT_T;
+  t += ci_net_random() % CI_TCP_HELPER_PERIODIC_FLOAT_T;
 
   if (atomic_read(&rs->timer_running) == 0) 
     return;
 
-  queue_delayed_work(rs->wq, &rs->timer, CI_TCP_HELPER_PERIODIC_BASE_T + t);
+  queue_delayed_work(rs->wq, &rs->timer, t);
+}
+
+/* May the periodic timer of [ni] sleep until its next timer is due when the
+ * stack is idle?  Only if network events will raise an interrupt, as
+ * otherwise the periodic timer is what notices them.
+ */
+static int
+linux_tcp_timer_may_idle(ci_netif* ni)
+{
+  return NI_OPTS(ni).periodic_timer_max_msec != 0 &&
+         (NI_OPTS(ni).int_driven || NI_OPTS(ni).timer_usec != 0);
+}
+
+/* Returns how long the periodic timer of an idle stack can sleep: until its
+ * earliest pending timer is due, but for no less than the usual period and
+ * no more than EF_PERIODIC_TIMER_MAX_MSEC.  The stack must be locked.
+ */
+static unsigned long
+linux_tcp_timer_idle_delay(tcp_helper_resource_t* rs)
+{
+  ci_netif* ni = &rs->netif;
+  ci_iptime_t now, next, wake, base;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  now = ci_ip_time_now(ni);
+  base = ci_ip_time_ms2ticks_slow(ni,
+                          jiffies_to_msecs(CI_TCP_HELPER_PERIODIC_BASE_T));
+  wake = now + ci_ip_time_ms2ticks_slow(ni,
+                                        NI_OPTS(ni).periodic_timer_max_msec);
+  if( ci_ip_timer_next_expiry(ni, &next) && TIME_LT(next, wake) )
+    wake = next;
+  if( TIME_LT(wake, now + base) )
+    wake = now + base;
+
+  /* We'd have run within one usual period of anything due before this
+   * anyway, so only timers due sooner need us to re-arm.
+   */
+  ni->state->periodic_rearm_ticks = wake - base;
+
+  return usecs_to_jiffies(oo_cycles64_to_usec(ni, (ci_uint64) (wake - now) <<
+                                     IPTIMER_STATE(ni)->ci_ip_time_frc2tick));
 }
 
+/* A timer has been set on [rs] that is due well before the periodic timer
+ * will next run, so bring the periodic timer forward.  The stack must be
+ * locked.
+ */
 static void
+tcp_helper_periodic_timer_rearm(tcp_helper_resource_t* rs)
+{
+  unsigned long t = linux_tcp_timer_idle_delay(rs);
+
+  if( atomic_read(&rs->timer_running) == 0 )
+    return;
+
+  CITP_STATS_NETIF_INC(&rs->netif, periodic_rearms);
+  cancel_delayed_work(&rs->timer);
+  queue_delayed_work(rs->wq, &rs->timer, t);
+}
+
+/* Returns the delay until the periodic timer should run again. */
+static unsigned long
 linux_tcp_timer_do(tcp_helper_resource_t* rs)
 {
   ci_netif* ni = &rs->netif;
+  unsigned long t = CI_TCP_HELPER_PERIODIC_BASE_T;
   ci_uint64 now_frc;
-  int rc;
+  int rc, idle = 0;
 
   TCP_HELPER_RESOURCE_ASSERT_VALID(rs, -1);
   OO_DEBUG_VERB(ci_log("%s: running", __FUNCTION__));
+  CITP_STATS_NETIF_INC(ni, periodic_wakeups);
 
   oo_timesync_update(CICP_HANDLE(ni));
 
@@ -4826,15 +5097,30 @@ linux_tcp_timer_do(tcp_helper_resource_t* rs)
       ni->state->timer_prime_cycles * 5 ) {
     if( efab_tcp_helper_netif_try_lock(rs, 0) ) {
       rc = ci_netif_poll(ni);
+      /* Nothing doing, so sleep until the next timer is due. */
+      if( rc == 0 && linux_tcp_timer_may_idle(ni) ) {
+        t = linux_tcp_timer_idle_delay(rs);
+        idle = 1;
+      }
       efab_tcp_helper_netif_unlock(rs, 0);
       CITP_STATS_NETIF_INC(ni, periodic_polls);
       if( rc > 0 )
         CITP_STATS_NETIF_ADD(ni, periodic_evs, rc);
+      /* linux_tcp_timer_idle_delay() has set periodic_rearm_ticks. */
+      if( idle )
+        return t;
     }
     else {
       CITP_STATS_NETIF_INC(ni, periodic_lock_contends);
     }
   }
+
+  /* We'll be back within the usual period, so no timer needs us to
+   * re-arm.
+   */
+  if( NI_OPTS(ni).periodic_timer_max_msec != 0 )
+    ni->state->periodic_rearm_ticks = ci_ip_time_now(ni);
+  return t;
 }
 
 static void
@@ -4851,8 +5137,7 @@ linux_tcp_helper_periodic_timer(struct work_struct *work)
 
   OO_DEBUG_VERB(ci_log("linux_tcp_helper_periodic_timer: fired"));
 
-  linux_tcp_timer_do(rs);
-  linux_set_periodic_timer_restart(rs);
+  linux_set_periodic_timer_restart(rs, linux_tcp_timer_do(rs));
 }
 
 static void
@@ -4862,7 +5147,7 @@ tcp_helper_initialize_and_start_periodic_timer(tcp_helper_resource_t* rs)
 
   INIT_DELAYED_WORK(&rs->timer, linux_tcp_helper_periodic_timer);
 
-  linux_set_periodic_timer_restart(rs);
+  linux_set_periodic_timer_restart(rs, CI_TCP_HELPER_PERIODIC_BASE_T);
 }
 
 
@@ -5192,9 +5477,21 @@ void tcp_helper_endpoint_wakeup(tcp_helper_resource_t* thr,
   int wq_active;
   w->wake_request = 0;
   wq_active = ci_waitable_active(&ep->waitq);
-  ci_waitable_wakeup_all(&ep->waitq);
+  if( w->state == CI_TCP_LISTEN &&
+      NI_OPTS(&thr->netif).accept_wake_exclusive ) {
+    /* Threads in accept() sleep exclusively, so wake one per connection. */
+    ci_tcp_socket_listen* tls = SP_TO_TCP_LISTEN(&thr->netif, ep->id);
+    ci_waitable_wakeup_nr(&ep->waitq, CI_MAX((int) ci_tcp_acceptq_n(tls), 1));
+  }
+  else {
+    ci_waitable_wakeup_all(&ep->waitq);
+  }
   if( wq_active ) {
     thr->netif.state->poll_did_wake = 1;
+    int sleep_cpu = OO_ACCESS_ONCE(ep->sleep_cpu);
+    OO_ACCESS_ONCE(ep->wake_frc) = thr->interrupt_frc;
+    if( sleep_cpu >= 0 && sleep_cpu != raw_smp_processor_id() )
+      CITP_STATS_NETIF_INC(&thr->netif, sock_wakes_remote_cpu);
     if( w->sb_flags & CI_SB_FLAG_WAKE_RX )
       CITP_STATS_NETIF_INC(&thr->netif, sock_wakes_rx);
     if( w->sb_flags & CI_SB_FLAG_WAKE_TX )
@@ -5461,6 +5758,9 @@ efab_tcp_helper_netif_lock_callback(eplock_helper_t* epl, ci_uint64 lock_val,
     if( flags_set & CI_EPLOCK_NETIF_PURGE_TXQS )
       tcp_helper_purge_txq_locked(thr);
 
+    if( flags_set & CI_EPLOCK_NETIF_PERIODIC_REARM )
+      tcp_helper_periodic_timer_rearm(thr);
+
     /* IN_DL_CONTEXT flag should be removed under the stack lock - so we
      * remove it inside the "while" loop here and set back if necessary at
      * the beginning of the loop. */
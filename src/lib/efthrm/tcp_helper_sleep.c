@@ -38,11 +38,22 @@ sock_sleep__on_wakeup(ci_waiter_t* waiter, void* opaque_trs,
   tcp_helper_resource_t* trs = (tcp_helper_resource_t*) opaque_trs;
   oo_tcp_sock_sleep_t* op = (oo_tcp_sock_sleep_t*) opaque_op;
   tcp_helper_endpoint_t* ep = ci_trs_ep_get(trs, op->sock_id);
+  ci_uint64 wake_frc;
 
   if( rc == -ETIMEDOUT )  rc = -EAGAIN;
 
   ci_waiter_post(waiter, &ep->waitq);
 
+  /* A waker may be storing a new [wake_frc] as we take this one. */
+  wake_frc = OO_ACCESS_ONCE(ep->wake_frc);
+  if( wake_frc != 0 && ci_cas64u_succeed(&ep->wake_frc, wake_frc, 0) ) {
+#if CI_CFG_STATS_NETIF
+    ci_uint64 now_frc;
+    ci_frc64(&now_frc);
+    ci_lat_hist_stage_add(&trs->netif.state->wake_lat, now_frc - wake_frc);
+#endif
+  }
+
   if( rc == 0 && (op->lock_flags & CI_SLEEP_NETIF_RQ) )
     if( ! (trs->netif.state->lock.lock & CI_EPLOCK_UNLOCKED) ) {
       rc = efab_eplock_lock_wait(&trs->netif
@@ -122,10 +133,18 @@ efab_tcp_helper_sock_sleep(tcp_helper_resource_t* trs,
       return -EBUSY;
   }
 
-  /* Put ourselves on the wait queue to avoid races. */
-  rc = ci_waiter_pre(&waiter, &ep->waitq
-		     CI_BLOCKING_CTX_ARG(bc));
+  /* Put ourselves on the wait queue to avoid races.  Threads waiting to
+   * accept are woken one per connection if EF_ACCEPT_WAKE_EXCLUSIVE.
+   */
+  if( w->state == CI_TCP_LISTEN && (op->why & CI_SB_FLAG_WAKE_RX) &&
+      NI_OPTS(ni).accept_wake_exclusive )
+    rc = ci_waiter_exclusive_pre(&waiter, &ep->waitq
+                                 CI_BLOCKING_CTX_ARG(bc));
+  else
+    rc = ci_waiter_pre(&waiter, &ep->waitq
+                       CI_BLOCKING_CTX_ARG(bc));
   if( rc )  return rc;
+  OO_ACCESS_ONCE(ep->sleep_cpu) = raw_smp_processor_id();
 
   /* Set [wake_needed] so stack knows to wake us up. */
   if( op->why & CI_SB_FLAG_WAKE_RX )
@@ -248,3 +248,37 @@ onload_get_tcp_info(int fd, struct onload_tcp_info* info, int* len_in_out)
   return -1;
 }
 
+__attribute__((weak))
+int
+onload_cluster_stack_index(int fd, int* cluster_size_out)
+{
+  errno = EINVAL;
+  return -1;
+}
+
+__attribute__((weak))
+int
+onload_cluster_tuple_index(int fd, const struct onload_cluster_tuple* tuples,
+                           int n_tuples, int* indices_out, unsigned flags)
+{
+  errno = EINVAL;
+  return -1;
+}
+
+__attribute__((weak))
+int
+onload_cluster_bind_for_connect(int fd, const struct sockaddr_in* laddr,
+                                const struct sockaddr_in* raddr)
+{
+  errno = EINVAL;
+  return -1;
+}
+
+__attribute__((weak))
+int
+onload_stack_warm(int fd, unsigned flags, struct onload_warm_stats* stats)
+{
+  errno = EINVAL;
+  return -1;
+}
+
@@ -191,3 +191,18 @@ wrap( int,  oo_raw_send,
 wrap( int,  onload_get_tcp_info,
       (int fd, struct onload_tcp_info* info, int* len),
       (fd, info, len), -ENOSYS)
+
+wrap( int,  onload_cluster_stack_index, (int fd, int* cluster_size_out),
+      (fd, cluster_size_out), -ENOSYS)
+wrap( int,  onload_cluster_tuple_index,
+      (int fd, const struct onload_cluster_tuple* tuples, int n_tuples,
+       int* indices_out, unsigned flags),
+      (fd, tuples, n_tuples, indices_out, flags), -ENOSYS)
+wrap( int,  onload_cluster_bind_for_connect,
+      (int fd, const struct sockaddr_in* laddr,
+       const struct sockaddr_in* raddr),
+      (fd, laddr, raddr), -ENOSYS)
+
+wrap( int,  onload_stack_warm,
+      (int fd, unsigned flags, struct onload_warm_stats* stats),
+      (fd, flags, stats), -ENOSYS)
@@ -279,6 +279,21 @@ void citp_cmn_netif_init_ctor(unsigned netif_dtor_mode)
 }
 
 
+/* If we shouldn't destruct private netifs at user-level add an extra
+** 'destruct protect' reference to a newly allocated [ni] to prevent it
+** happening.
+*/
+static void citp_netif_dtor_protect(ci_netif* ni)
+{
+  if( citp_netif_dtor_mode == CITP_NETIF_DTOR_ONLY_SHARED ) {
+    citp_netif_add_ref(ni);
+    ni->flags |= CI_NETIF_FLAGS_DTOR_PROTECTED;
+  }
+  else if( citp_netif_dtor_mode == CITP_NETIF_DTOR_NONE )
+    citp_netif_add_ref(ni);
+}
+
+
 /* Common netif initialiser.  
  * \param IN fd file descriptor
  * \param OUT netif constructed
@@ -341,16 +356,7 @@ int citp_netif_alloc_and_init(ef_driver_handle* fd, ci_netif** out_ni)
       goto fail;
     } 
 
-    /* If we shouldn't destruct private netifs at user-level add an extra
-    ** 'destruct protect' reference to prevent it happening.
-    */
-    if( citp_netif_dtor_mode == CITP_NETIF_DTOR_ONLY_SHARED ) {
-      citp_netif_add_ref(ni);
-      ni->flags |= CI_NETIF_FLAGS_DTOR_PROTECTED;
-    }
-    else if( citp_netif_dtor_mode == CITP_NETIF_DTOR_NONE )
-      citp_netif_add_ref(ni);
-
+    citp_netif_dtor_protect(ni);
     VERB(ci_log("%s: constructed NI %d", __FUNCTION__, NI_ID(ni)));
   }
 
@@ -372,6 +378,49 @@ int citp_netif_alloc_and_init(ef_driver_handle* fd, ci_netif** out_ni)
 }
 
 
+/* Find or create the calling thread's stack in the process's cluster
+ * (EF_CLUSTER_NAME), creating the cluster too if needed.  [*stack_id] is
+ * one more than the id of the cluster stack the thread used before, or 0,
+ * and is updated.  As citp_netif_alloc_and_init(), the stack is returned
+ * with a reference for the endpoint that is to be moved into it.
+ */
+int citp_netif_cluster_alloc_and_init(ef_driver_handle* fd, ci_netif** out_ni,
+                                      int* stack_id)
+{
+  ci_netif* ni = NULL;
+  int rc;
+
+  ci_assert( citp_netifs_inited );
+  ci_assert( fd );
+  ci_assert( out_ni );
+
+  CITP_FDTABLE_LOCK();
+  if( *stack_id != 0 )
+    ni = citp_find_ul_netif(*stack_id - 1, 1);
+  if( ni == NULL ) {
+    rc = __citp_netif_alloc(fd, "",
+                            CI_NETIF_FLAG_DO_ALLOCATE_SCALABLE_FILTERS_RSS,
+                            &ni);
+    if( rc < 0 ) {
+      Log_E(ci_log("%s: failed to create cluster netif (%d)",
+                   __FUNCTION__, -rc));
+      CITP_FDTABLE_UNLOCK();
+      errno = -rc;
+      return rc;
+    }
+    citp_netif_dtor_protect(ni);
+    *stack_id = NI_ID(ni) + 1;
+    VERB(ci_log("%s: constructed NI %d", __FUNCTION__, NI_ID(ni)));
+  }
+  citp_netif_add_ref(ni);
+  CITP_FDTABLE_UNLOCK();
+  CI_MAGIC_CHECK(ni, NETIF_MAGIC);
+  *fd = ci_netif_get_driver_handle(ni);
+  *out_ni = ni;
+  return 0;
+}
+
+
 /* Recreate a netif for a 'probed' user-level endpoint, must already hold
 ** the writer lock to the FD table. caller_fd is the fd of the ep that is
 ** associated with the netif to be recreated.
@@ -84,6 +84,15 @@
 # include <onload/cplane.h>
 #endif
 
+/* Compare a MAC table bucket's tags with SSE2 where we can; the kernel
+ * can't use vector registers here so uses the portable version. */
+#if !defined(__ci_driver__) && defined(__SSE2__)
+# include <emmintrin.h>
+# define CICP_MAC_BUCKET_SSE2 1
+#else
+# define CICP_MAC_BUCKET_SSE2 0
+#endif
+
 
 
 #ifndef TRUE
@@ -215,154 +224,100 @@
 
 
 
-/*! This number defines the number of hash table entries that will be
- *  searched to find a match.  A maximum of CICP_MAC_HASHMAX entries
- *  will be searched.  Note that this number of entries may have to be
- *  searched whether a match is found or not because
- *  former intermediate collisions may have been deleted from the table.
- *
- *  Note that with a perfect hash/rehash the chances of clashing when the table
- *  is "2^-o" percent occupied is 2^-o.  The probability of clashing n times is
- *  2^(-no). If we want to keep this probability low, say lower than 2^-p, we
- *  need to ensure that 2^(-no) <= 2^-p,
- *                     =>   -no <= -p,
- *                     =>     o > p/n
- *
- *  The occupancy of the table depends on its size and the number of used
- *  entries, u:   2^-o = u/2^s
- *                2^(s-o) = u
- *                o = s - ln2(u)
- *
- *  If o > p/n then ideally the size, 2^s, will be such that
- *         s - ln2(u) > p/CICP_MAC_HASHMAX
- *  =>     s - p/CICP_MAC_HASHMAX > ln2(u)
- *  =>     u < 2^(s - p/CICP_MAC_HASHMAX)
- *
- *  In principle we can work out p/CICP_MAC_HASHMAX once (e.g. for a
- *  one-in-a million failure p=20 with a maximum of 8 rehashes this would be
- *  20/8 = 2.5 which we would round up to the next integer 3). We would
- *  re-evaluate this condition on each addition to the table, doubling the size
- *  of the table (increasing s by one) every time it is found to be false.
- *
- *  Actually, now that we employ reference counts in the entries, it is less
- *  important that this number be small - since a search will now be stopped
- *  by an unused entry.
- */
-#define CICP_MAC_HASHMAX 500
-/*  A value of 20 allows a 1K entry table to grow to 2^9 = 512 entries
- *  maintaining a failure probability of 2^-20
- */
-
-
-
-
-/*! Generate a rows_ln2-bit hash of an IP address
- *
- *  This function tries to ensure that, roughly speaking, there is as much
- *  dependence of the hash value on all parts of the IP address as possible
- *  whatever the size of the hash.
+/*! Generate a 32-bit hash of an IP address and ifindex
  *
  *  Note that it is very likely that all of the addresses submitted to this
  *  function belong to the same one or two subnets (since all addresses are
- *  next hops), so it is much more important to make use of variability in the
- *  bottom bits than in the top ones.
+ *  next hops), so every bit of the result should depend on the bottom bits
+ *  of the address.  The low bits select a bucket, and the top seven bits
+ *  form the tag.
  */
-ci_inline cicp_mac_rowid_t
-cicp_mac_hash(int rows_ln2, ci_uint32 ip_hash32, ci_ifid_t ifindex)
-{   ci_uint32 hash = ip_hash32 ^ (ip_hash32 >> 16) ^ ifindex;
-    hash = hash ^ (hash >> 8);
-    /* This hash value has contributions from all four bytes in the bottom
-       byte, and both 16-bit values in the bottom 16-bits
-    */
-    DEBUGMACHASH(DPRINTF(CODEID": %02d %08X #%x",
-			 ifindex, ip_hash32, hash & ((1<<rows_ln2) - 1));)
-    return hash & ((1<<rows_ln2) - 1);
+ci_inline ci_uint32
+cicp_mac_hash(ci_ip_addr_t ip, ci_ifid_t ifindex)
+{   ci_uint32 hash = CI_IP_ADDR_HASH32(&ip) ^ ((ci_uint32) ifindex << 16);
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    DEBUGMACHASH(DPRINTF(CODEID": %02d "CI_IP_PRINTF_FORMAT" #%08x",
+			 ifindex, CI_IP_PRINTF_ARGS(&ip), hash);)
+    return hash;
 }
 
 
-
-
-#ifndef ci_rot_r
-ci_inline int ci_rot_r(ci_uint32 i, int n)
-{   /* I bet the processor has a more efficient way of doing a 32-bit right
-       rotate!
-    */
-    n = n & 0x1f;
-    return (i >> n) | (i << (32-n));
+ci_inline unsigned
+cicp_mac_hash_tag(ci_uint32 hash)
+{   return CICP_MAC_TAG_FULL | (hash >> 25);
 }
-#endif
-
-
-
 
 
-ci_inline cicp_mac_rowid_t
-cicp_mac_rehash(int rows_ln2, ci_uint32 ip_hash32, ci_ifid_t ifindex,
-		int iteration)
-{   /* We hope we get a result on the first hash and that this function
-       won't be called so often as the initial hash.
-       There is probably more variability in the lower order bits of
-       the IP address so it might be best to ensure they get used in
-       the rehash.
-       This function rotates lower order bits into place depending on
-       the iteration.
-       We add the iteration number in so that if we continue to clash
-       with other hashes after the 32nd iteration subsequent rehashes we
-       will not simply repeat - the cost is some loss of dependence on
-       the original address in the bottom bits.
-    */
-    return cicp_mac_hash(rows_ln2,
-			 ci_rot_r(ip_hash32, iteration) + iteration,
-			 ifindex);
+/*! Return a mask of the rows of a bucket with the given tag */
+ci_inline unsigned
+cicp_mac_bucket_match(const cicp_mac_bucket_t *bucket, unsigned tag)
+{
+#if CICP_MAC_BUCKET_SSE2
+    __m128i tags = _mm_load_si128((const __m128i *)bucket->tag);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(tag)));
+#else
+    /* Find the zero bytes of each half of (tags ^ tag), without carries
+     * from one byte to the next giving false matches, and gather the top
+     * bit of each into the bottom byte.
+     */
+    const ci_uint64 lo7 = 0x7f7f7f7f7f7f7f7full;
+    const ci_uint64 ones = 0x0101010101010101ull;
+    unsigned i, mask = 0;
+    ci_uint64 x;
+
+    for (i = 0; i < 2; ++i) {
+	memcpy(&x, bucket->tag + i * 8, 8);
+	x ^= tag * ones;
+	x = ~(((x & lo7) + lo7) | x | lo7);
+	mask |= (unsigned)(((x >> 7) * 0x0102040810204080ull) >> 56) << (i * 8);
+    }
+    return mask;
+#endif
 }
 
 
-
-
 /* Find an allocated MAC entry holding the given IP address
  * - see header for documentation
  */
 extern cicp_mac_rowid_t
 cicpos_mac_find_ip(const cicp_mac_mib_t *mact, ci_ifid_t ifindex,
 		   ci_ip_addr_t ip, ci_verlock_value_t *out_ver)
-{   int rows_ln2 = mact->rows_ln2;
-    ci_uint32 ip_hash32 = CI_IP_ADDR_HASH32(&ip);
-    /* above preferably with high-order subnet-constant address bits */
-    cicp_mac_rowid_t rowid = cicp_mac_hash(rows_ln2, ip_hash32, ifindex);
-    const cicp_mac_row_t *ipmac = &mact->ipmac[0];
-    const cicp_mac_row_t *row = &ipmac[rowid];
-    int iteration = 0;
-
-    *out_ver = ci_verlock_get(&row->version);
-    /* record initial version - before we use it */
-
-    /* Single initial test to optimize hoped-for best case */
-    if (cicp_mac_row_allocated(row) &&
-	row->ifindex == ifindex &&
-	CI_IP_ADDR_EQ(&row->ip_addr, &ip))
-	return rowid;
-    else if (cicp_mac_row_usecount(row) <= 0)
-	/* nothing hashes through here - that was the only row it could be */
-	return CICP_MAC_ROWID_BAD;  
-    else
-    {	int /*bool*/ found;
-	do {
-	    DEBUGMACHASH(DPRINTF(CODEID": retry");)
-	    rowid = cicp_mac_rehash(rows_ln2, ip_hash32, ifindex, ++iteration);
-	    row = &ipmac[rowid];
-            *out_ver = ci_verlock_get(&row->version);
-	    found = cicp_mac_row_allocated(row) &&
-                    row->ifindex == ifindex &&
-		    CI_IP_ADDR_EQ(&row->ip_addr, &ip);
-	} while (!found && cicp_mac_row_usecount(row)> 0 &&
-		 iteration < CICP_MAC_HASHMAX);
-	/* we rehash no more than CICP_MAC_HASHMAX number of times but only
-	   until we find a row with a zero use count (i.e. one on no hash
-	   chains
-	*/
-
-        return found? rowid: CICP_MAC_ROWID_BAD;
+{   ci_uint32 hash = cicp_mac_hash(ip, ifindex);
+    unsigned tag = cicp_mac_hash_tag(hash);
+    unsigned buckets_mask = cicp_mac_mib_buckets(mact) - 1;
+    unsigned bucket = hash & buckets_mask;
+    const cicp_mac_bucket_t *b;
+    const cicp_mac_row_t *row;
+    cicp_mac_rowid_t rowid;
+    unsigned match;
+    int probe;
+
+    for (probe = 0;
+	 probe < CICP_MAC_BUCKET_PROBES && probe <= (int) buckets_mask;
+	 ++probe)
+    {   b = cicp_mac_bucket(mact, bucket);
+	for (match = cicp_mac_bucket_match(b, tag); match != 0;
+	     match &= match - 1)
+	{   rowid = (bucket << CICP_MAC_BUCKET_ROWS_LN2) + __builtin_ctz(match);
+	    row = &mact->ipmac[rowid];
+	    *out_ver = ci_verlock_get(&row->version);
+	    /* record initial version - before we use it */
+	    if (cicp_mac_row_allocated(row) &&
+		row->ifindex == ifindex &&
+		CI_IP_ADDR_EQ(&row->ip_addr, &ip))
+		return rowid;
+	}
+	/* nothing went past a bucket that had room */
+	if (cicp_mac_bucket_match(b, CICP_MAC_TAG_EMPTY) != 0)
+	    break;
+	DEBUGMACHASH(DPRINTF(CODEID": next bucket");)
+	bucket = (bucket + 1) & buckets_mask;
     }
+    return CICP_MAC_ROWID_BAD;
 }
 	   
     
@@ -372,8 +327,75 @@ cicpos_mac_find_ip(const cicp_mac_mib_t *mact, ci_ifid_t ifindex,
 
 
 
+/*! Return whether any entry was put beyond the given bucket
+ *
+ *  An entry in a later bucket went past this one if its home bucket is at
+ *  least as far back as this one.
+ */
+static int /* bool */
+cicp_mac_bucket_passed(const cicp_mac_mib_t *mact, unsigned bucket)
+{   unsigned buckets_mask = cicp_mac_mib_buckets(mact) - 1;
+    unsigned later = bucket, home, match;
+    const cicp_mac_bucket_t *b;
+    const cicp_mac_row_t *row;
+    int probe;
+
+    for (probe = 1;
+	 probe < CICP_MAC_BUCKET_PROBES && probe <= (int) buckets_mask;
+	 ++probe)
+    {   later = (later + 1) & buckets_mask;
+	b = cicp_mac_bucket(mact, later);
+	match = ~(cicp_mac_bucket_match(b, CICP_MAC_TAG_EMPTY) |
+		  cicp_mac_bucket_match(b, CICP_MAC_TAG_DELETED)) &
+		((1u << CICP_MAC_BUCKET_ROWS) - 1);
+	for (; match != 0; match &= match - 1)
+	{   row = &mact->ipmac[(later << CICP_MAC_BUCKET_ROWS_LN2) +
+			       __builtin_ctz(match)];
+	    home = cicp_mac_hash(row->ip_addr, row->ifindex) & buckets_mask;
+	    if (((later - home) & buckets_mask) >= (unsigned) probe)
+		return TRUE;
+	}
+	/* nothing went past a bucket that had room */
+	if (cicp_mac_bucket_match(b, CICP_MAC_TAG_EMPTY) != 0)
+	    break;
+    }
+    return FALSE;
+}
+
+
+/*! Make deleted tags empty in the buckets that no entry goes past
+ *
+ *  Lookups that reach such a bucket may stop there again.  Readers may be
+ *  looking at the tags as they change, but none of them is looking for an
+ *  entry beyond the bucket.
+ */
+static void
+cicp_mac_mib_compact(cicp_mac_mib_t *mact)
+{   unsigned bucket, buckets = cicp_mac_mib_buckets(mact);
+    unsigned match, left = 0;
+    cicp_mac_rowid_t rowid;
+
+    for (bucket = 0; bucket < buckets; ++bucket)
+    {   match = cicp_mac_bucket_match(cicp_mac_bucket(mact, bucket),
+				      CICP_MAC_TAG_DELETED);
+	if (match == 0)
+	    continue;
+	if (cicp_mac_bucket_passed(mact, bucket))
+	{   left += __builtin_popcount(match);
+	    continue;
+	}
+	for (; match != 0; match &= match - 1)
+	{   rowid = (bucket << CICP_MAC_BUCKET_ROWS_LN2) + __builtin_ctz(match);
+	    *cicp_mac_row_tag(mact, rowid) = CICP_MAC_TAG_EMPTY;
+	}
+    }
+    DEBUGMACHASH(DPRINTF(CODEID": compacted %u deleted rows to %u",
+			 mact->deleted_rows, left);)
+    mact->deleted_rows = left;
+    mact->deleted_max = left +
+	(cicp_mac_mib_rows(mact) >> CICP_MAC_DELETED_COMPACT_LN2);
+}
 
-#ifdef __ci_driver__
 
 /* Find and delete an allocated MAC entry that holds the given IP address
  *
@@ -385,8 +407,8 @@ cicpos_mac_find_ip(const cicp_mac_mib_t *mact, ci_ifid_t ifindex,
  * This function should only be used when it is known that an address table
  * entry holding the given MAC and IP address is known to exist.
  *
- * This function decrements the hash chain use-count of all of the entries
- * which are hashed/rehashed to.
+ * This function releases the entry's tag, but the caller must free the row
+ * itself.
  *
  * No locking of the MAC table is used in this function, but locking is
  * required in order to ensure that none of the entries are written to
@@ -395,33 +417,23 @@ cicpos_mac_find_ip(const cicp_mac_mib_t *mact, ci_ifid_t ifindex,
 extern cicp_mac_rowid_t
 _cicp_mac_find_ipaloc(cicp_mac_mib_t *mact, ci_ifid_t ifindex,
 		      ci_ip_addr_t ip)
-{   int rows_ln2 = mact->rows_ln2;
-    ci_uint32 ip_hash32 = CI_IP_ADDR_HASH32(&ip);
-    /* above preferably with high-order subnet-constant address bits */
-    cicp_mac_row_t *ipmac = &mact->ipmac[0];
-    cicp_mac_rowid_t rowid = cicp_mac_hash(rows_ln2, ip_hash32, ifindex);
-    cicp_mac_row_t *row = &ipmac[rowid];
-    int iteration = 0;
-
-    cicp_mac_row_usecount_dec(row); /* no longer on this hash chain */
-	
-    /* Single initial test to optimize hoped-for best case */
-    if (cicp_mac_row_allocated(row) &&
-	row->ifindex == ifindex && CI_IP_ADDR_EQ(&row->ip_addr, &ip))
-        return rowid;
-    else
-    {	int /*bool*/ found;
-	do {
-	    rowid = cicp_mac_rehash(rows_ln2, ip_hash32, ifindex, iteration);
-	    row = &ipmac[rowid];
-	    cicp_mac_row_usecount_dec(row); /* no longer on this hash chain */
-	    found = cicp_mac_row_allocated(row) &&
-                    row->ifindex == ifindex &&
-		    CI_IP_ADDR_EQ(&row->ip_addr, &ip);
-	} while (!found && ++iteration < CICP_MAC_HASHMAX);
-
-        return found? rowid: CICP_MAC_ROWID_BAD;;
+{   ci_verlock_value_t version; /* ignored */
+    cicp_mac_rowid_t rowid = cicpos_mac_find_ip(mact, ifindex, ip, &version);
+
+    if (CICP_MAC_ROWID_BAD != rowid)
+    {	const cicp_mac_bucket_t *b =
+	    cicp_mac_bucket(mact, rowid >> CICP_MAC_BUCKET_ROWS_LN2);
+	/* If the bucket is not full then no lookup goes past it, so this row
+	   can become empty.  Otherwise later lookups must not stop here. */
+	if (cicp_mac_bucket_match(b, CICP_MAC_TAG_EMPTY) != 0)
+	    *cicp_mac_row_tag(mact, rowid) = CICP_MAC_TAG_EMPTY;
+	else
+	{   *cicp_mac_row_tag(mact, rowid) = CICP_MAC_TAG_DELETED;
+	    if (++mact->deleted_rows > mact->deleted_max)
+		cicp_mac_mib_compact(mact);
+	}
     }
+    return rowid;
 }
 	   
     
@@ -442,14 +454,12 @@ _cicp_mac_find_ipaloc(cicp_mac_mib_t *mact, ci_ifid_t ifindex,
  * \c CICP_MAC_ROWID_BAD or will be a value guaranteed to be within the bounds
  * of the address resolution table.
  *
- * If a free entry is found this function increments the hash chain use-count
- * of all of the entries which are hashed/rehashed to.
+ * If a free entry is found this function sets its tag, so the caller must
+ * fill it in.  A row marked deleted is used before an empty one.
  *
- * Note that this function executes only CICP_MAC_HASHMAX inspections
- * of the table.  This will limit the number of corresponding inspections
- * needed to locate the entry once it has been positioned.  Unfortunately
- * it also increases the chances that no free entry will be found in a
- * heavily occupied table.
+ * Note that this function looks in only CICP_MAC_BUCKET_PROBES buckets.
+ * This limits the number of buckets that a lookup has to inspect, but it
+ * means that a heavily occupied table can fail to find a free entry.
  *
  * No locking of the MAC table is used in this function, but locking is
  * required in order to ensure that none of the entries are written to
@@ -458,39 +468,34 @@ _cicp_mac_find_ipaloc(cicp_mac_mib_t *mact, ci_ifid_t ifindex,
 extern cicp_mac_rowid_t
 _cicp_mac_find_ipunaloc(cicp_mac_mib_t *mact, ci_ifid_t ifindex,
 		        ci_ip_addr_t ip)
-{   int rows_ln2 = mact->rows_ln2;
-    ci_uint32 ip_hash32 = CI_IP_ADDR_HASH32(&ip);
-    /* above preferably with high-order subnet-constant address bits */
-    cicp_mac_row_t *ipmac = &mact->ipmac[0];
-    cicp_mac_rowid_t rowid = cicp_mac_hash(rows_ln2, ip_hash32, ifindex);
-    cicp_mac_row_t *row = &ipmac[rowid];
-    int iteration = 0;
-
-    cicp_mac_row_usecount_inc(row); /* now on another hash chain */
-    
-    /* Single initial test to optimize hoped-for best case */
-    if (!cicp_mac_row_allocated(row))
-	return rowid;
-    else
-    {	int /*bool*/ found;
-	do {
-	    rowid = cicp_mac_rehash(rows_ln2, ip_hash32, ifindex, iteration);
-	    row = &ipmac[rowid];
-	    cicp_mac_row_usecount_inc(row); /* now on another hash chain */
-	    found = !cicp_mac_row_allocated(row);
-	} while (!found && ++iteration < CICP_MAC_HASHMAX);
-
-	if (found)
-	    return rowid;
+{   ci_uint32 hash = cicp_mac_hash(ip, ifindex);
+    unsigned buckets_mask = cicp_mac_mib_buckets(mact) - 1;
+    unsigned bucket = hash & buckets_mask;
+    cicp_mac_rowid_t rowid;
+    unsigned match;
+    int probe;
+
+    for (probe = 0;
+	 probe < CICP_MAC_BUCKET_PROBES && probe <= (int) buckets_mask;
+	 ++probe)
+    {   const cicp_mac_bucket_t *b = cicp_mac_bucket(mact, bucket);
+	/* reuse a deleted row first: an empty one lets lookups stop here */
+	match = cicp_mac_bucket_match(b, CICP_MAC_TAG_DELETED);
+	if (match != 0)
+	    --mact->deleted_rows;
 	else
-	{   /* we'd better undo all the hash chain increments we've added! */
-	    (void)_cicp_mac_find_ipaloc(mact, ifindex, ip);
-	    return CICP_MAC_ROWID_BAD;
-	}	    
+	    match = cicp_mac_bucket_match(b, CICP_MAC_TAG_EMPTY);
+	if (match != 0)
+	{   rowid = (bucket << CICP_MAC_BUCKET_ROWS_LN2) + __builtin_ctz(match);
+	    ci_assert(!cicp_mac_row_allocated(&mact->ipmac[rowid]));
+	    *cicp_mac_row_tag(mact, rowid) = cicp_mac_hash_tag(hash);
+	    return rowid;
+	}
+	bucket = (bucket + 1) & buckets_mask;
     }
+    return CICP_MAC_ROWID_BAD;
 }
 
-#endif
     
 
 
@@ -925,11 +930,8 @@ cicp_fwdinfo_addr_kind(const cicp_fwdinfo_t *fwdt, ci_ip_addr_net_t ip,
 
 
 
-/*! Locate an entry in the routing table that incorporates the destination
- *
- *  It is assumed that this table is short and that it is, by and large,
- *  cheaper to search its content linearly than to maintain per-netmask
- *  structure and to search that.
+/*! Find the first row of the routing table that incorporates the
+ *  destination by scanning it
  *
  *  The routing decision is made solely on the destination IP address.
  *  Currently TOS, routing metric, source IP address, etc. are not used.
@@ -939,7 +941,7 @@ cicp_fwdinfo_addr_kind(const cicp_fwdinfo_t *fwdt, ci_ip_addr_net_t ip,
  *  ones.  Thus the first match will always be the correct one.
  */
 static const cicp_fwd_row_t *
-_cicp_fwd_find_ip(const cicp_fwdinfo_t *fwdt, ci_ip_addr_t ip_dest,
+_cicp_fwd_scan_ip(const cicp_fwdinfo_t *fwdt, ci_ip_addr_t ip_dest,
                   ci_ifid_t dest_ifindex)
 {
   const cicp_fwd_row_t *row    = &fwdt->path[0];
@@ -956,6 +958,161 @@ _cicp_fwd_find_ip(const cicp_fwdinfo_t *fwdt, ci_ip_addr_t ip_dest,
 }
 
 
+/*! Find the first row of the routing table that incorporates the
+ *  destination using the route index
+ *
+ *  Returns NULL if there is no such row, and [fwdt] itself if the index
+ *  cannot be used.
+ *
+ *  User level reads the index while the kernel may be rebuilding it, so
+ *  we must not trust anything we find there to be in range: the caller
+ *  discovers that it raced with an update by checking the table version.
+ */
+static const cicp_fwd_row_t *
+_cicp_fwd_index_find_ip(const cicp_fwdinfo_t *fwdt, ci_ip_addr_t ip_dest)
+{
+  const cicp_fwd_index_t *idx = cicp_fwd_index(fwdt);
+  ci_uint32 ip = CI_BSWAP_BE32(ip_dest);
+  unsigned entry, node;
+  int shift = 32 - CICP_FWD_INDEX_ROOT_BITS;
+
+  if (idx == NULL || ! idx->valid)
+    return (const cicp_fwd_row_t *)fwdt;
+
+  entry = idx->root[ip >> shift];
+  while (entry & CICP_FWD_INDEX_NODE) {
+    node = entry & ~CICP_FWD_INDEX_NODE;
+    if (CI_UNLIKELY( node >= idx->nodes_max || shift == 0 ))
+      return NULL;
+    shift -= CICP_FWD_INDEX_NODE_BITS;
+    entry = idx->node[node][(ip >> shift) &
+                            ((1u << CICP_FWD_INDEX_NODE_BITS) - 1)];
+  }
+  return entry < fwdt->rows_max ? &fwdt->path[entry] : NULL;
+}
+
+
+/*! Locate an entry in the routing table that incorporates the destination
+ *
+ *  Routes are looked up in the route index if we can, but the index does
+ *  not know about interfaces, so lookups restricted to an interface (for
+ *  SO_BINDTODEVICE) have to scan the table.
+ */
+extern const cicp_fwd_row_t *
+_cicp_fwd_find_ip(const cicp_fwdinfo_t *fwdt, ci_ip_addr_t ip_dest,
+                  ci_ifid_t dest_ifindex)
+{
+  const cicp_fwd_row_t *row;
+
+  if (dest_ifindex == CI_IFID_BAD) {
+    row = _cicp_fwd_index_find_ip(fwdt, ip_dest);
+    if (row != (const cicp_fwd_row_t *)fwdt)
+      return row;
+  }
+  return _cicp_fwd_scan_ip(fwdt, ip_dest, dest_ifindex);
+}
+
+
+/*! Point the index entries for [prefix_len] bits of [ip] at [rowid],
+ *  adding nodes as necessary
+ */
+static int /* rc */
+cicp_fwd_index_add(cicp_fwd_index_t *idx, ci_uint32 ip, int prefix_len,
+                   cicp_fwd_index_entry_t rowid)
+{
+  cicp_fwd_index_entry_t *tbl = idx->root;
+  int bits = CICP_FWD_INDEX_ROOT_BITS;
+  int shift = 32 - bits;
+  unsigned i, n;
+
+  while (prefix_len > 32 - shift) {
+    cicp_fwd_index_entry_t *entry = &tbl[(ip >> shift) & ((1u << bits) - 1)];
+    if (! (*entry & CICP_FWD_INDEX_NODE)) {
+      if (idx->nodes_used == idx->nodes_max)
+        return -ENOSPC;
+      for (i = 0; i < (1u << CICP_FWD_INDEX_NODE_BITS); ++i)
+        idx->node[idx->nodes_used][i] = *entry;
+      *entry = CICP_FWD_INDEX_NODE | idx->nodes_used++;
+    }
+    tbl = idx->node[*entry & ~CICP_FWD_INDEX_NODE];
+    bits = CICP_FWD_INDEX_NODE_BITS;
+    shift -= bits;
+  }
+
+  /* The prefix ends at this level, and covers [n] of its entries.  Any
+   * nodes below them are forgotten, which only happens if the table is
+   * not sorted.
+   */
+  i = (ip >> shift) & ((1u << bits) - 1);
+  for (n = 1u << (32 - shift - prefix_len); n--; ++i)
+    tbl[i] = rowid;
+  return 0;
+}
+
+
+extern void
+cicp_fwd_index_build(cicp_fwdinfo_t *fwdt)
+{
+  cicp_fwd_index_t *idx = cicp_fwd_index(fwdt);
+  const cicp_fwd_row_t *row;
+  int rowid, n_rows;
+
+  if (idx == NULL)
+    return;
+
+  idx->valid = 0;
+  idx->nodes_used = 0;
+  for (n_rows = 0; n_rows < (1 << CICP_FWD_INDEX_ROOT_BITS); ++n_rows)
+    idx->root[n_rows] = CICP_FWD_INDEX_MISS;
+
+  for (n_rows = 0;
+       n_rows < fwdt->rows_max && cicp_fwd_row_allocated(&fwdt->path[n_rows]);
+       ++n_rows)
+    ;
+
+  /* Add rows last first, so that where routes overlap each address ends
+   * up with the first row that matches it, as the scan would find.
+   */
+  for (rowid = n_rows - 1; rowid >= 0; --rowid) {
+    row = &fwdt->path[rowid];
+    if (cicp_fwd_index_add(idx, CI_BSWAP_BE32(row->destnet_ip) &
+                           ci_ip_prefix2mask(row->destnet_ipset),
+                           row->destnet_ipset, rowid) < 0)
+      return;
+  }
+
+  ci_wmb();
+  idx->valid = 1;
+}
+
+
+
+
+
+
+/* Invalidate forwarding information that a new, changed or removed route
+ * could affect - see header for documentation
+ */
+extern void
+cicp_fwd_route_changed(cicp_fwdinfo_t *fwdt, ci_ip_addr_t dest_ip,
+                       ci_ip_addrset_t dest_set)
+{
+  cicp_fwd_row_t *row;
+  int rowid;
+
+  /* Lookups that found no route, or found a route no more specific than
+   * this one and containing it, may now find a different route.  Lookups
+   * that found a more specific route, or one elsewhere, are unaffected.
+   */
+  fwdt->noroute_version = cicp_fwd_stamp_next(fwdt);
+  for (rowid = 0;
+       rowid < fwdt->rows_max && cicp_fwd_row_allocated(row = &fwdt->path[rowid]);
+       ++rowid)
+    if (row->destnet_ipset <= dest_set &&
+        CI_IP_ADDR_SAME_NETWORK(&dest_ip, &row->destnet_ip,
+                                row->destnet_ipset))
+      cicp_fwd_row_stamp(fwdt, row);
+}
 
 
 
@@ -1169,6 +1326,7 @@ cicp_user_retrieve(ci_netif*                    ni,
   const cicp_fwd_row_t* row;
   ci_verlock_value_t version;
   cicp_mac_verinfo_t mac_info;
+  cicp_fwd_verinfo_t fwd_info;
   ci_ip_addr_kind_t kind;
   ci_mac_addr_t mac_storage;
   void* source_mac;
@@ -1196,6 +1354,14 @@ cicp_user_retrieve(ci_netif*                    ni,
    */
   row = _cicp_fwd_find_ip(fwdt, ipcache->ip.ip_daddr_be32,
                           sock_cp->so_bindtodevice);
+  if( row != NULL ) {
+    fwd_info.row_index = row->stamp_id;
+    fwd_info.row_version = cicp_fwd_stamps(fwdt)[row->stamp_id];
+  }
+  else {
+    fwd_info.row_index = CICP_FWD_ROWID_BAD;
+    fwd_info.row_version = fwdt->noroute_version;
+  }
 
   if( sock_cp->so_bindtodevice != CI_IFID_BAD ) {
     ipcache->ifindex = sock_cp->so_bindtodevice;
@@ -1413,6 +1579,7 @@ cicp_user_retrieve(ci_netif*                    ni,
   ci_rmb();
   if(CI_UNLIKELY( ci_verlock_updating(&version) || fwdt->version != version ))
     goto again;
+  ipcache->fwd_integrity = fwd_info;
   CICP_LOCK_END;
  out:
   ci_assert(ipcache->status != -1);
@@ -1438,6 +1605,8 @@ cicp_user_retrieve(ci_netif*                    ni,
   ipcache->intf_i = -1;
   cicp_mac_set_mostly_valid(CICP_MIBS(CICP_HANDLE(ni))->user.mac_utable,
                             &ipcache->mac_integrity);
+  ipcache->fwd_integrity.row_index = CICP_FWD_ROWID_BAD;
+  ipcache->fwd_integrity.row_version = fwdt->noroute_version;
   ipcache->status = retrrc_alienroute;
   goto out;
 }
@@ -1454,6 +1623,7 @@ cicp_ip_cache_update_from(ci_netif* ni, ci_ip_cached_hdrs* ipcache,
   ci_assert_equal(ipcache->dport_be16, from_ipcache->dport_be16);
 
   ipcache->mac_integrity = from_ipcache->mac_integrity;
+  ipcache->fwd_integrity = from_ipcache->fwd_integrity;
   ipcache->ip_saddr_be32 = from_ipcache->ip_saddr_be32;
   ipcache->ip.ip_ttl = from_ipcache->ip.ip_ttl;
   ipcache->status = from_ipcache->status;
@@ -51,7 +51,7 @@ static int __ef_eplock_lock_wait(ci_netif *ni, int maybe_wedged)
 }
 
 
-int __ef_eplock_lock_slow(ci_netif *ni, int maybe_wedged)
+static int __ef_eplock_lock_contended(ci_netif *ni, int maybe_wedged)
 {
 #ifndef __KERNEL__
   ci_uint64 start_frc, now_frc;
@@ -128,4 +128,32 @@ int __ef_eplock_lock_slow(ci_netif *ni, int maybe_wedged)
   return 0;
 }
 
+
+int __ef_eplock_lock_slow(ci_netif *ni, int maybe_wedged)
+{
+#if CI_CFG_LOCK_PROFILE || CI_CFG_TRACE
+  ci_uint64 start_frc;
+  unsigned site = CI_NETIF_LOCK_SITE_NONE;
+  int rc;
+
+  if(CI_LIKELY( ni->state->lock_prof.sample_n == 0 &&
+                ! CI_NETIF_TRACE_ON(ni) ))
+    return __ef_eplock_lock_contended(ni, maybe_wedged);
+
+  /* Charge the wait to whatever the holder is doing now. */
+  if( ni->state->lock_prof.sample_n != 0 )
+    site = ci_netif_lock_prof_blocker(ni);
+  ci_frc64(&start_frc);
+  rc = __ef_eplock_lock_contended(ni, maybe_wedged);
+  if( rc == 0 ) {
+    if( site != CI_NETIF_LOCK_SITE_NONE )
+      __ci_netif_lock_prof_wait(ni, site, start_frc);
+    ci_netif_trace_latency(ni, CI_TRACE_LOCK_WAIT, site, start_frc);
+  }
+  return rc;
+#else
+  return __ef_eplock_lock_contended(ni, maybe_wedged);
+#endif
+}
+
 /*! \cidoxg_end */
@@ -216,6 +216,46 @@ ci_tcp_ep_set_filters(ci_netif *        ni,
   return rc;
 }
 
+
+/*--------------------------------------------------------------------
+ *!
+ * As ci_tcp_ep_set_filters(), for many endpoints.  At user level the ops
+ * go to the driver in one call, unless any of them can be done here.
+ *
+ * \param ni              ci_netif structure
+ * \param ops             endpoints and arguments
+ * \param rcs             out: result of each op
+ * \param n_ops           number of ops
+ * \return                0 if every op was attempted, else standard error
+ *                        codes
+ *
+ *--------------------------------------------------------------------*/
+
+ci_inline int
+ci_tcp_ep_set_filters_batch(ci_netif *                 ni,
+                            const oo_tcp_filter_set_t* ops,
+                            ci_int32*                  rcs,
+                            int                        n_ops)
+{
+  int i;
+
+  ci_assert(ni);
+
+#ifndef __ci_driver__
+  for( i = 0; i < n_ops; ++i )
+    if( ci_tcp_can_set_filter_in_ul(ni, SP_TO_SOCK(ni, ops[i].tcp_id)) )
+      break;
+  if( i == n_ops )
+    return ci_tcp_helper_ep_set_filters_batch(ci_netif_get_driver_handle(ni),
+                                              ops, rcs, n_ops);
+#endif
+
+  for( i = 0; i < n_ops; ++i )
+    rcs[i] = ci_tcp_ep_set_filters(ni, ops[i].tcp_id, ops[i].bindto_ifindex,
+                                   ops[i].from_tcp_id);
+  return 0;
+}
+
 #ifndef __ci_driver__
 ci_inline int
 ci_tcp_ep_reuseport_bind(ci_fd_t fd, const char* cluster_name,
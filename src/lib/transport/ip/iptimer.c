@@ -208,6 +208,17 @@ void __ci_ip_timer_set(ci_netif *netif, ci_ip_timer *ts, ci_iptime_t t)
 
   ci_assert(ci_ip_timer_is_link_valid(netif, ts));
   DETAILED_CHECK_TIMERS(netif);
+
+  /* If the kernel's periodic timer is only armed for the earliest pending
+   * timer, and this one is due well before that, get it re-armed when the
+   * lock is dropped.
+   */
+  if( NI_OPTS(netif).periodic_timer_max_msec != 0 &&
+      TIME_LT(t, netif->state->periodic_rearm_ticks) ) {
+    netif->state->periodic_rearm_ticks = t;
+    ef_eplock_holder_set_flag(&netif->state->lock,
+                              CI_EPLOCK_NETIF_PERIODIC_REARM);
+  }
 }
 
 
@@ -273,11 +284,55 @@ static void ci_ip_timer_cascadewheel(ci_netif* netif, int wheelno,
   }
 }
 
+int ci_ip_timer_next_expiry(ci_netif* netif, ci_iptime_t* t_out)
+{
+  ci_ip_timer_state* ipts = IPTIMER_STATE(netif);
+  ci_iptime_t stime = ipts->sched_ticks;
+  ci_ni_dllist_t* bucket;
+  ci_ni_dllist_link* l;
+  ci_ip_timer* ts;
+  int w, b, i, n, found = 0;
+
+  ci_assert(ci_netif_is_locked(netif));
+
+  /* Timers in each wheel are in buckets after the current one, and any
+   * timer in a wheel is due before every timer in the wheels above it.  So
+   * the first non-empty bucket we find holds the earliest timer.  Only the
+   * top wheel wraps.
+   */
+  for( w = 0; w < CI_IPTIME_WHEELS; ++w ) {
+    b = BUCKETNO(w, stime);
+    if( w == CI_IPTIME_WHEELS - 1 )
+      n = CI_IPTIME_BUCKETS - 1;
+    else
+      n = CI_IPTIME_BUCKETMASK - b;
+    for( i = 1; i <= n; ++i ) {
+      bucket = &ipts->warray[w * CI_IPTIME_BUCKETS +
+                             ((b + i) & CI_IPTIME_BUCKETMASK)];
+      if( ci_ni_dllist_is_empty(netif, bucket) )
+        continue;
+      for( l = ci_ni_dllist_start(netif, bucket);
+           l != ci_ni_dllist_end(netif, bucket);
+           ci_ni_dllist_iter(netif, l) ) {
+        ts = LINK2TIMER(l);
+        if( ! found || TIME_LT(ts->time, *t_out) )
+          *t_out = ts->time;
+        found = 1;
+      }
+      return found;
+    }
+  }
+  return 0;
+}
+
+
 /* unpick the ci_ip_timer structure to actually do the callback */ 
 static void ci_ip_timer_docallback(ci_netif *netif, ci_ip_timer* ts)
 {
   ci_assert( TIME_LE(ts->time, ci_ip_time_now(netif)) );
   ci_assert( ts->time == IPTIMER_STATE(netif)->sched_ticks );
+  ci_netif_trace(netif, CI_TRACE_TIMER, OO_SP_TO_INT(ts->param1), ts->fn,
+                 ts->time, 0);
 
   switch(ts->fn){
   case CI_IP_TIMER_TCP_RTO:
@@ -0,0 +1,220 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  Per-socket latency histograms (EF_LAT_HIST).
+**   \date  2016/10/18
+**    \cop  (c) Solarflare Communications Inc.
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_transport_ip */
+
+/* Histogram buffers are whole endpoint buffers, so they are taken with
+ * citp_waitable_obj_alloc() and marked as aux buffers so that everything
+ * that walks the endpoints skips them.  They are never returned to the
+ * endpoint free list: when a socket is freed its buffer goes onto
+ * lat_hist_free_head instead.  Sockets can be freed without the stack
+ * lock (citp_waitable_obj_free_nnl()) so that list is pushed with a
+ * compare-and-swap.  Buffers are only taken off it with the stack lock
+ * held, so there is a single popper and ABA is not a concern.
+ */
+
+#include "ip_internal.h"
+
+
+CI_BUILD_ASSERT(CI_AUX_MEM_SIZE + sizeof(ci_lat_hist) <= EP_BUF_SIZE);
+
+
+static oo_sp ci_lat_hist_alloc(ci_netif* ni)
+{
+  citp_waitable_obj* wo;
+  ci_lat_hist* lh;
+  ci_int32 id;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  while( (id = ni->state->lat_hist_free_head) != CI_ILL_END ) {
+    wo = ID_TO_WAITABLE_OBJ(ni, id);
+    lh = (ci_lat_hist*) ((char*) wo + CI_AUX_MEM_SIZE);
+    if( ci_cas32_succeed(&ni->state->lat_hist_free_head, id, lh->next_id) )
+      return W_SP(&wo->waitable);
+  }
+
+  if( (wo = citp_waitable_obj_alloc(ni)) == NULL )
+    return OO_SP_NULL;
+  wo->header.state = CI_TCP_STATE_AUXBUF;
+  ++ni->state->n_lat_hist_bufs;
+  return W_SP(&wo->waitable);
+}
+
+
+void ci_lat_hist_attach(ci_netif* ni, citp_waitable* w)
+{
+  ci_lat_hist* lh;
+  oo_sp sp = w->lat_hist;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  if( OO_SP_IS_NULL(sp) && OO_SP_IS_NULL(sp = ci_lat_hist_alloc(ni)) ) {
+    LOG_U(ci_log("%s: [%d:%d] out of endpoint buffers", __FUNCTION__,
+                 NI_ID(ni), W_FMT(w)));
+    return;
+  }
+  /* A TCP socket taken from the cache comes through here again with its
+   * buffer still attached.  Clear it so that the new connection's
+   * histograms do not include the old one's.
+   */
+  lh = (ci_lat_hist*) ((char*) SP_TO_WAITABLE_OBJ(ni, sp) + CI_AUX_MEM_SIZE);
+  memset(lh, 0, sizeof(*lh));
+  lh->owner = W_SP(w);
+  lh->next_id = CI_ILL_END;
+  w->lat_hist = sp;
+}
+
+
+void ci_lat_hist_release(ci_netif* ni, citp_waitable* w)
+{
+  ci_lat_hist* lh = ci_lat_hist_get(ni, w);
+  ci_int32 id = OO_SP_TO_INT(w->lat_hist);
+
+  w->lat_hist = OO_SP_NULL;
+  lh->owner = OO_SP_NULL;
+  do
+    lh->next_id = ni->state->lat_hist_free_head;
+  while( ci_cas32_fail(&ni->state->lat_hist_free_head, lh->next_id, id) );
+}
+
+
+unsigned ci_lat_hist_bucket(ci_uint64 cycles)
+{
+  unsigned msb;
+
+  if( cycles < 2 )
+    return (unsigned) cycles;
+  if( cycles >= (1ull << (CI_LAT_HIST_N_BUCKETS / 2)) )
+    return CI_LAT_HIST_N_BUCKETS - 1;
+  msb = ci_log2_le((unsigned long) cycles);
+  return msb * 2 + ((unsigned) (cycles >> (msb - 1)) & 1);
+}
+
+
+ci_uint64 ci_lat_hist_bucket_lo(unsigned i)
+{
+  unsigned msb = i / 2;
+  if( i < 2 )
+    return i;
+  return (1ull << msb) + (ci_uint64) (i & 1) * (1ull << (msb - 1));
+}
+
+
+void ci_lat_hist_stage_add(ci_lat_hist_stage* st, ci_uint64 cycles)
+{
+  ++st->n;
+  st->sum += cycles;
+  if( cycles > st->max )
+    st->max = cycles;
+  ++st->bucket[ci_lat_hist_bucket(cycles)];
+}
+
+
+void __ci_lat_hist_record(ci_netif* ni, citp_waitable* w, int stage,
+                          ci_uint64 start)
+{
+  ci_lat_hist_stage_add(&ci_lat_hist_get(ni, w)->stage[stage],
+                        ci_frc64_since(start));
+}
+
+
+#ifndef __KERNEL__
+
+static const char* const lat_hist_stage_names[CI_LAT_HIST_N_STAGES] = {
+  "rx_stack", "rx_app", "tx_send", "tx_done",
+};
+
+
+static ci_uint64 lat_hist_ns(ci_netif* ni, ci_uint64 cycles)
+{
+  unsigned khz = IPTIMER_STATE(ni)->khz;
+  if( cycles > ((ci_uint64) -1) / 1000000 )
+    return cycles / khz * 1000000;
+  return cycles * 1000000 / khz;
+}
+
+
+/* Returns an upper bound, in cycles, on the [pct_x10]/1000 quantile. */
+static ci_uint64 lat_hist_quantile(const ci_lat_hist_stage* st,
+                                   unsigned pct_x10)
+{
+  ci_uint64 target = (st->n * pct_x10 + 999) / 1000;
+  ci_uint64 sum = 0;
+  unsigned i;
+
+  for( i = 0; i < CI_LAT_HIST_N_BUCKETS - 1; ++i )
+    if( (sum += st->bucket[i]) >= target )
+      return CI_MIN(ci_lat_hist_bucket_lo(i + 1) - 1, st->max);
+  return st->max;
+}
+
+
+void ci_lat_hist_stage_dump(ci_netif* ni, const ci_lat_hist_stage* live,
+                            const char* name, int verbose, const char* pf,
+                            oo_dump_log_fn_t logger, void* log_arg)
+{
+  /* The stack may be recording into [live] as we read it, and reset it
+   * when a cached socket is reused, so work from a copy.
+   */
+  ci_lat_hist_stage snap = *live;
+  const ci_lat_hist_stage* st = &snap;
+  unsigned i;
+
+  if( st->n == 0 )
+    return;
+  logger(log_arg, "%s  %-9s n=%llu mean=%lluns p50=%lluns p90=%lluns "
+         "p99=%lluns p99.9=%lluns max=%lluns", pf, name,
+         (unsigned long long) st->n,
+         (unsigned long long) lat_hist_ns(ni, st->sum / st->n),
+         (unsigned long long) lat_hist_ns(ni, lat_hist_quantile(st, 500)),
+         (unsigned long long) lat_hist_ns(ni, lat_hist_quantile(st, 900)),
+         (unsigned long long) lat_hist_ns(ni, lat_hist_quantile(st, 990)),
+         (unsigned long long) lat_hist_ns(ni, lat_hist_quantile(st, 999)),
+         (unsigned long long) lat_hist_ns(ni, st->max));
+  if( ! verbose )
+    return;
+  for( i = 0; i < CI_LAT_HIST_N_BUCKETS; ++i )
+    if( st->bucket[i] )
+      logger(log_arg, "%s    >=%-10llu %u", pf,
+             (unsigned long long) lat_hist_ns(ni, ci_lat_hist_bucket_lo(i)),
+             st->bucket[i]);
+}
+
+
+void ci_lat_hist_dump(ci_netif* ni, const ci_lat_hist* lh, int verbose,
+                      const char* pf, oo_dump_log_fn_t logger, void* log_arg)
+{
+  int s;
+
+  for( s = 0; s < CI_LAT_HIST_N_STAGES; ++s )
+    if( lh->stage[s].n != 0 )
+      ci_lat_hist_stage_dump(ni, &lh->stage[s], lat_hist_stage_names[s],
+                             verbose, pf, logger, log_arg);
+}
+
+#endif
+
+/*! \cidoxg_end */
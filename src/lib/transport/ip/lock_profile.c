@@ -0,0 +1,135 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  Stack lock hold and wait time profile (EF_LOCK_PROFILE).
+**   \date  2016/10/18
+**    \cop  (c) Solarflare Communications Inc.
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_transport_ip */
+
+/* Only acquisitions made with ci_netif_lock() and ci_netif_trylock() are
+ * seen here.  The lock can also be taken by the kernel on behalf of a
+ * stack (e.g. ef_eplock_trylock_and_set_flags()), and such holds are
+ * neither sampled nor re-tagged, so they are charged to whatever held the
+ * lock before.  The profile is for finding where the contention is, and
+ * that is good enough.
+ *
+ * A hold is recorded only by the mapping of the stack that sampled it,
+ * which CI_NETIF_FLAG_LOCK_SAMPLED marks.  A sampled lock can be released
+ * by another mapping, e.g. by the kernel when a thread goes to sleep with
+ * the lock held.  Then the grant time is dropped rather than charged to
+ * whoever releases the lock next.
+ *
+ * The state lives in shared memory, so the site indices are range checked
+ * before use.
+ */
+
+#include "ip_internal.h"
+
+
+#ifdef __KERNEL__
+
+void ci_netif_lock_prof_init(ci_netif* ni)
+{
+  ci_netif_lock_prof* lp = &ni->state->lock_prof;
+
+#if CI_CFG_LOCK_PROFILE
+  lp->sample_n = NI_OPTS(ni).lock_profile;
+#else
+  lp->sample_n = 0;
+#endif
+  lp->sample_i = 0;
+  lp->grant_frc = 0;
+  lp->site = lp->sample_n ? CI_NETIF_LOCK_SITE_OTHER : CI_NETIF_LOCK_SITE_NONE;
+  lp->section = CI_NETIF_LOCK_SITE_OTHER;
+}
+
+#endif
+
+
+ci_inline unsigned lock_prof_site(unsigned site)
+{
+  return site < CI_NETIF_LOCK_N_SITES ? site : CI_NETIF_LOCK_SITE_OTHER;
+}
+
+
+void __ci_netif_lock_prof_grant(ci_netif* ni)
+{
+  ci_netif_lock_prof* lp = &ni->state->lock_prof;
+
+  lp->site = CI_NETIF_LOCK_SITE_OTHER;
+  lp->section = CI_NETIF_LOCK_SITE_OTHER;
+  if( lp->sample_i == 0 ) {
+    lp->sample_i = lp->sample_n - 1;
+    ci_frc64(&lp->grant_frc);
+    ni->flags |= CI_NETIF_FLAG_LOCK_SAMPLED;
+  }
+  else {
+    --lp->sample_i;
+    lp->grant_frc = 0;
+    ni->flags &= ~CI_NETIF_FLAG_LOCK_SAMPLED;
+  }
+}
+
+
+void __ci_netif_lock_prof_release(ci_netif* ni)
+{
+  ci_netif_lock_prof* lp = &ni->state->lock_prof;
+
+  ci_assert(ci_netif_is_locked(ni));
+  if( ni->flags & CI_NETIF_FLAG_LOCK_SAMPLED )
+    ci_lat_hist_stage_add(&lp->hold[lock_prof_site(lp->site)],
+                          ci_frc64_since(lp->grant_frc));
+  ni->flags &= ~CI_NETIF_FLAG_LOCK_SAMPLED;
+  lp->grant_frc = 0;
+}
+
+
+void __ci_netif_lock_prof_wait(ci_netif* ni, unsigned site, ci_uint64 start)
+{
+  ci_assert(ci_netif_is_locked(ni));
+  ci_lat_hist_stage_add(&ni->state->lock_prof.wait[lock_prof_site(site)],
+                        ci_frc64_since(start));
+}
+
+
+void __ci_netif_lock_prof_section(ci_netif* ni, unsigned site,
+                                  ci_uint64 start)
+{
+  ci_assert(ci_netif_is_locked(ni));
+  ci_lat_hist_stage_add(&ni->state->lock_prof.hold[lock_prof_site(site)],
+                        ci_frc64_since(start));
+}
+
+
+#ifndef __KERNEL__
+
+const char* ci_netif_lock_site_name(unsigned site)
+{
+  static const char* const names[CI_NETIF_LOCK_N_SITES] = {
+    "other", "poll", "sendmsg", "recvmsg", "timers", "post_poll",
+  };
+  return names[lock_prof_site(site)];
+}
+
+#endif
+
+/*! \cidoxg_end */
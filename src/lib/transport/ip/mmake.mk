@@ -21,6 +21,7 @@ LIB_SRCS	:=		\
 		ip_tx.c		\
 		udp.c		\
 		udp_rx.c	\
+		udp_filter.c	\
 		udp_connect.c	\
 		udp_misc.c	\
 		sockerr.c	\
@@ -37,6 +38,9 @@ LIB_SRCS	:=		\
 		netif_init.c	\
 		tcp_connect.c	\
 		waitable.c	\
+		lat_hist.c	\
+		lock_profile.c	\
+		trace.c		\
 		socket.c	\
 		ip_cmsg.c	\
 		eplock_slow.c	\
@@ -62,7 +66,8 @@ LIB_SRCS	+=		\
 		save_fd.c	\
 		tcp_helper.c	\
 		syscall.c	\
-		per_thread.c
+		per_thread.c	\
+		rss.c
 endif
 
 ifeq ($(DRIVER),1)
@@ -565,6 +565,12 @@ static void ci_netif_mem_pressure_enter_critical(ci_netif* ni, int intf_i)
   CITP_STATS_NETIF_INC(ni, memory_pressure_enter);
   ni->state->mem_pressure |= OO_MEM_PRESSURE_CRITICAL;
   ni->state->rxq_limit = 2*CI_CFG_RX_DESC_BATCH;
+  ci_netif_trace(ni, CI_TRACE_MEM_PRESSURE, -1, 1, ni->state->n_rx_pkts,
+                 intf_i);
+#if CI_CFG_TRACE
+  if( ni->state->trace.freeze_mem_pressure )
+    ci_netif_trace_freeze(ni, CI_TRACE_FREEZE_MEM_PRESSURE, 0);
+#endif
   ci_netif_mem_pressure_pkt_pool_use(ni);
   if( ci_netif_rx_vi_space(ni, ci_netif_rx_vi(ni, intf_i)) >=
       CI_CFG_RX_DESC_BATCH )
@@ -578,6 +584,7 @@ static void ci_netif_mem_pressure_exit_critical(ci_netif* ni)
   ci_netif_mem_pressure_pkt_pool_fill(ni);
   ni->state->rxq_limit = NI_OPTS(ni).rxq_limit;
   ni->state->mem_pressure &= ~OO_MEM_PRESSURE_CRITICAL;
+  ci_netif_trace(ni, CI_TRACE_MEM_PRESSURE, -1, 0, ni->state->n_rx_pkts, 0);
 }
 
 
@@ -742,7 +749,7 @@ void ci_netif_rx_post(ci_netif* netif, int intf_i)
     }
 
  find_new_bufset:
-    bufset_id = ci_netif_pktset_best(netif);
+    bufset_id = ci_netif_pktset_best_for_intf(netif, intf_i);
     if( bufset_id == -1 ||
         netif->packets->set[bufset_id].n_free < CI_CFG_RX_DESC_BATCH )
       goto not_enough_pkts;
@@ -907,6 +914,8 @@ int ci_netif_lock_or_defer_work(ci_netif* ni, citp_waitable* w)
       new_v = (v & ~CI_EPLOCK_NETIF_SOCKET_LIST) | (W_ID(w) + 1);
       if( ci_cas64u_succeed(&ni->state->lock.lock, v, new_v) ) {
         ++ni->state->defer_work_count;
+        ci_netif_trace(ni, CI_TRACE_LOCK_DEFER, W_ID(w),
+                       ni->state->defer_work_count, 0, 0);
         return 0;
       }
       CI_DEBUG(w->next_id = CI_ILL_END);
@@ -1089,6 +1098,10 @@ void ci_netif_unlock(ci_netif* ni)
 #endif
 
   ci_assert_equal(ni->state->in_poll, 0);
+#if CI_CFG_LOCK_PROFILE
+  if(CI_UNLIKELY( ni->state->lock_prof.grant_frc != 0 ))
+    __ci_netif_lock_prof_release(ni);
+#endif
   if(CI_LIKELY( ni->state->lock.lock == CI_EPLOCK_LOCKED &&
                 ci_cas64u_succeed(&ni->state->lock.lock,
                                   CI_EPLOCK_LOCKED, CI_EPLOCK_UNLOCKED) ))
@@ -276,6 +276,18 @@ void ci_netif_print_sockets(ci_netif* ni)
 }
 
 
+static const char* page_shift_str(int page_shift)
+{
+  switch( page_shift ) {
+  case 12:  return "4K";
+  case 16:  return "64K";
+  case 21:  return "2M";
+  case 30:  return "1G";
+  default:  return "?";
+  }
+}
+
+
 static void ci_netif_dump_pkt_summary(ci_netif* ni, oo_dump_log_fn_t logger,
                                       void* log_arg)
 {
@@ -287,7 +299,9 @@ static void ci_netif_dump_pkt_summary(ci_netif* ni, oo_dump_log_fn_t logger,
          ni->packets->sets_n);
 
   for( i = 0; i < ni->packets->sets_n; i++ ) {
-    logger(log_arg, "  pkt_set[%d]: free=%d%s", i, ni->packets->set[i].n_free,
+    logger(log_arg, "  pkt_set[%d]: free=%d node=%d page=%s%s", i,
+           ni->packets->set[i].n_free, (int) ni->packets->set[i].numa_node,
+           page_shift_str(ni->packets->set[i].page_shift),
            i == ni->packets->id ? " current" : "");
   }
 
@@ -567,11 +581,31 @@ void ci_netif_dump_extra(ci_netif* ni)
   log("  hwport_to_intf_i=%s intf_i_to_hwport=%s", hp2i, i2hp);
   log("  uk_intf_ver=%s", OO_UK_INTF_VER);
   log("  deferred count %d/%d", ns->defer_work_count, NI_OPTS(ni).defer_work_limit);
-  log("  numa nodes: creation=%d load=%d",
-      ns->creation_numa_node, ns->load_numa_node);
+  log("  numa nodes: creation=%d load=%d mem=%d state=%d",
+      ns->creation_numa_node, ns->load_numa_node, ns->mem_numa_node,
+      ns->state_numa_node);
   log("  numa node masks: packet alloc=%x sock alloc=%x interrupt=%x",
       ns->packet_alloc_numa_nodes, ns->sock_alloc_numa_nodes,
       ns->interrupt_numa_nodes);
+
+  /* Where the packet memory actually ended up, and in what size pages,
+   * so that a fallback from huge pages or from the preferred node shows.
+   */
+  for( i = 0; i < ni->packets->sets_n; ++i ) {
+    oo_pktbuf_set* set = &ni->packets->set[i];
+    int j, n = 0;
+    for( j = 0; j < i; ++j )
+      if( ni->packets->set[j].numa_node == set->numa_node &&
+          ni->packets->set[j].page_shift == set->page_shift )
+        break;
+    if( j < i )
+      continue;
+    for( j = i; j < ni->packets->sets_n; ++j )
+      n += ni->packets->set[j].numa_node == set->numa_node &&
+           ni->packets->set[j].page_shift == set->page_shift;
+    log("  pkt_mem: node=%d page=%s sets=%d", (int) set->numa_node,
+        page_shift_str(set->page_shift), n);
+  }
 }
 
 
@@ -588,13 +622,17 @@ static void ci_netif_dump_vi(ci_netif* ni, int intf_i, oo_dump_log_fn_t logger,
     return;
   }
 
-  logger(log_arg, "%s: stack=%d intf=%d dev=%s hw=%d%c%d", __FUNCTION__,
-         NI_ID(ni), intf_i, nic->pci_dev, (int) nic->vi_arch,
-         nic->vi_variant, (int) nic->vi_revision);
+  logger(log_arg, "%s: stack=%d intf=%d dev=%s node=%d hw=%d%c%d",
+         __FUNCTION__, NI_ID(ni), intf_i, nic->pci_dev, (int) nic->numa_node,
+         (int) nic->vi_arch, nic->vi_variant, (int) nic->vi_revision);
   logger(log_arg, "  vi=%d pd_owner=%d channel=%d%s oo_vi_flags=%x",
          ef_vi_instance(vi), nic->pd_owner, (int) nic->vi_channel,
          ni->state->dump_intf[intf_i] ? " tcpdump" : "",
          nic->oo_vi_flags);
+  if( nic->rss_n_queues != 0 )
+    logger(log_arg, "  cluster: rss_queue=%d/%d hash=%x/%x",
+           (int) nic->rss_queue, (int) nic->rss_n_queues,
+           (unsigned) nic->rss_hash_passive, (unsigned) nic->rss_hash_active);
   logger(log_arg, "  evq: cap=%d current=%x is_32_evs=%d is_ev=%d",
          ef_eventq_capacity(vi), (unsigned) ef_eventq_current(vi),
          ef_eventq_has_many_events(vi, 32), ef_eventq_has_event(vi));
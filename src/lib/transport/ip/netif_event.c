@@ -497,7 +497,7 @@ static void ci_sock_put_on_reap_list(ci_netif* ni, ci_sock_cmn* s)
 }
 
 
-static void process_post_poll_list(ci_netif* ni)
+static void __process_post_poll_list(ci_netif* ni)
 {
   ci_ni_dllist_link* lnk;
   int i, need_wake = 0;
@@ -536,6 +536,8 @@ static void process_post_poll_list(ci_netif* ni)
         sb->sb_flags = 0;
       }
       else {
+        ci_netif_trace(ni, CI_TRACE_WAKE, W_ID(sb), sb->sb_flags,
+                       sb->wake_request, 0);
 #ifdef __KERNEL__
         /* In realtime kernel, citp_waitable_wakeup() from NAPI context is
          * harmful */
@@ -600,6 +602,18 @@ static void process_post_poll_list(ci_netif* ni)
 }
 
 
+static void process_post_poll_list(ci_netif* ni)
+{
+  ci_uint64 prof_start;
+
+  prof_start = ci_netif_lock_prof_section_enter(ni,
+                                                CI_NETIF_LOCK_SITE_POST_POLL);
+  __process_post_poll_list(ni);
+  ci_netif_lock_prof_section_leave(ni, CI_NETIF_LOCK_SITE_POST_POLL,
+                                   prof_start);
+}
+
+
 #if CI_CFG_UDP
 
 # define UDP_CAN_FREE(us)  ((us)->tx_count == 0)
@@ -619,6 +633,8 @@ static void ci_netif_tx_pkt_complete_udp(ci_netif* netif,
 
   us = SP_TO_UDP(netif, pkt->pf.udp.tx_sock_id);
 
+  ci_lat_hist_record(netif, &us->s.b, CI_LAT_HIST_TX_DONE,
+                     pkt->pf.udp.tx_stamp);
   ci_udp_dec_tx_count(us, pkt);
 
   if( ci_udp_tx_advertise_space(us) ) {
@@ -825,6 +841,10 @@ static int ci_netif_poll_evq(ci_netif* ni, struct ci_netif_poll_state* ps,
 
       else if( EF_EVENT_TYPE(ev[i]) == EF_EVENT_TYPE_OFLOW ) {
         LOG_E(log(LPF "***** EVENT QUEUE OVERFLOW *****"));
+#ifndef __KERNEL__
+        if( ps->filter_pending_n )
+          ci_tcp_listenq_promote_flush(ni, ps);
+#endif
         return 0;
       }
 
@@ -861,6 +881,14 @@ static int ci_netif_poll_evq(ci_netif* ni, struct ci_netif_poll_state* ps,
     ni->state->nic[intf_i].rx_frags = OO_PKT_P(s.frag_pkt);
   }
 
+#ifndef __KERNEL__
+  /* Connections promoted from the listen queue during this poll wait here
+   * so that their filters can be set with a single call into the driver.
+   */
+  if( ps->filter_pending_n )
+    ci_tcp_listenq_promote_flush(ni, ps);
+#endif
+
   return total_evs;
 }
 
@@ -902,6 +930,9 @@ static int ci_netif_poll_intf(ci_netif* ni, int intf_i, int max_evs)
   ci_assert(ci_netif_is_locked(ni));
   ps.tx_pkt_free_list_insert = &ps.tx_pkt_free_list;
   ps.tx_pkt_free_list_n = 0;
+#ifndef __KERNEL__
+  ps.filter_pending_n = 0;
+#endif
 
   do {
     rc = ci_netif_poll_evq(ni, &ps, intf_i);
@@ -951,11 +982,15 @@ int ci_netif_poll_intf_fast(ci_netif* ni, int intf_i, ci_uint64 now_frc)
 
   ci_assert(ci_netif_is_locked(ni));
   ci_assert(ni->state->in_poll == 0);
+  ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_POLL);
 
   if(CI_LIKELY( ni->state->poll_work_outstanding == 0 )) {
     ci_ip_time_update(IPTIMER_STATE(ni), now_frc);
     ps.tx_pkt_free_list_insert = &ps.tx_pkt_free_list;
     ps.tx_pkt_free_list_n = 0;
+#ifndef __KERNEL__
+    ps.filter_pending_n = 0;
+#endif
     ++ni->state->in_poll;
     if( (rc = ci_netif_poll_evq(ni, &ps, intf_i)) ) {
       process_post_poll_list(ni);
@@ -1029,6 +1064,7 @@ static void ci_netif_loopback_pkts_send(ci_netif* ni)
 int ci_netif_poll_n(ci_netif* netif, int max_evs)
 {
   int intf_i, n_evs_handled = 0;
+  ci_uint64 prof_start, trace_start;
 
 #if defined(__KERNEL__) || ! defined(NDEBUG)
   if( netif->error_flags )
@@ -1037,6 +1073,9 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
 
   ci_assert(ci_netif_is_locked(netif));
   CHECK_NI(netif);
+  ci_netif_lock_prof_site(netif, CI_NETIF_LOCK_SITE_POLL);
+  trace_start = ci_netif_trace_stamp(netif);
+  ci_netif_trace(netif, CI_TRACE_POLL_START, -1, max_evs, 0, 0);
 
 #ifdef __KERNEL__
   CITP_STATS_NETIF_INC(netif, k_polls);
@@ -1073,15 +1112,26 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
 
   /* Timer code can't use in-poll wakeup, since endpoints are out of
    * post-poll list.  So, poll timers after --in_poll. */
+  prof_start = ci_netif_lock_prof_section_enter(netif,
+                                                CI_NETIF_LOCK_SITE_TIMER);
   ci_ip_timer_poll(netif);
+  ci_netif_lock_prof_section_leave(netif, CI_NETIF_LOCK_SITE_TIMER,
+                                   prof_start);
 
   /* Timers MUST NOT send via loopback. */
   ci_assert(OO_PP_IS_NULL(netif->state->looppkts));
 
   if(CI_LIKELY( netif->state->rxq_low <= 1 ))
     netif->state->mem_pressure &= ~OO_MEM_PRESSURE_LOW;
-  else
+  else if( ~netif->state->mem_pressure & OO_MEM_PRESSURE_LOW ) {
     netif->state->mem_pressure |= OO_MEM_PRESSURE_LOW;
+    /* Grow now rather than waiting for the free pool to run dry. */
+    if( netif->packets->sets_n < netif->packets->sets_max ) {
+      ef_eplock_holder_set_flag(&netif->state->lock,
+                                CI_EPLOCK_NETIF_NEED_PKT_SET);
+      CITP_STATS_NETIF_INC(netif, mem_pressure_pkt_set_requests);
+    }
+  }
 
   /* ?? TODO: move this into an unlock flag. */
   if(CI_UNLIKELY( netif->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL ))
@@ -1089,6 +1139,8 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
       CITP_STATS_NETIF_INC(netif, memory_pressure_exit_poll);
 
   netif->state->poll_work_outstanding = 0;
+  ci_netif_trace_latency(netif, CI_TRACE_POLL_END, n_evs_handled,
+                         trace_start);
 
   /* returns the number of events handled */
   return n_evs_handled;
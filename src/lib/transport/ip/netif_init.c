@@ -146,6 +146,8 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
 
   nis->free_eps_head = OO_SP_NULL;
   nis->deferred_free_eps_head = CI_ILL_END;
+  nis->lat_hist_free_head = CI_ILL_END;
+  assert_zero(nis->n_lat_hist_bufs);
   assert_zero(nis->n_ep_bufs);
   nis->max_ep_bufs = NI_OPTS(ni).max_ep_bufs;
 
@@ -174,6 +176,7 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
             __oo_usec_to_cycles64(cpu_khz, NI_OPTS(ni).timer_prime_usec);
 
   ci_ip_timer_state_init(ni, cpu_khz);
+  nis->periodic_rearm_ticks = IPTIMER_STATE(ni)->sched_ticks;
   nis->last_spin_poll_frc = IPTIMER_STATE(ni)->frc;
   nis->last_sleep_frc = IPTIMER_STATE(ni)->frc;
   
@@ -198,7 +201,7 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
   /* This gets set appropriately in tcp_helper_init_max_mss() */
   nis->max_mss = 0;
 
-  if( nis->opts.tcp_syncookies )
+  if( nis->opts.tcp_syncookies || nis->opts.tcp_syncookies_pressure )
     get_random_bytes(&nis->hash_salt, sizeof(nis->hash_salt));
 
   nis->ready_lists_in_use = 1;
@@ -215,6 +218,11 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
   nis->creation_numa_node = numa_node_id();
   nis->load_numa_node = efab_tcp_driver.load_numa_node;
 
+  ci_netif_lock_prof_init(ni);
+#if CI_CFG_TRACE
+  ci_netif_trace_init(ni);
+#endif
+
 #if CI_CFG_FD_CACHING
   ci_ni_dllist_init(ni, &nis->active_cache.cache,
                     oo_ptr_to_statep(ni, &nis->active_cache.cache), "ach");
@@ -682,6 +690,11 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
       opts->int_driven = 0;
   }
 
+  if( (s = getenv("EF_SPIN_ADAPTIVE")) )
+    opts->spin_adaptive = atoi(s);
+  if( (s = getenv("EF_SPIN_WAKE_COST_USEC")) )
+    opts->spin_wake_cost_usec = atoi(s);
+
   if( (s = getenv("EF_INT_DRIVEN")) )
     opts->int_driven = atoi(s);
   if( opts->int_driven )
@@ -695,6 +708,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   }
   if( (s = getenv("EF_HELPER_PRIME_USEC")) )
     opts->timer_prime_usec = atoi(s);
+  if( (s = getenv("EF_PERIODIC_TIMER_MAX_MSEC")) )
+    opts->periodic_timer_max_msec = atoi(s);
 
   if( (s = getenv("EF_BUZZ_USEC")) ) {
     opts->buzz_usec = atoi(s);
@@ -776,6 +791,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     if( opts->max_rx_packets > opts->max_packets )
       opts->max_rx_packets = opts->max_packets;
   }
+  if( (s = getenv("EF_RX_PKT_QUOTA")) )
+    opts->rx_pkt_quota = atoi(s);
   if ( (s = getenv("EF_MAX_TX_PACKETS")) ) {
     opts->max_tx_packets = atoi(s);
     if( opts->max_tx_packets > opts->max_packets )
@@ -799,6 +816,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   if( (s = getenv("EF_USE_HUGE_PAGES")) ) {
     opts->huge_pages = atoi(s);
   }
+  if( (s = getenv("EF_USE_1G_HUGE_PAGES")) )
+    opts->huge_pages_1g = atoi(s);
   if( opts->huge_pages != 0 && opts->share_with != 0 ) {
     CONFIG_LOG(opts, CONFIG_WARNINGS, "Turning huge pages off because the "
                "stack is going to be used by multiple users");
@@ -807,6 +826,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
 #endif
   if ( (s = getenv("EF_COMPOUND_PAGES_MODE")) )
     opts->compound_pages = atoi(s);
+  if( (s = getenv("EF_NUMA_NODE")) )
+    opts->numa_node = atoi(s);
   if ( (s = getenv("EF_SYNC_CPLANE_AT_CREATE")) ) {
     opts->sync_cplane = atoi(s);
   }
@@ -897,6 +918,10 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     opts->poll_on_demand = atoi(s);
   if( (s = getenv("EF_INT_REPRIME")) )
     opts->int_reprime = atoi(s);
+  if( (s = getenv("EF_INT_WAKE_BATCH")) )
+    opts->int_wake_batch = atoi(s);
+  if( (s = getenv("EF_ACCEPT_WAKE_EXCLUSIVE")) )
+    opts->accept_wake_exclusive = atoi(s);
   if( (s = getenv("EF_IRQ_MODERATION")) )
     opts->irq_usec = atoi(s);
   if( (s = getenv("EF_NONAGLE_INFLIGHT_MAX")) )
@@ -987,6 +1012,10 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
 
   if( (s = getenv("EF_ACCEPTQ_MIN_BACKLOG")) )
     opts->acceptq_min_backlog = atoi(s);
+  if( (s = getenv("EF_TCP_ACCEPTQ_SHARDS")) )
+    opts->tcp_acceptq_shards = atoi(s);
+  if( (s = getenv("EF_TCP_ACCEPTQ_SHARD_MODE")) )
+    opts->tcp_acceptq_shard_mode = atoi(s);
 
   if ( (s = getenv("EF_TCP_SNDBUF")) )
     opts->tcp_sndbuf_user = atoi(s);
@@ -1132,8 +1161,21 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   if( (s = getenv("EF_TIMESTAMPING_REPORTING")) )
     opts->timestamping_reporting = atoi(s);
 
+  if( (s = getenv("EF_LAT_HIST")) )
+    opts->lat_hist = atoi(s);
+  if( (s = getenv("EF_LOCK_PROFILE")) )
+    opts->lock_profile = atoi(s);
+  if( (s = getenv("EF_TRACE")) )
+    opts->trace = atoi(s);
+  if( (s = getenv("EF_TRACE_FREEZE_USEC")) )
+    opts->trace_freeze_usec = atoi(s);
+  if( (s = getenv("EF_TRACE_FREEZE_MEM_PRESSURE")) )
+    opts->trace_freeze_mem_pressure = atoi(s);
+
   if( (s = getenv("EF_TCP_SYNCOOKIES")) )
     opts->tcp_syncookies = atoi(s);
+  if( (s = getenv("EF_TCP_SYNCOOKIES_PRESSURE")) )
+    opts->tcp_syncookies_pressure = atoi(s);
 
   if( (s = getenv("EF_CLUSTER_IGNORE")) )
     opts->cluster_ignore = atoi(s);
@@ -1329,6 +1371,10 @@ static void netif_tcp_helper_build2(ci_netif* ni)
   ni->filter_table =
     (ci_netif_filter_table*) ((char*) ni->state + ni->state->table_ofs);
   ni->packets = (oo_pktbuf_manager*) ((char*) ni->state + ni->state->buf_ofs);
+#if CI_CFG_TRACE
+  ni->trace_rec = ni->state->trace.rec_ofs == 0 ? NULL :
+    (ci_trace_rec*) ((char*) ni->state + ni->state->trace.rec_ofs);
+#endif
 }
 
 
@@ -1346,8 +1392,19 @@ static void netif_tcp_helper_munmap(ci_netif* ni)
     for( id = 0; id < ni->packets->sets_n; id++ ) {
       if( PKT_BUFSET_U_MMAPPED(ni, id) ) {
 #if CI_CFG_PKTS_AS_HUGE_PAGES
-        if( ni->packets->set[id].shm_id >= 0 )
-          rc = shmdt(ni->pkt_bufs[id]);
+        if( ni->packets->set[id].shm_id >= 0 ) {
+          /* Sets sharing a 1GB segment were attached once; detach it
+           * with the first of them. */
+          unsigned j;
+          for( j = 0; j < id; j++ )
+            if( PKT_BUFSET_U_MMAPPED(ni, j) &&
+                ni->packets->set[j].shm_id == ni->packets->set[id].shm_id )
+              break;
+          rc = 0;
+          if( j == id )
+            rc = shmdt((char*) ni->pkt_bufs[id] -
+                       ni->packets->set[id].shm_offset);
+        }
         else
 #endif
         {
@@ -2074,14 +2131,13 @@ static void ci_netif_pkt_reserve_free(ci_netif* ni, oo_pkt_p pkt_list, int n)
 
 #ifndef __KERNEL__
 
-static int ci_netif_pkt_prefault(ci_netif* ni)
+static int ci_netif_pkt_touch(ci_netif* ni)
 {
   /* Touch all allocated packet buffers so we don't incur the cost of
    * faulting them info this address space later.
    *
    * The return value is not useful, and only exists to prevent
-   * optimisations that would render this function useless.  This is also
-   * the reason the function is not static.
+   * optimisations that would render this function useless.
    *
    * Similarly, the cast into volatile is designed to prevent compiler
    * optimisations.
@@ -2090,17 +2146,65 @@ static int ci_netif_pkt_prefault(ci_netif* ni)
   int i, n;
   int rc = 0;
 
-  if( NI_OPTS(ni).prefault_packets ) {
-    n = ni->packets->n_pkts_allocated;
-    for( i = 0; i < n; ++i ) {
-      pkt = PKT(ni, i);
-      rc += *(volatile ci_int32*)(&pkt->refcount);
-    }
+  n = ni->packets->n_pkts_allocated;
+  for( i = 0; i < n; ++i ) {
+    pkt = PKT(ni, i);
+    rc += *(volatile ci_int32*)(&pkt->refcount);
   }
   return rc;
 }
 
 
+static int ci_netif_pkt_prefault(ci_netif* ni)
+{
+  if( NI_OPTS(ni).prefault_packets )
+    return ci_netif_pkt_touch(ni);
+  return 0;
+}
+
+
+/* Read a byte from each page of [p, p + len), and return the number of
+ * pages.
+ */
+int ci_netif_touch_pages(const void* p, size_t len)
+{
+  const char* c = (const char*) ((ci_uintptr_t) p & ~(CI_PAGE_SIZE - 1));
+  const char* end = (const char*) p + len;
+  int n = 0;
+
+  for( ; c < end; c += CI_PAGE_SIZE, ++n )
+    (void) *(volatile const char*) CI_MAX(c, (const char*) p);
+  return n;
+}
+
+
+int ci_netif_warm(ci_netif* ni)
+{
+  ci_netif_state* ns = ni->state;
+  int intf_i, n;
+  ef_vi* vi;
+
+  /* The shared state, and the endpoint buffers in use. */
+  n = ci_netif_touch_pages(ns, ns->ep_ofs);
+  n += ci_netif_touch_pages((char*) ns + ns->ep_ofs,
+                            (size_t) ns->n_ep_bufs * EP_BUF_SIZE);
+
+  /* The rings we poll and post to. */
+  OO_STACK_FOR_EACH_INTF_I(ni, intf_i) {
+    vi = &ni->nic_hw[intf_i].vi;
+    n += ci_netif_touch_pages(vi->evq_base, vi->evq_mask + 1);
+    n += ci_netif_touch_pages(vi->vi_rxq.descriptors,
+                              (vi->vi_rxq.mask + 1) * sizeof(ci_uint64));
+    n += ci_netif_touch_pages(vi->vi_txq.descriptors,
+                              (vi->vi_txq.mask + 1) * sizeof(ci_uint64));
+  }
+
+  ci_netif_pkt_touch(ni);
+  n += (ni->packets->n_pkts_allocated * CI_CFG_PKT_BUF_SIZE) / CI_PAGE_SIZE;
+  return n;
+}
+
+
 static void ci_netif_pkt_prefault_reserve(ci_netif* ni)
 {
   oo_pkt_p pkt_list;
@@ -2178,6 +2282,7 @@ int ci_netif_ctor(ci_netif* ni, ef_driver_handle fd, const char* stack_name,
   oo_atomic_set(&ni->ref_count, 0);
   ni->flags = 0;
   ni->error_flags = 0;
+  ni->rss_hash_cache = NULL;
 
   NI_LOG(ni, BANNER,
          "Using "ONLOAD_PRODUCT" "ONLOAD_VERSION" "ONLOAD_COPYRIGHT" [%s]",
@@ -2370,6 +2475,9 @@ int ci_netif_dtor(ci_netif* ni)
 {
   ci_assert(ni);
 
+#ifndef __KERNEL__
+  ci_netif_rss_dtor(ni);
+#endif
   /* \TODO Check if we should be calling ci_ipid_dtor() here. */
   /* Free the TCP helper resource */
   netif_tcp_helper_free(ni);
@@ -2482,6 +2590,7 @@ int ci_netif_restore(ci_netif* ni, ef_driver_handle fd,
   ni->driver_handle = fd;
   ni->flags = 0;
   ni->error_flags = 0;
+  ni->rss_hash_cache = NULL;
 
   CI_TRY_RET(netif_tcp_helper_restore(ni, netif_mmap_bytes));
 
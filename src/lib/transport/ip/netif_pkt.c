@@ -31,6 +31,22 @@
 
 pthread_mutex_t citp_pkt_map_lock = PTHREAD_MUTEX_INITIALIZER;
 
+#if CI_CFG_PKTS_AS_HUGE_PAGES
+/* Sets carved from the same 1GB huge page share a segment, which need only
+ * be attached once.  Returns the address of the segment, or NULL if it is
+ * not yet attached.
+ */
+static char* ci_netif_pkt_shm_attached(ci_netif* ni, int shm_id)
+{
+  int i;
+
+  for( i = 0; i < ni->packets->sets_n; ++i )
+    if( ni->packets->set[i].shm_id == shm_id && PKT_BUFSET_U_MMAPPED(ni, i) )
+      return (char*) ni->pkt_bufs[i] - ni->packets->set[i].shm_offset;
+  return NULL;
+}
+#endif
+
 ci_ip_pkt_fmt* __ci_netif_pkt(ci_netif* ni, unsigned id)
 {
   int rc;
@@ -48,7 +64,9 @@ ci_ip_pkt_fmt* __ci_netif_pkt(ci_netif* ni, unsigned id)
 
 #if CI_CFG_PKTS_AS_HUGE_PAGES
   if( ni->packets->set[setid].shm_id >= 0 ) {
-    p = shmat(ni->packets->set[setid].shm_id, NULL, 0);
+    p = ci_netif_pkt_shm_attached(ni, ni->packets->set[setid].shm_id);
+    if( p == NULL )
+      p = shmat(ni->packets->set[setid].shm_id, NULL, 0);
     if( p == (void *)-1) {
       if( errno == EACCES ) {
         ci_log("Failed to mmap packet buffer for [%s] with errno=EACCES.\n"
@@ -64,6 +82,7 @@ ci_ip_pkt_fmt* __ci_netif_pkt(ci_netif* ni, unsigned id)
       }
       goto out;
     }
+    p = (char*) p + ni->packets->set[setid].shm_offset;
   }
   else
 #endif
@@ -109,6 +128,30 @@ int ci_netif_pktset_best(ci_netif* ni)
 }
 
 
+int ci_netif_pktset_best_for_intf(ci_netif* ni, int intf_i)
+{
+  /* As ci_netif_pktset_best(), but prefer a set whose memory is on the
+   * same NUMA node as the NIC, provided it has enough free buffers for an
+   * RX refill batch.
+   */
+  int i, ret = -1, n_free = CI_CFG_RX_DESC_BATCH - 1;
+  int node = ni->state->nic[intf_i].numa_node;
+
+  if( node >= 0 )
+    for( i = 0; i < ni->packets->sets_n; i ++ )
+      if( ni->packets->set[i].numa_node == node &&
+          ni->packets->set[i].n_free > n_free ) {
+        n_free = ni->packets->set[i].n_free;
+        ret = i;
+      }
+  if( ret < 0 )
+    return ci_netif_pktset_best(ni);
+  if( ni->packets->set[NI_PKT_SET(ni)].numa_node != node )
+    CITP_STATS_NETIF_INC(ni, rx_refill_numa_local);
+  return ret;
+}
+
+
 ci_ip_pkt_fmt* ci_netif_pkt_alloc_slow(ci_netif* ni, int for_tcp_tx, int use_nonb)
 {
   /* This is the slow path of ci_netif_pkt_alloc() and
@@ -270,10 +313,22 @@ void ci_netif_pkt_free(ci_netif* ni, ci_ip_pkt_fmt* pkt
 }
 
 
+static int ci_netif_sock_rx_pkts(citp_waitable_obj* wo)
+{
+  if( wo->waitable.state & CI_TCP_STATE_TCP_CONN )
+    return wo->tcp.recv1.num + wo->tcp.recv2.num + wo->tcp.rob.num;
+#if CI_CFG_UDP
+  else if( wo->waitable.state == CI_TCP_STATE_UDP )
+    return ci_udp_recv_q_pkts(&wo->udp.recv_q);
+#endif
+  return 0;
+}
+
+
 int ci_netif_pkt_try_to_free(ci_netif* ni, int desperation, int stop_once_freed_n)
 {
   unsigned id;
-  int freed = 0;
+  int freed = 0, pass, quota, n;
 
   ci_assert(ci_netif_is_locked(ni));
   ci_assert_ge(desperation, 0);
@@ -287,17 +342,29 @@ int ci_netif_pkt_try_to_free(ci_netif* ni, int desperation, int stop_once_freed_
             == CI_NETIF_PKT_TRY_TO_FREE_MAX_DESP);
   CITP_STATS_NETIF(++(&ni->state->stats.pkt_scramble0)[desperation]);
 
-  for( id = 0; id < ni->state->n_ep_bufs; ++id ) {
-    citp_waitable_obj* wo = ID_TO_WAITABLE_OBJ(ni, id);
-    if( wo->waitable.state & CI_TCP_STATE_TCP_CONN )
-      freed += ci_tcp_try_to_free_pkts(ni, &wo->tcp, desperation);
+  /* Reclaim first from the sockets holding the most buffers, so that the
+   * cost of a slow reader falls on that reader.  Only then try everyone.
+   */
+  quota = ci_netif_rx_pkt_quota(ni);
+  for( pass = 0; pass < 2; ++pass )
+    for( id = 0; id < ni->state->n_ep_bufs; ++id ) {
+      citp_waitable_obj* wo = ID_TO_WAITABLE_OBJ(ni, id);
+      if( (ci_netif_sock_rx_pkts(wo) > quota) == pass )
+        continue;
+      if( wo->waitable.state & CI_TCP_STATE_TCP_CONN )
+        n = ci_tcp_try_to_free_pkts(ni, &wo->tcp, desperation);
 #if CI_CFG_UDP
-    else if( wo->waitable.state == CI_TCP_STATE_UDP )
-      freed += ci_udp_try_to_free_pkts(ni, &wo->udp, desperation);
+      else if( wo->waitable.state == CI_TCP_STATE_UDP )
+        n = ci_udp_try_to_free_pkts(ni, &wo->udp, desperation);
 #endif
-    if( freed >= stop_once_freed_n )
-      return freed;
-  }
+      else
+        continue;
+      freed += n;
+      if( pass == 0 && NI_OPTS(ni).rx_pkt_quota != 0 )
+        CITP_STATS_NETIF_ADD(ni, rx_pkt_quota_reclaimed, n);
+      if( freed >= stop_once_freed_n )
+        return freed;
+    }
   return freed;
 }
 
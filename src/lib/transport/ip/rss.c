@@ -0,0 +1,136 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  Predict which cluster member receives a flow.
+**   \date  2016/10/18
+**    \cop  (c) Solarflare Communications Inc.
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_transport_ip */
+
+/* A cluster's listen filters spread flows over its stacks with the NIC's
+ * RSS hash.  The driver publishes the key and indirection table in each
+ * stack's per-interface state, so we can compute the same hash here.
+ *
+ * The hash input is the received packet's source address, destination
+ * address, source port and destination port, omitting whichever half of
+ * the tuple the context does not cover (see CI_RSS_HASH_*).
+ */
+
+#include "ip_internal.h"
+
+
+#define RSS_BATCH  64
+
+
+int ci_netif_rss_intf(ci_netif* ni)
+{
+  int intf_i;
+
+  /* All interfaces of a cluster spread with the same key and table, so
+   * just use the first one that knows how.
+   */
+  OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
+    if( ni->state->nic[intf_i].rss_n_queues != 0 )
+      return intf_i;
+  return -1;
+}
+
+
+static const ci_toeplitz_cache* ci_netif_rss_cache(ci_netif* ni, int intf_i)
+{
+  ci_toeplitz_cache* cache = ni->rss_hash_cache;
+
+  if( cache != NULL )
+    return cache;
+  if( (cache = malloc(sizeof(*cache))) == NULL )
+    return NULL;
+  ci_toeplitz_cache_init(cache, ni->state->nic[intf_i].rss_key);
+  /* Another thread may have got there first. */
+  if( ci_cas_uintptr_fail(&ni->rss_hash_cache, 0, (ci_uintptr_t) cache) ) {
+    free(cache);
+    cache = ni->rss_hash_cache;
+  }
+  return cache;
+}
+
+
+static void rss_tuple_input(const ci_rss_tuple* t, unsigned hash,
+                            ci_uint8* p)
+{
+  if( hash & CI_RSS_HASH_SRC ) {
+    memcpy(p, &t->raddr_be32, 4);
+    p += 4;
+  }
+  if( hash & CI_RSS_HASH_DST ) {
+    memcpy(p, &t->laddr_be32, 4);
+    p += 4;
+  }
+  if( hash & CI_RSS_HASH_SRC ) {
+    memcpy(p, &t->rport_be16, 2);
+    p += 2;
+  }
+  if( hash & CI_RSS_HASH_DST ) {
+    memcpy(p, &t->lport_be16, 2);
+    p += 2;
+  }
+}
+
+
+int ci_netif_rss_queues(ci_netif* ni, int active, const ci_rss_tuple* tuples,
+                        int n, int* queues)
+{
+  ci_uint8 input[RSS_BATCH * CI_TOEPLITZ_CACHE_MAX_INPUT];
+  ci_uint32 hashes[RSS_BATCH];
+  const ci_toeplitz_cache* cache;
+  const ci_netif_state_nic_t* nsn;
+  int intf_i, i, j, batch, len;
+  unsigned hash;
+
+  if( (intf_i = ci_netif_rss_intf(ni)) < 0 )
+    return -ENOENT;
+  if( (cache = ci_netif_rss_cache(ni, intf_i)) == NULL )
+    return -ENOMEM;
+  nsn = &ni->state->nic[intf_i];
+  hash = active ? nsn->rss_hash_active : nsn->rss_hash_passive;
+  /* An address and a port for each half of the tuple covered. */
+  len = ((hash & CI_RSS_HASH_SRC) ? 6 : 0) +
+        ((hash & CI_RSS_HASH_DST) ? 6 : 0);
+
+  for( i = 0; i < n; i += batch ) {
+    batch = CI_MIN(n - i, RSS_BATCH);
+    for( j = 0; j < batch; ++j )
+      rss_tuple_input(&tuples[i + j], hash, input + j * len);
+    ci_toeplitz_hash_batch(cache, input, len, batch, hashes);
+    for( j = 0; j < batch; ++j )
+      queues[i + j] =
+        nsn->rss_indir_table[hashes[j] & (CI_RSS_TABLE_LEN - 1)];
+  }
+  return 0;
+}
+
+
+void ci_netif_rss_dtor(ci_netif* ni)
+{
+  free(ni->rss_hash_cache);
+  ni->rss_hash_cache = NULL;
+}
+
+/*! \cidoxg_end */
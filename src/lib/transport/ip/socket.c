@@ -99,6 +99,11 @@ void ci_sock_cmn_init(ci_netif* ni, ci_sock_cmn* s, int can_poison)
 
   ci_sock_cmn_reinit(ni, s);
 
+#if CI_CFG_LAT_HIST
+  if( NI_OPTS(ni).lat_hist )
+    ci_lat_hist_attach(ni, &s->b);
+#endif
+
   sp = oo_sockp_to_statep(ni, SC_SP(s));
   OO_P_ADD(sp, CI_MEMBER_OFFSET(ci_sock_cmn, reap_link));
   ci_ni_dllist_link_init(ni, &s->reap_link, sp, "reap");
@@ -616,7 +616,12 @@ void ci_tcp_listen_shutdown_queues(ci_netif* netif, ci_tcp_socket_listen* tls)
     ci_tcp_state* ats;    /* accepted ts */
     tcp_helper_resource_t *thr = NULL;
 
+    /* A concurrent accept() may have emptied the queue, or held a shard
+     * lock for too long.  Anything left is dropped when the listener is
+     * finally closed. */
     w = ci_tcp_acceptq_get(netif, tls);
+    if( w == NULL )
+      break;
 
     if( w->sb_aflags & CI_SB_AFLAG_MOVED_AWAY ) {
       oo_sp sp;
@@ -702,7 +707,9 @@ void ci_tcp_listen_shutdown_queues(ci_netif* netif, ci_tcp_socket_listen* tls)
 #endif
   }
 
-  ci_assert_equal(ci_tcp_acceptq_n(tls), 0);
+  /* Only an orphan is sure to have no accept() racing with us. */
+  if( tls->s.b.sb_aflags & CI_SB_AFLAG_ORPHAN )
+    ci_assert_equal(ci_tcp_acceptq_n(tls), 0);
 
 #if CI_CFG_FD_CACHING
   /* Above we uncached and closed EPs on the accept q.  While an EP is cached
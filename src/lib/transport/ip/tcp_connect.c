@@ -899,11 +899,18 @@ static int ci_tcp_listen_init(ci_netif *ni, ci_tcp_socket_listen *tls)
   int i;
   oo_p sp;
 
-  tls->acceptq_n_in = tls->acceptq_n_out = 0;
-  tls->acceptq_put = CI_ILL_END;
-  tls->acceptq_get = OO_SP_NULL;
+  tls->acceptq_n_in = 0;
+  tls->acceptq_n_shards = NI_OPTS(ni).tcp_acceptq_shards;
+  tls->acceptq_put_rr = 0;
+  for( i = 0; i < tls->acceptq_n_shards; ++i ) {
+    tls->acceptq[i].put = CI_ILL_END;
+    tls->acceptq[i].get = OO_SP_NULL;
+    tls->acceptq[i].n_out = 0;
+    tls->acceptq[i].lock = 0;
+  }
   tls->n_listenq = 0;
   tls->n_listenq_new = 0;
+  tls->syncookie_pressure = 0;
 
   /* Allocate and initialise the listen bucket */
   tls->bucket = ci_ni_aux_alloc_bucket(ni);
@@ -1032,7 +1039,8 @@ int ci_tcp_connect_lo_toconn(ci_netif *c_ni, oo_sp c_id, ci_uint32 dst,
   rc = ci_tcp_connect_lo_samestack(c_ni, ts, tls->s.b.bufid);
 
   /* Accept as from tls */
-  if( !ci_tcp_acceptq_not_empty(tls) ) {
+  w = ci_tcp_acceptq_get(c_ni, tls);
+  if( w == NULL ) {
     /* it is possible, for example, if ci_tcp_listenq_try_promote() failed
      * because there are no endpoints */
     ci_tcp_listenq_drop_all(c_ni, tls);
@@ -1040,8 +1048,6 @@ int ci_tcp_connect_lo_toconn(ci_netif *c_ni, oo_sp c_id, ci_uint32 dst,
     ci_netif_unlock(c_ni);
     return -EBUSY;
   }
-  w = ci_tcp_acceptq_get(c_ni, tls);
-  ci_assert(w);
   LOG_TV(ci_log("%s: %d:%d to %d:%d shadow %d:%d accepted %d:%d",
                 __FUNCTION__,
                 c_ni->state->stack_id, OO_SP_TO_INT(c_id),
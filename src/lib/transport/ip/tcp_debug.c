@@ -690,8 +690,9 @@ void ci_tcp_socket_listen_dump(ci_netif* ni, ci_tcp_socket_listen* tls,
   logger(log_arg, "%s  listenq: max=%d n=%d new=%d buckets=%d", pf, 
          ci_tcp_listenq_max(ni), tls->n_listenq, tls->n_listenq_new,
          tls->n_buckets);
-  logger(log_arg, "%s  acceptq: max=%d n=%d accepted=%d", pf,
-         tls->acceptq_max, ci_tcp_acceptq_n(tls), tls->acceptq_n_out);
+  logger(log_arg, "%s  acceptq: max=%d n=%d accepted=%d shards=%d", pf,
+         tls->acceptq_max, ci_tcp_acceptq_n(tls),
+         tls->acceptq_n_in - ci_tcp_acceptq_n(tls), tls->acceptq_n_shards);
   logger(log_arg, "%s  defer_accept=%d", pf, tls->c.tcp_defer_accept);
 #if CI_CFG_FD_CACHING
   logger(log_arg, "%s  sockcache: n=%d sock_n=%d cache=%s pending=%s",
@@ -712,10 +713,11 @@ void ci_tcp_socket_listen_dump(ci_netif* ni, ci_tcp_socket_listen* tls,
     logger(log_arg, "%s  a_loop2_closed=%d a_no_fd=%d ack_rsts=%d os=%d",
            pf, s->n_accept_loop2_closed, s->n_accept_no_fd,
            s->n_acks_reset, s->n_accept_os);
-    if( NI_OPTS(ni).tcp_syncookies ) {
-      logger(log_arg, "%s  syncookies: syn_recv=%d ack_recv=%d ack_answ=%d",
-             pf, s->n_syncookie_syn, s->n_syncookie_ack_recv,
-             s->n_syncookie_ack_answ);
+    if( ci_tcp_syncookies_enabled(ni) ) {
+      logger(log_arg, "%s  syncookies: syn_recv=%d ack_recv=%d ack_answ=%d "
+             "pressure=%d%s", pf, s->n_syncookie_syn, s->n_syncookie_ack_recv,
+             s->n_syncookie_ack_answ, s->n_syncookie_pressure,
+             tls->syncookie_pressure ? " (now)" : "");
       logger(log_arg, "%s  syncookies rejected: timestamp=%d crypto_hash=%d",
              pf, s->n_syncookie_ack_ts_rej, s->n_syncookie_ack_hash_rej);
     }
@@ -100,6 +100,45 @@ int ci_tcp_helper_ep_set_filters(ci_fd_t           fd,
 }
 
 
+/*--------------------------------------------------------------------
+ *!
+ * Set the filters for many endpoints with one call into the driver per
+ * OO_TCP_FILTER_SET_BATCH_MAX endpoints.
+ *
+ * \param fd              File descriptor of tcp_helper
+ * \param ops             Endpoints and arguments, as for
+ *                        ci_tcp_helper_ep_set_filters()
+ * \param rcs             Out: result of each op
+ * \param n_ops           Number of ops
+ *
+ * \return                0 if every op was attempted, else standard error
+ *                        codes
+ *
+ *--------------------------------------------------------------------*/
+int ci_tcp_helper_ep_set_filters_batch(ci_fd_t                    fd,
+                                       const oo_tcp_filter_set_t* ops,
+                                       ci_int32*                  rcs,
+                                       int                        n_ops)
+{
+  oo_tcp_filter_set_batch_t op;
+  int rc, done;
+
+  VERB(ci_log("%s: n_ops=%d", __FUNCTION__, n_ops));
+  for( done = 0; done < n_ops; done += op.n_ops ) {
+    CI_USER_PTR_SET(op.ops, ops + done);
+    CI_USER_PTR_SET(op.rcs, rcs + done);
+    op.n_ops = CI_MIN(n_ops - done, OO_TCP_FILTER_SET_BATCH_MAX);
+    rc = oo_resource_op(fd, OO_IOC_EP_FILTER_SET_BATCH, &op);
+    if( rc < 0 ) {
+      LOG_SV(ci_log("%s: failed for %d ops (rc=%d)", __FUNCTION__,
+                    op.n_ops, rc));
+      return rc;
+    }
+  }
+  return 0;
+}
+
+
 /*--------------------------------------------------------------------
  *!
  * TODO
@@ -597,6 +597,10 @@ int ci_tcp_recvmsg(const ci_tcp_recvmsg_args* a)
   /* Spin (if enabled) until timeout, or something happens, or we get
   ** contention on the netif lock.
   */
+  if( tcp_recv_spin && NI_OPTS(ni).spin_adaptive &&
+      ! ci_waitable_spin_adapt_should_spin(ni, &ts->s.b) )
+    tcp_recv_spin = 0;
+
   if( tcp_recv_spin ) {
     int rc2;
 
@@ -606,9 +610,15 @@ int ci_tcp_recvmsg(const ci_tcp_recvmsg_args* a)
         CI_SET_ERROR(rinf.rc, -rc2);
         goto unlock_out;
       }
+      if( NI_OPTS(ni).spin_adaptive ) {
+        CITP_STATS_NETIF_INC(ni, spin_adapt_hit);
+        ci_waitable_spin_adapt_update(ni, &ts->s.b, start_frc, 0);
+      }
       goto poll_recv_queue;
     }
 
+    if( NI_OPTS(ni).spin_adaptive )
+      CITP_STATS_NETIF_INC(ni, spin_adapt_miss);
     tcp_recv_spin = 0;
     if( timeout ) {
       ci_uint32 spin_ms = NI_OPTS(ni).spin_usec >> 10;
@@ -641,8 +651,11 @@ int ci_tcp_recvmsg(const ci_tcp_recvmsg_args* a)
     rc2 = ci_sock_sleep(ni, &ts->s.b, CI_SB_FLAG_WAKE_RX,
                         CI_SLEEP_SOCK_LOCKED | CI_SLEEP_SOCK_RQ,
                         sleep_seq, &timeout);
-    if( rc2 == 0 )
+    if( rc2 == 0 ) {
+      if( NI_OPTS(ni).spin_adaptive )
+        ci_waitable_spin_adapt_update(ni, &ts->s.b, start_frc, 1);
       rc2 = ci_sock_lock(ni, &ts->s.b);
+    }
     if( rc2 < 0 ) {
       /* If we've received anything at all, we must say how much. */
       if( rinf.rc ) {
@@ -758,6 +771,8 @@ int ci_tcp_recvmsg(const ci_tcp_recvmsg_args* a)
   ci_tcp_fill_recv_timestamp(ni, a->msg, rinf.timestamp, &rinf.hw_timestamp,
       ts->s.cmsg_flags, ts->s.timestamping_flags);
 #endif
+  if( CI_LAT_HIST_ON(&ts->s.b) && rinf.rc > 0 )
+    __ci_lat_hist_record(ni, &ts->s.b, CI_LAT_HIST_RX_APP, rinf.timestamp);
  unlock_out:
 
   /* If we've received FIN and RXQ is empty, let's reap it.
@@ -842,6 +857,7 @@ static int ci_tcp_recvmsg_urg(struct tcp_recv_info *rinf)
     if( rc != 0 )
       return rc;
     rinf->stack_locked = 1;
+    ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_RECVMSG);
   }
   CHECK_TS(ni, ts);
 
@@ -1011,6 +1027,7 @@ static int ci_tcp_recvmsg_recv2_peek(struct tcp_recv_info *rinf)
     if( rc != 0 )
       return rc;
     rinf->stack_locked = 1;
+    ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_RECVMSG);
   }
 
   pkt = PKT_CHK(ni, recv2->head);
@@ -1070,6 +1087,7 @@ static int ci_tcp_recvmsg_handle_race(struct tcp_recv_info *rinf)
   if( rc != 0 )
     return rc;
   rinf->stack_locked = 1;
+  ci_netif_lock_prof_site(rinf->a->ni, CI_NETIF_LOCK_SITE_RECVMSG);
   /* NB. No more data can have arrived in recv1, because once we start
   ** using recv2 we stick with it until the consumer switches back to
   ** recv1.  Which we haven't.
@@ -1112,6 +1130,7 @@ static int ci_tcp_recvmsg_recv2(struct tcp_recv_info *rinf)
     if( rc != 0 )
       return rc;
     rinf->stack_locked = 1;
+    ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_RECVMSG);
   }
   CHECK_TS(ni, ts);
 
@@ -166,8 +166,12 @@ static void ci_tcp_rx_enqueue_packet(ci_netif *netif, ci_tcp_state *ts,
                   oo_offbuf_left(&pkt->buf));
 
   tcp_rcv_nxt(ts) = pkt->pf.tcp_rx.end_seq;
+  ci_lat_hist_record(netif, &ts->s.b, CI_LAT_HIST_RX_STACK,
+                     pkt->pf.tcp_rx.rx_stamp);
 
   bytes = oo_offbuf_left(&pkt->buf);
+  ci_netif_trace(netif, CI_TRACE_RX_DELIVER, S_ID(ts), OO_PKT_ID(pkt),
+                 bytes, 0);
   ci_ip_queue_enqueue(netif, rxq, pkt);
 
   if( rxq == &ts->recv1 ) {
@@ -2219,7 +2223,8 @@ static void handle_rx_synrecv_ack(ci_netif* netif, ci_tcp_socket_listen* tls,
     CITP_STATS_TCP_LISTEN(++netif->state->stats.accepts_deferred);
     ci_netif_pkt_release(netif, pkt);
   }
-  else if( ci_tcp_listenq_try_promote(netif, tls, tsr, ipcache, &ts) < 0 ) {
+  else if( ci_tcp_listenq_try_promote(netif, tls, tsr, ipcache,
+                                      rxp->poll_state, &ts) < 0 ) {
     CI_TCP_EXT_STATS_INC_LISTEN_DROPS( netif );
     LOG_U(log(LNT_FMT "SYNRECV failed to promote to acceptq, seq=%08x",
               LNT_PRI_ARGS(netif, tls), rxp->seq));
@@ -2279,6 +2284,8 @@ static void handle_rx_listen(ci_netif* netif, ci_tcp_socket_listen* tls,
   ci_ip4_hdr* ip = oo_ip_hdr(pkt);
   ci_tcp_hdr* tcp = rxp->tcp;
   ci_tcp_state_synrecv* tsr;
+  /* Stands in for a synrecv when answering with or checking a syncookie. */
+  ci_tcp_state_synrecv cookie_tsr;
   ci_ip_cached_hdrs ipcache;
   struct oo_sock_cplane sock_cp;
   oo_sp local_peer = OO_SP_NULL;
@@ -2339,9 +2346,14 @@ static void handle_rx_listen(ci_netif* netif, ci_tcp_socket_listen* tls,
       goto freepkt_out;
     }
 
+    /* Under a flood, answer without allocating any state, and create the
+    ** connection only if the final ACK arrives.
+    */
+    if( ci_tcp_listenq_syncookie_pressure(netif, tls) )
+      do_syncookie = 1;
     /* If listen queue is full: */
-    if( (tls->n_listenq >= ci_tcp_listenq_max(netif)) |
-        ( ! ci_ni_aux_can_alloc(netif) ) ) {
+    else if( (tls->n_listenq >= ci_tcp_listenq_max(netif)) |
+             ( ! ci_ni_aux_can_alloc(netif) ) ) {
 
       /* If we cope with acceptq, we can try syncookie. */
       if( NI_OPTS(netif).tcp_syncookies )
@@ -2405,18 +2417,18 @@ static void handle_rx_listen(ci_netif* netif, ci_tcp_socket_listen* tls,
   }
 
   /* Does this packet match a connection in the synrecv state? */
-  if( (tsr = ci_tcp_listenq_lookup(netif, tls, rxp)) ) {
+  if( tls->n_listenq != 0 && (tsr = ci_tcp_listenq_lookup(netif, tls, rxp)) ) {
     /* pass to relevant synrecv structure for processing */
     handle_rx_synrecv_ack(netif, tls, tsr, rxp, &ipcache);
     return;
   }
   
   /* Is it a syncookie? */
-  if( NI_OPTS(netif).tcp_syncookies && (tcp->tcp_flags & CI_TCP_FLAG_ACK) &&
+  if( ci_tcp_syncookies_enabled(netif) &&
+      (tcp->tcp_flags & CI_TCP_FLAG_ACK) &&
       ci_tcp_acceptq_n(tls) < tls->acceptq_max ) {
-    ci_tcp_state_synrecv* tsr;
-    ci_tcp_syncookie_ack(netif, tls, rxp, &tsr);
-    if( tsr != NULL ) {
+    tsr = &cookie_tsr;
+    if( ci_tcp_syncookie_ack(netif, tls, rxp, tsr) == 0 ) {
       tsr->amss = ipcache.mtu - sizeof(ci_tcp_hdr) - sizeof(ci_ip4_hdr);
 #if CI_CFG_LIMIT_AMSS
       tsr->amss = ci_tcp_limit_mss(tsr->amss, netif, __FUNCTION__);
@@ -2526,7 +2538,7 @@ static void handle_rx_listen(ci_netif* netif, ci_tcp_socket_listen* tls,
 
   /* Allocate synrecv. */
   if( do_syncookie ) {
-    tsr = ci_alloc(sizeof(ci_tcp_state_synrecv));
+    tsr = &cookie_tsr;
   }
   else {
     /* We've already called ci_ni_aux_can_alloc() above, so we are sure
@@ -2551,9 +2563,7 @@ static void handle_rx_listen(ci_netif* netif, ci_tcp_socket_listen* tls,
 #if CI_CFG_TCP_INVALID_OPT_RST
     /* bad option block, send reset rfc1122 4.2.2.5 */
     LOG_U(log(LPF "%d LISTEN bad SYN options will reset", S_FMT(tls)));
-    if( do_syncookie )
-      ci_free(tsr);
-    else
+    if( !do_syncookie )
       ci_tcp_synrecv_free(netif, tsr);
     CITP_STATS_NETIF_INC(netif, rst_sent_bad_options);
     goto reset_out;
@@ -2626,7 +2636,8 @@ static void handle_rx_listen(ci_netif* netif, ci_tcp_socket_listen* tls,
       LOG_TC(log(LNT_FMT "loopback connection deferred",
                  LNT_PRI_ARGS(netif, peer)));
     }
-    else if( ci_tcp_listenq_try_promote(netif, tls, tsr, &ipcache, &ts) < 0 ) {
+    else if( ci_tcp_listenq_try_promote(netif, tls, tsr, &ipcache,
+                                        NULL, &ts) < 0 ) {
       CI_TCP_EXT_STATS_INC_LISTEN_DROPS( netif );
       LOG_U(log(LNT_FMT "SYNRECV failed to promote local connection "
                 "to acceptq", LNT_PRI_ARGS(netif, tls)));
@@ -2634,9 +2645,6 @@ static void handle_rx_listen(ci_netif* netif, ci_tcp_socket_listen* tls,
     }
     ci_netif_pkt_release(netif, pkt);
   }
-
-  if( do_syncookie )
-    ci_free(tsr);
   return;
 
  freepkt_out:
@@ -3400,7 +3408,7 @@ static void handle_rx_slow(ci_tcp_state* ts, ci_netif* netif,
     goto unacceptable_seq;
  not_unacceptable_seqno:
 
-  if(CI_UNLIKELY( netif->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL ))
+  if(CI_UNLIKELY( ci_netif_rx_mem_pressure(netif) ))
     goto mem_pressure;
  continue_mem_pressure:
 
@@ -3815,6 +3823,13 @@ static void handle_rx_slow(ci_tcp_state* ts, ci_netif* netif,
   if( pkt->pf.tcp_rx.pay_len <= 0 )
     /* Process segments without payload, as they'll be freed immediately. */
     goto continue_mem_pressure;
+  if( ~netif->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL ) {
+    /* Only sockets over their quota drop until pressure is critical. */
+    if( ! ci_netif_rx_pkt_quota_exceeded(netif, ts->recv1.num +
+                                         ts->recv2.num + ts->rob.num) )
+      goto continue_mem_pressure;
+    CITP_STATS_NETIF_INC(netif, rx_pkt_quota_drops);
+  }
   CITP_STATS_NETIF_INC(netif, memory_pressure_drops);
   ts->tcpflags |= CI_TCPT_FLAG_MEM_DROP;
   ci_tcp_drop_rob(netif, ts);
@@ -4000,7 +4015,7 @@ static int ci_tcp_rx_deliver_to_conn(ci_sock_cmn* s, void* opaque_arg)
               /* fits in the IP datagram and has data? */
               (pkt->pf.tcp_rx.pay_len <= 0) |
               /* we're suffering from memory pressure */
-              (ni->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL));
+              ci_netif_rx_mem_pressure(ni));
 
   /* All DSACKs should be cleared when ACK is sent;
    * dsack_block may be != CI_ILL_UNUSED only when duplicate packet is
@@ -4112,6 +4127,34 @@ static int ci_tcp_rx_deliver_to_listen(ci_sock_cmn* s, void* opaque_arg)
 }
 
 
+#ifndef __KERNEL__
+/* Delivers [rxp] to the connection it belongs to, if that is one that
+ * ci_tcp_listenq_try_promote() left in [ps] to have its filters set
+ * later.  Returns 0 if there isn't one.
+ */
+static int ci_tcp_rx_deliver_filter_pending(ci_netif* netif,
+                                            struct ci_netif_poll_state* ps,
+                                            ciip_tcp_rx_pkt* rxp)
+{
+  ci_ip4_hdr* ip = oo_ip_hdr(rxp->pkt);
+  ci_tcp_state* ts;
+  int i;
+
+  for( i = 0; i < ps->filter_pending_n; ++i ) {
+    ts = SP_TO_TCP(netif, ps->filter_pending_ts[i]);
+    if( tcp_laddr_be32(ts) == ip->ip_daddr_be32 &&
+        tcp_lport_be16(ts) == rxp->tcp->tcp_dest_be16 &&
+        tcp_raddr_be32(ts) == ip->ip_saddr_be32 &&
+        tcp_rport_be16(ts) == rxp->tcp->tcp_source_be16 ) {
+      ci_tcp_rx_deliver_to_conn(&ts->s, rxp);
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif
+
+
 void ci_tcp_handle_rx(ci_netif* netif, struct ci_netif_poll_state* ps,
                       ci_ip_pkt_fmt* pkt, ci_tcp_hdr* tcp, int ip_paylen)
 {
@@ -4211,6 +4254,12 @@ void ci_tcp_handle_rx(ci_netif* netif, struct ci_netif_poll_state* ps,
   if(CI_LIKELY( rxp.pkt == NULL ))
     return;
 
+#ifndef __KERNEL__
+  if( ps != NULL && ps->filter_pending_n != 0 &&
+      ci_tcp_rx_deliver_filter_pending(netif, ps, &rxp) )
+    return;
+#endif
+
   ci_netif_filter_for_each_match(netif,
                                  ip->ip_daddr_be32, tcp->tcp_dest_be16,
                                  0, 0, IPPROTO_TCP, pkt->intf_i, pkt->vlan,
@@ -57,7 +57,9 @@
  */
 
 #define trylock(ni, locked)                                     \
-  ((locked) || (ci_netif_trylock(ni) && ((locked) = 1)))
+  ((locked) || (ci_netif_trylock(ni) &&                         \
+                (ci_netif_lock_prof_site((ni), CI_NETIF_LOCK_SITE_SENDMSG), \
+                 (locked) = 1)))
 #define si_trylock(ni, sinf)                    \
   trylock((ni), (sinf)->stack_locked)
 
@@ -1291,6 +1293,7 @@ static int ci_tcp_sendmsg_notsynchronised(ci_netif* ni, ci_tcp_state* ts,
     if( (sinf->rc = ci_netif_lock(ni)) )
       return -1;
     sinf->stack_locked = 1;
+    ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_SENDMSG);
   }
   CI_TCP_SLEEP_WHILE(ni, ts, CI_SB_FLAG_WAKE_RX, ts->s.so.rcvtimeo_msec, 
                      CONNECT_IN_PROGRESS, &sinf->rc);
@@ -1418,6 +1421,7 @@ static int ci_tcp_sendmsg_no_pkt_buf(ci_netif* ni, ci_tcp_state* ts,
         return -1;
       }
       sinf->stack_locked = 1;
+      ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_SENDMSG);
       CITP_STATS_NETIF_INC(ni, tcp_send_ni_lock_contends);
     }
     ci_assert(ci_netif_is_locked(ni));
@@ -1496,6 +1500,7 @@ static int ci_tcp_sendmsg_no_pkt_buf(ci_netif* ni, ci_tcp_state* ts,
           return -1;
         }
         sinf->stack_locked = 1;
+        ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_SENDMSG);
         CITP_STATS_NETIF_INC(ni, tcp_send_ni_lock_contends);
       }
     }
@@ -1817,12 +1822,10 @@ ci_tcp_send_fill_pkts(ci_netif* ni, ci_tcp_state* ts,
   while( --n_pkts > 0 );
 }
 
-/* It is not safe to call this function while holding the netif lock */
-/*! \todo Confirm */
-int ci_tcp_sendmsg(ci_netif* ni, ci_tcp_state* ts,
-                   const ci_iovec* iov, unsigned long iovlen,
-                   int flags 
-                   CI_KERNEL_ARG(ci_addr_spc_t addr_spc))
+static int __ci_tcp_sendmsg(ci_netif* ni, ci_tcp_state* ts,
+                            const ci_iovec* iov, unsigned long iovlen,
+                            int flags
+                            CI_KERNEL_ARG(ci_addr_spc_t addr_spc))
 {
   ci_ip_pkt_queue* sendq = &ts->send;
   ci_ip_pkt_fmt* pkt;
@@ -2037,6 +2040,7 @@ int ci_tcp_sendmsg(ci_netif* ni, ci_tcp_state* ts,
       ci_assert_equal(sinf.stack_locked, 0);
       if( ci_netif_lock_or_defer_work(ni, &ts->s.b) ) {
         sinf.stack_locked = 1;
+        ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_SENDMSG);
 	sinf.fill_list = 0;
 	if( ts->s.tx_errno ) {
           ci_tcp_sendmsg_handle_tx_errno(ni, ts, flags, &sinf);
@@ -2188,6 +2192,26 @@ int ci_tcp_sendmsg(ci_netif* ni, ci_tcp_state* ts,
 }
 
 
+/* It is not safe to call this function while holding the netif lock */
+/*! \todo Confirm */
+int ci_tcp_sendmsg(ci_netif* ni, ci_tcp_state* ts,
+                   const ci_iovec* iov, unsigned long iovlen,
+                   int flags 
+                   CI_KERNEL_ARG(ci_addr_spc_t addr_spc))
+{
+  ci_uint64 start;
+  int rc;
+
+  if( ! CI_LAT_HIST_ON(&ts->s.b) )
+    return __ci_tcp_sendmsg(ni, ts, iov, iovlen, flags
+                            CI_KERNEL_ARG(addr_spc));
+  ci_frc64(&start);
+  rc = __ci_tcp_sendmsg(ni, ts, iov, iovlen, flags CI_KERNEL_ARG(addr_spc));
+  __ci_lat_hist_record(ni, &ts->s.b, CI_LAT_HIST_TX_SEND, start);
+  return rc;
+}
+
+
 #ifndef __KERNEL__
 /* 
  * TODO:
@@ -2352,6 +2376,7 @@ int ci_tcp_zc_send(ci_netif* ni, ci_tcp_state* ts, struct onload_zc_mmsg* msg,
     ci_assert_equal(sinf.stack_locked, 0);
     if( ci_netif_lock_or_defer_work(ni, &ts->s.b) ) {
       sinf.stack_locked = 1;
+      ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_SENDMSG);
       if( ts->s.tx_errno )
         goto tx_errno;
       ci_tcp_sendmsg_enqueue_prequeue(ni, ts);
@@ -2451,6 +2476,7 @@ int ci_tcp_zc_send(ci_netif* ni, ci_tcp_state* ts, struct onload_zc_mmsg* msg,
       ci_assert_equal(sinf.stack_locked, 0);
       if( ci_netif_lock_or_defer_work(ni, &ts->s.b) ) {
         sinf.stack_locked = 1;
+        ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_SENDMSG);
         if( ts->s.tx_errno )
           goto tx_errno;
         ci_tcp_sendmsg_enqueue_prequeue(ni, ts);
@@ -2479,7 +2505,7 @@ int ci_tcp_zc_send(ci_netif* ni, ci_tcp_state* ts, struct onload_zc_mmsg* msg,
 }
 
 
-static int ci_tcp_ds_get_arp(ci_netif* ni, ci_tcp_state* ts)
+int ci_tcp_resolve_arp(ci_netif* ni, ci_tcp_state* ts)
 {
   int i;
 
@@ -2539,7 +2565,7 @@ ci_tcp_ds_fill_headers(ci_netif* ni, ci_tcp_state* ts, unsigned flags,
   /* Try to get valid cache */
   if( ! cicp_ip_cache_is_valid(CICP_HANDLE(ni), &ts->s.pkt) &&
       (~flags & ONLOAD_DELEGATED_SEND_FLAG_IGNORE_ARP ) &&
-      ! ci_tcp_ds_get_arp(ni, ts) ) {
+      ! ci_tcp_resolve_arp(ni, ts) ) {
     return ONLOAD_DELEGATED_SEND_RC_NOARP;
   }
 
@@ -2624,6 +2650,7 @@ ci_tcp_ds_done(ci_netif* ni, ci_tcp_state* ts,
     if( ! si_trylock(ni, &sinf) ) {
       ci_netif_lock(ni);
       sinf.stack_locked = 1;
+      ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_SENDMSG);
     }
 
     already_acked = SEQ_SUB(ts->snd_una,  ts->snd_nxt);
@@ -210,17 +210,18 @@ ci_tcp_syncookie_syn(ci_netif* netif, ci_tcp_socket_listen* tls,
   CITP_STATS_TCP_LISTEN(++tls->stats.n_syncookie_syn);
 }
 
-void
+/* Check whether the ACK in [rxp] answers one of our syncookies, and if so
+ * fill in [tsr] as though a synrecv had been kept for it.  [tsr] belongs to
+ * the caller, and is not on any listenq.  Returns 0 if the cookie is good.
+ */
+int
 ci_tcp_syncookie_ack(ci_netif* netif, ci_tcp_socket_listen* tls,
-                     ciip_tcp_rx_pkt* rxp,
-                     ci_tcp_state_synrecv** tsr_p)
+                     ciip_tcp_rx_pkt* rxp, ci_tcp_state_synrecv* tsr)
 {
   int t, m, t_now;
-  ci_tcp_state_synrecv* tsr;
   ci_uint32 isn = rxp->ack - 1;
 
   CITP_STATS_TCP_LISTEN(++tls->stats.n_syncookie_ack_recv);
-  *tsr_p = NULL;
 
   t_now = ci_tcp_syncookie_get_t(netif);
 
@@ -229,12 +230,9 @@ ci_tcp_syncookie_ack(ci_netif* netif, ci_tcp_socket_listen* tls,
 
   if( t != t_now && t != ((t_now - 1) & 0x1f) ) {
     CITP_STATS_TCP_LISTEN(++tls->stats.n_syncookie_ack_ts_rej);
-    return;
+    return -1;
   }
 
-  tsr = ci_alloc(sizeof(ci_tcp_state_synrecv));
-  if( tsr == NULL )
-    return;
   memset(tsr, 0, sizeof(ci_tcp_state_synrecv));
   tsr->tcpopts.flags = CI_TCPT_FLAG_SYNCOOKIE;
 
@@ -248,14 +246,11 @@ ci_tcp_syncookie_ack(ci_netif* netif, ci_tcp_socket_listen* tls,
   if( (isn >> 8) !=
       (ci_tcp_syncookie_hash(netif, tls, tsr, t, m) & 0xffffff) ) {
     CITP_STATS_TCP_LISTEN(++tls->stats.n_syncookie_ack_hash_rej);
-    ci_free(tsr);
-    return;
+    return -1;
   }
 
   tsr->local_peer = OO_SP_NULL;
 
-  *tsr_p = tsr;
-
   if( rxp->flags & CI_TCPT_FLAG_TSO ) {
     tsr->timest = (rxp->timestamp_echo & ~0x1ff);
     if( rxp->timestamp_echo & 0xff ) {
@@ -268,5 +263,6 @@ ci_tcp_syncookie_ack(ci_netif* netif, ci_tcp_socket_listen* tls,
   }
 
   CITP_STATS_TCP_LISTEN(++tls->stats.n_syncookie_ack_answ);
+  return 0;
 }
 
@@ -26,8 +26,13 @@
 
 /*! \cidoxg_lib_transport_ip */
 
+#define _GNU_SOURCE  /* for sched_getcpu */
+
 #include "ip_internal.h"
 #include "tcp_rx.h"
+#ifndef __KERNEL__
+# include <sched.h>
+#endif
 
 
 #define LPF "TCP SYNRECV "
@@ -572,25 +577,68 @@ ci_inline void ci_tcp_set_addr_on_promote(ci_netif* netif, ci_tcp_state* ts,
 /* Copy socket options & related fields that should be inherited. 
  * Inherits into [ts] from [tls] */
     
+unsigned ci_tcp_acceptq_cpu(void)
+{
+#ifdef __KERNEL__
+  return raw_smp_processor_id();
+#else
+  int cpu = sched_getcpu();
+  return cpu < 0 ? 0 : cpu;
+#endif
+}
+
+
+#ifndef __KERNEL__
+/* Number of connections for [tls] waiting in [ps] for their filters. */
+static int ci_tcp_listenq_n_filter_pending(struct ci_netif_poll_state* ps,
+                                           ci_tcp_socket_listen* tls)
+{
+  int i, n = 0;
+  for( i = 0; i < ps->filter_pending_n; ++i )
+    n += OO_SP_EQ(ps->filter_pending_tls[i], S_SP(tls));
+  return n;
+}
+#endif
+
+
 /*
 ** promote a synrecv structure to an established socket
 **
 ** Assumes that the caller will handle a fail if we can't allocate a new
 ** tcp_state structure due to memory pressure or the like
+**
+** At user level, setting the filters of the new socket needs a call into
+** the driver.  If [ps] is not NULL, we are polling, so we leave the
+** filters to be set for all the connections promoted during the poll at
+** once by ci_tcp_listenq_promote_flush(), which also puts them on the
+** accept queue.  Until then ci_tcp_handle_rx() finds the new socket in
+** [ps].
 */
 int ci_tcp_listenq_try_promote(ci_netif* netif, ci_tcp_socket_listen* tls,
                                ci_tcp_state_synrecv* tsr,
                                ci_ip_cached_hdrs* ipcache,
+                               struct ci_netif_poll_state* ps,
                                ci_tcp_state** ts_out)
 {
   int rc = 0;
+  int acceptq_n = ci_tcp_acceptq_n(tls);
+#ifndef __KERNEL__
+  int defer_filters = 0;
+#endif
   
   ci_assert(netif);
   ci_assert(tls);
   ci_assert(tls->s.b.state == CI_TCP_LISTEN);
   ci_assert(tsr);
 
-  if( (int) ci_tcp_acceptq_n(tls) < tls->acceptq_max ) {
+#ifndef __KERNEL__
+  if( ps != NULL && ps->filter_pending_n != 0 )
+    acceptq_n += ci_tcp_listenq_n_filter_pending(ps, tls);
+#else
+  (void) ps;
+#endif
+
+  if( acceptq_n < tls->acceptq_max ) {
     ci_tcp_state* ts;
 
     /* grab a tcp_state structure that will go onto the accept queue.  We take
@@ -638,8 +686,15 @@ int ci_tcp_listenq_try_promote(ci_netif* netif, ci_tcp_socket_listen* tls,
       /* "borrow" filter from listening socket.  For loopback socket, we
        * do not need filters, but we have to take a reference of the OS
        * socket. */
-      rc = ci_tcp_ep_set_filters(netif, S_SP(ts), ts->s.cp.so_bindtodevice,
-                                 S_SP(tls));
+#ifndef __KERNEL__
+      if( ps != NULL && OO_SP_IS_NULL(tsr->local_peer) &&
+          ps->filter_pending_n < CI_CFG_TCP_FILTER_SET_BATCH &&
+          ! ci_tcp_can_set_filter_in_ul(netif, &ts->s) )
+        defer_filters = 1;
+      else
+#endif
+        rc = ci_tcp_ep_set_filters(netif, S_SP(ts), ts->s.cp.so_bindtodevice,
+                                   S_SP(tls));
       if( rc < 0 ) {
         LOG_U(ci_log("%s: Unable to set filters %d", __FUNCTION__, rc));
         /* Either put this back on the list (at the head) or free it */
@@ -763,16 +818,15 @@ int ci_tcp_listenq_try_promote(ci_netif* netif, ci_tcp_socket_listen* tls,
     ci_tcp_set_flags(ts, CI_TCP_FLAG_ACK);
 
     /* Remove the synrecv structure from the listen queue, and free the
-    ** buffer. */
-    if( tsr->tcpopts.flags & CI_TCPT_FLAG_SYNCOOKIE )
-      ci_free(tsr);
-    else {
+    ** buffer.  A syncookie's synrecv is the caller's, and on no queue. */
+    if( ~tsr->tcpopts.flags & CI_TCPT_FLAG_SYNCOOKIE ) {
       ci_tcp_listenq_remove(netif, tls, tsr);
       ci_tcp_synrecv_free(netif, tsr);
     }
 
+    /* Set IN_ACCEPTQ even if the filters are deferred, so that dropping
+     * the connection before then does not free it. */
     ci_bit_set(&ts->s.b.sb_aflags, CI_SB_AFLAG_TCP_IN_ACCEPTQ_BIT);
-    ci_tcp_acceptq_put(netif, tls, &ts->s.b);
 
     LOG_TC(log(LNT_FMT "new ts=%d SYN-RECV->ESTABLISHED flags=0x%x",
                LNT_PRI_ARGS(netif, tls), S_FMT(ts), ts->tcpflags);
@@ -781,6 +835,17 @@ int ci_tcp_listenq_try_promote(ci_netif* netif, ci_tcp_socket_listen* tls,
                tcp_snd_una(ts),
                tcp_snd_nxt(ts), ts->snd_max, tcp_enq_nxt(ts)));
 
+#ifndef __KERNEL__
+    if( defer_filters ) {
+      ps->filter_pending_ts[ps->filter_pending_n] = S_SP(ts);
+      ps->filter_pending_tls[ps->filter_pending_n] = S_SP(tls);
+      ++ps->filter_pending_n;
+      *ts_out = ts;
+      return 0;
+    }
+#endif
+
+    ci_tcp_acceptq_put(netif, tls, &ts->s.b);
     citp_waitable_wake(netif, &tls->s.b, CI_SB_FLAG_WAKE_RX);
     *ts_out = ts;
     return 0;
@@ -793,4 +858,63 @@ int ci_tcp_listenq_try_promote(ci_netif* netif, ci_tcp_socket_listen* tls,
   return -ENOSPC;
 }
 
+#ifndef __KERNEL__
+/* Sets the filters of the connections that ci_tcp_listenq_try_promote()
+ * left in [ps], with one call into the driver, and puts them on their
+ * listeners' accept queues.  A connection whose filters could not be set
+ * is reset.
+ */
+void ci_tcp_listenq_promote_flush(ci_netif* netif,
+                                  struct ci_netif_poll_state* ps)
+{
+  oo_tcp_filter_set_t ops[CI_CFG_TCP_FILTER_SET_BATCH];
+  ci_int32 rcs[CI_CFG_TCP_FILTER_SET_BATCH];
+  ci_int32 ts_rc[CI_CFG_TCP_FILTER_SET_BATCH];
+  ci_tcp_socket_listen* tls;
+  ci_tcp_state* ts;
+  int i, rc = 0, n_ops = 0, n = ps->filter_pending_n;
+
+  ci_assert(ci_netif_is_locked(netif));
+  ci_assert_gt(n, 0);
+  ps->filter_pending_n = 0;
+
+  /* A connection that has been reset meanwhile needs no filters, but
+   * still goes on the accept queue, as it would have done if it had been
+   * reset there. */
+  for( i = 0; i < n; ++i ) {
+    ts = SP_TO_TCP(netif, ps->filter_pending_ts[i]);
+    ts_rc[i] = ts->s.b.state == CI_TCP_CLOSED ? 0 : 1;
+    if( ! ts_rc[i] )
+      continue;
+    ops[n_ops].tcp_id = S_SP(ts);
+    ops[n_ops].from_tcp_id = ps->filter_pending_tls[i];
+    ops[n_ops].bindto_ifindex = ts->s.cp.so_bindtodevice;
+    ++n_ops;
+  }
+  if( n_ops != 0 ) {
+    rc = ci_tcp_ep_set_filters_batch(netif, ops, rcs, n_ops);
+    CITP_STATS_NETIF_INC(netif, tcp_filter_set_batches);
+    CITP_STATS_NETIF_ADD(netif, tcp_filter_set_batched, n_ops);
+  }
+
+  for( i = 0, n_ops = 0; i < n; ++i ) {
+    ts = SP_TO_TCP(netif, ps->filter_pending_ts[i]);
+    tls = SP_TO_TCP_LISTEN(netif, ps->filter_pending_tls[i]);
+    ci_assert(ts->s.b.sb_aflags & CI_SB_AFLAG_TCP_IN_ACCEPTQ);
+    if( ts_rc[i] )
+      ts_rc[i] = rc < 0 ? rc : rcs[n_ops++];
+    if( ts_rc[i] < 0 ) {
+      LOG_U(ci_log("%s: Unable to set filters %d", __FUNCTION__, ts_rc[i]));
+      CI_TCP_EXT_STATS_INC_LISTEN_DROPS(netif);
+      ci_bit_clear(&ts->s.b.sb_aflags, CI_SB_AFLAG_TCP_IN_ACCEPTQ_BIT);
+      ci_tcp_send_rst(netif, ts);
+      ci_tcp_drop(netif, ts, ECONNRESET);
+      continue;
+    }
+    ci_tcp_acceptq_put(netif, tls, &ts->s.b);
+    citp_waitable_wake(netif, &tls->s.b, CI_SB_FLAG_WAKE_RX);
+  }
+}
+#endif
+
 /*! \cidoxg_end */
@@ -0,0 +1,131 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  Per-stack flight recorder (EF_TRACE).
+**   \date  2016/10/18
+**    \cop  (c) Solarflare Communications Inc.
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_transport_ip */
+
+/* Events are written from user-level and from the kernel, with and
+ * without the stack lock, so the ring is shared between writers with a
+ * compare-and-swap on [head].  See ci_netif_trace for how readers cope.
+ */
+
+#include "ip_internal.h"
+
+#if CI_CFG_TRACE
+
+CI_BUILD_ASSERT(sizeof(ci_trace_rec) == 32);
+CI_BUILD_ASSERT(CI_IS_POW2(CI_CFG_TRACE_LEN));
+
+
+#ifdef __KERNEL__
+
+void ci_netif_trace_init(ci_netif* ni)
+{
+  ci_netif_trace* t = &ni->state->trace;
+
+  t->head = 0;
+  t->frozen = 0;
+  t->freeze_mem_pressure = NI_OPTS(ni).trace_freeze_mem_pressure;
+  t->freeze_cycles = oo_usec_to_cycles64(ni, NI_OPTS(ni).trace_freeze_usec);
+  t->enabled = NI_OPTS(ni).trace && ni->trace_rec != NULL;
+}
+
+#endif
+
+
+void __ci_netif_trace(ci_netif* ni, unsigned type, ci_int32 sock,
+                      ci_uint32 a0, ci_uint32 a1, ci_uint32 a2)
+{
+  ci_netif_trace* t = &ni->state->trace;
+  ci_trace_rec* r;
+  ci_uint32 seq;
+
+  /* [enabled] is in the shared state; the ring may not exist. */
+  if( ni->trace_rec == NULL )
+    return;
+
+  do
+    seq = t->head;
+  while( ci_cas32u_fail(&t->head, seq, seq + 1) );
+
+  r = &ni->trace_rec[seq & (CI_CFG_TRACE_LEN - 1)];
+  r->seq = 0;
+  ci_wmb();
+  ci_frc64(&r->frc);
+  r->type = type;
+  r->sock = sock;
+  r->a[0] = a0;
+  r->a[1] = a1;
+  r->a[2] = a2;
+  ci_wmb();
+  r->seq = seq + 1;
+}
+
+
+void ci_netif_trace_freeze(ci_netif* ni, unsigned reason, ci_uint64 cycles)
+{
+  ci_netif_trace* t = &ni->state->trace;
+
+  if( ! t->enabled )
+    return;
+  __ci_netif_trace(ni, CI_TRACE_FREEZE, -1, reason,
+                   (ci_uint32) CI_MIN(cycles, (ci_uint64) 0xffffffff), 0);
+  t->frozen = reason;
+  t->enabled = 0;
+}
+
+
+void __ci_netif_trace_latency(ci_netif* ni, unsigned type, ci_uint32 a0,
+                              ci_uint64 start)
+{
+  ci_netif_trace* t = &ni->state->trace;
+  ci_uint64 d;
+
+  if( ! t->enabled )
+    return;
+  d = ci_frc64_since(start);
+  __ci_netif_trace(ni, type, -1, a0,
+                   (ci_uint32) CI_MIN(d, (ci_uint64) 0xffffffff), 0);
+  if( t->freeze_cycles != 0 && d > t->freeze_cycles )
+    ci_netif_trace_freeze(ni, type == CI_TRACE_POLL_END ?
+                          CI_TRACE_FREEZE_POLL : CI_TRACE_FREEZE_LOCK_WAIT, d);
+}
+
+
+#ifndef __KERNEL__
+
+const char* ci_netif_trace_type_str(unsigned type)
+{
+  static const char* const names[CI_TRACE_N_TYPES] = {
+    "?", "poll_start", "poll_end", "rx_deliver", "timer", "lock_wait",
+    "lock_defer", "wake", "mem_pressure", "freeze",
+  };
+  return type < CI_TRACE_N_TYPES ? names[type] : "?";
+}
+
+#endif
+
+#endif
+
+/*! \cidoxg_end */
@@ -95,6 +95,7 @@ static void ci_udp_state_init(ci_netif* netif, ci_udp_state* us)
   us->udpflags = CI_UDPF_MCAST_LOOP;
   us->stamp = 0;
   memset(&us->stats, 0, sizeof(us->stats));
+  us->rx_filter_len = 0;
 }
 
 
@@ -258,7 +259,8 @@ void ci_udp_state_dump(ci_netif* ni, ci_udp_state* us, const char* pf,
   ci_udp_socket_stats uss = us->stats;
   unsigned rx_added = us->recv_q.pkts_added;
   unsigned rx_os = uss.n_rx_os + uss.n_rx_os_slow;
-  unsigned rx_total = rx_added + uss.n_rx_mem_drop + uss.n_rx_overflow + rx_os;
+  unsigned rx_total = rx_added + uss.n_rx_mem_drop + uss.n_rx_overflow + rx_os +
+                      uss.n_rx_filter_drop;
   unsigned n_tx_onload = uss.n_tx_onload_uc + uss.n_tx_onload_c;
   unsigned tx_total = n_tx_onload + uss.n_tx_os;
   ci_ip_cached_hdrs* ipcache;
@@ -284,6 +286,9 @@ void ci_udp_state_dump(ci_netif* ni, ci_udp_state* us, const char* pf,
          uss.max_recvq_pkts);
   logger(log_arg, "%s  rcv: os=%u(%u%%) os_slow=%u os_error=%u", pf,
          rx_os, percent(rx_os, rx_total), uss.n_rx_os_slow, uss.n_rx_os_error);
+  if( us->udpflags & CI_UDPF_RX_FILTER )
+    logger(log_arg, "%s  rcv: bpf_insns=%u bpf_drop=%u", pf,
+           us->rx_filter_len, uss.n_rx_filter_drop);
 
   /* Send path. */
   logger(log_arg, "%s  snd: q=%u+%u ul=%u os=%u(%u%%)", pf,
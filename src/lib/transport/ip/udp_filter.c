@@ -0,0 +1,366 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  Classic BPF receive filters for UDP sockets (SO_ATTACH_FILTER).
+**   \date  2016/10/18
+**    \cop  (c) Solarflare Communications Inc.
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_transport_ip */
+
+/* Programs are copied into the socket's shared state when attached, so
+ * that they can be run by whichever process (or the kernel) happens to be
+ * polling the stack.  Because of that we interpret rather than compile
+ * them: there is nowhere shared to put executable code.  Only the subset
+ * of classic BPF that makes sense for UDP payload matching is accepted, and
+ * ci_udp_filter_check() rejects bad programs when they are attached.  The
+ * application can rewrite the shared copy afterwards, though, so the
+ * interpreter does not trust it: it reads each instruction once, keeps the
+ * program counter and scratch memory indices in range, and treats anything
+ * that would be out of bounds, or an instruction the check would have
+ * rejected, as a drop.  As on Linux, offset 0 is the start of the UDP
+ * header.
+ */
+
+#include "ip_internal.h"
+#include "udp_internal.h"
+#include <linux/filter.h>
+
+
+#define BPF_MEMWORDS_MAX  16
+
+
+int ci_udp_filter_check(const ci_udp_filter_insn* prog, int len)
+{
+  int i;
+
+  if( len <= 0 || len > CI_CFG_UDP_RX_FILTER_MAX_INSNS )
+    return -EINVAL;
+
+  for( i = 0; i < len; ++i ) {
+    const ci_udp_filter_insn* insn = &prog[i];
+    switch( insn->code ) {
+    case BPF_LD | BPF_W | BPF_ABS:
+    case BPF_LD | BPF_H | BPF_ABS:
+    case BPF_LD | BPF_B | BPF_ABS:
+    case BPF_LD | BPF_W | BPF_IND:
+    case BPF_LD | BPF_H | BPF_IND:
+    case BPF_LD | BPF_B | BPF_IND:
+    case BPF_LDX | BPF_B | BPF_MSH:
+      /* Negative offsets select ancillary data (SKF_AD_OFF etc.), which
+       * we don't have.
+       */
+      if( (ci_int32) insn->k < 0 )
+        return -EINVAL;
+      break;
+    case BPF_LD | BPF_MEM:
+    case BPF_LDX | BPF_MEM:
+    case BPF_ST:
+    case BPF_STX:
+      if( insn->k >= BPF_MEMWORDS_MAX )
+        return -EINVAL;
+      break;
+    case BPF_ALU | BPF_DIV | BPF_K:
+    case BPF_ALU | BPF_MOD | BPF_K:
+      if( insn->k == 0 )
+        return -EINVAL;
+      break;
+    case BPF_ALU | BPF_LSH | BPF_K:
+    case BPF_ALU | BPF_RSH | BPF_K:
+      if( insn->k >= 32 )
+        return -EINVAL;
+      break;
+    case BPF_JMP | BPF_JA:
+      if( insn->k >= (unsigned) (len - i - 1) )
+        return -EINVAL;
+      break;
+    case BPF_JMP | BPF_JEQ | BPF_K:
+    case BPF_JMP | BPF_JEQ | BPF_X:
+    case BPF_JMP | BPF_JGT | BPF_K:
+    case BPF_JMP | BPF_JGT | BPF_X:
+    case BPF_JMP | BPF_JGE | BPF_K:
+    case BPF_JMP | BPF_JGE | BPF_X:
+    case BPF_JMP | BPF_JSET | BPF_K:
+    case BPF_JMP | BPF_JSET | BPF_X:
+      if( insn->jt >= len - i - 1 || insn->jf >= len - i - 1 )
+        return -EINVAL;
+      break;
+    case BPF_LD | BPF_W | BPF_LEN:
+    case BPF_LD | BPF_IMM:
+    case BPF_LDX | BPF_W | BPF_LEN:
+    case BPF_LDX | BPF_IMM:
+    case BPF_ALU | BPF_ADD | BPF_K:
+    case BPF_ALU | BPF_ADD | BPF_X:
+    case BPF_ALU | BPF_SUB | BPF_K:
+    case BPF_ALU | BPF_SUB | BPF_X:
+    case BPF_ALU | BPF_MUL | BPF_K:
+    case BPF_ALU | BPF_MUL | BPF_X:
+    case BPF_ALU | BPF_DIV | BPF_X:
+    case BPF_ALU | BPF_MOD | BPF_X:
+    case BPF_ALU | BPF_AND | BPF_K:
+    case BPF_ALU | BPF_AND | BPF_X:
+    case BPF_ALU | BPF_OR | BPF_K:
+    case BPF_ALU | BPF_OR | BPF_X:
+    case BPF_ALU | BPF_XOR | BPF_K:
+    case BPF_ALU | BPF_XOR | BPF_X:
+    case BPF_ALU | BPF_LSH | BPF_X:
+    case BPF_ALU | BPF_RSH | BPF_X:
+    case BPF_ALU | BPF_NEG:
+    case BPF_MISC | BPF_TAX:
+    case BPF_MISC | BPF_TXA:
+    case BPF_RET | BPF_K:
+    case BPF_RET | BPF_A:
+      break;
+    default:
+      return -EINVAL;
+    }
+  }
+
+  /* Every path must end in a return.  Jumps are forwards only and in
+   * range, so it is enough that the last instruction is one.
+   */
+  if( BPF_CLASS(prog[len - 1].code) != BPF_RET )
+    return -EINVAL;
+  return 0;
+}
+
+
+/* Slow path for loads that are not wholly within the first buffer of a
+ * multi-buffer datagram.  Returns 0 if [off, off+size) is not inside the
+ * datagram.
+ */
+static int ci_udp_filter_load_frags(ci_netif* ni, ci_ip_pkt_fmt* pkt,
+                                    const ci_uint8* udp, unsigned udp_len,
+                                    unsigned off, unsigned size,
+                                    ci_uint32* val_out)
+{
+  const ci_uint8* p = udp;
+  unsigned seg_len, seg_off = 0, v = 0;
+
+  if( off + size > udp_len || off + size < off )
+    return 0;
+
+  seg_len = (const ci_uint8*) oo_offbuf_end(&pkt->buf) - udp;
+  while( size ) {
+    if( off < seg_off + seg_len ) {
+      v = (v << 8) | p[off - seg_off];
+      ++off;
+      --size;
+      continue;
+    }
+    if( OO_PP_IS_NULL(pkt->frag_next) )
+      return 0;
+    seg_off += seg_len;
+    pkt = PKT_CHK(ni, pkt->frag_next);
+    p = (const ci_uint8*) oo_offbuf_ptr(&pkt->buf);
+    seg_len = oo_offbuf_left(&pkt->buf);
+  }
+  *val_out = v;
+  return 1;
+}
+
+
+int ci_udp_filter_run(ci_netif* ni, ci_udp_state* us, ci_ip_pkt_fmt* pkt)
+{
+  const ci_udp_filter_insn* prog = us->rx_filter;
+  ci_udp_filter_insn insn;
+  unsigned pc, len = OO_ACCESS_ONCE(us->rx_filter_len);
+  const ci_uint8* udp = (const ci_uint8*) oo_offbuf_ptr(&pkt->buf) -
+                        sizeof(ci_udp_hdr);
+  unsigned udp_len = pkt->pf.udp.pay_len + sizeof(ci_udp_hdr);
+  unsigned seg_len = (const ci_uint8*) oo_offbuf_end(&pkt->buf) - udp;
+  ci_uint32 mem[BPF_MEMWORDS_MAX] = { 0 };
+  ci_uint32 a = 0, x = 0, off;
+
+  ci_assert(us->udpflags & CI_UDPF_RX_FILTER);
+  ci_assert_gt(us->rx_filter_len, 0);
+
+  seg_len = CI_MIN(seg_len, udp_len);
+  if( len > CI_CFG_UDP_RX_FILTER_MAX_INSNS )
+    return 0;
+
+  for( pc = 0; pc < len; ++pc ) {
+    insn = OO_ACCESS_ONCE(prog[pc]);
+    switch( insn.code ) {
+    case BPF_LD | BPF_W | BPF_ABS:
+      off = insn.k;
+      goto load_w;
+    case BPF_LD | BPF_H | BPF_ABS:
+      off = insn.k;
+      goto load_h;
+    case BPF_LD | BPF_B | BPF_ABS:
+      off = insn.k;
+      goto load_b;
+    case BPF_LD | BPF_W | BPF_IND:
+      off = x + insn.k;
+    load_w:
+      if( off + 4 <= seg_len && off + 4 > off )
+        a = ((ci_uint32) udp[off] << 24) | ((ci_uint32) udp[off + 1] << 16) |
+            ((ci_uint32) udp[off + 2] << 8) | udp[off + 3];
+      else if( ! ci_udp_filter_load_frags(ni, pkt, udp, udp_len,
+                                          off, 4, &a) )
+        return 0;
+      break;
+    case BPF_LD | BPF_H | BPF_IND:
+      off = x + insn.k;
+    load_h:
+      if( off + 2 <= seg_len && off + 2 > off )
+        a = ((ci_uint32) udp[off] << 8) | udp[off + 1];
+      else if( ! ci_udp_filter_load_frags(ni, pkt, udp, udp_len,
+                                          off, 2, &a) )
+        return 0;
+      break;
+    case BPF_LD | BPF_B | BPF_IND:
+      off = x + insn.k;
+    load_b:
+      if( off < seg_len )
+        a = udp[off];
+      else if( ! ci_udp_filter_load_frags(ni, pkt, udp, udp_len,
+                                          off, 1, &a) )
+        return 0;
+      break;
+    case BPF_LDX | BPF_B | BPF_MSH:
+      if( insn.k < seg_len )
+        x = udp[insn.k];
+      else if( ! ci_udp_filter_load_frags(ni, pkt, udp, udp_len,
+                                          insn.k, 1, &x) )
+        return 0;
+      x = (x & 0xf) << 2;
+      break;
+    case BPF_LD | BPF_W | BPF_LEN:
+      a = udp_len;
+      break;
+    case BPF_LDX | BPF_W | BPF_LEN:
+      x = udp_len;
+      break;
+    case BPF_LD | BPF_IMM:
+      a = insn.k;
+      break;
+    case BPF_LDX | BPF_IMM:
+      x = insn.k;
+      break;
+    case BPF_LD | BPF_MEM:
+      a = mem[insn.k & (BPF_MEMWORDS_MAX - 1)];
+      break;
+    case BPF_LDX | BPF_MEM:
+      x = mem[insn.k & (BPF_MEMWORDS_MAX - 1)];
+      break;
+    case BPF_ST:
+      mem[insn.k & (BPF_MEMWORDS_MAX - 1)] = a;
+      break;
+    case BPF_STX:
+      mem[insn.k & (BPF_MEMWORDS_MAX - 1)] = x;
+      break;
+    case BPF_ALU | BPF_ADD | BPF_K:  a += insn.k;  break;
+    case BPF_ALU | BPF_ADD | BPF_X:  a += x;        break;
+    case BPF_ALU | BPF_SUB | BPF_K:  a -= insn.k;  break;
+    case BPF_ALU | BPF_SUB | BPF_X:  a -= x;        break;
+    case BPF_ALU | BPF_MUL | BPF_K:  a *= insn.k;  break;
+    case BPF_ALU | BPF_MUL | BPF_X:  a *= x;        break;
+    case BPF_ALU | BPF_DIV | BPF_K:
+      if( insn.k == 0 )
+        return 0;
+      a /= insn.k;
+      break;
+    case BPF_ALU | BPF_MOD | BPF_K:
+      if( insn.k == 0 )
+        return 0;
+      a %= insn.k;
+      break;
+    case BPF_ALU | BPF_AND | BPF_K:  a &= insn.k;  break;
+    case BPF_ALU | BPF_AND | BPF_X:  a &= x;        break;
+    case BPF_ALU | BPF_OR | BPF_K:   a |= insn.k;  break;
+    case BPF_ALU | BPF_OR | BPF_X:   a |= x;        break;
+    case BPF_ALU | BPF_XOR | BPF_K:  a ^= insn.k;  break;
+    case BPF_ALU | BPF_XOR | BPF_X:  a ^= x;        break;
+    case BPF_ALU | BPF_LSH | BPF_K:  a <<= insn.k & 31; break;
+    case BPF_ALU | BPF_RSH | BPF_K:  a >>= insn.k & 31; break;
+    case BPF_ALU | BPF_DIV | BPF_X:
+      if( x == 0 )
+        return 0;
+      a /= x;
+      break;
+    case BPF_ALU | BPF_MOD | BPF_X:
+      if( x == 0 )
+        return 0;
+      a %= x;
+      break;
+    case BPF_ALU | BPF_LSH | BPF_X:
+      a = x < 32 ? a << x : 0;
+      break;
+    case BPF_ALU | BPF_RSH | BPF_X:
+      a = x < 32 ? a >> x : 0;
+      break;
+    case BPF_ALU | BPF_NEG:
+      a = -a;
+      break;
+    case BPF_MISC | BPF_TAX:
+      x = a;
+      break;
+    case BPF_MISC | BPF_TXA:
+      a = x;
+      break;
+    case BPF_JMP | BPF_JA:
+      if( insn.k >= len - pc )
+        return 0;
+      pc += insn.k;
+      break;
+    case BPF_JMP | BPF_JEQ | BPF_K:
+      pc += (a == insn.k) ? insn.jt : insn.jf;
+      break;
+    case BPF_JMP | BPF_JEQ | BPF_X:
+      pc += (a == x) ? insn.jt : insn.jf;
+      break;
+    case BPF_JMP | BPF_JGT | BPF_K:
+      pc += (a > insn.k) ? insn.jt : insn.jf;
+      break;
+    case BPF_JMP | BPF_JGT | BPF_X:
+      pc += (a > x) ? insn.jt : insn.jf;
+      break;
+    case BPF_JMP | BPF_JGE | BPF_K:
+      pc += (a >= insn.k) ? insn.jt : insn.jf;
+      break;
+    case BPF_JMP | BPF_JGE | BPF_X:
+      pc += (a >= x) ? insn.jt : insn.jf;
+      break;
+    case BPF_JMP | BPF_JSET | BPF_K:
+      pc += (a & insn.k) ? insn.jt : insn.jf;
+      break;
+    case BPF_JMP | BPF_JSET | BPF_X:
+      pc += (a & x) ? insn.jt : insn.jf;
+      break;
+    case BPF_RET | BPF_K:
+      return insn.k;
+    case BPF_RET | BPF_A:
+      return a;
+    default:
+      /* ci_udp_filter_check() rejected this when the program was attached,
+       * so the shared copy has been overwritten since.
+       */
+      CITP_STATS_NETIF_INC(ni, udp_rx_filter_bad_insn);
+      return 0;
+    }
+  }
+
+  /* Fell off the end, which ci_udp_filter_check() also rejects. */
+  return 0;
+}
+
+/*! \cidoxg_end */
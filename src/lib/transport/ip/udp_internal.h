@@ -56,5 +56,15 @@ ci_mcast_ipcache_set_mac(ci_netif* ni, ci_ip_cached_hdrs* ipcache,
 
 extern int ci_udp_rx_deliver(ci_sock_cmn*, void*) CI_HF;
 
+/*! Validate a classic BPF program for use as a UDP receive filter.
+ * Returns 0 if it is acceptable, or -EINVAL.
+ */
+extern int ci_udp_filter_check(const ci_udp_filter_insn* prog, int len) CI_HF;
+
+/*! Run the socket's receive filter over [pkt].  Returns 0 if the datagram
+ * should be dropped.
+ */
+extern int ci_udp_filter_run(ci_netif*, ci_udp_state*, ci_ip_pkt_fmt*) CI_HF;
+
 
 #endif  /* __UDP_INTERNAL_H__ */
@@ -316,6 +316,7 @@ static int ci_udp_recvmsg_get(ci_netif* ni, ci_udp_state* us,
     if( ! (flags & MSG_PEEK) )
       ci_udp_recv_q_deliver(ni, &us->recv_q, pkt);
     us->udpflags |= CI_UDPF_LAST_RECV_ON;
+    ci_lat_hist_record(ni, &us->s.b, CI_LAT_HIST_RX_APP, us->stamp);
   }
 
   return rc;
@@ -546,6 +547,7 @@ struct recvmsg_spinstate {
   ci_uint64 max_spin;
   int do_spin;
   int spin_limit_by_so;
+  int waited;
   ci_uint32 timeout;
 #ifndef __KERNEL__
   citp_signal_info* si;
@@ -634,6 +636,24 @@ ci_udp_recvmsg_block(ci_udp_iomsg_args* a, ci_netif* ni, ci_udp_state* us,
 }
 
 
+/* EF_SPIN_ADAPTIVE: called once a caller that had to wait finds the socket
+ * readable.
+ */
+ci_inline void
+ci_udp_recvmsg_spin_adapt_done(ci_netif* ni, ci_udp_state* us,
+                               struct recvmsg_spinstate* spin_state)
+{
+  if( NI_OPTS(ni).spin_adaptive ) {
+    /* We stop spinning before we block. */
+    int blocked = spin_state->do_spin <= 0;
+    if( ! blocked )
+      CITP_STATS_NETIF_INC(ni, spin_adapt_hit);
+    ci_waitable_spin_adapt_update(ni, &us->s.b, spin_state->start_frc,
+                                  blocked);
+  }
+}
+
+
 ci_inline int
 ci_udp_recvmsg_socklocked_spin(ci_udp_iomsg_args* a,
                                ci_netif* ni, ci_udp_state* us,
@@ -670,6 +690,8 @@ ci_udp_recvmsg_socklocked_spin(ci_udp_iomsg_args* a,
                                            &us->s.b, spin_state->si);
   }
   else {
+    if( NI_OPTS(ni).spin_adaptive )
+      CITP_STATS_NETIF_INC(ni, spin_adapt_miss);
     if( spin_state->spin_limit_by_so ) {
       ++us->stats.n_rx_eagain;
       return -EAGAIN;
@@ -743,8 +765,11 @@ ci_udp_recvmsg_common(ci_udp_iomsg_args *a, ci_msghdr* msg, int flags,
 
  check_ul_recv_q:
   rc = ci_udp_recvmsg_get(ni, us, &piov, msg, flags);
-  if( rc >= 0 )
+  if( rc >= 0 ) {
+    if(CI_UNLIKELY( spin_state.waited ))
+      ci_udp_recvmsg_spin_adapt_done(ni, us, &spin_state);
     goto out;
+  }
 
   /* User-level receive queue is empty. */
 
@@ -794,12 +819,16 @@ ci_udp_recvmsg_common(ci_udp_iomsg_args *a, ci_msghdr* msg, int flags,
   }
 
   /* We need to block (optionally spinning first). */
+  spin_state.waited = 1;
 
 #ifndef __KERNEL__    
   /* -1 is special value for uninitialised */
   if( spin_state.do_spin == -1 ) {
     spin_state.do_spin = 
       oo_per_thread_get()->spinstate & (1 << ONLOAD_SPIN_UDP_RECV);
+    if( spin_state.do_spin && NI_OPTS(ni).spin_adaptive &&
+        ! ci_waitable_spin_adapt_should_spin(ni, &us->s.b) )
+      spin_state.do_spin = 0;
 
     if( spin_state.do_spin ) {
       spin_state.schedule_frc = spin_state.start_frc;
@@ -1140,6 +1169,7 @@ int ci_udp_zc_recv(ci_udp_iomsg_args* a, struct onload_zc_recv_args* args)
 
       us->stamp = pkt->pf.udp.rx_stamp;
       us->udpflags |= CI_UDPF_LAST_RECV_ON;
+      ci_lat_hist_record(ni, &us->s.b, CI_LAT_HIST_RX_APP, us->stamp);
     
       cb_flags = CI_IP_IS_MULTICAST(oo_ip_hdr(pkt)->ip_daddr_be32) ? 
         ONLOAD_ZC_MSG_SHARED : 0;
@@ -1276,6 +1306,9 @@ int ci_udp_zc_recv(ci_udp_iomsg_args* a, struct onload_zc_recv_args* args)
   if( spin_state.do_spin == -1 ) {
     spin_state.do_spin = 
       oo_per_thread_get()->spinstate & (1 << ONLOAD_SPIN_UDP_RECV);
+    if( spin_state.do_spin && NI_OPTS(ni).spin_adaptive &&
+        ! ci_waitable_spin_adapt_should_spin(ni, &us->s.b) )
+      spin_state.do_spin = 0;
   
     if( spin_state.do_spin ) {
       spin_state.si = citp_signal_get_specific_inited();
@@ -1299,8 +1332,10 @@ int ci_udp_zc_recv(ci_udp_iomsg_args* a, struct onload_zc_recv_args* args)
      * -ve => error 
      */
     if( rc == 0 ) {
-      if( ci_udp_recv_q_not_empty(&us->recv_q) )
+      if( ci_udp_recv_q_not_empty(&us->recv_q) ) {
+        ci_udp_recvmsg_spin_adapt_done(ni, us, &spin_state);
         goto not_empty;
+      }
       goto spin_loop;
     }
     else if( rc < 0 )
@@ -1311,8 +1346,10 @@ int ci_udp_zc_recv(ci_udp_iomsg_args* a, struct onload_zc_recv_args* args)
   rc = ci_udp_recvmsg_block(a, ni, us, spin_state.timeout);
   ci_sock_lock(ni, &us->s.b);
   if( rc == 0 ) {
-    if( ci_udp_recv_q_not_empty(&us->recv_q) )
+    if( ci_udp_recv_q_not_empty(&us->recv_q) ) {
+      ci_udp_recvmsg_spin_adapt_done(ni, us, &spin_state);
       goto not_empty;
+    }
     else
       goto empty;
   }
@@ -171,8 +171,17 @@ int ci_udp_rx_deliver(ci_sock_cmn* s, void* opaque_arg)
   }
 #endif
 
+  if( (us->udpflags & CI_UDPF_RX_FILTER) &&
+      ci_udp_filter_run(ni, us, pkt) == 0 ) {
+    LOG_UR(log(FNS_FMT "DROP (filter) pay_len=%d",
+               FNS_PRI_ARGS(ni, s), pkt->pf.udp.pay_len));
+    ++us->stats.n_rx_filter_drop;
+    return 0; /* deliver to other sockets if their filters allow */
+  }
+
   if( (recvq_depth <= us->stats.max_recvq_pkts) &&
-      ! (ni->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL) ) {
+      ! (ni->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL) &&
+      ! ci_netif_rx_pkt_quota_exceeded(ni, recvq_depth) ) {
   fast_receive:
     /* The same queue link is used for both the TX timestamp_q and the
      * udp recv_q, so we need to use an indirect packet if this is
@@ -207,6 +216,10 @@ int ci_udp_rx_deliver(ci_sock_cmn* s, void* opaque_arg)
     }
     ci_assert( (pkt->rx_flags & CI_PKT_RX_FLAG_UDP_KEEP) == 0 );
     ci_udp_recv_q_put(ni, &us->recv_q, pkt);
+    ci_lat_hist_record(ni, &us->s.b, CI_LAT_HIST_RX_STACK,
+                       pkt->pf.udp.rx_stamp);
+    ci_netif_trace(ni, CI_TRACE_RX_DELIVER, S_ID(us), OO_PKT_ID(pkt),
+                   pkt->pf.udp.pay_len, 0);
     us->s.b.sb_flags |= CI_SB_FLAG_RX_DELIVERED;
     ci_netif_put_on_post_poll(ni, &us->s.b);
     ci_udp_wake_possibly_not_in_poll(ni, us, CI_SB_FLAG_WAKE_RX);
@@ -226,7 +239,8 @@ int ci_udp_rx_deliver(ci_sock_cmn* s, void* opaque_arg)
   /* First check if we've come here just to update max_recvq_depth */
   if( recvq_depth > us->stats.max_recvq_pkts ) {
     if( recvq_depth <= ci_udp_recv_q_bytes2packets(us->s.so.rcvbuf)  &&
-        ! (ni->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL) ) {
+        ! (ni->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL) &&
+        ! ci_netif_rx_pkt_quota_exceeded(ni, recvq_depth) ) {
       us->stats.max_recvq_pkts = recvq_depth;
       goto fast_receive;
     }
@@ -243,6 +257,8 @@ int ci_udp_rx_deliver(ci_sock_cmn* s, void* opaque_arg)
     LOG_UR(log(FNS_FMT "DROP (memory pressure) pay_len=%d",
                FNS_PRI_ARGS(ni, s), pkt->pf.udp.pay_len));
     CITP_STATS_NETIF_INC(ni, memory_pressure_drops);
+    if( ci_netif_rx_pkt_quota_exceeded(ni, recvq_depth) )
+      CITP_STATS_NETIF_INC(ni, rx_pkt_quota_drops);
     ++us->stats.n_rx_mem_drop;
   }
   return 0;  /* continue delivering to other sockets */
@@ -60,11 +60,15 @@
  * false.  si_ variants take a [struct udp_send_info*].
  */
 #define trylock(ni, locked)                                     \
-  ((locked) || (ci_netif_trylock(ni) && ((locked) = 1)))
+  ((locked) || (ci_netif_trylock(ni) &&                         \
+                (ci_netif_lock_prof_site((ni), CI_NETIF_LOCK_SITE_SENDMSG), \
+                 (locked) = 1)))
 #define si_trylock(ni, sinf)                    \
   trylock((ni), (sinf)->stack_locked)
 #define trylock_and_inc(ni, locked, cntr)                               \
-  ((locked) || (ci_netif_trylock(ni) && (++(cntr), (locked) = 1)))
+  ((locked) || (ci_netif_trylock(ni) &&                                 \
+                (ci_netif_lock_prof_site((ni), CI_NETIF_LOCK_SITE_SENDMSG), \
+                 ++(cntr), (locked) = 1)))
 #define si_trylock_and_inc(ni, sinf, cntr)              \
   trylock_and_inc((ni), (sinf)->stack_locked, (cntr))
 
@@ -299,6 +303,7 @@ ci_inline void prep_send_pkt(ci_netif* ni, ci_udp_state* us,
   us->tx_count += pkt->pf.udp.tx_length;
   pkt->flags |= CI_PKT_FLAG_UDP;
   pkt->pf.udp.tx_sock_id = S_SP(us);
+  ci_lat_hist_stamp(&us->s.b, &pkt->pf.udp.tx_stamp);
   CI_UDP_STATS_INC_OUT_DGRAMS( ni );
 
   if( (ip->ip_frag_off_be16 & CI_IP4_OFFSET_MASK) == 0 ) {
@@ -1114,8 +1119,9 @@ int ci_udp_sendmsg_fill(ci_netif* ni, ci_udp_state* us,
    * because we avoid the cost of atomic ops to allocate packet buffers.
    */
   if( bytes_to_send < NI_OPTS(ni).udp_send_unlock_thresh &&
-      ! sinf->stack_locked )
-    sinf->stack_locked = ci_netif_trylock(ni);
+      ! sinf->stack_locked &&
+      (sinf->stack_locked = ci_netif_trylock(ni)) )
+    ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_SENDMSG);
 
   rc = ci_netif_pkt_alloc_block(ni, &us->s, &sinf->stack_locked, can_block,
                                 &first_pkt);
@@ -1355,10 +1361,12 @@ int ci_udp_sendmsg(ci_udp_iomsg_args *a,
   ci_netif *ni = a->ni;
   ci_udp_state *us = a->us;
   struct udp_send_info sinf;
+  ci_uint64 start = 0;
   int rc;
 
   /* Caller should have checked this. */
   ci_assert(msg != NULL);
+  ci_lat_hist_stamp(&us->s.b, &start);
 
   /* Init sinf to properly unlock netif on exit */
   sinf.rc = 0;
@@ -1400,6 +1408,7 @@ int ci_udp_sendmsg(ci_udp_iomsg_args *a,
     }
 # endif
     sinf.stack_locked = 1;
+    ci_netif_lock_prof_site(ni, CI_NETIF_LOCK_SITE_SENDMSG);
   }
 #endif
 
@@ -1547,6 +1556,7 @@ int ci_udp_sendmsg(ci_udp_iomsg_args *a,
   ci_udp_sendmsg_onload(ni, us, msg, flags, &sinf);
   if( sinf.stack_locked )
     ci_netif_unlock(ni);
+  ci_lat_hist_record(ni, &us->s.b, CI_LAT_HIST_TX_SEND, start);
   if( sinf.rc < 0 )
       CI_SET_ERROR(sinf.rc, -sinf.rc);
   return sinf.rc;
@@ -27,6 +27,7 @@
 /*! \cidoxg_lib_transport_ip */
 
 #include "ip_internal.h"
+#include "udp_internal.h"
 #include <ci/internal/cplane_ops.h>
 
 #ifndef __KERNEL__
@@ -34,6 +35,7 @@
 #endif
 
 # include <netinet/udp.h>
+# include <linux/filter.h>
 
 
 #define LPF "UDP SOCKOPTS "
@@ -366,6 +368,41 @@ static int ci_udp_setsockopt_lk(citp_socket* ep, ci_fd_t fd, ci_fd_t os_sock,
       return ci_set_sol_socket(netif, &us->s, optname, optval, optlen);
       break;
 
+    case SO_ATTACH_FILTER:
+    {
+      const struct sock_fprog* fprog = optval;
+      ci_udp_filter_insn prog[CI_CFG_UDP_RX_FILTER_MAX_INSNS];
+
+      if( (rc = opt_not_ok(optval, optlen, struct sock_fprog)) )
+        goto fail_inval;
+
+      /* The OS socket has accepted the program.  If we can't run it
+       * ourselves it applies to the OS socket only, as it always used to.
+       */
+      if( fprog->len <= CI_CFG_UDP_RX_FILTER_MAX_INSNS )
+        memcpy(prog, fprog->filter, fprog->len * sizeof(prog[0]));
+      if( fprog->len > CI_CFG_UDP_RX_FILTER_MAX_INSNS ||
+          ci_udp_filter_check(prog, fprog->len) != 0 ) {
+        LOG_U(ci_log(FNS_FMT "SO_ATTACH_FILTER: unsupported program "
+                     "(len=%d max=%d) applies to OS socket only",
+                     FNS_PRI_ARGS(netif, ep->s),
+                     fprog->len, CI_CFG_UDP_RX_FILTER_MAX_INSNS));
+        us->udpflags &= ~CI_UDPF_RX_FILTER;
+        us->rx_filter_len = 0;
+        break;
+      }
+
+      memcpy(us->rx_filter, prog, fprog->len * sizeof(prog[0]));
+      us->rx_filter_len = fprog->len;
+      us->udpflags |= CI_UDPF_RX_FILTER;
+      break;
+    }
+
+    case SO_DETACH_FILTER:
+      us->udpflags &= ~CI_UDPF_RX_FILTER;
+      us->rx_filter_len = 0;
+      break;
+
     default:
       /* Common socket level options */
       return ci_set_sol_socket(netif, &us->s, optname, optval, optlen);
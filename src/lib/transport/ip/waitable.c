@@ -36,6 +36,7 @@ void citp_waitable_reinit(ci_netif* ni, citp_waitable* w)
   w->sleep_seq.all = 0;
   w->sigown = 0;
   w->spin_cycles = ni->state->sock_spin_cycles;
+  w->spin_adapt.avg = w->spin_adapt.dev = w->spin_adapt.n_blocked = 0;
 }
 
 
@@ -64,6 +65,7 @@ void citp_waitable_init(ci_netif* ni, citp_waitable* w, int id)
   ci_ni_dllist_self_link(ni, &w->ready_link);
 
   w->lock.wl_val = 0;
+  w->lat_hist = OO_SP_NULL;
   CI_DEBUG(w->wt_next = OO_SP_NULL);
   CI_DEBUG(w->next_id = CI_ILL_END);
 
@@ -212,6 +214,8 @@ static void __citp_waitable_obj_free(ci_netif* ni, citp_waitable* w)
   w->lock.wl_val = 0;
   w->ready_list_id = 0;
   CI_USER_PTR_SET(w->eitem, NULL);
+  if( OO_SP_NOT_NULL(w->lat_hist) )
+    ci_lat_hist_release(ni, w);
 }
 
 
@@ -383,6 +387,9 @@ static void citp_waitable_dump2(ci_netif* ni, citp_waitable* w, const char* pf,
   else
     logger(log_arg, "%s  ul_poll: %llu spin cycles %u usec", pf,
          w->spin_cycles, oo_cycles64_to_usec(ni, w->spin_cycles));
+  if( NI_OPTS(ni).spin_adaptive )
+    logger(log_arg, "%s  spin_adapt: wait avg=%uus dev=%uus", pf,
+           w->spin_adapt.avg >> 3, w->spin_adapt.dev >> 2);
 }
 
 
@@ -482,6 +489,7 @@ void citp_waitable_wake_not_in_poll(ci_netif* ni, citp_waitable* sb,
 
   if( what & sb->wake_request ) {
     sb->sb_flags |= what;
+    ci_netif_trace(ni, CI_TRACE_WAKE, W_ID(sb), what, sb->wake_request, 0);
     citp_waitable_wakeup(ni, sb);
   }
 
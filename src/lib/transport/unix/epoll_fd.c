@@ -459,6 +459,7 @@ int citp_epoll_create(int size, int flags)
   ep->blocking = 0;
   ep->home_stack = NULL;
   ep->ready_list = 0;
+  ep->spin_adapt.avg = ep->spin_adapt.dev = ep->spin_adapt.n_blocked = 0;
   citp_fdtable_insert(fdi, fd, 0);
   Log_POLL(ci_log("%s: fd=%d driver_fd=%d epfd=%d", __FUNCTION__,
                   fd, ep->epfd_os, (int) ep->shared->epfd));
@@ -1482,6 +1483,34 @@ citp_epoll_find_timeout(ci_int64* timeout_hr, ci_uint64* poll_start_frc)
 #error "Can not implement epoll_pwait() without ppoll()"
 #endif
 
+/* EF_SPIN_ADAPTIVE: should a caller about to block in epoll_wait() spin
+ * first?  The decision is counted in the home stack, if there is one.
+ */
+static int citp_epoll_spin_adapt_should_spin(struct citp_epoll_fd* ep)
+{
+  int spin = ci_spin_adapt_should_spin(&ep->spin_adapt,
+                                       CITP_OPTS.ul_spin_wake_cost_usec);
+  if( ep->home_stack != NULL ) {
+    if( spin )
+      CITP_STATS_NETIF_INC(ep->home_stack, spin_adapt_spin);
+    else
+      CITP_STATS_NETIF_INC(ep->home_stack, spin_adapt_block);
+  }
+  return spin;
+}
+
+
+static void citp_epoll_spin_adapt_update(struct citp_epoll_fd* ep,
+                                         ci_uint64 start_frc,
+                                         ci_uint64 now_frc, int blocked)
+{
+  ci_uint64 usec = (now_frc - start_frc) * 1000 / citp.cpu_khz;
+  ci_spin_adapt_update(&ep->spin_adapt,
+                       (unsigned) CI_MIN(usec, (ci_uint64) (unsigned) -1),
+                       blocked ? CITP_OPTS.ul_spin_wake_cost_usec : 0);
+}
+
+
 int citp_epoll_wait(citp_fdinfo* fdi, struct epoll_event*__restrict__ events,
                     struct citp_ordered_wait* ordering,
                     int maxevents, int timeout, const sigset_t *sigmask,
@@ -1589,6 +1618,11 @@ int citp_epoll_wait(citp_fdinfo* fdi, struct epoll_event*__restrict__ events,
       ordering->next_timeout = citp_epoll_find_timeout(&timeout_hr,
                                                        &poll_start_frc);
     }
+    if( have_spin && CITP_OPTS.ul_spin_adaptive ) {
+      if( ep->home_stack != NULL )
+        CITP_STATS_NETIF_INC(ep->home_stack, spin_adapt_hit);
+      citp_epoll_spin_adapt_update(ep, poll_start_frc, eps.this_poll_frc, 0);
+    }
 
     Log_POLL(ci_log("%s(%d): return %d ul + %d kernel",
                     __FUNCTION__, fdi->fd, rc, rc_os));
@@ -1605,6 +1639,9 @@ int citp_epoll_wait(citp_fdinfo* fdi, struct epoll_event*__restrict__ events,
   }
 
   /* Blocking.  Shall we spin? */
+  if( ! have_spin && eps.ul_epoll_spin && CITP_OPTS.ul_spin_adaptive &&
+      ! citp_epoll_spin_adapt_should_spin(ep) )
+    eps.ul_epoll_spin = 0;
   if( KEEP_POLLING(eps.ul_epoll_spin, eps.this_poll_frc, poll_start_frc) ) {
 #if CI_LIBC_HAS_epoll_pwait
     if( !pwait_was_spinning && sigmask != NULL) {
@@ -1651,6 +1688,9 @@ int citp_epoll_wait(citp_fdinfo* fdi, struct epoll_event*__restrict__ events,
     goto poll_again;
   } /* endif ul_epoll_spin spinning*/
 
+  if( have_spin && CITP_OPTS.ul_spin_adaptive && ep->home_stack != NULL )
+    CITP_STATS_NETIF_INC(ep->home_stack, spin_adapt_miss);
+
   /* Re-calculate timeout.  We should do it if we were spinning a lot. */
   if( eps.ul_epoll_spin && timeout > 0 ) {
     timeout_hr -= eps.this_poll_frc - poll_start_frc;
@@ -1791,6 +1831,8 @@ int citp_epoll_wait(citp_fdinfo* fdi, struct epoll_event*__restrict__ events,
     ordering->next_timeout = citp_epoll_find_timeout(&timeout_hr,
                                                      &poll_start_frc);
   }
+  if( rc > 0 && CITP_OPTS.ul_spin_adaptive )
+    citp_epoll_spin_adapt_update(ep, poll_start_frc, ci_frc64_get(), 1);
 
   Log_POLL(ci_log("%s(%d): to kernel => %d (%d)", __FUNCTION__, fdi->fd,
                   rc, errno));
@@ -2324,4 +2366,48 @@ out:
 }
 
 
+/* Fault in what epoll_wait() walks for this set: the set itself, its
+ * members and their sockets, and the home stack's ready list.  Returns the
+ * number of pages touched.
+ */
+int citp_epoll_warm(citp_fdinfo* fdi)
+{
+  struct citp_epoll_fd* ep = fdi_to_epoll(fdi);
+  ci_dllist* lists[] = { &ep->oo_stack_sockets,
+                         &ep->oo_stack_not_ready_sockets,
+                         &ep->oo_sockets };
+  struct citp_epoll_member* eitem;
+  citp_fdinfo* sock_fdi;
+  unsigned i;
+  int n;
+
+  CITP_EPOLL_EP_LOCK(ep);
+  n = ci_netif_touch_pages(ep, sizeof(*ep));
+  if( ep->shared != NULL )
+    n += ci_netif_touch_pages(ep->shared, sizeof(*ep->shared));
+  if( ep->home_stack != NULL )
+    n += ci_netif_touch_pages(
+                        &ep->home_stack->state->ready_lists[ep->ready_list],
+                        sizeof(ep->home_stack->state->ready_lists[0]));
+
+  /* As when polling the members, hold the fdtable lock so that a member
+   * cannot be closed and its fdinfo freed while we look at its socket.
+   */
+  if( citp_fdtable_not_mt_safe() )
+    CITP_FDTABLE_LOCK_RD();
+  for( i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i )
+    CI_DLLIST_FOR_EACH2(struct citp_epoll_member, eitem, dllink, lists[i]) {
+      n += ci_netif_touch_pages(eitem, sizeof(*eitem));
+      sock_fdi = citp_ul_epoll_member_to_fdi(eitem);
+      if( sock_fdi != NULL && citp_fdinfo_is_socket(sock_fdi) )
+        n += ci_netif_touch_pages(fdi_to_sock_fdi(sock_fdi)->sock.s,
+                                  sizeof(citp_waitable_obj));
+    }
+  if( citp_fdtable_not_mt_safe() )
+    CITP_FDTABLE_UNLOCK_RD();
+  CITP_EPOLL_EP_UNLOCK(ep, 0);
+  return n;
+}
+
+
 #endif  /* CI_CFG_USERSPACE_EPOLL */
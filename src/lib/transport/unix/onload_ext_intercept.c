@@ -30,12 +30,15 @@
 #include <sys/syscall.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <fcntl.h>
 #include <dlfcn.h>
+#include <sys/resource.h>
 
 #include "internal.h"
 #include <onload/extensions.h>
 #include <onload/ul/stackname.h>
 #include <ci/internal/tls.h>
+#include <ci/internal/cplane_ops.h>
 
 #if CI_CFG_USERSPACE_PIPE
 #include "ul_pipe.h"
@@ -472,3 +475,410 @@ fail:
   citp_exit_lib(&lib_context, FALSE);
   return rc;
 }
+
+
+/* Returns the stack of [fd], with a reference to [fd] held in [*fdi_out],
+ * or NULL with errno set.
+ */
+static ci_netif* cluster_fd_netif(int fd, citp_fdinfo** fdi_out)
+{
+  citp_fdinfo* fdi = citp_fdtable_lookup(fd);
+  ci_netif* ni;
+
+  *fdi_out = fdi;
+  if( fdi == NULL || ! citp_fdinfo_is_socket(fdi) ) {
+    errno = EINVAL;
+    return NULL;
+  }
+  ni = fdi_to_sock_fdi(fdi)->sock.netif;
+  if( ci_netif_rss_intf(ni) < 0 ) {
+    errno = ENOENT;
+    return NULL;
+  }
+  return ni;
+}
+
+
+int onload_cluster_stack_index(int fd, int* cluster_size_out)
+{
+  citp_lib_context_t lib_context;
+  citp_fdinfo* fdi;
+  ci_netif* ni;
+  int rc = -1;
+
+  Log_CALL(ci_log("%s(%d, %p)", __FUNCTION__, fd, cluster_size_out));
+  citp_enter_lib(&lib_context);
+  if( (ni = cluster_fd_netif(fd, &fdi)) != NULL ) {
+    const ci_netif_state_nic_t* nsn = &ni->state->nic[ci_netif_rss_intf(ni)];
+    if( cluster_size_out != NULL )
+      *cluster_size_out = nsn->rss_n_queues;
+    rc = nsn->rss_queue;
+  }
+  if( fdi != NULL )
+    citp_fdinfo_release_ref(fdi, 0);
+  citp_exit_lib(&lib_context, rc >= 0);
+  Log_CALL_RESULT(rc);
+  return rc;
+}
+
+
+int onload_cluster_tuple_index(int fd,
+                               const struct onload_cluster_tuple* tuples,
+                               int n_tuples, int* indices_out, unsigned flags)
+{
+  citp_lib_context_t lib_context;
+  ci_rss_tuple t[64];
+  citp_fdinfo* fdi;
+  ci_netif* ni;
+  int i, n, rc = -1;
+
+  Log_CALL(ci_log("%s(%d, %p, %d, %p, %x)", __FUNCTION__,
+                  fd, tuples, n_tuples, indices_out, flags));
+  citp_enter_lib(&lib_context);
+  if( (ni = cluster_fd_netif(fd, &fdi)) == NULL )
+    goto out;
+  for( rc = 0; n_tuples > 0 && rc == 0;
+       tuples += n, indices_out += n, n_tuples -= n ) {
+    n = CI_MIN(n_tuples, sizeof(t) / sizeof(t[0]));
+    for( i = 0; i < n; ++i ) {
+      t[i].laddr_be32 = tuples[i].laddr.s_addr;
+      t[i].raddr_be32 = tuples[i].raddr.s_addr;
+      t[i].lport_be16 = tuples[i].lport;
+      t[i].rport_be16 = tuples[i].rport;
+    }
+    rc = ci_netif_rss_queues(ni, flags & ONLOAD_CLUSTER_TUPLE_ACTIVE,
+                             t, n, indices_out);
+  }
+  if( rc < 0 ) {
+    errno = -rc;
+    rc = -1;
+  }
+ out:
+  if( fdi != NULL )
+    citp_fdinfo_release_ref(fdi, 0);
+  citp_exit_lib(&lib_context, rc == 0);
+  Log_CALL_RESULT(rc);
+  return rc;
+}
+
+
+static void cluster_ephemeral_ports(unsigned* lo, unsigned* hi)
+{
+  char buf[32];
+  int fd, n;
+
+  *lo = 32768;
+  *hi = 60999;
+  fd = ci_sys_open("/proc/sys/net/ipv4/ip_local_port_range", O_RDONLY);
+  if( fd < 0 )
+    return;
+  n = ci_sys_read(fd, buf, sizeof(buf) - 1);
+  ci_sys_close(fd);
+  if( n <= 0 )
+    return;
+  buf[n] = '\0';
+  if( sscanf(buf, "%u %u", lo, hi) != 2 || *lo == 0 || *hi > 65535 ||
+      *lo > *hi ) {
+    *lo = 32768;
+    *hi = 60999;
+  }
+}
+
+
+/* Moves the unbound TCP socket of [*fdi_io], whose stack is not
+ * clustered, into the calling thread's stack in the process's cluster,
+ * creating the cluster or the stack if needed.  The reference at [*fdi_io]
+ * is replaced by one to the moved socket's fdinfo.  Returns the new stack,
+ * or NULL with errno set.
+ */
+static ci_netif* cluster_join(int fd, citp_fdinfo** fdi_io,
+                              struct oo_per_thread* pt)
+{
+  citp_fdinfo* fdi = *fdi_io;
+  citp_sock_fdi* epi = fdi_to_sock_fdi(fdi);
+  ci_fixed_descriptor_t op_arg = fd;
+  ef_driver_handle fd_ni;
+  ci_netif* ni;
+  int rc;
+
+  if( citp_fdinfo_get_type(fdi) != CITP_TCP_SOCKET ||
+      epi->sock.s->b.state != CI_TCP_CLOSED ||
+      (epi->sock.s->s_flags & CI_SOCK_FLAG_PORT_BOUND) ||
+      CITP_OPTS.cluster_size < 2 || NI_OPTS(epi->sock.netif).cluster_ignore ) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  if( citp_netif_cluster_alloc_and_init(&fd_ni, &ni, &pt->cluster_stack) != 0 )
+    return NULL;
+  if( (rc = oo_resource_op(fd_ni, OO_IOC_MOVE_FD, &op_arg)) != 0 ) {
+    citp_netif_release_ref(ni, 0);
+    errno = -rc;
+    return NULL;
+  }
+
+  /* This drops our reference to the old fdinfo. */
+  *fdi_io = NULL;
+  if( (fdi = citp_reprobe_moved(fdi, CI_FALSE, CI_FALSE)) == NULL ) {
+    errno = EBADF;
+    return NULL;
+  }
+  *fdi_io = fdi;
+  if( ! citp_fdinfo_is_socket(fdi) ) {
+    errno = EINVAL;
+    return NULL;
+  }
+  ni = fdi_to_sock_fdi(fdi)->sock.netif;
+  if( ci_netif_rss_intf(ni) < 0 ) {
+    errno = ENOENT;
+    return NULL;
+  }
+  return ni;
+}
+
+
+int onload_cluster_bind_for_connect(int fd, const struct sockaddr_in* laddr,
+                                    const struct sockaddr_in* raddr)
+{
+  citp_lib_context_t lib_context;
+  struct sockaddr_in sin;
+  ci_rss_tuple t[64];
+  int queues[64];
+  citp_fdinfo* fdi;
+  citp_fdinfo* bound_fdi;
+  ci_netif* ni;
+  unsigned lo, hi, range, start, tried, i, n;
+  ci_uint64 frc;
+  int queue, bind_errno, rc = -1;
+
+  Log_CALL(ci_log("%s(%d, %p, %p)", __FUNCTION__, fd, laddr, raddr));
+  citp_enter_lib(&lib_context);
+  if( laddr->sin_family != AF_INET || raddr->sin_family != AF_INET ||
+      laddr->sin_addr.s_addr == INADDR_ANY ) {
+    fdi = NULL;
+    errno = EINVAL;
+    goto out;
+  }
+  /* A new socket is created in the process's usual stack, and joins a
+   * cluster only when bound.  Move it into one now, so that we know how
+   * its flows will be spread.
+   */
+  if( (ni = cluster_fd_netif(fd, &fdi)) == NULL &&
+      (errno != ENOENT ||
+       (ni = cluster_join(fd, &fdi, lib_context.thread)) == NULL) )
+    goto out;
+  if( citp_fdinfo_get_type(fdi) != CITP_TCP_SOCKET ) {
+    errno = EINVAL;
+    goto out;
+  }
+  queue = ni->state->nic[ci_netif_rss_intf(ni)].rss_queue;
+
+  /* Hash the ephemeral ports in batches from a random starting point,
+   * and try to bind to each one that hashes to our stack.  About one in
+   * every cluster-size ports will do.
+   */
+  cluster_ephemeral_ports(&lo, &hi);
+  range = hi - lo + 1;
+  ci_frc64(&frc);
+  start = (unsigned) frc % range;
+  sin = *laddr;
+  for( tried = 0; tried < range; tried += n ) {
+    n = CI_MIN(range - tried, sizeof(t) / sizeof(t[0]));
+    for( i = 0; i < n; ++i ) {
+      t[i].laddr_be32 = laddr->sin_addr.s_addr;
+      t[i].raddr_be32 = raddr->sin_addr.s_addr;
+      t[i].lport_be16 = htons(lo + (start + tried + i) % range);
+      t[i].rport_be16 = raddr->sin_port;
+    }
+    if( (rc = ci_netif_rss_queues(ni, 1, t, n, queues)) < 0 ) {
+      errno = -rc;
+      rc = -1;
+      goto out;
+    }
+    for( i = 0; i < n; ++i ) {
+      if( queues[i] != queue )
+        continue;
+      sin.sin_port = t[i].lport_be16;
+      /* The bind handler drops a reference to [fdi], and may hand the
+       * socket over or move it to another stack.  So look it up again,
+       * and give up unless it is still the socket we hashed for.
+       */
+      citp_fdinfo_ref(fdi);
+      rc = citp_fdinfo_get_ops(fdi)->bind(fdi, (struct sockaddr*) &sin,
+                                          sizeof(sin));
+      bind_errno = errno;
+      bound_fdi = citp_fdtable_lookup(fd);
+      citp_fdinfo_release_ref(fdi, 0);
+      fdi = bound_fdi;
+      errno = bind_errno;
+      if( rc == 0 || errno != EADDRINUSE )
+        goto out;
+      if( fdi == NULL || ! citp_fdinfo_is_socket(fdi) ||
+          fdi_to_sock_fdi(fdi)->sock.netif != ni )
+        goto out;
+    }
+  }
+  errno = EADDRNOTAVAIL;
+  rc = -1;
+
+ out:
+  if( fdi != NULL )
+    citp_fdinfo_release_ref(fdi, 0);
+  citp_exit_lib(&lib_context, rc == 0);
+  Log_CALL_RESULT(rc);
+  return rc;
+}
+
+
+/**************************************************************************/
+
+static int warm_tcp_connected(ci_sock_cmn* s)
+{
+  return s->b.state == CI_TCP_ESTABLISHED || s->b.state == CI_TCP_CLOSE_WAIT;
+}
+
+
+static void warm_send(citp_fdinfo* fdi, ci_netif* ni, ci_sock_cmn* s)
+{
+  if( citp_fdinfo_get_type(fdi) == CITP_TCP_SOCKET ) {
+    char buf[1] = { 0 };
+    struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+    if( warm_tcp_connected(s) )
+      citp_fdinfo_get_ops(fdi)->send(fdi, &msg, ONLOAD_MSG_WARM);
+  }
+  else {
+    /* UDP has no ONLOAD_MSG_WARM, so do the parts of a send that touch
+     * memory: take a packet and lay down the cached headers.
+     */
+    ci_ip_pkt_fmt* pkt;
+
+    ci_netif_lock(ni);
+    if( (pkt = ci_netif_pkt_alloc(ni)) != NULL ) {
+      ci_pkt_init_from_ipcache_len(pkt, &s->pkt,
+                                   sizeof(ci_ip4_hdr) + sizeof(ci_udp_hdr));
+      ci_netif_pkt_release(ni, pkt);
+    }
+    ci_netif_unlock(ni);
+  }
+}
+
+
+static void warm_recv(citp_fdinfo* fdi)
+{
+  char buf[1];
+  struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+  struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+  citp_fdinfo_get_ops(fdi)->recv(fdi, &msg, MSG_PEEK | MSG_DONTWAIT);
+}
+
+
+static int warm_epoll_sock(ci_netif* ni, ci_sock_cmn* s)
+{
+  int n = 0;
+
+  if( s->b.ready_list_id >= 0 && s->b.ready_list_id < CI_CFG_N_READY_LISTS )
+    n += ci_netif_touch_pages(&ni->state->ready_lists[s->b.ready_list_id],
+                              sizeof(ni->state->ready_lists[0]));
+  if( s->b.eitem_pid == getpid() && CI_USER_PTR_GET(s->b.eitem) != NULL )
+    n += ci_netif_touch_pages(CI_USER_PTR_GET(s->b.eitem),
+                              sizeof(struct citp_epoll_member));
+  return n;
+}
+
+
+static void warm_cplane(citp_fdinfo* fdi, ci_netif* ni, ci_sock_cmn* s,
+                        struct onload_warm_stats* stats)
+{
+  ci_netif_lock(ni);
+  if( citp_fdinfo_get_type(fdi) == CITP_TCP_SOCKET ) {
+    if( warm_tcp_connected(s) ) {
+      ++stats->cplane_lookups;
+      stats->route_ok = ci_tcp_resolve_arp(ni, SOCK_TO_TCP(s));
+    }
+  }
+  else if( udp_raddr_be32(SOCK_TO_UDP(s)) ) {
+    ++stats->cplane_lookups;
+    cicp_user_retrieve(ni, &s->pkt, &s->cp);
+    stats->route_ok = s->pkt.status == retrrc_success;
+  }
+  ci_netif_unlock(ni);
+}
+
+
+int onload_stack_warm(int fd, unsigned flags, struct onload_warm_stats* stats)
+{
+  citp_lib_context_t lib_context;
+  struct onload_warm_stats local_stats;
+  struct rusage ru_before, ru_after;
+  citp_fdinfo* fdi;
+  ci_netif* ni = NULL;
+  ci_sock_cmn* s;
+  int rc = -1, saved_errno;
+
+  Log_CALL(ci_log("%s(%d, %x, %p)", __FUNCTION__, fd, flags, stats));
+  if( stats == NULL )
+    stats = &local_stats;
+  memset(stats, 0, sizeof(*stats));
+  getrusage(RUSAGE_THREAD, &ru_before);
+
+  citp_enter_lib(&lib_context);
+  if( (fdi = citp_fdtable_lookup(fd)) == NULL ) {
+    errno = EINVAL;
+    goto out;
+  }
+  saved_errno = errno;
+
+#if CI_CFG_USERSPACE_EPOLL
+  if( citp_fdinfo_get_type(fdi) == CITP_EPOLL_FD ) {
+    if( flags & ONLOAD_WARM_EPOLL )
+      stats->pages_touched += citp_epoll_warm(fdi);
+    if( (ni = fdi_to_epoll(fdi)->home_stack) != NULL &&
+        (flags & ONLOAD_WARM_STACK) )
+      stats->pages_touched += ci_netif_warm(ni);
+    rc = 0;
+    goto out;
+  }
+#endif
+  if( citp_fdinfo_get_type(fdi) != CITP_TCP_SOCKET &&
+      citp_fdinfo_get_type(fdi) != CITP_UDP_SOCKET ) {
+    errno = EINVAL;
+    goto out;
+  }
+  ni = fdi_to_sock_fdi(fdi)->sock.netif;
+  s = fdi_to_sock_fdi(fdi)->sock.s;
+
+  if( flags & ONLOAD_WARM_STACK ) {
+    stats->pages_touched += ci_netif_warm(ni);
+    stats->pages_touched +=
+      ci_netif_touch_pages(CI_CONTAINER(citp_waitable_obj, waitable, &s->b),
+                           sizeof(citp_waitable_obj));
+  }
+  if( flags & ONLOAD_WARM_CPLANE )
+    warm_cplane(fdi, ni, s, stats);
+  if( flags & ONLOAD_WARM_SEND )
+    warm_send(fdi, ni, s);
+  if( flags & ONLOAD_WARM_RECV )
+    warm_recv(fdi);
+  if( flags & ONLOAD_WARM_EPOLL )
+    stats->pages_touched += warm_epoll_sock(ni, s);
+  /* The send and receive above may fail harmlessly. */
+  errno = saved_errno;
+  rc = 0;
+
+ out:
+  getrusage(RUSAGE_THREAD, &ru_after);
+  stats->faults = (ru_after.ru_minflt - ru_before.ru_minflt) +
+                  (ru_after.ru_majflt - ru_before.ru_majflt);
+  if( ni != NULL ) {
+    CITP_STATS_NETIF_INC(ni, warm_calls);
+    CITP_STATS_NETIF_ADD(ni, warm_faults, stats->faults);
+  }
+  if( fdi != NULL )
+    citp_fdinfo_release_ref(fdi, 0);
+  citp_exit_lib(&lib_context, rc == 0);
+  Log_CALL_RESULT(rc);
+  return rc;
+}
@@ -200,6 +200,8 @@ static void citp_dump_opts(citp_opts_t *o)
 #endif
   DUMP_OPT_INT("EF_FDTABLE_SIZE",	fdtable_size);
   DUMP_OPT_INT("EF_SPIN_USEC",		ul_spin_usec);
+  DUMP_OPT_INT("EF_SPIN_ADAPTIVE",	ul_spin_adaptive);
+  DUMP_OPT_INT("EF_SPIN_WAKE_COST_USEC", ul_spin_wake_cost_usec);
   DUMP_OPT_INT("EF_STACK_PER_THREAD",	stack_per_thread);
   DUMP_OPT_INT("EF_DONT_ACCELERATE",	dont_accelerate);
   DUMP_OPT_INT("EF_FDTABLE_STRICT",	fdtable_strict);
@@ -448,6 +450,8 @@ static void citp_opts_getenv(citp_opts_t* opts)
 #endif
   GET_ENV_OPT_INT("EF_FDTABLE_SIZE",	fdtable_size);
   GET_ENV_OPT_INT("EF_SPIN_USEC",	ul_spin_usec);
+  GET_ENV_OPT_INT("EF_SPIN_ADAPTIVE",	ul_spin_adaptive);
+  GET_ENV_OPT_INT("EF_SPIN_WAKE_COST_USEC", ul_spin_wake_cost_usec);
   GET_ENV_OPT_INT("EF_STACK_PER_THREAD",stack_per_thread);
   GET_ENV_OPT_INT("EF_DONT_ACCELERATE",	dont_accelerate);
   GET_ENV_OPT_INT("EF_FDTABLE_STRICT",	fdtable_strict);
@@ -39,6 +39,7 @@
 #include <onload/tcp_poll.h>
 #include <onload/ul/tcp_helper.h>
 #include <onload/osfile.h>
+#include <sched.h>
 
 
 #define LPF      "citp_tcp_"
@@ -662,52 +663,69 @@ fail:
 }
 
 
+/* Returns the accept queue shard that this thread should take connections
+ * from first.  The caller reduces it modulo the number of shards.
+ */
+static unsigned citp_tcp_accept_home_shard(ci_netif* ni,
+                                           ci_tcp_socket_listen* listener)
+{
+  static ci_atomic_t next_shard;
+  struct oo_per_thread* pt;
+  int cpu;
+
+  if( listener->acceptq_n_shards == 1 )
+    return 0;
+  if( NI_OPTS(ni).tcp_acceptq_shard_mode == CITP_TCP_ACCEPTQ_SHARD_CPU ) {
+    cpu = sched_getcpu();
+    return cpu < 0 ? 0 : cpu;
+  }
+  pt = oo_per_thread_get();
+  if( pt->accept_shard == 0 )
+    pt->accept_shard = ci_atomic_xadd(&next_shard, 1) + 1;
+  return pt->accept_shard - 1;
+}
+
+
 static int citp_tcp_accept_ul(citp_fdinfo* fdinfo, ci_netif* ni,
 			      ci_tcp_socket_listen* listener,
 			      struct sockaddr* sa, socklen_t* p_sa_len,
-                              int flags)
+                              int flags, citp_waitable* w, unsigned shard)
 {
   citp_sock_fdi* newepi;
   citp_fdinfo* newfdi;
   ci_tcp_state* ts;
-  citp_waitable* w;
   int newfd;
 #if CI_CFG_FD_CACHING
   int from_cache;
 #endif
 
-  Log_VSS(ci_log(LPF "accept(%d:%d, sa, %d)", fdinfo->fd,
-                 S_FMT(listener), p_sa_len ? *p_sa_len : -1));
+  Log_VSS(ci_log(LPF "accept(%d:%d, sa, %d) shard=%u", fdinfo->fd,
+                 S_FMT(listener), p_sa_len ? *p_sa_len : -1, shard));
 
-  /* Pop the socket off the accept queue. */
-  ci_assert(ci_sock_is_locked(ni, &listener->s.b));
-  ci_assert(ci_tcp_acceptq_not_empty(listener));
-  w = ci_tcp_acceptq_get(ni, listener);
-
-  if( w->sb_aflags & CI_SB_AFLAG_MOVED_AWAY ) {
-    ci_sock_unlock(ni, &listener->s.b);
+  if( w->sb_aflags & CI_SB_AFLAG_MOVED_AWAY )
     return citp_tcp_accept_alien(ni, listener, sa, p_sa_len, flags, w);
-  }
 
   ci_assert(w->state & CI_TCP_STATE_TCP);
   ci_assert(w->state != CI_TCP_LISTEN);
   ts = &CI_CONTAINER(citp_waitable_obj, waitable, w)->tcp;
 #if CI_CFG_FD_CACHING
   from_cache = ci_tcp_is_cached(ts);
-  ci_ni_dllist_remove_safe(ni, &ts->epcache_fd_link);
+  if( from_cache ) {
+    /* The listener's sock lock protects its list of cached fds. */
+    ci_sock_lock(ni, &listener->s.b);
+    ci_ni_dllist_remove_safe(ni, &ts->epcache_fd_link);
+    ci_sock_unlock(ni, &listener->s.b);
+  }
 #endif
-  ci_sock_unlock(ni, &listener->s.b);
 
   newfd = citp_tcp_ep_acquire_fd(ni, ts, listener, ts->s.domain, SOCK_STREAM,
                                  flags);
   if( newfd < 0 ) {
     Log_E(ci_log(LPF "%s: citp_tcp_ep_acquire_fd failed: %d",
                  __FUNCTION__, newfd));
-    ci_sock_lock(ni, &listener->s.b);
     ci_assert(ts->s.b.sb_aflags & CI_SB_AFLAG_TCP_IN_ACCEPTQ);
-    ci_tcp_acceptq_put_back(ni, listener, &ts->s.b);
+    ci_tcp_acceptq_put_back(ni, listener, shard, &ts->s.b);
     CITP_STATS_TCP_LISTEN(++listener->stats.n_accept_no_fd);
-    ci_sock_unlock(ni, &listener->s.b);
     return -1;
   }
 
@@ -805,14 +823,18 @@ check_ul_accept_q:
   }
 
   if( ci_tcp_acceptq_n(listener) ) {
-      ci_sock_lock(ni, &listener->s.b);
-      if( ci_tcp_acceptq_not_empty(listener) ) {
-          if( CI_UNLIKELY(p_sa_len == NULL && sa != NULL) ) {
-              ci_sock_unlock(ni, &listener->s.b);
-              CI_SET_ERROR(rc, EFAULT);
-              return rc;
-          }
-          rc = citp_tcp_accept_ul(fdinfo, ni, listener, sa, p_sa_len, flags);
+      citp_waitable* w;
+      unsigned shard;
+      if( CI_UNLIKELY(p_sa_len == NULL && sa != NULL) ) {
+          CI_SET_ERROR(rc, EFAULT);
+          return rc;
+      }
+      w = ci_tcp_acceptq_get_from(ni, listener,
+                                  citp_tcp_accept_home_shard(ni, listener),
+                                  &shard);
+      if( w != NULL ) {
+          rc = citp_tcp_accept_ul(fdinfo, ni, listener, sa, p_sa_len, flags,
+                                  w, shard);
           if( rc < 0 && errno != EMFILE ) {
             CITP_STATS_TCP_LISTEN(++listener->stats.n_accept_loop2_closed);
             ci_log("%s: failed to accept connection: errno=%d",
@@ -823,7 +845,6 @@ check_ul_accept_q:
           }
           return rc;
       }
-      ci_sock_unlock(ni, &listener->s.b);
   }
 
   /* User-level accept queue is empty.  Are we up-to-date? */
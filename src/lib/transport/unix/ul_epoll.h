@@ -163,6 +163,10 @@ struct citp_epoll_fd {
   /* Avoid spinning in next epoll_pwait call */
   int avoid_spin_once;
 
+  /* How long epoll_wait() callers have waited for events
+   * (EF_SPIN_ADAPTIVE). */
+  ci_spin_adapt spin_adapt;
+
   ci_netif* home_stack;
   int ready_list;
 };
@@ -243,6 +247,7 @@ extern int citp_epoll_ordered_wait(citp_fdinfo* fdi,
                                    int maxevents, int timeout,
                                    const sigset_t *sigmask,
                                    citp_lib_context_t *lib_context);
+extern int citp_epoll_warm(citp_fdinfo* fdi) CI_HF;
 extern void citp_epoll_remove_if_not_ready(struct oo_ul_epoll_state* eps,
                                            struct citp_epoll_member* eitem,
                                            ci_netif* ni, citp_waitable* w);
@@ -0,0 +1,244 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* csum_test
+ *
+ * Checks each Internet checksum implementation that the CPU supports
+ * (see ci_ip_csum_select()) against the C reference, using random
+ * lengths, alignments, data and initial sums, and then measures the
+ * throughput of checksum and copy-with-checksum across a range of sizes.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <ci/tools.h>
+#include <ci/tools/ipcsum.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+
+#define BUF_MAX  (64 * 1024)
+#define PAD      256
+
+
+static int      cfg_fuzz_iter = 100000;
+static int      cfg_bench_ms = 200;
+static int      cfg_impl = -1;
+static unsigned cfg_seed;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  csum_test [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <iter>   - number of fuzz iterations per "
+          "implementation (0 to skip)\n");
+  fprintf(stderr, "  -t <ms>     - benchmark time per size (0 to skip)\n");
+  fprintf(stderr, "  -i <impl>   - test only this implementation "
+          "(c, sse2, avx2, avx512)\n");
+  fprintf(stderr, "  -s <seed>   - random seed\n");
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+static unsigned fold(unsigned sum)
+{
+  return ci_ip_hdr_csum_finish(sum);
+}
+
+
+static ci_uint64 now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ci_uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static int fuzz(int impl, ci_uint8* src, ci_uint8* dst, ci_uint8* ref)
+{
+  int i, n, soff, doff, errors = 0;
+  unsigned sum, want, got;
+
+  for( i = 0; i < cfg_fuzz_iter; ++i ) {
+    /* Mostly small, sometimes up to the maximum. */
+    n = (i & 7) ? rand() % 2048 : rand() % BUF_MAX;
+    soff = rand() % 64;
+    doff = rand() % 64;
+    sum = (i & 1) ? (unsigned) rand() : 0;
+    switch( i % 5 ) {
+    case 0:
+      memset(src + soff, 0xff, n);
+      break;
+    case 1:
+      memset(src + soff, 0, n);
+      break;
+    default: {
+        int j;
+        for( j = 0; j < n; ++j )
+          src[soff + j] = rand();
+      }
+    }
+
+    ci_ip_csum_select(CI_IP_CSUM_IMPL_C);
+    want = fold(ci_ip_csum_aligned(src + soff, n, sum));
+    ci_ip_csum_select(impl);
+    got = fold(ci_ip_csum_aligned(src + soff, n, sum));
+    if( got != want ) {
+      fprintf(stderr, "%s: csum mismatch n=%d off=%d sum=%x: %x != %x\n",
+              ci_ip_csum_impl_name(impl), n, soff, sum, got, want);
+      ++errors;
+    }
+    if( fold(ci_ip_csum_partial(sum, src + soff, n)) != want ) {
+      fprintf(stderr, "%s: ci_ip_csum_partial mismatch n=%d off=%d\n",
+              ci_ip_csum_impl_name(impl), n, soff);
+      ++errors;
+    }
+
+    memset(ref, 0x5a, BUF_MAX + PAD);
+    memcpy(ref + doff, src + soff, n);
+    memset(dst, 0x5a, BUF_MAX + PAD);
+    got = fold(ci_ip_csum_copy_aligned(dst + doff, src + soff, n, sum));
+    if( got != want ) {
+      fprintf(stderr, "%s: csum_copy mismatch n=%d off=%d/%d: %x != %x\n",
+              ci_ip_csum_impl_name(impl), n, soff, doff, got, want);
+      ++errors;
+    }
+    if( memcmp(dst, ref, BUF_MAX + PAD) ) {
+      fprintf(stderr, "%s: csum_copy bad copy n=%d off=%d/%d\n",
+              ci_ip_csum_impl_name(impl), n, soff, doff);
+      ++errors;
+    }
+    if( errors >= 10 )
+      break;
+  }
+  return errors;
+}
+
+
+static double bench(int copy, ci_uint8* src, ci_uint8* dst, int n)
+{
+  ci_uint64 start, end, iters = 0, bytes;
+  volatile unsigned sink = 0;
+  int i;
+
+  start = now_ns();
+  do {
+    for( i = 0; i < 64; ++i ) {
+      if( copy )
+        sink += ci_ip_csum_copy_aligned(dst, src, n, 0);
+      else
+        sink += ci_ip_csum_aligned(src, n, 0);
+    }
+    iters += 64;
+    end = now_ns();
+  } while( end - start < (ci_uint64) cfg_bench_ms * 1000000 );
+  (void) sink;
+  bytes = iters * n;
+  return (double) bytes / (end - start);  /* bytes/ns == GB/s */
+}
+
+
+int main(int argc, char* argv[])
+{
+  static const int sizes[] = {
+    64, 128, 256, 512, 1024, 1472, 2048, 4096, 8192, 16384, 32768, 65536,
+  };
+  ci_uint8 *src, *dst, *ref;
+  int c, impl, errors = 0, n_impls = 0, impls[CI_IP_CSUM_IMPL_N];
+  unsigned s;
+
+  cfg_seed = (unsigned) time(NULL);
+  while( (c = getopt(argc, argv, "n:t:i:s:")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_fuzz_iter = atoi(optarg);
+      break;
+    case 't':
+      cfg_bench_ms = atoi(optarg);
+      break;
+    case 'i':
+      for( impl = 0; impl < CI_IP_CSUM_IMPL_N; ++impl )
+        if( ! strcmp(optarg, ci_ip_csum_impl_name(impl)) )
+          break;
+      if( impl == CI_IP_CSUM_IMPL_N )
+        usage();
+      cfg_impl = impl;
+      break;
+    case 's':
+      cfg_seed = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc )
+    usage();
+
+  src = malloc(BUF_MAX + PAD);
+  dst = malloc(BUF_MAX + PAD);
+  ref = malloc(BUF_MAX + PAD);
+  if( src == NULL || dst == NULL || ref == NULL ) {
+    fprintf(stderr, "csum_test: out of memory\n");
+    return 1;
+  }
+  srand(cfg_seed);
+  printf("# seed=%u default=%s\n", cfg_seed,
+         ci_ip_csum_impl_name(ci_ip_csum_select(CI_IP_CSUM_IMPL_AUTO)));
+
+  for( impl = 0; impl < CI_IP_CSUM_IMPL_N; ++impl ) {
+    if( cfg_impl >= 0 && impl != cfg_impl )
+      continue;
+    if( ci_ip_csum_select(impl) != impl ) {
+      printf("# %s: not supported\n", ci_ip_csum_impl_name(impl));
+      continue;
+    }
+    impls[n_impls++] = impl;
+    if( cfg_fuzz_iter ) {
+      int e = fuzz(impl, src, dst, ref);
+      printf("# %s: fuzz %s\n", ci_ip_csum_impl_name(impl),
+             e ? "FAILED" : "passed");
+      errors += e;
+    }
+  }
+
+  if( cfg_bench_ms ) {
+    for( c = 0; c < BUF_MAX + PAD; ++c )
+      src[c] = rand();
+    printf("#%-9s %7s", "op", "bytes");
+    for( impl = 0; impl < n_impls; ++impl )
+      printf(" %7s", ci_ip_csum_impl_name(impls[impl]));
+    printf("   (GB/s)\n");
+    for( c = 0; c < 2; ++c )
+      for( s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s ) {
+        printf("%-10s %7d", c ? "csum_copy" : "csum", sizes[s]);
+        for( impl = 0; impl < n_impls; ++impl ) {
+          ci_ip_csum_select(impls[impl]);
+          printf(" %7.2f", bench(c, src, dst, sizes[s]));
+        }
+        printf("\n");
+      }
+  }
+
+  free(src);
+  free(dst);
+  free(ref);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,263 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* hash_test
+ *
+ * Cross-checks ci_crc32c_partial() against the table-driven CRC32C, and
+ * the cached and batched Toeplitz hashes against ci_toeplitz_hash(), then
+ * measures the throughput of each.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <ci/tools.h>
+#include <ci/tools/crc32c.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+
+#define BUF_MAX   (64 * 1024)
+#define N_TUPLES  1024
+#define TUPLE_LEN 12
+
+
+static int      cfg_iter = 100000;
+static int      cfg_bench_ms = 200;
+static unsigned cfg_seed;
+
+
+/* The RSS verification key and IPv4 4-tuple test vectors from the
+ * Microsoft RSS specification.
+ */
+static const ci_uint8 rss_key[40] = {
+  0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+  0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+  0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+  0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+  0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+static const struct {
+  ci_uint8  tuple[TUPLE_LEN];  /* saddr, daddr, sport, dport */
+  ci_uint32 hash;
+} rss_vectors[] = {
+  { { 66, 9, 149, 187, 161, 142, 100, 80, 0x0a, 0xea, 0x06, 0xe6 },
+    0x51ccc178 },
+  { { 199, 92, 111, 2, 65, 69, 140, 83, 0x37, 0x96, 0x12, 0x83 },
+    0xc626b0ea },
+  { { 24, 19, 198, 95, 12, 22, 207, 184, 0x32, 0x62, 0x94, 0x88 },
+    0x5c2b394a },
+};
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  hash_test [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <iter>   - number of cross-check iterations\n");
+  fprintf(stderr, "  -t <ms>     - benchmark time per test (0 to skip)\n");
+  fprintf(stderr, "  -s <seed>   - random seed\n");
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+static ci_uint64 now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ci_uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static int check_crc32c(ci_uint8* src, ci_uint8* dst)
+{
+  int i, n, off, errors = 0;
+  ci_uint32 crc, want, got;
+
+  if( ci_crc32c((const ci_uint8*) "123456789", 9) != 0xe3069283 ) {
+    fprintf(stderr, "crc32c: check value mismatch\n");
+    ++errors;
+  }
+  for( i = 0; i < cfg_iter && errors < 10; ++i ) {
+    n = (i & 7) ? rand() % 2048 : rand() % BUF_MAX;
+    off = rand() % 64;
+    crc = (i & 1) ? (ci_uint32) rand() : 0xffffffff;
+    for( got = 0; got < (ci_uint32) n; ++got )
+      src[off + got] = rand();
+
+    want = ci_crc32c_partial_sw(src + off, n, crc);
+    got = ci_crc32c_partial(src + off, n, crc);
+    if( got != want ) {
+      fprintf(stderr, "crc32c: mismatch n=%d off=%d: %x != %x\n",
+              n, off, got, want);
+      ++errors;
+    }
+    got = ci_crc32c_partial_copy(dst, src + off, n, crc);
+    if( got != want || memcmp(dst, src + off, n) ) {
+      fprintf(stderr, "crc32c: copy mismatch n=%d off=%d\n", n, off);
+      ++errors;
+    }
+  }
+  return errors;
+}
+
+
+static int check_toeplitz(const ci_toeplitz_cache* cache, ci_uint8* tuples,
+                          ci_uint32* hashes)
+{
+  int i, j, n, errors = 0;
+  ci_uint32 want;
+
+  for( i = 0; i < sizeof(rss_vectors) / sizeof(rss_vectors[0]); ++i ) {
+    if( ci_toeplitz_hash(rss_key, rss_vectors[i].tuple, TUPLE_LEN) !=
+        rss_vectors[i].hash ||
+        ci_toeplitz_hash_cached(cache, rss_vectors[i].tuple, TUPLE_LEN) !=
+        rss_vectors[i].hash ) {
+      fprintf(stderr, "toeplitz: test vector %d mismatch\n", i);
+      ++errors;
+    }
+  }
+
+  for( i = 0; i < cfg_iter / N_TUPLES + 1 && errors < 10; ++i ) {
+    for( j = 0; j < N_TUPLES * TUPLE_LEN; ++j )
+      tuples[j] = rand();
+    n = rand() % (TUPLE_LEN + 1);
+    ci_toeplitz_hash_batch(cache, tuples, n, N_TUPLES - i % 4, hashes);
+    for( j = 0; j < N_TUPLES - i % 4; ++j ) {
+      want = ci_toeplitz_hash(rss_key, tuples + j * n, n);
+      if( ci_toeplitz_hash_cached(cache, tuples + j * n, n) != want ||
+          hashes[j] != want ) {
+        fprintf(stderr, "toeplitz: mismatch n=%d tuple=%d\n", n, j);
+        ++errors;
+        break;
+      }
+    }
+  }
+  return errors;
+}
+
+
+/* Time [stmt], which performs [n_ops] operations on [op_bytes] each. */
+#define BENCH(name, n_ops, op_bytes, stmt)                              \
+  do {                                                                  \
+    ci_uint64 start, end, iters = 0;                                    \
+    start = now_ns();                                                   \
+    do {                                                                \
+      int _i;                                                           \
+      for( _i = 0; _i < 16; ++_i ) {                                    \
+        stmt;                                                           \
+      }                                                                 \
+      iters += 16;                                                      \
+      end = now_ns();                                                   \
+    } while( end - start < (ci_uint64) cfg_bench_ms * 1000000 );        \
+    iters *= (n_ops);                                                   \
+    printf("%-24s %10.2f ns/op %8.2f GB/s\n", (name),                   \
+           (double) (end - start) / iters,                              \
+           (double) iters * (op_bytes) / (end - start));                \
+  } while( 0 )
+
+
+int main(int argc, char* argv[])
+{
+  static const int sizes[] = { 64, 1500, 4096, 65536 };
+  ci_toeplitz_cache* cache;
+  ci_uint8 *src, *dst, *tuples;
+  ci_uint32* hashes;
+  volatile ci_uint32 sink = 0;
+  int c, errors = 0;
+  unsigned s;
+  char name[32];
+
+  cfg_seed = (unsigned) time(NULL);
+  while( (c = getopt(argc, argv, "n:t:s:")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_iter = atoi(optarg);
+      break;
+    case 't':
+      cfg_bench_ms = atoi(optarg);
+      break;
+    case 's':
+      cfg_seed = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc )
+    usage();
+
+  src = malloc(BUF_MAX + 64);
+  dst = malloc(BUF_MAX + 64);
+  tuples = malloc(N_TUPLES * TUPLE_LEN);
+  hashes = malloc(N_TUPLES * sizeof(*hashes));
+  cache = malloc(sizeof(*cache));
+  if( ! src || ! dst || ! tuples || ! hashes || ! cache ) {
+    fprintf(stderr, "hash_test: out of memory\n");
+    return 1;
+  }
+  srand(cfg_seed);
+  printf("# seed=%u sse4.2=%s\n", cfg_seed,
+         (ci_cpu_features() & CI_CPU_FEAT_SSE42) ? "yes" : "no");
+
+  ci_toeplitz_cache_init(cache, rss_key);
+  c = check_crc32c(src, dst);
+  printf("# crc32c: cross-check %s\n", c ? "FAILED" : "passed");
+  errors += c;
+  c = check_toeplitz(cache, tuples, hashes);
+  printf("# toeplitz: cross-check %s\n", c ? "FAILED" : "passed");
+  errors += c;
+
+  if( cfg_bench_ms ) {
+    for( c = 0; c < BUF_MAX + 64; ++c )
+      src[c] = rand();
+    for( c = 0; c < N_TUPLES * TUPLE_LEN; ++c )
+      tuples[c] = rand();
+    for( s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s ) {
+      snprintf(name, sizeof(name), "crc32c_sw %d", sizes[s]);
+      BENCH(name, 1, sizes[s], sink += ci_crc32c_partial_sw(src, sizes[s], 0));
+      snprintf(name, sizeof(name), "crc32c %d", sizes[s]);
+      BENCH(name, 1, sizes[s], sink += ci_crc32c_partial(src, sizes[s], 0));
+      snprintf(name, sizeof(name), "crc32c_copy %d", sizes[s]);
+      BENCH(name, 1, sizes[s],
+            sink += ci_crc32c_partial_copy(dst, src, sizes[s], 0));
+    }
+    BENCH("toeplitz", 1, TUPLE_LEN,
+          sink += ci_toeplitz_hash(rss_key,
+                                   tuples + (_i & 63) * TUPLE_LEN,
+                                   TUPLE_LEN));
+    BENCH("toeplitz_cached", 1, TUPLE_LEN,
+          sink += ci_toeplitz_hash_cached(cache,
+                                          tuples + (_i & 63) * TUPLE_LEN,
+                                          TUPLE_LEN));
+    BENCH("toeplitz_batch", N_TUPLES / 16, TUPLE_LEN,
+          ci_toeplitz_hash_batch(cache,
+                                 tuples + _i * (N_TUPLES / 16) * TUPLE_LEN,
+                                 TUPLE_LEN, N_TUPLES / 16, hashes));
+  }
+  (void) sink;
+
+  free(src);
+  free(dst);
+  free(tuples);
+  free(hashes);
+  free(cache);
+  return errors ? 1 : 0;
+}
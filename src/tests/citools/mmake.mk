@@ -0,0 +1,13 @@
+TEST_APPS	:= csum_test hash_test
+
+TARGETS		:= $(TEST_APPS:%=$(AppPattern))
+
+
+MMAKE_LIBS	:= $(LINK_CITOOLS_LIB)
+MMAKE_LIB_DEPS	:= $(CITOOLS_LIB_DEPEND)
+
+
+all: $(TARGETS)
+
+clean:
+	@$(MakeClean)
@@ -45,7 +45,22 @@
 
 /* efforward
  *
- * Forward packets between two interfaces without modification.
+ * Forward packets between interfaces.
+ *
+ * Packets received on any of the RX interfaces are transmitted on one of
+ * the TX interfaces, chosen by hashing the IP addresses so that each flow
+ * stays in order.  When given one interface of each kind, packets are
+ * forwarded in both directions (unless -u is given).
+ *
+ * Buffers are shared by all VIs and are never copied: a received buffer
+ * is transmitted in place and returned to the pool when the transmit
+ * completes.  Transmits are pushed once per burst rather than per packet.
+ *
+ * With -m the VIs are backed by memory rather than an adapter: each RX VI
+ * receives a stream of generated UDP frames (from many source addresses,
+ * so that they spread over the TX VIs), and each TX VI completes its sends
+ * when they are pushed.  This measures the cost of the forwarding path
+ * itself.
  *
  * 2011 Solarflare Communications Inc.
  * Author: David Riddoch
@@ -55,6 +70,9 @@
 #include <etherfabric/vi.h>
 #include <etherfabric/pd.h>
 #include <etherfabric/memreg.h>
+#include <signal.h>
+#include <time.h>
+#include <inttypes.h>
 
 #include "utils.h"
 
@@ -66,21 +84,46 @@
  */
 #define PKT_BUF_SIZE         2048
 
+/* Room in front of each packet, so that a VLAN tag can be inserted. */
+#define VLAN_TAG_LEN         4
+
 /* Align address where data is delivered onto EF_VI_DMA_ALIGN boundary,
  * because that gives best performance.
  */
-#define RX_DMA_OFF           ROUND_UP(sizeof(struct pkt_buf), EF_VI_DMA_ALIGN)
+#define RX_DMA_OFF           ROUND_UP(sizeof(struct pkt_buf) + VLAN_TAG_LEN, \
+                                      EF_VI_DMA_ALIGN)
+
+#define MAX_VIS              8
+
+/* Queue sizes of the memory-backed VIs, matching the default hardware
+ * capacity of 511.
+ */
+#define MEM_Q_SIZE           512
+
+/* Frames generated for a memory-backed VI to receive. */
+#define MEM_FRAME_LEN        60
+#define MEM_N_FLOWS          256
+
+/* Log2 buckets, in nanoseconds. */
+#define LAT_HIST_BUCKETS     32
+
+#define ETH_HLEN             14
+#define ETHERTYPE_IP         0x0800
+#define ETHERTYPE_8021Q      0x8100
 
 
 struct pkt_buf {
   /* I/O address corresponding to the start of this pkt_buf struct.
-   * The pkt_buf is mapped into both VIs so there are two sets of rx
-   * and tx IO addresses. */
-  ef_addr            rx_ef_addr[2];
-  ef_addr            tx_ef_addr[2];
+   * The pkt_buf is mapped into every VI so there is one set of rx and
+   * tx IO addresses per VI. */
+  ef_addr            rx_ef_addr[MAX_VIS];
+  ef_addr            tx_ef_addr[MAX_VIS];
 
   /* pointer to where received packets start */
-  void*              rx_ptr[2];
+  void*              rx_ptr[MAX_VIS];
+
+  /* time at which the receive was handled, for latency stats */
+  uint64_t           rx_ns;
 
   /* id to help look up the buffer when polling the EVQ */
   int                id;
@@ -103,7 +146,32 @@ struct pkt_bufs {
 };
 
 
+struct vi_stats {
+  uint64_t           rx_pkts;
+  uint64_t           rx_bytes;
+  uint64_t           rx_discards;
+  uint64_t           tx_pkts;
+  uint64_t           tx_bytes;
+  /* dropped because TXQ was full */
+  uint64_t           tx_drops;
+  /* dropped because TTL expired */
+  uint64_t           ttl_drops;
+};
+
+
+/* A queue of a memory-backed VI, holding buffer ids. */
+struct mem_q {
+  int                ids[MEM_Q_SIZE];
+  int                lens[MEM_Q_SIZE];
+  unsigned           added;
+  unsigned           removed;
+};
+
+
 struct vi {
+  /* name of the interface */
+  const char*        intf;
+
   /* handle for accessing the driver */
   ef_driver_handle   dh;
 
@@ -116,13 +184,46 @@ struct vi {
   /* registered memory for DMA */
   ef_memreg          memreg;
 
+  /* whether we receive on this VI, and where we forward to */
+  int                is_rx;
+  int                tx_vis[MAX_VIS];
+  int                n_tx_vis;
+
+  /* sends initialised but not yet pushed */
+  int                tx_pending;
+
+  /* for memory-backed VIs: posted receives, and sends not yet completed,
+   * of which those before [mem_tx_pushed] have been pushed */
+  struct mem_q       mem_rxq;
+  struct mem_q       mem_txq;
+  unsigned           mem_tx_pushed;
+
   /* statistics */
-  uint64_t           n_pkts;
+  struct vi_stats    stats;
 };
 
 
-static struct vi vis[2];
+static struct vi vis[MAX_VIS];
+static int n_vis;
 static struct pkt_bufs pbs;
+static uint64_t lat_hist[LAT_HIST_BUCKETS];
+static volatile int stop;
+
+static int cfg_unidirectional;
+static int cfg_tx_batch = 32;
+static int cfg_set_dmac, cfg_set_smac;
+static uint8_t cfg_dmac[6], cfg_smac[6];
+static int cfg_vlan_id = -1;
+static int cfg_dec_ttl;
+static int cfg_mem;
+
+
+static inline uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
 
 /* Given a id to a packet buffer, look up the data structure.  The ids
@@ -134,17 +235,69 @@ static inline struct pkt_buf* pkt_buf_from_id(int pkt_buf_i)
 }
 
 
+/* The ef_vi calls we make, or their equivalents on a memory-backed VI.
+ * Buffer addresses are not used by a memory-backed VI.
+ */
+
+static inline int vi_receive_space(int vi_i)
+{
+  struct mem_q* q = &vis[vi_i].mem_rxq;
+  if( cfg_mem )
+    return MEM_Q_SIZE - 1 - (int) (q->added - q->removed);
+  return ef_vi_receive_space(&vis[vi_i].vi);
+}
+
+
+static inline void vi_receive_init(int vi_i, ef_addr addr, int id)
+{
+  struct mem_q* q = &vis[vi_i].mem_rxq;
+  if( cfg_mem )
+    q->ids[q->added++ % MEM_Q_SIZE] = id;
+  else
+    ef_vi_receive_init(&vis[vi_i].vi, addr, id);
+}
+
+
+static inline void vi_receive_push(int vi_i)
+{
+  if( ! cfg_mem )
+    ef_vi_receive_push(&vis[vi_i].vi);
+}
+
+
+static inline int vi_transmit_init(int vi_i, ef_addr addr, int len, int id)
+{
+  struct mem_q* q = &vis[vi_i].mem_txq;
+  if( ! cfg_mem )
+    return ef_vi_transmit_init(&vis[vi_i].vi, addr, len, id);
+  if( q->added - q->removed == MEM_Q_SIZE - 1 )
+    return -EAGAIN;
+  q->ids[q->added % MEM_Q_SIZE] = id;
+  q->lens[q->added % MEM_Q_SIZE] = len;
+  ++q->added;
+  return 0;
+}
+
+
+static inline void vi_transmit_push(int vi_i)
+{
+  if( cfg_mem )
+    vis[vi_i].mem_tx_pushed = vis[vi_i].mem_txq.added;
+  else
+    ef_vi_transmit_push(&vis[vi_i].vi);
+}
+
+
 /* Try to refill the RXQ on the given VI with at most
  * REFILL_BATCH_SIZE packets if it has enough space and we have
  * enough free buffers. */
 static void vi_refill_rx_ring(int vi_i)
 {
-  ef_vi* vi = &vis[vi_i].vi;
 #define REFILL_BATCH_SIZE  16
   struct pkt_buf* pkt_buf;
   int i;
 
-  if( ef_vi_receive_space(vi) < REFILL_BATCH_SIZE ||
+  if( vi_receive_space(vi_i) < REFILL_BATCH_SIZE ||
       pbs.free_pool_n < REFILL_BATCH_SIZE )
     return;
 
@@ -152,9 +305,9 @@ static void vi_refill_rx_ring(int vi_i)
     pkt_buf = pbs.free_pool;
     pbs.free_pool = pbs.free_pool->next;
     --pbs.free_pool_n;
-    ef_vi_receive_init(vi, pkt_buf->rx_ef_addr[vi_i], pkt_buf->id);
+    vi_receive_init(vi_i, pkt_buf->rx_ef_addr[vi_i], pkt_buf->id);
   }
-  ef_vi_receive_push(vi);
+  vi_receive_push(vi_i);
 }
 
 
@@ -167,80 +320,286 @@ static inline void pkt_buf_free(struct pkt_buf* pkt_buf)
 }
 
 
-/* Handle an RX event on a VI.  We forward the packet on the other VI. */
-static void handle_rx(int rx_vi_i, int pkt_buf_i, int len)
+/* Choose which of [rx_vi]'s TX VIs to send on.  Hashing on the IP
+ * addresses keeps each flow in order.
+ */
+static inline int choose_tx_vi(const struct vi* rx_vi, const uint8_t* eth)
+{
+  const uint8_t* ip;
+  uint32_t h;
+
+  if( rx_vi->n_tx_vis == 1 )
+    return rx_vi->tx_vis[0];
+  ip = eth + ETH_HLEN;
+  if( ((eth[12] << 8) | eth[13]) == ETHERTYPE_8021Q )
+    ip += VLAN_TAG_LEN;
+  h = ((uint32_t) ip[12] << 24 | ip[13] << 16 | ip[14] << 8 | ip[15]) ^
+      ((uint32_t) ip[16] << 24 | ip[17] << 16 | ip[18] << 8 | ip[19]);
+  h ^= h >> 16;
+  h ^= h >> 8;
+  return rx_vi->tx_vis[h % rx_vi->n_tx_vis];
+}
+
+
+/* Incrementally update a 16-bit ones-complement checksum when the 16-bit
+ * word [old] changes to [new] (RFC 1624, eqn. 3).
+ */
+static inline uint16_t csum_update16(uint16_t csum, uint16_t old,
+                                     uint16_t new)
+{
+  uint32_t sum = (uint16_t) ~csum + (uint16_t) ~old + new;
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return ~sum;
+}
+
+
+/* Apply the configured header rewrites to the frame at [*eth_p] of
+ * length [*len_p].  Returns false if the packet should be dropped.  May
+ * move the start of the frame back by VLAN_TAG_LEN.
+ */
+static bool rewrite_headers(uint8_t** eth_p, int* len_p, struct vi* rx_vi)
+{
+  uint8_t* eth = *eth_p;
+  uint8_t* ip;
+
+  if( cfg_vlan_id >= 0 ) {
+    if( ((eth[12] << 8) | eth[13]) != ETHERTYPE_8021Q ) {
+      memmove(eth - VLAN_TAG_LEN, eth, 12);
+      eth -= VLAN_TAG_LEN;
+      *len_p += VLAN_TAG_LEN;
+      eth[12] = ETHERTYPE_8021Q >> 8;
+      eth[13] = ETHERTYPE_8021Q & 0xff;
+      eth[14] = 0;
+    }
+    eth[14] = (eth[14] & 0xf0) | ((cfg_vlan_id >> 8) & 0xf);
+    eth[15] = cfg_vlan_id & 0xff;
+    *eth_p = eth;
+  }
+  if( cfg_set_dmac )
+    memcpy(eth, cfg_dmac, 6);
+  if( cfg_set_smac )
+    memcpy(eth + 6, cfg_smac, 6);
+
+  if( cfg_dec_ttl ) {
+    ip = eth + 12;
+    if( ((ip[0] << 8) | ip[1]) == ETHERTYPE_8021Q )
+      ip += VLAN_TAG_LEN;
+    if( ((ip[0] << 8) | ip[1]) == ETHERTYPE_IP ) {
+      uint16_t old, new, csum;
+      ip += 2;
+      if( ip[8] <= 1 ) {
+        ++rx_vi->stats.ttl_drops;
+        return false;
+      }
+      /* TTL shares a 16-bit word with the protocol. */
+      old = (ip[8] << 8) | ip[9];
+      --ip[8];
+      new = (ip[8] << 8) | ip[9];
+      csum = (ip[10] << 8) | ip[11];
+      csum = csum_update16(csum, old, new);
+      ip[10] = csum >> 8;
+      ip[11] = csum & 0xff;
+    }
+  }
+  return true;
+}
+
+
+static void push_tx(int vi_i)
 {
-  int rc;
-  int tx_vi_i = 2 - 1 - rx_vi_i;
+  struct vi* vi = &vis[vi_i];
+  if( vi->tx_pending ) {
+    vi_transmit_push(vi_i);
+    vi->tx_pending = 0;
+  }
+}
+
+
+/* Handle an RX event on a VI.  We forward the packet on one of its TX
+ * VIs.  The send is pushed with the rest of the burst. */
+static void handle_rx(int rx_vi_i, int pkt_buf_i, int len, uint64_t now)
+{
+  int rc, tx_vi_i;
   struct vi* rx_vi = &vis[rx_vi_i];
-  struct vi* tx_vi = &vis[tx_vi_i];
+  struct vi* tx_vi;
   struct pkt_buf* pkt_buf = pkt_buf_from_id(pkt_buf_i);
+  uint8_t* eth = pkt_buf->rx_ptr[rx_vi_i];
+  ef_addr dma_addr;
+
+  ++rx_vi->stats.rx_pkts;
+  rx_vi->stats.rx_bytes += len;
+  pkt_buf->rx_ns = now;
+
+  tx_vi_i = choose_tx_vi(rx_vi, eth);
+  tx_vi = &vis[tx_vi_i];
+  if( ! rewrite_headers(&eth, &len, rx_vi) ) {
+    pkt_buf_free(pkt_buf);
+    return;
+  }
 
-  ++rx_vi->n_pkts;
-  rc = ef_vi_transmit(&tx_vi->vi, pkt_buf->tx_ef_addr[tx_vi_i], len,
-                          pkt_buf->id);
+  /* The buffer may have been received with a different prefix length
+   * from the one the TX VI's address assumes, and the rewrite may have
+   * moved the start of the frame.
+   */
+  dma_addr = pkt_buf->tx_ef_addr[tx_vi_i] +
+             (eth - (uint8_t*) pkt_buf->rx_ptr[tx_vi_i]);
+  rc = vi_transmit_init(tx_vi_i, dma_addr, len, pkt_buf->id);
   if( rc != 0 ) {
     assert(rc == -EAGAIN);
     /* TXQ is full.  A real app might consider implementing an overflow
      * queue in software.  We simply choose not to send.
      */
+    ++tx_vi->stats.tx_drops;
     pkt_buf_free(pkt_buf);
+    return;
   }
+  ++tx_vi->stats.tx_pkts;
+  tx_vi->stats.tx_bytes += len;
+  if( ++tx_vi->tx_pending >= cfg_tx_batch )
+    push_tx(tx_vi_i);
 }
 
 
-static void handle_rx_discard(int pkt_buf_i, int discard_type)
+static void handle_rx_discard(int vi_i, int pkt_buf_i, int discard_type)
 {
   struct pkt_buf* pkt_buf = pkt_buf_from_id(pkt_buf_i);
+  ++vis[vi_i].stats.rx_discards;
   pkt_buf_free(pkt_buf);
 }
 
 
-static void complete_tx(int vi_i, int pkt_buf_i)
+static void complete_tx(int vi_i, int pkt_buf_i, uint64_t now)
 {
   struct pkt_buf* pkt_buf = pkt_buf_from_id(pkt_buf_i);
+  uint64_t lat = now - pkt_buf->rx_ns;
+  int b = 0;
+  while( lat > 1 && b < LAT_HIST_BUCKETS - 1 ) {
+    lat >>= 1;
+    ++b;
+  }
+  ++lat_hist[b];
   pkt_buf_free(pkt_buf);
 }
 
 
-/* The main loop.  Poll each VI handling various types of events and
- * then try to refill them. */
-static void main_loop(void)
+/* Write the [n]th generated frame into [eth]: UDP from one of
+ * MEM_N_FLOWS sources to a single destination.
+ */
+static void mem_make_frame(uint8_t* eth, unsigned n)
 {
-  int i, j, k;
+  static const uint8_t template[MEM_FRAME_LEN] = {
+    0x00, 0x0f, 0x53, 0x00, 0x00, 0x02,  0x00, 0x0f, 0x53, 0x00, 0x00, 0x01,
+    0x08, 0x00,
+    0x45, 0x00, 0x00, 0x2e, 0x00, 0x00, 0x40, 0x00, 0x40, 0x11, 0x00, 0x00,
+    0x0a, 0x00, 0x00, 0x00,  0x0a, 0x00, 0x01, 0x01,
+    0x30, 0x39, 0x30, 0x39, 0x00, 0x1a, 0x00, 0x00,
+  };
+  uint8_t* ip = eth + ETH_HLEN;
+  uint32_t sum = 0;
+  int i;
 
-  while( 1 ) {
-    for( i = 0; i < 2; ++i ) {
-      ef_vi* vi = &vis[i].vi;
-      ef_event evs[EF_VI_EVENT_POLL_MIN_EVS];
-      int n_ev = ef_eventq_poll(vi, evs, sizeof(evs) / sizeof(evs[0]));
-      for( j = 0; j < n_ev; ++j ) {
-        switch( EF_EVENT_TYPE(evs[j]) ) {
-        case EF_EVENT_TYPE_RX:
-          /* This code does not handle jumbos. */
-          assert(EF_EVENT_RX_SOP(evs[j]) != 0);
-          assert(EF_EVENT_RX_CONT(evs[j]) == 0);
-          handle_rx(i, EF_EVENT_RX_RQ_ID(evs[j]),
-                    EF_EVENT_RX_BYTES(evs[j]) -
-                    ef_vi_receive_prefix_len(vi));
-          break;
-        case EF_EVENT_TYPE_TX: {
-          ef_request_id ids[EF_VI_TRANSMIT_BATCH];
-          int ntx = ef_vi_transmit_unbundle(vi, &evs[j], ids);
-          for( k = 0; k < ntx; ++k )
-            complete_tx(i, ids[k]);
-          break;
-        }
-        case EF_EVENT_TYPE_RX_DISCARD:
-          handle_rx_discard(EF_EVENT_RX_DISCARD_RQ_ID(evs[j]),
-                            EF_EVENT_RX_DISCARD_TYPE(evs[j]));
-          break;
-        default:
-          LOGE("ERROR: unexpected event %d\n", (int) EF_EVENT_TYPE(evs[j]));
-          break;
-        }
-      }
-      vi_refill_rx_ring(i);
+  memcpy(eth, template, MEM_FRAME_LEN);
+  ip[14] = (n % MEM_N_FLOWS) >> 8;
+  ip[15] = n % MEM_N_FLOWS;
+  for( i = 0; i < 20; i += 2 )
+    sum += (ip[i] << 8) | ip[i + 1];
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  ip[10] = ~sum >> 8;
+  ip[11] = ~sum & 0xff;
+}
+
+
+/* Poll a memory-backed VI: complete up to [max] of the sends that have
+ * been pushed, and receive a generated frame into up to [max] of the
+ * posted buffers.  Returns the number of events.
+ */
+static int mem_poll(int vi_i, int max, uint64_t now)
+{
+  static unsigned n_frames;
+  struct vi* vi = &vis[vi_i];
+  struct mem_q* q;
+  int n_tx = 0, n_rx = 0, id;
+
+  q = &vi->mem_txq;
+  while( q->removed != vi->mem_tx_pushed && n_tx < max ) {
+    complete_tx(vi_i, q->ids[q->removed++ % MEM_Q_SIZE], now);
+    ++n_tx;
+  }
+  if( ! vi->is_rx )
+    return n_tx;
+  q = &vi->mem_rxq;
+  while( q->removed != q->added && n_rx < max ) {
+    id = q->ids[q->removed++ % MEM_Q_SIZE];
+    mem_make_frame(pkt_buf_from_id(id)->rx_ptr[vi_i], n_frames++);
+    handle_rx(vi_i, id, MEM_FRAME_LEN, now);
+    ++n_rx;
+  }
+  return n_tx + n_rx;
+}
+
+
+/* Poll a VI's event queue and handle the events.  Returns the number of
+ * events. */
+static int poll_vi(int vi_i)
+{
+  ef_vi* vi = &vis[vi_i].vi;
+  ef_event evs[EF_VI_EVENT_POLL_MIN_EVS];
+  uint64_t now;
+  int j, k, n_ev;
+
+  n_ev = ef_eventq_poll(vi, evs, sizeof(evs) / sizeof(evs[0]));
+  if( n_ev == 0 )
+    return 0;
+  now = now_ns();
+  for( j = 0; j < n_ev; ++j ) {
+    switch( EF_EVENT_TYPE(evs[j]) ) {
+    case EF_EVENT_TYPE_RX:
+      /* This code does not handle jumbos. */
+      assert(EF_EVENT_RX_SOP(evs[j]) != 0);
+      assert(EF_EVENT_RX_CONT(evs[j]) == 0);
+      handle_rx(vi_i, EF_EVENT_RX_RQ_ID(evs[j]),
+                EF_EVENT_RX_BYTES(evs[j]) - ef_vi_receive_prefix_len(vi), now);
+      break;
+    case EF_EVENT_TYPE_TX: {
+      ef_request_id ids[EF_VI_TRANSMIT_BATCH];
+      int ntx = ef_vi_transmit_unbundle(vi, &evs[j], ids);
+      for( k = 0; k < ntx; ++k )
+        complete_tx(vi_i, ids[k], now);
+      break;
+    }
+    case EF_EVENT_TYPE_RX_DISCARD:
+      handle_rx_discard(vi_i, EF_EVENT_RX_DISCARD_RQ_ID(evs[j]),
+                        EF_EVENT_RX_DISCARD_TYPE(evs[j]));
+      break;
+    default:
+      LOGE("ERROR: unexpected event %d\n", (int) EF_EVENT_TYPE(evs[j]));
+      break;
+    }
+  }
+  return n_ev;
+}
+
+
+/* The main loop.  Poll each VI handling various types of events, push
+ * any sends they generated and then try to refill them. */
+static void main_loop(void)
+{
+  int i, j, n_ev;
+
+  while( ! stop ) {
+    for( i = 0; i < n_vis; ++i ) {
+      if( cfg_mem )
+        n_ev = mem_poll(i, EF_VI_EVENT_POLL_MIN_EVS, now_ns());
+      else
+        n_ev = poll_vi(i);
+      if( n_ev == 0 )
+        continue;
+      for( j = 0; j < vis[i].n_tx_vis; ++j )
+        push_tx(vis[i].tx_vis[j]);
+      if( vis[i].is_rx )
+        vi_refill_rx_ring(i);
     }
   }
 }
@@ -250,44 +609,92 @@ static void main_loop(void)
 static void* monitor_fn(void* dummy)
 {
   struct timeval start, end;
-  int prev_pkts[2], now_pkts[2];
-  int pkt_rates[2];
+  uint64_t prev_rx[MAX_VIS], prev_tx[MAX_VIS];
+  uint64_t now_rx[MAX_VIS], now_tx[MAX_VIS];
   int ms, i;
 
-  for( i = 0; i < 2; ++i )
-    prev_pkts[i] = vis[i].n_pkts;
+  for( i = 0; i < n_vis; ++i ) {
+    prev_rx[i] = vis[i].stats.rx_pkts;
+    prev_tx[i] = vis[i].stats.tx_pkts;
+  }
   gettimeofday(&start, NULL);
 
-  printf("vi0-rx\tvi1-rx\n");
+  for( i = 0; i < n_vis; ++i )
+    printf("%svi%d-rx\tvi%d-tx", i ? "\t" : "", i, i);
+  printf("\n");
   while( 1 ) {
     sleep(1);
-    for( i = 0; i < 2; ++i )
-      now_pkts[i] = vis[i].n_pkts;
+    for( i = 0; i < n_vis; ++i ) {
+      now_rx[i] = vis[i].stats.rx_pkts;
+      now_tx[i] = vis[i].stats.tx_pkts;
+    }
     gettimeofday(&end, NULL);
     ms = (end.tv_sec - start.tv_sec) * 1000;
     ms += (end.tv_usec - start.tv_usec) / 1000;
 
-    for( i = 0; i < 2; ++i )
-      pkt_rates[i] = (int64_t)(now_pkts[i] - prev_pkts[i]) * 1000 / ms;
-    printf("%d\t%d\n", pkt_rates[0], pkt_rates[1]);
+    for( i = 0; i < n_vis; ++i )
+      printf("%s%d\t%d", i ? "\t" : "",
+             (int) ((now_rx[i] - prev_rx[i]) * 1000 / ms),
+             (int) ((now_tx[i] - prev_tx[i]) * 1000 / ms));
+    printf("\n");
     fflush(stdout);
-    for( i = 0; i < 2; ++i )
-      prev_pkts[i] = now_pkts[i];
+    for( i = 0; i < n_vis; ++i ) {
+      prev_rx[i] = now_rx[i];
+      prev_tx[i] = now_tx[i];
+    }
     start = end;
   }
   return NULL;
 }
 
 
+static void print_summary(void)
+{
+  uint64_t total = 0, cum = 0;
+  int i, lo, hi;
+
+  printf("\n#vi\tintf\trx_pkts\trx_bytes\trx_discards\ttx_pkts\ttx_bytes"
+         "\ttx_drops\tttl_drops\n");
+  for( i = 0; i < n_vis; ++i ) {
+    const struct vi_stats* s = &vis[i].stats;
+    printf("%d\t%s\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64
+           "\t%"PRIu64"\t%"PRIu64"\n", i, vis[i].intf, s->rx_pkts,
+           s->rx_bytes, s->rx_discards, s->tx_pkts, s->tx_bytes,
+           s->tx_drops, s->ttl_drops);
+  }
+
+  /* Time from handling the receive to seeing the transmit complete. */
+  for( i = 0; i < LAT_HIST_BUCKETS; ++i )
+    total += lat_hist[i];
+  if( total == 0 )
+    return;
+  for( lo = 0; lat_hist[lo] == 0; ++lo )
+    ;
+  for( hi = LAT_HIST_BUCKETS - 1; lat_hist[hi] == 0; --hi )
+    ;
+  printf("\n#latency_ns\tcount\tcumulative%%\n");
+  for( i = lo; i <= hi; ++i ) {
+    cum += lat_hist[i];
+    printf("<%"PRIu64"\t%"PRIu64"\t%.2f\n", (uint64_t) 2 << i, lat_hist[i],
+           100.0 * cum / total);
+  }
+}
+
+
+static void handle_signal(int sig)
+{
+  stop = 1;
+}
+
+
 /* Allocate and initialize the packet buffers. */
 static int init_pkts_memory(void)
 {
   int i;
 
   /* Number of buffers is the worst case to fill up all the queues
-   * assuming that you are going to allocate 2 VIs, both have a RXQ
-   * and TXQ and both have default capacity of 512. */
-  pbs.num = 4 * 512;
+   * assuming that each VI has a RXQ and TXQ of default capacity 512. */
+  pbs.num = n_vis * 2 * 512;
   pbs.mem_size = pbs.num * PKT_BUF_SIZE;
   pbs.mem_size = ROUND_UP(pbs.mem_size, huge_page_size);
   /* Allocate huge-page-aligned memory to give best chance of allocating
@@ -304,13 +711,32 @@ static int init_pkts_memory(void)
 }
 
 
+/* Initialize a memory-backed VI.  The buffers' addresses are their
+ * offsets, which are not used.
+ */
+static int init_mem(int vi_i)
+{
+  int i;
+  for( i = 0; i < pbs.num; ++i ) {
+    struct pkt_buf* pkt_buf = pkt_buf_from_id(i);
+    pkt_buf->rx_ef_addr[vi_i] = (ef_addr) i * PKT_BUF_SIZE + RX_DMA_OFF;
+    pkt_buf->tx_ef_addr[vi_i] = pkt_buf->rx_ef_addr[vi_i];
+    pkt_buf->rx_ptr[vi_i] = (char*) pkt_buf + RX_DMA_OFF;
+  }
+  if( vis[vi_i].is_rx )
+    while( vi_receive_space(vi_i) > REFILL_BATCH_SIZE )
+      vi_refill_rx_ring(vi_i);
+  return 0;
+}
+
+
 /* Allocate and initialize a VI. */
-static int init(const char* intf, int vi_i)
+static int init(int vi_i)
 {
   struct vi* vi = &vis[vi_i];
   int i;
   TRY(ef_driver_open(&vi->dh));
-  TRY(ef_pd_alloc_by_name(&vi->pd, vi->dh, intf, EF_PD_DEFAULT));
+  TRY(ef_pd_alloc_by_name(&vi->pd, vi->dh, vi->intf, EF_PD_DEFAULT));
   TRY(ef_vi_alloc_from_pd(&vi->vi, vi->dh, &vi->pd, vi->dh, -1, -1, -1, NULL,
                           -1, EF_VI_FLAGS_DEFAULT));
 
@@ -333,6 +759,9 @@ static int init(const char* intf, int vi_i)
   assert(ef_vi_receive_capacity(&vi->vi) == 511);
   assert(ef_vi_transmit_capacity(&vi->vi) == 511);
 
+  if( ! vi->is_rx )
+    return 0;
+
   while( ef_vi_receive_space(&vi->vi) > REFILL_BATCH_SIZE )
     vi_refill_rx_ring(vi_i);
 
@@ -350,23 +779,134 @@ static int init(const char* intf, int vi_i)
 static void usage(void)
 {
   fprintf(stderr, "usage:\n");
-  fprintf(stderr, "  efforward <intf0> <intf1>\n");
+  fprintf(stderr, "  efforward [options] <rx-intf>[,<rx-intf>...] "
+          "<tx-intf>[,<tx-intf>...]\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "  -u          With one interface of each kind, only "
+          "forward from rx to tx\n");
+  fprintf(stderr, "  -b <n>      Push sends in bursts of at most n "
+          "(default 32)\n");
+  fprintf(stderr, "  -d <mac>    Rewrite destination MAC\n");
+  fprintf(stderr, "  -s <mac>    Rewrite source MAC\n");
+  fprintf(stderr, "  -V <vlan>   Set VLAN ID, adding a tag if needed\n");
+  fprintf(stderr, "  -t          Decrement IP TTL (drop if it expires)\n");
+  fprintf(stderr, "  -m          Use memory-backed VIs, named by the "
+          "interfaces\n");
   exit(1);
 }
 
 
+static void parse_mac(const char* s, uint8_t* mac)
+{
+  if( sscanf(s, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &mac[0], &mac[1], &mac[2],
+             &mac[3], &mac[4], &mac[5]) != 6 ) {
+    fprintf(stderr, "ERROR: bad MAC address '%s'\n", s);
+    usage();
+  }
+}
+
+
+/* Find or add the VI for [intf]. */
+static int add_vi(const char* intf)
+{
+  int i;
+  for( i = 0; i < n_vis; ++i )
+    if( ! strcmp(vis[i].intf, intf) )
+      return i;
+  if( n_vis == MAX_VIS ) {
+    fprintf(stderr, "ERROR: at most %d interfaces supported\n", MAX_VIS);
+    exit(1);
+  }
+  vis[n_vis].intf = intf;
+  return n_vis++;
+}
+
+
+/* Split comma-separated [list] into VIs, returning their indices. */
+static int parse_intfs(char* list, int* vi_is)
+{
+  char* intf;
+  int n = 0;
+  for( intf = strtok(list, ","); intf != NULL; intf = strtok(NULL, ",") ) {
+    if( n == MAX_VIS ) {
+      fprintf(stderr, "ERROR: at most %d interfaces in a list\n", MAX_VIS);
+      usage();
+    }
+    vi_is[n++] = add_vi(intf);
+  }
+  return n;
+}
+
+
 int main(int argc, char* argv[])
 {
   pthread_t thread_id;
-  if( argc != 3 )
+  int rx_vis[MAX_VIS], tx_vis[MAX_VIS];
+  int n_rx, n_tx, i, j, c;
+
+  while( (c = getopt(argc, argv, "ub:d:s:V:tm")) != -1 )
+    switch( c ) {
+    case 'u':
+      cfg_unidirectional = 1;
+      break;
+    case 'b':
+      cfg_tx_batch = atoi(optarg);
+      break;
+    case 'd':
+      parse_mac(optarg, cfg_dmac);
+      cfg_set_dmac = 1;
+      break;
+    case 's':
+      parse_mac(optarg, cfg_smac);
+      cfg_set_smac = 1;
+      break;
+    case 'V':
+      cfg_vlan_id = atoi(optarg);
+      if( cfg_vlan_id < 0 || cfg_vlan_id > 4095 )
+        usage();
+      break;
+    case 't':
+      cfg_dec_ttl = 1;
+      break;
+    case 'm':
+      cfg_mem = 1;
+      break;
+    case '?':
+      usage();
+    default:
+      TEST(0);
+    }
+
+  argc -= optind;
+  argv += optind;
+  if( argc != 2 || cfg_tx_batch < 1 )
     usage();
 
+  n_rx = parse_intfs(argv[0], rx_vis);
+  n_tx = parse_intfs(argv[1], tx_vis);
+  for( i = 0; i < n_rx; ++i ) {
+    struct vi* vi = &vis[rx_vis[i]];
+    vi->is_rx = 1;
+    for( j = 0; j < n_tx; ++j )
+      vi->tx_vis[vi->n_tx_vis++] = tx_vis[j];
+  }
+  if( n_rx == 1 && n_tx == 1 && rx_vis[0] != tx_vis[0] &&
+      ! cfg_unidirectional ) {
+    vis[tx_vis[0]].is_rx = 1;
+    vis[tx_vis[0]].tx_vis[0] = rx_vis[0];
+    vis[tx_vis[0]].n_tx_vis = 1;
+  }
+
   TRY(init_pkts_memory());
-  TRY(init(argv[1], 0));
-  TRY(init(argv[2], 1));
+  for( i = 0; i < n_vis; ++i )
+    TRY(cfg_mem ? init_mem(i) : init(i));
 
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
   TEST(pthread_create(&thread_id, NULL, monitor_fn, NULL) == 0);
   main_loop();
+  print_summary();
 
   return 0;
 }
@@ -60,22 +60,13 @@
 #include "utils.h"
 
 
-struct buf {
-  ef_addr     ef_addr;
-  struct buf* next;
-};
-
-
 struct thread {
   ef_driver_handle         dh;
   struct ef_pd             pd;
   struct ef_vi             vi;
   struct ef_memreg         memreg;
-  int                      psp_start_offset;
-  struct buf*              current_buf;
-  struct buf*              posted_bufs;
-  struct buf**             posted_bufs_tail;
-  ef_packed_stream_packet* ps_pkt_iter;
+  ef_packed_stream_demux   demux;
+  ef_packed_stream_iter    ps_iter;
   uint64_t                 n_rx_pkts;
   uint64_t                 n_rx_bytes;
 };
@@ -84,6 +75,7 @@ struct thread {
 static int cfg_hexdump;
 static int cfg_timestamping;
 static int cfg_verbose;
+static int cfg_credit_batch;
 
 
 static void hexdump(const void* pv, int len)
@@ -113,28 +105,8 @@ static void hexdump(const void* pv, int len)
 }
 
 
-static inline void posted_buf_put(struct thread* t, struct buf* buf)
-{
-  buf->next = NULL;
-  *(t->posted_bufs_tail) = buf;
-  t->posted_bufs_tail = &buf->next;
-}
-
-
-static inline struct buf* posted_buf_get(struct thread* t)
-{
-  struct buf* buf = t->posted_bufs;
-  if( buf != NULL ) {
-    t->posted_bufs = buf->next;
-    if( t->posted_bufs == NULL )
-      t->posted_bufs_tail = &(t->posted_bufs);
-  }
-  return buf;
-}
-
-
-static inline void consume_packet(struct thread* t,
-                                  ef_packed_stream_packet* ps_pkt)
+static void consume_packet(void* arg, int flow_id,
+                           ef_packed_stream_packet* ps_pkt)
 {
   /* Do something useful with the received packet! */
 
@@ -155,32 +127,14 @@ static inline void consume_packet(struct thread* t,
 
 static inline void handle_rx_ps(struct thread* t, const ef_event* pev)
 {
-  int n_pkts, n_bytes, rc;
+  int n_pkts;
 
-  if( EF_EVENT_RX_PS_NEXT_BUFFER(*pev) ) {
-    if( t->current_buf != NULL ) {
-      TRY(ef_vi_receive_post(&t->vi, t->current_buf->ef_addr, 0));
-      posted_buf_put(t, t->current_buf);
-    }
-    t->current_buf = posted_buf_get(t);
-    t->ps_pkt_iter = ef_packed_stream_packet_first(t->current_buf,
-                                                   t->psp_start_offset);
-  }
-
-  ef_packed_stream_packet* ps_pkt = t->ps_pkt_iter;
-  rc = ef_vi_packed_stream_unbundle(&t->vi, pev, &t->ps_pkt_iter,
-                                    &n_pkts, &n_bytes);
-  t->n_rx_pkts += n_pkts;
-  t->n_rx_bytes += n_bytes;
+  TRY(n_pkts = ef_packed_stream_iter_event(&t->ps_iter, pev));
+  t->n_rx_pkts = t->ps_iter.psi_n_pkts;
+  t->n_rx_bytes = t->ps_iter.psi_n_bytes;
 
   if( cfg_verbose )
-    printf("EVT: rc=%d n_pkts=%d n_bytes=%d\n", rc, n_pkts, n_bytes);
-
-  int i;
-  for( i = 0; i < n_pkts; ++i ) {
-    consume_packet(t, ps_pkt);
-    ps_pkt = ef_packed_stream_packet_next(ps_pkt);
-  }
+    printf("EVT: n_pkts=%d\n", n_pkts);
 }
 
 
@@ -268,6 +222,7 @@ static void usage(void)
   fprintf(stderr, "options:\n");
   fprintf(stderr, "  -d     hexdump received packet\n");
   fprintf(stderr, "  -t     Request hardware timestamping of packets\n");
+  fprintf(stderr, "  -b <n> Return packed-stream credits in batches of n\n");
   exit(1);
 }
 
@@ -278,10 +233,13 @@ int main(int argc, char* argv[])
   pthread_t thread_id;
   struct thread* t;
   unsigned vi_flags;
-  int c, i;
+  int c;
 
-  while( (c = getopt (argc, argv, "dtv")) != -1 )
+  while( (c = getopt (argc, argv, "dtvb:")) != -1 )
     switch( c ) {
+    case 'b':
+      cfg_credit_batch = atoi(optarg);
+      break;
     case 'd':
       cfg_hexdump = 1;
       break;
@@ -305,9 +263,6 @@ int main(int argc, char* argv[])
   ++argv; --argc;
 
   TEST((t = calloc(1, sizeof(*t))) != NULL);
-  t->current_buf = NULL;
-  t->posted_bufs = NULL;
-  t->posted_bufs_tail = &(t->posted_bufs);
 
   TRY(ef_driver_open(&t->dh));
   TRY(ef_pd_alloc_by_name(&t->pd, t->dh, interface, EF_PD_RX_PACKED_STREAM));
@@ -325,7 +280,6 @@ int main(int argc, char* argv[])
   fprintf(stderr, "psp_buffer_align=%d\n", psp.psp_buffer_align);
   fprintf(stderr, "psp_start_offset=%d\n", psp.psp_start_offset);
   fprintf(stderr, "psp_max_usable_buffers=%d\n", psp.psp_max_usable_buffers);
-  t->psp_start_offset = psp.psp_start_offset;
 
   /* Packed stream mode requires large contiguous buffers, so allocate huge
    * pages.  (Also makes consuming packets more efficient of course).
@@ -340,12 +294,14 @@ int main(int argc, char* argv[])
   TEST(p != MAP_FAILED);
   TEST(((uintptr_t) p & (psp.psp_buffer_align - 1)) == 0);
   TRY(ef_memreg_alloc(&t->memreg, t->dh, &t->pd, t->dh, p, alloc_size));
-  for( i = 0; i < n_bufs; ++i ) {
-    struct buf* buf = (void*) ((char*) p + i * buf_size);
-    buf->ef_addr = ef_memreg_dma_addr(&t->memreg, i * buf_size);
-    TRY(ef_vi_receive_post(&t->vi, buf->ef_addr, 0));
-    posted_buf_put(t, buf);
-  }
+
+  /* No per-flow handlers: everything goes to the default handler. */
+  void* demux_mem;
+  TEST((demux_mem = malloc(ef_packed_stream_demux_calc_bytes(1))) != NULL);
+  TRY(ef_packed_stream_demux_init(&t->demux, demux_mem, 1,
+                                  consume_packet, t));
+  TRY(ef_packed_stream_iter_init(&t->ps_iter, &t->vi, &t->demux, p,
+                                 &t->memreg, 0, n_bufs, cfg_credit_batch));
 
   while( argc > 0 ) {
     ef_filter_spec filter_spec;
@@ -0,0 +1,286 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* accept_scale
+ *
+ * Connection rate of one listening socket against the number of threads
+ * calling accept() on it.  For each thread count in the list (-n) we
+ * start that many acceptor threads on a fresh listener, let -c client
+ * threads connect() to it as fast as they can for -t seconds, and report
+ * the accept rate and how evenly the connections were spread over the
+ * acceptors.
+ *
+ * Run it under Onload with loopback acceleration, and compare the accept
+ * queue sharding options:
+ *
+ *   EF_TCP_SERVER_LOOPBACK=1 EF_TCP_CLIENT_LOOPBACK=1 \
+ *     EF_TCP_ACCEPTQ_SHARDS=16 onload ./accept_scale
+ *
+ * With -L it is the listener only, for clients on another host (-e):
+ *
+ *   server$ EF_TCP_ACCEPTQ_SHARDS=16 onload ./accept_scale -L -n 8
+ *   client$ ./accept_scale -e -a <server> -c 16
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "test_util.h"
+
+
+#define MAX_THREADS  64
+
+
+static const char*     cfg_threads = "1,2,4,8,16,32";
+static int             cfg_clients = 8;
+static int             cfg_seconds = 2;
+static int             cfg_backlog = 1024;
+static int             cfg_external;
+static int             cfg_listen_only;
+static const char*     cfg_addr = "127.0.0.1";
+static int             cfg_port = 8125;
+
+static volatile int    stop;
+static struct sockaddr_in target;
+
+/* Counters are padded so the threads don't share cache lines. */
+struct counter {
+  volatile uint64_t n;
+  char              pad[56];
+};
+
+static struct counter  accepts[MAX_THREADS];
+static struct counter  connects[MAX_THREADS];
+static struct counter  connect_fails[MAX_THREADS];
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  accept_scale [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <n,n,..> - numbers of acceptor threads to try\n");
+  fprintf(stderr, "  -c <n>      - number of client threads\n");
+  fprintf(stderr, "  -t <secs>   - duration of each run\n");
+  fprintf(stderr, "  -b <n>      - listen backlog\n");
+  fprintf(stderr, "  -a <addr>   - address of listener\n");
+  fprintf(stderr, "  -p <port>   - port of listener\n");
+  fprintf(stderr, "  -e          - connect to an external listener\n");
+  fprintf(stderr, "  -L          - be the listener only\n");
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+struct acceptor {
+  pthread_t tid;
+  int       lsock;
+  int       id;
+};
+
+
+static void* acceptor_main(void* arg)
+{
+  struct acceptor* a = arg;
+  int sock;
+
+  while( ! stop )
+    if( (sock = accept(a->lsock, NULL, NULL)) >= 0 ) {
+      ++accepts[a->id].n;
+      close(sock);
+    }
+  return NULL;
+}
+
+
+/* Connect and close straight away.  The RST on close keeps the client's
+ * ephemeral ports out of TIME_WAIT.
+ */
+static int connect_once(void)
+{
+  struct linger l = { 1, 0 };
+  int sock, rc;
+
+  TRY(sock = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(setsockopt(sock, SOL_SOCKET, SO_LINGER, &l, sizeof(l)));
+  rc = connect(sock, (void*) &target, sizeof(target));
+  close(sock);
+  return rc;
+}
+
+
+static void* client_main(void* arg)
+{
+  int id = (int) (intptr_t) arg;
+
+  while( ! stop ) {
+    if( connect_once() == 0 )
+      ++connects[id].n;
+    else
+      ++connect_fails[id].n;
+  }
+  return NULL;
+}
+
+
+static int listener_open(void)
+{
+  struct sockaddr_in sa = target;
+  int lsock, one = 1;
+
+  if( cfg_listen_only )
+    sa.sin_addr.s_addr = INADDR_ANY;
+  TRY(lsock = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  TRY(bind(lsock, (void*) &sa, sizeof(sa)));
+  TRY(listen(lsock, cfg_backlog));
+  return lsock;
+}
+
+
+static uint64_t sum(const struct counter* c, int n)
+{
+  uint64_t s = 0;
+  int i;
+  for( i = 0; i < n; ++i )
+    s += c[i].n;
+  return s;
+}
+
+
+/* One run with [n_acceptors] acceptor threads. */
+static void run(int n_acceptors)
+{
+  struct acceptor acceptors[MAX_THREADS];
+  pthread_t clients[MAX_THREADS];
+  uint64_t t0, t1, n, min = UINT64_MAX, max = 0;
+  int i, lsock = -1;
+
+  memset(accepts, 0, sizeof(accepts));
+  memset(connects, 0, sizeof(connects));
+  memset(connect_fails, 0, sizeof(connect_fails));
+  stop = 0;
+
+  if( ! cfg_external ) {
+    lsock = listener_open();
+    for( i = 0; i < n_acceptors; ++i ) {
+      acceptors[i].lsock = lsock;
+      acceptors[i].id = i;
+      TRY(pthread_create(&acceptors[i].tid, NULL, acceptor_main,
+                         &acceptors[i]));
+    }
+  }
+  if( ! cfg_listen_only )
+    for( i = 0; i < cfg_clients; ++i )
+      TRY(pthread_create(&clients[i], NULL, client_main,
+                         (void*) (intptr_t) i));
+
+  t0 = now_ns();
+  sleep(cfg_seconds);
+  t1 = now_ns();
+  stop = 1;
+
+  if( ! cfg_listen_only )
+    for( i = 0; i < cfg_clients; ++i )
+      pthread_join(clients[i], NULL);
+  if( ! cfg_external ) {
+    /* Acceptors may be blocked in accept(), so give each one a last
+     * connection to find. */
+    for( i = 0; i < n_acceptors; ++i )
+      connect_once();
+    for( i = 0; i < n_acceptors; ++i )
+      pthread_join(acceptors[i].tid, NULL);
+    close(lsock);
+  }
+
+  for( i = 0; i < n_acceptors; ++i ) {
+    if( accepts[i].n < min )  min = accepts[i].n;
+    if( accepts[i].n > max )  max = accepts[i].n;
+  }
+  n = cfg_external ? sum(connects, cfg_clients) : sum(accepts, n_acceptors);
+  printf("%-8d %12.0f %12.0f %10lu %10lu %8lu\n", n_acceptors,
+         n * 1e9 / (t1 - t0), n * 1e9 / (t1 - t0) / n_acceptors,
+         (unsigned long) (cfg_external ? 0 : min),
+         (unsigned long) (cfg_external ? 0 : max),
+         (unsigned long) sum(connect_fails, cfg_clients));
+  fflush(stdout);
+}
+
+
+int main(int argc, char* argv[])
+{
+  char* list;
+  char* tok;
+  int c, n;
+
+  while( (c = getopt(argc, argv, "n:c:t:b:a:p:eL")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_threads = optarg;
+      break;
+    case 'c':
+      cfg_clients = atoi(optarg);
+      break;
+    case 't':
+      cfg_seconds = atoi(optarg);
+      break;
+    case 'b':
+      cfg_backlog = atoi(optarg);
+      break;
+    case 'a':
+      cfg_addr = optarg;
+      break;
+    case 'p':
+      cfg_port = atoi(optarg);
+      break;
+    case 'e':
+      cfg_external = 1;
+      break;
+    case 'L':
+      cfg_listen_only = 1;
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_seconds < 1 || cfg_clients < 1 ||
+      cfg_clients > MAX_THREADS || (cfg_external && cfg_listen_only) )
+    usage();
+
+  target.sin_family = AF_INET;
+  target.sin_addr.s_addr = inet_addr(cfg_addr);
+  target.sin_port = htons(cfg_port);
+
+  printf("#%-7s %12s %12s %10s %10s %8s\n", "threads", "accepts/s",
+         "per_thread", "min", "max", "failed");
+  list = strdup(cfg_threads);
+  for( tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",") ) {
+    n = atoi(tok);
+    if( n < 1 || n > MAX_THREADS )
+      usage();
+    run(n);
+  }
+  free(list);
+  return 0;
+}
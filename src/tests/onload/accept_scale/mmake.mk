@@ -0,0 +1,3 @@
+TARGETS	:= accept_scale
+
+include $(TOP)/src/tests/onload/onload_test.mk
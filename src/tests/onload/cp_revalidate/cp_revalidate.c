@@ -0,0 +1,441 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* cp_revalidate
+ *
+ * Test for revalidation of sockets' cached forwarding information.  Builds
+ * private route and address resolution tables, and a set of "sockets" each
+ * holding the route row and MAC row stamps that cicp_user_retrieve() would
+ * record.  Then churns the tables the way the driver does and counts how
+ * many sockets have to go back to the slow path after each change:
+ *
+ *   unrelated neighbours  - MAC changes and re-adds of neighbours that no
+ *                           socket uses: no socket should revalidate
+ *   gateway neighbour     - a gateway's MAC changes: only its users
+ *   unrelated route       - a /24 route to elsewhere comes and goes: only
+ *                           users of routes that contain it (the default)
+ *   more specific route   - a /24 inside a /16 that sockets use
+ *
+ * After every change each socket's cached next hop and MAC are checked
+ * against a fresh lookup, so that any socket that should have revalidated
+ * and did not is reported as stale.  Before per-route stamps every route
+ * change sent every socket through the slow path.
+ *
+ *   $ cp_revalidate
+ *   #churn                   changes  retrievals  per_change  stale
+ *   unrelated neighbours         200           0         0.0      0
+ *   gateway neighbour            200     3333400     16667.0      0
+ *   unrelated route              200     3333200     16666.0      0
+ *   more specific route          200     6666600     33333.0      0
+ *   sockets: 50000  (before per-route stamps, every route change ...)
+ *   PASS
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <ci/internal/ip.h>
+#include <ci/internal/cplane_ops.h>
+#include "test_util.h"
+
+
+#define IFINDEX      2
+#define ROWS_MAX     64
+#define NEIGH_MAX    4096
+
+#define IP(a, b, c, d)  htonl(((a) << 24) | ((b) << 16) | ((c) << 8) | (d))
+
+#define GW_SUBNET    IP(10, 1, 0, 1)     /* gateway to 10.2.0.0/16 */
+#define GW_DEFAULT   IP(10, 1, 0, 254)   /* default gateway */
+
+
+struct sock {
+  ci_ip_addr_t       daddr;
+  ci_ip_addr_t       nexthop;
+  ci_mac_addr_t      mac;
+  cicp_fwd_verinfo_t fwd_integrity;
+  cicp_mac_verinfo_t mac_integrity;
+};
+
+
+static int             cfg_socks = 50000;
+static int             cfg_changes = 200;
+
+static cicp_fwdinfo_t* fwdt;
+static cicp_mac_mib_t* mact;
+static struct sock*    socks;
+static unsigned        mac_gen;
+static unsigned long   n_retrievals;
+static unsigned long   n_stale;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  cp_revalidate [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <sockets>  - number of sockets\n");
+  fprintf(stderr, "  -c <changes>  - table changes of each kind\n");
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+/**********************************************************************
+ * Route table, maintained as the driver does
+ */
+
+static void fwd_alloc(void)
+{
+  int nodes_max = CICP_FWD_INDEX_NODES(ROWS_MAX);
+  size_t bytes, stamps_ofs, index_ofs;
+  int i;
+
+  /* As cicp_fwdinfo_ctor() */
+  bytes = sizeof(*fwdt) + (ROWS_MAX - 1) * sizeof(cicp_fwd_row_t);
+  stamps_ofs = CI_ROUND_UP(bytes, sizeof(ci_verlock_value_t));
+  bytes = stamps_ofs + ROWS_MAX * sizeof(ci_verlock_value_t);
+  index_ofs = CI_ROUND_UP(bytes, CI_CACHE_LINE_SIZE);
+  bytes = index_ofs + CICP_FWD_INDEX_SIZE(nodes_max);
+  TRY(-posix_memalign((void**) &fwdt, CI_PAGE_SIZE, bytes));
+  memset(fwdt, 0, bytes);
+  fwdt->version = CI_VERLOCK_INIT_VALID;
+  fwdt->rows_max = ROWS_MAX;
+  fwdt->index_ofs = index_ofs;
+  fwdt->stamps_ofs = stamps_ofs;
+  fwdt->stamp_last = CI_VERLOCK_BAD;
+  fwdt->noroute_version = cicp_fwd_stamp_next(fwdt);
+  cicp_fwd_index(fwdt)->nodes_max = nodes_max;
+  for( i = 0; i < ROWS_MAX; ++i ) {
+    cicp_fwd_row_free(&fwdt->path[i]);
+    cicp_fwd_stamps(fwdt)[i] = CI_VERLOCK_BAD;
+  }
+  cicp_fwd_index_build(fwdt);
+}
+
+
+static int fwd_rows(void)
+{
+  int n;
+  for( n = 0; n < ROWS_MAX && cicp_fwd_row_allocated(&fwdt->path[n]); ++n )
+    ;
+  return n;
+}
+
+
+/* Add a route, keeping the rows sorted longest prefix first as
+ * cicp_route_sort() does (so rows after it move down).
+ */
+static void route_add(ci_ip_addr_t dest, int prefix_len, ci_ip_addr_t gw)
+{
+  int n = fwd_rows(), i;
+  cicp_fwd_row_t* row;
+
+  ci_assert_lt(n, ROWS_MAX);
+  CI_VERLOCK_WRITE_BEGIN(fwdt->version)
+    for( i = n; i > 0 && fwdt->path[i - 1].destnet_ipset < prefix_len; --i )
+      fwdt->path[i] = fwdt->path[i - 1];
+    row = &fwdt->path[i];
+    memset(row, 0, sizeof(*row));
+    CI_IP_ADDR_SET_SUBNET(&row->destnet_ip, &dest, prefix_len);
+    row->destnet_ipset = prefix_len;
+    row->first_hop = gw;
+    row->dest_ifindex = IFINDEX;
+    row->hwport = 0;
+    row->mtu = 1500;
+    cicp_fwd_row_stamp_new(fwdt, row);
+    cicp_fwd_index_build(fwdt);
+  CI_VERLOCK_WRITE_END(fwdt->version)
+  CI_VERLOCK_WRITE(fwdt->version, cicp_fwd_route_changed(fwdt, dest,
+                                                          prefix_len));
+}
+
+
+/* Remove a route, compressing the rows as cicpos_route_compress() does. */
+static void route_del(ci_ip_addr_t dest, int prefix_len)
+{
+  int n = fwd_rows(), i;
+
+  CI_VERLOCK_WRITE_BEGIN(fwdt->version)
+    for( i = 0; i < n; ++i )
+      if( fwdt->path[i].destnet_ip == dest &&
+          fwdt->path[i].destnet_ipset == prefix_len )
+        break;
+    ci_assert_lt(i, n);
+    cicp_fwd_row_remove(fwdt, &fwdt->path[i]);
+    for( ; i < n - 1; ++i )
+      fwdt->path[i] = fwdt->path[i + 1];
+    cicp_fwd_row_free(&fwdt->path[n - 1]);
+    cicp_fwd_index_build(fwdt);
+  CI_VERLOCK_WRITE_END(fwdt->version)
+  CI_VERLOCK_WRITE(fwdt->version, cicp_fwd_route_changed(fwdt, dest,
+                                                          prefix_len));
+}
+
+
+/**********************************************************************
+ * Address resolution table
+ */
+
+static void mac_alloc(void)
+{
+  int rows_ln2 = ci_log2_ge(NEIGH_MAX, 5);
+  int rows = 1 << rows_ln2;
+  int i;
+
+  /* As cicp_mac_mib_ctor() */
+  TRY(-posix_memalign((void**) &mact, CI_PAGE_SIZE,
+                      CICP_MAC_MIB_SIZE(mact, rows)));
+  mact->rows_ln2 = rows_ln2;
+  mact->tags_ofs = CICP_MAC_MIB_TAGS_OFS(mact, rows);
+  memset(cicp_mac_row_tag(mact, 0), CICP_MAC_TAG_EMPTY, rows);
+  mact->deleted_rows = 0;
+  mact->deleted_max = rows >> CICP_MAC_DELETED_COMPACT_LN2;
+  for( i = 0; i < rows; ++i ) {
+    cicp_mac_row_t* row = &mact->ipmac[i];
+    memset(row, 0, sizeof(*row));
+    row->version = CI_VERLOCK_INIT_VALID;
+    cicp_mac_row_free(row);
+  }
+  /* This is ipmac[CICP_MAC_MIB_ROW_MOSTLY_VALID], but the compiler would
+   * see that index as out of bounds. */
+  memset(&mact->mostly_valid_row, 0, sizeof(mact->mostly_valid_row));
+  mact->mostly_valid_row.version = CI_VERLOCK_INIT_VALID;
+}
+
+
+static void mac_fill(ci_mac_addr_t* mac, ci_ip_addr_t ip)
+{
+  (*mac)[0] = 0x02;
+  (*mac)[1] = ++mac_gen;
+  memcpy(&(*mac)[2], &ip, 4);
+}
+
+
+static void neigh_add(ci_ip_addr_t ip)
+{
+  cicp_mac_rowid_t rowid = _cicp_mac_find_ipunaloc(mact, IFINDEX, ip);
+  cicp_mac_row_t* row;
+
+  ci_assert_nequal(rowid, CICP_MAC_ROWID_BAD);
+  row = &mact->ipmac[rowid];
+  row->ifindex = IFINDEX;
+  row->need_update = 0;
+  row->rc = 0;
+  mac_fill(&row->mac_addr, ip);
+  CI_IP_ADDR_SET(&row->ip_addr, &ip);
+  cicp_mac_row_allocate(row);
+}
+
+
+static void neigh_del(ci_ip_addr_t ip)
+{
+  cicp_mac_rowid_t rowid = _cicp_mac_find_ipaloc(mact, IFINDEX, ip);
+  if( rowid != CICP_MAC_ROWID_BAD )
+    cicp_mac_row_free(&mact->ipmac[rowid]);
+}
+
+
+static void neigh_change(ci_ip_addr_t ip)
+{
+  ci_verlock_value_t ver;
+  cicp_mac_rowid_t rowid = cicpos_mac_find_ip(mact, IFINDEX, ip, &ver);
+  cicp_mac_row_t* row;
+
+  ci_assert_nequal(rowid, CICP_MAC_ROWID_BAD);
+  row = &mact->ipmac[rowid];
+  CI_VERLOCK_WRITE(row->version, mac_fill(&row->mac_addr, ip));
+}
+
+
+/**********************************************************************
+ * Sockets
+ */
+
+/* The parts of cicp_user_retrieve() that these tables exercise. */
+static void lookup(struct sock* s, ci_ip_addr_t* nexthop, ci_mac_addr_t* mac,
+                   cicp_fwd_verinfo_t* fwd_info, cicp_mac_verinfo_t* mac_info)
+{
+  const cicp_fwd_row_t* row = _cicp_fwd_find_ip(fwdt, s->daddr, CI_IFID_BAD);
+
+  ci_assert(row != NULL);
+  fwd_info->row_index = row->stamp_id;
+  fwd_info->row_version = cicp_fwd_stamps(fwdt)[row->stamp_id];
+  *nexthop = row->first_hop != 0 ? row->first_hop : s->daddr;
+  if( cicp_mac_get(mact, row->dest_ifindex, *nexthop, mac, mac_info) != 0 )
+    mac_info->row_version = CI_VERLOCK_BAD;
+}
+
+
+static void sock_retrieve(struct sock* s)
+{
+  lookup(s, &s->nexthop, &s->mac, &s->fwd_integrity, &s->mac_integrity);
+  ++n_retrievals;
+}
+
+
+/* What sending on each socket would do: revalidate it if its cached
+ * information is no longer valid, then check it against a fresh lookup.
+ */
+static void socks_send(void)
+{
+  cicp_fwd_verinfo_t fwd_info;
+  cicp_mac_verinfo_t mac_info;
+  ci_ip_addr_t nexthop;
+  ci_mac_addr_t mac;
+  int i;
+
+  for( i = 0; i < cfg_socks; ++i ) {
+    struct sock* s = &socks[i];
+    if( ! cicp_mac_is_valid(mact, &s->mac_integrity) ||
+        ! cicp_fwd_is_valid(fwdt, &s->fwd_integrity) )
+      sock_retrieve(s);
+    lookup(s, &nexthop, &mac, &fwd_info, &mac_info);
+    if( nexthop != s->nexthop || memcmp(mac, s->mac, sizeof(mac)) )
+      ++n_stale;
+  }
+}
+
+
+static void report(const char* churn, int changes)
+{
+  printf("%-22s %9d %11lu %11.1f %6lu\n", churn, changes, n_retrievals,
+         (double) n_retrievals / changes, n_stale);
+}
+
+
+int main(int argc, char* argv[])
+{
+  unsigned long total_stale = 0, unrelated_retrievals;
+  int c, i;
+
+  while( (c = getopt(argc, argv, "n:c:")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_socks = atoi(optarg);
+      break;
+    case 'c':
+      cfg_changes = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_socks < 3 || cfg_changes < 1 )
+    usage();
+
+  fwd_alloc();
+  mac_alloc();
+  route_add(IP(10, 1, 0, 0), 16, 0);
+  route_add(IP(10, 2, 0, 0), 16, GW_SUBNET);
+  route_add(0, 0, GW_DEFAULT);
+  neigh_add(GW_SUBNET);
+  neigh_add(GW_DEFAULT);
+
+  /* A third of the sockets talk to neighbours directly, a third via the
+   * gateway to 10.2.0.0/16 and a third via the default gateway.  Each
+   * directly connected neighbour has several sockets.
+   */
+  socks = calloc(cfg_socks, sizeof(*socks));
+  for( i = 0; i < cfg_socks; ++i ) {
+    int host = i / 3 % 1000;
+    switch( i % 3 ) {
+    case 0:
+      socks[i].daddr = IP(10, 1, 1 + host / 250, 1 + host % 250);
+      if( i < 3000 )
+        neigh_add(socks[i].daddr);
+      break;
+    case 1:
+      socks[i].daddr = IP(10, 2, host / 250, 1 + host % 250);
+      break;
+    default:
+      socks[i].daddr = IP(172, 16, host / 250, 1 + host % 250);
+      break;
+    }
+  }
+  /* Neighbours that no socket uses. */
+  for( i = 0; i < 1000; ++i )
+    neigh_add(IP(10, 1, 200 + i / 250, 1 + i % 250));
+
+  for( i = 0; i < cfg_socks; ++i )
+    sock_retrieve(&socks[i]);
+  n_retrievals = 0;
+
+  printf("#%-21s %9s %11s %11s %6s\n",
+         "churn", "changes", "retrievals", "per_change", "stale");
+
+  for( i = 0; i < cfg_changes; ++i ) {
+    ci_ip_addr_t ip = IP(10, 1, 200 + i % 1000 / 250, 1 + i % 250);
+    if( i & 1 )
+      neigh_change(ip);
+    else {
+      neigh_del(ip);
+      neigh_add(ip);
+    }
+    socks_send();
+  }
+  report("unrelated neighbours", cfg_changes);
+  unrelated_retrievals = n_retrievals;
+  total_stale += n_stale;
+  n_retrievals = n_stale = 0;
+
+  for( i = 0; i < cfg_changes; ++i ) {
+    neigh_change(GW_SUBNET);
+    socks_send();
+  }
+  report("gateway neighbour", cfg_changes);
+  total_stale += n_stale;
+  n_retrievals = n_stale = 0;
+
+  for( i = 0; i < cfg_changes; ++i ) {
+    ci_ip_addr_t dest = IP(192, 168, i / 2 % 256, 0);
+    if( i & 1 )
+      route_del(dest, 24);
+    else
+      route_add(dest, 24, GW_SUBNET);
+    socks_send();
+  }
+  if( cfg_changes & 1 )
+    route_del(IP(192, 168, (cfg_changes - 1) / 2 % 256, 0), 24);
+  report("unrelated route", cfg_changes);
+  total_stale += n_stale;
+  n_retrievals = n_stale = 0;
+
+  for( i = 0; i < cfg_changes; ++i ) {
+    if( i & 1 )
+      route_del(IP(10, 2, 1, 0), 24);
+    else
+      route_add(IP(10, 2, 1, 0), 24, GW_DEFAULT);
+    socks_send();
+  }
+  if( cfg_changes & 1 )
+    route_del(IP(10, 2, 1, 0), 24);
+  report("more specific route", cfg_changes);
+  total_stale += n_stale;
+
+  printf("sockets: %d  (before per-route stamps, every route change "
+         "revalidated all of them)\n", cfg_socks);
+  if( total_stale != 0 || unrelated_retrievals != 0 ) {
+    printf("FAIL: %lu stale, %lu retrievals for unrelated neighbours\n",
+           total_stale, unrelated_retrievals);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
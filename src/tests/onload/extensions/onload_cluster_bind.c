@@ -0,0 +1,159 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/*
+ * Build the file using the following command:
+ *   $ gcc -lonload_ext -o onload_cluster_bind onload_cluster_bind.c
+ *
+ * Calls onload_cluster_bind_for_connect() on fresh TCP sockets, which are
+ * not yet in a clustered stack, and checks that each is bound to a port of
+ * the ephemeral range whose return traffic the cluster steers to the
+ * socket's own stack.  <local-addr> must be on an interface that Onload
+ * accelerates with an RSS context of its own:
+ *
+ *   $ EF_CLUSTER_SIZE=2 EF_CLUSTER_NAME=cb \
+ *     onload ./onload_cluster_bind <local-addr> <remote-addr> [sockets]
+ *   PASS
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <onload/extensions.h>
+
+#define REMOTE_PORT  5201
+
+
+static void ephemeral_ports(unsigned* lo, unsigned* hi)
+{
+  FILE* f = fopen("/proc/sys/net/ipv4/ip_local_port_range", "r");
+
+  *lo = 32768;
+  *hi = 60999;
+  if( f != NULL ) {
+    if( fscanf(f, "%u %u", lo, hi) != 2 ) {
+      *lo = 32768;
+      *hi = 60999;
+    }
+    fclose(f);
+  }
+}
+
+
+/* Binds a fresh socket for a connection to [raddr], and returns the
+ * number of things wrong with the result.
+ */
+static int check_one(const struct sockaddr_in* laddr,
+                     const struct sockaddr_in* raddr)
+{
+  struct onload_cluster_tuple tuple;
+  struct sockaddr_in bound;
+  socklen_t len = sizeof(bound);
+  unsigned lo, hi, port;
+  int sock, stack, size, index, n_fail = 0;
+
+  if( (sock = socket(AF_INET, SOCK_STREAM, 0)) < 0 ) {
+    perror("socket");
+    exit(1);
+  }
+  if( onload_cluster_bind_for_connect(sock, laddr, raddr) < 0 ) {
+    printf("FAIL: onload_cluster_bind_for_connect: %s\n", strerror(errno));
+    close(sock);
+    return 1;
+  }
+
+  if( getsockname(sock, (struct sockaddr*) &bound, &len) < 0 ) {
+    perror("getsockname");
+    exit(1);
+  }
+  port = ntohs(bound.sin_port);
+  ephemeral_ports(&lo, &hi);
+  if( bound.sin_addr.s_addr != laddr->sin_addr.s_addr ) {
+    printf("FAIL: bound to %s\n", inet_ntoa(bound.sin_addr));
+    ++n_fail;
+  }
+  if( port < lo || port > hi ) {
+    printf("FAIL: port %u is outside %u-%u\n", port, lo, hi);
+    ++n_fail;
+  }
+
+  if( (stack = onload_cluster_stack_index(sock, &size)) < 0 ) {
+    printf("FAIL: socket is not in a clustered stack: %s\n",
+           strerror(errno));
+    close(sock);
+    return n_fail + 1;
+  }
+  tuple.laddr = bound.sin_addr;
+  tuple.lport = bound.sin_port;
+  tuple.raddr = raddr->sin_addr;
+  tuple.rport = raddr->sin_port;
+  if( onload_cluster_tuple_index(sock, &tuple, 1, &index,
+                                 ONLOAD_CLUSTER_TUPLE_ACTIVE) < 0 ) {
+    printf("FAIL: onload_cluster_tuple_index: %s\n", strerror(errno));
+    ++n_fail;
+  }
+  else if( index != stack ) {
+    printf("FAIL: port %u goes to stack %d of %d, not %d\n",
+           port, index, size, stack);
+    ++n_fail;
+  }
+
+  close(sock);
+  return n_fail;
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct sockaddr_in laddr, raddr;
+  int i, n, n_fail = 0;
+
+  if( argc < 3 || argc > 4 ) {
+    fprintf(stderr, "usage: onload_cluster_bind <local-addr> <remote-addr> "
+            "[sockets]\n");
+    return 1;
+  }
+  n = argc > 3 ? atoi(argv[3]) : 16;
+
+  if( ! onload_is_present() ) {
+    printf("Onload is not present\n");
+    return 1;
+  }
+
+  memset(&laddr, 0, sizeof(laddr));
+  laddr.sin_family = AF_INET;
+  raddr = laddr;
+  raddr.sin_port = htons(REMOTE_PORT);
+  if( inet_aton(argv[1], &laddr.sin_addr) == 0 ||
+      inet_aton(argv[2], &raddr.sin_addr) == 0 ) {
+    fprintf(stderr, "onload_cluster_bind: bad address\n");
+    return 1;
+  }
+
+  for( i = 0; i < n; ++i )
+    n_fail += check_one(&laddr, &raddr);
+
+  if( n_fail ) {
+    printf("FAIL: %d checks\n", n_fail);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,195 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* filter_storm
+ *
+ * Cost of setting the filters of many sockets at once, as when every
+ * connection re-establishes after a failover.  We bind -n Onload sockets
+ * to consecutive ports of a local address (-l), then set and clear their
+ * filters with the driver's ioctls: first OO_IOC_EP_FILTER_SET once per
+ * socket, and then OO_IOC_EP_FILTER_SET_BATCH once per -b sockets.  Each
+ * round is run twice and only the second is reported.
+ *
+ *   $ onload ./filter_storm -l 192.168.0.1 -n 4096 -b 32
+ *
+ * The address must be on an interface Onload accelerates, so that each
+ * filter is inserted in hardware.  For each batch size we report the time
+ * per socket to set and to clear its filters, and how many sets failed.
+ * set_ns times the number of sockets is the time to set every socket's
+ * filters.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <ci/internal/ip.h>
+#include <onload/ul/tcp_helper.h>
+#include <onload/extensions.h>
+#include "test_util.h"
+
+
+static int             cfg_sockets = 1024;
+static int             cfg_batch = 32;
+static int             cfg_port = 20000;
+static const char*     cfg_laddr;
+
+static ci_netif        ni;
+static int*            fds;
+static oo_tcp_filter_set_t* ops;
+static ci_int32*       rcs;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  onload filter_storm [options] -l <local-addr>\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -l <addr>        - local address to bind to\n");
+  fprintf(stderr, "  -n <sockets>     - number of sockets\n");
+  fprintf(stderr, "  -b <sockets>     - sockets per batched ioctl\n");
+  fprintf(stderr, "  -p <port>        - first port to bind to\n");
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+/* Binds the sockets, and finds their stack and endpoints. */
+static void make_sockets(void)
+{
+  struct onload_stat stat;
+  struct sockaddr_in sa;
+  int i, stack_id = -1;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  if( inet_aton(cfg_laddr, &sa.sin_addr) == 0 )
+    usage();
+
+  for( i = 0; i < cfg_sockets; ++i ) {
+    TRY(fds[i] = socket(AF_INET, SOCK_STREAM, 0));
+    sa.sin_port = htons(cfg_port + i);
+    TRY(bind(fds[i], (struct sockaddr*) &sa, sizeof(sa)));
+    if( onload_fd_stat(fds[i], &stat) <= 0 ) {
+      fprintf(stderr, "ERROR: socket is not accelerated; run under "
+              "onload\n");
+      exit(1);
+    }
+    free(stat.stack_name);
+    if( stack_id >= 0 && stat.stack_id != stack_id ) {
+      fprintf(stderr, "ERROR: sockets are in more than one stack\n");
+      exit(1);
+    }
+    stack_id = stat.stack_id;
+    ops[i].tcp_id = OO_SP_FROM_INT(&ni, stat.endpoint_id);
+    ops[i].from_tcp_id = OO_SP_NULL;
+    ops[i].bindto_ifindex = 0;
+  }
+
+  TRY(ci_netif_restore_id(&ni, stack_id));
+}
+
+
+static void run_test(int batch)
+{
+  ci_fd_t fd = ci_netif_get_driver_handle(&ni);
+  ci_uint64 t0, t1, t2;
+  double ns = 1e6 / ci_cpu_khz;
+  int i, round, failed = 0;
+
+  for( round = 0; round < 2; ++round ) {
+    TRY(ci_netif_lock(&ni));
+    failed = 0;
+    ci_frc64(&t0);
+    if( batch == 1 )
+      for( i = 0; i < cfg_sockets; ++i )
+        rcs[i] = ci_tcp_helper_ep_set_filters(fd, ops[i].tcp_id,
+                                              ops[i].bindto_ifindex,
+                                              ops[i].from_tcp_id);
+    else
+      for( i = 0; i < cfg_sockets; i += batch )
+        TRY(ci_tcp_helper_ep_set_filters_batch(fd, ops + i, rcs + i,
+                                              CI_MIN(batch,
+                                                     cfg_sockets - i)));
+    ci_frc64(&t1);
+    for( i = 0; i < cfg_sockets; ++i )
+      if( rcs[i] == 0 )
+        ci_tcp_helper_ep_clear_filters(fd, ops[i].tcp_id, 0);
+      else
+        ++failed;
+    ci_frc64(&t2);
+    ci_netif_unlock(&ni);
+  }
+
+  printf("%-8d %9d %8.0f %8.0f %8d\n", batch, cfg_sockets,
+         (t1 - t0) * ns / cfg_sockets, (t2 - t1) * ns / cfg_sockets,
+         failed);
+}
+
+
+int main(int argc, char* argv[])
+{
+  unsigned khz;
+  int c, i;
+
+  while( (c = getopt(argc, argv, "l:n:b:p:")) != -1 )
+    switch( c ) {
+    case 'l':
+      cfg_laddr = optarg;
+      break;
+    case 'n':
+      cfg_sockets = atoi(optarg);
+      break;
+    case 'b':
+      cfg_batch = atoi(optarg);
+      break;
+    case 'p':
+      cfg_port = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_laddr == NULL || cfg_sockets < 1 ||
+      cfg_batch < 2 || cfg_port < 1 || cfg_port + cfg_sockets > 65536 )
+    usage();
+  TRY(ci_get_cpu_khz(&khz));
+
+  fds = calloc(cfg_sockets, sizeof(*fds));
+  ops = calloc(cfg_sockets, sizeof(*ops));
+  rcs = calloc(cfg_sockets, sizeof(*rcs));
+  if( fds == NULL || ops == NULL || rcs == NULL ) {
+    fprintf(stderr, "ERROR: out of memory\n");
+    exit(1);
+  }
+  make_sockets();
+
+  printf("#%-7s %9s %8s %8s %8s\n", "batch", "sockets", "set_ns",
+         "clear_ns", "failed");
+  run_test(1);
+  run_test(cfg_batch);
+
+  for( i = 0; i < cfg_sockets; ++i )
+    close(fds[i]);
+  free(rcs);
+  free(ops);
+  free(fds);
+  return 0;
+}
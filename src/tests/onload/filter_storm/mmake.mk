@@ -0,0 +1,8 @@
+TARGETS	:= filter_storm
+
+MMAKE_LIBS	:= $(LINK_CIIP_LIB) $(LINK_CIUL_LIB) $(LINK_CITOOLS_LIB) \
+		   $(LINK_ONLOAD_EXT_LIB)
+MMAKE_LIB_DEPS	:= $(CIIP_LIB_DEPEND) $(CIUL_LIB_DEPEND) $(CITOOLS_LIB_DEPEND) \
+		   $(ONLOAD_EXT_LIB_DEPEND)
+
+include $(TOP)/src/tests/onload/onload_test.mk
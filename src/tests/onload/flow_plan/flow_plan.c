@@ -0,0 +1,232 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* flow_plan
+ *
+ * Table-driven test of the flow-plan compiler, ef_flow_plan_compile().
+ * The compiler does not talk to the adapter, so this runs anywhere.  Each
+ * case gives a set of flows and the filters we expect, in order, or the
+ * error we expect.
+ *
+ *   $ flow_plan
+ *   PASS  empty plan
+ *   ...
+ *   PASS
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <etherfabric/vi.h>
+#include <etherfabric/flowplan.h>
+
+
+#define FLOWS_MAX    8
+#define FILTERS_MAX  8
+
+#define AUTO         EF_FLOW_PLAN_VI_AUTO
+#define SET          EF_FLOW_PLAN_VI_SET
+#define ANY          EF_FILTER_VLAN_ID_ANY
+
+#define LADDR        0xc0a80001  /* 192.168.0.1 */
+#define RADDR        0xc0a80002  /* 192.168.0.2 */
+
+#define LOCAL(proto, port, vlan, vi, weight)                            \
+  { (proto), LADDR, (port), 0, 0, (vlan), (vi), (weight) }
+#define FULL(proto, port, rport, vlan, vi, weight)                      \
+  { (proto), LADDR, (port), RADDR, (rport), (vlan), (vi), (weight) }
+
+
+/* A filter we expect, identified by the flow that it was made from. */
+struct expect {
+  int      flow;
+  int      vi;
+  unsigned weight;
+  int      movable;
+};
+
+struct test_case {
+  const char*       name;
+  int               n_vis;
+  int               max_filters;
+  int               n_flows;
+  ef_flow_plan_flow flows[FLOWS_MAX];
+  int               rc;
+  struct expect     filters[FILTERS_MAX];
+};
+
+
+static const struct test_case cases[] = {
+  { "empty plan", 2, FILTERS_MAX, 0, { }, 0, { } },
+
+  { "bad protocol", 2, FILTERS_MAX, 1,
+    { LOCAL(IPPROTO_ICMP, 80, ANY, 0, 1) },
+    -EINVAL, { } },
+
+  { "target out of range", 2, FILTERS_MAX, 1,
+    { LOCAL(IPPROTO_TCP, 80, ANY, 2, 1) },
+    -EINVAL, { } },
+
+  { "automatic placement without VIs", 0, FILTERS_MAX, 1,
+    { LOCAL(IPPROTO_TCP, 80, ANY, AUTO, 1) },
+    -EINVAL, { } },
+
+  { "identical flows merge, zero weight is one", 2, FILTERS_MAX, 2,
+    { LOCAL(IPPROTO_UDP, 53, ANY, AUTO, 0),
+      LOCAL(IPPROTO_UDP, 53, ANY, AUTO, 3) },
+    1, { { 0, 0, 4, 1 } } },
+
+  { "explicit target wins over automatic", 2, FILTERS_MAX, 2,
+    { LOCAL(IPPROTO_TCP, 80, ANY, AUTO, 1),
+      LOCAL(IPPROTO_TCP, 80, ANY, 1, 1) },
+    1, { { 0, 1, 2, 0 } } },
+
+  { "identical flows with different targets", 2, FILTERS_MAX, 2,
+    { LOCAL(IPPROTO_TCP, 80, ANY, 0, 1),
+      LOCAL(IPPROTO_TCP, 80, ANY, 1, 1) },
+    -EINVAL, { } },
+
+  { "full match covered by local match", 2, FILTERS_MAX, 2,
+    { LOCAL(IPPROTO_TCP, 80, ANY, AUTO, 1),
+      FULL(IPPROTO_TCP, 80, 1024, ANY, AUTO, 4) },
+    1, { { 0, 0, 5, 1 } } },
+
+  { "full match on another VI is not covered", 2, FILTERS_MAX, 2,
+    { LOCAL(IPPROTO_TCP, 80, ANY, 0, 1),
+      FULL(IPPROTO_TCP, 80, 1024, ANY, 1, 1) },
+    2, { { 0, 0, 1, 0 }, { 1, 1, 1, 0 } } },
+
+  { "explicit full match pins its local match", 2, FILTERS_MAX, 3,
+    { LOCAL(IPPROTO_TCP, 80, ANY, AUTO, 1),
+      FULL(IPPROTO_TCP, 80, 1024, ANY, 0, 1),
+      LOCAL(IPPROTO_UDP, 53, ANY, 1, 5) },
+    2, { { 0, 0, 2, 0 }, { 2, 1, 5, 0 } } },
+
+  { "different VLAN is not covered", 2, FILTERS_MAX, 2,
+    { LOCAL(IPPROTO_TCP, 80, 5, AUTO, 1),
+      FULL(IPPROTO_TCP, 80, 1024, ANY, AUTO, 1) },
+    2, { { 0, 0, 1, 1 }, { 1, 1, 1, 1 } } },
+
+  { "heaviest placed first on least loaded VI", 2, FILTERS_MAX, 4,
+    { LOCAL(IPPROTO_TCP, 1, ANY, AUTO, 8),
+      LOCAL(IPPROTO_TCP, 2, ANY, AUTO, 1),
+      LOCAL(IPPROTO_TCP, 3, ANY, AUTO, 1),
+      LOCAL(IPPROTO_TCP, 4, ANY, AUTO, 6) },
+    4, { { 0, 0, 8, 1 }, { 1, 1, 1, 1 }, { 2, 1, 1, 1 },
+         { 3, 1, 6, 1 } } },
+
+  { "automatic flows avoid explicit load", 3, FILTERS_MAX, 3,
+    { LOCAL(IPPROTO_UDP, 1, ANY, 0, 10),
+      LOCAL(IPPROTO_UDP, 2, ANY, 1, 10),
+      LOCAL(IPPROTO_UDP, 3, ANY, AUTO, 1) },
+    3, { { 0, 0, 10, 0 }, { 1, 1, 10, 0 }, { 2, 2, 1, 1 } } },
+
+  { "VI set target", 2, FILTERS_MAX, 1,
+    { LOCAL(IPPROTO_UDP, 53, ANY, SET, 1) },
+    1, { { 0, SET, 1, 0 } } },
+
+  { "too many filters", 2, 2, 3,
+    { LOCAL(IPPROTO_TCP, 1, ANY, AUTO, 1),
+      LOCAL(IPPROTO_TCP, 2, ANY, AUTO, 1),
+      LOCAL(IPPROTO_TCP, 3, ANY, AUTO, 1) },
+    -ENOSPC, { } },
+};
+#define N_CASES  (sizeof(cases) / sizeof(cases[0]))
+
+
+/* Check that [fl] has the filter that [f] asks for, as made with the
+ * public filter spec calls. */
+static int check_spec(const ef_flow_plan_filter* fl,
+                      const ef_flow_plan_flow* f)
+{
+  const ef_filter_spec* fs = &fl->fpfl_spec;
+  ef_filter_spec want;
+
+  memset(&want, 0, sizeof(want));
+  ef_filter_spec_init(&want, EF_FILTER_FLAG_NONE);
+  if( f->fpf_raddr_be32 == 0 && f->fpf_rport_be16 == 0 )
+    ef_filter_spec_set_ip4_local(&want, f->fpf_protocol, f->fpf_laddr_be32,
+                                 f->fpf_lport_be16);
+  else
+    ef_filter_spec_set_ip4_full(&want, f->fpf_protocol, f->fpf_laddr_be32,
+                                f->fpf_lport_be16, f->fpf_raddr_be32,
+                                f->fpf_rport_be16);
+  if( f->fpf_vlan_id != ANY )
+    ef_filter_spec_set_vlan(&want, f->fpf_vlan_id);
+  return fs->type == want.type && fs->flags == want.flags &&
+         ! memcmp(fs->data, want.data,
+                  (f->fpf_vlan_id != ANY ? 6 : 5) * sizeof(fs->data[0]));
+}
+
+
+static int run_case(const struct test_case* tc)
+{
+  ef_flow_plan_flow flows[FLOWS_MAX];
+  ef_flow_plan_filter filters[FILTERS_MAX];
+  int i, rc;
+
+  /* Addresses and ports are big-endian. */
+  for( i = 0; i < tc->n_flows; ++i ) {
+    flows[i] = tc->flows[i];
+    flows[i].fpf_laddr_be32 = htonl(flows[i].fpf_laddr_be32);
+    flows[i].fpf_lport_be16 = htons(flows[i].fpf_lport_be16);
+    flows[i].fpf_raddr_be32 = htonl(flows[i].fpf_raddr_be32);
+    flows[i].fpf_rport_be16 = htons(flows[i].fpf_rport_be16);
+  }
+
+  rc = ef_flow_plan_compile(flows, tc->n_flows, tc->n_vis, filters,
+                            tc->max_filters);
+  if( rc != tc->rc ) {
+    printf("FAIL  %s: rc=%d, expected %d\n", tc->name, rc, tc->rc);
+    return 0;
+  }
+  for( i = 0; i < rc; ++i ) {
+    const struct expect* e = &tc->filters[i];
+    const ef_flow_plan_filter* fl = &filters[i];
+    if( ! check_spec(fl, &flows[e->flow]) || fl->fpfl_vi != e->vi ||
+        fl->fpfl_weight != e->weight ||
+        ! fl->fpfl_movable != ! e->movable ||
+        fl->fpfl_installed_vi != EF_FLOW_PLAN_VI_NONE ) {
+      printf("FAIL  %s: filter %d is vi=%d weight=%u movable=%d, expected "
+             "flow %d vi=%d weight=%u movable=%d\n", tc->name, i,
+             fl->fpfl_vi, fl->fpfl_weight, fl->fpfl_movable, e->flow,
+             e->vi, e->weight, e->movable);
+      return 0;
+    }
+  }
+  printf("PASS  %s\n", tc->name);
+  return 1;
+}
+
+
+int main(int argc, char* argv[])
+{
+  unsigned i, n_fail = 0;
+
+  for( i = 0; i < N_CASES; ++i )
+    n_fail += ! run_case(&cases[i]);
+
+  if( n_fail ) {
+    printf("FAIL: %u of %u cases\n", n_fail, (unsigned) N_CASES);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
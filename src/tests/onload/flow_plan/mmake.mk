@@ -0,0 +1,6 @@
+TARGETS	:= flow_plan
+
+MMAKE_LIBS	:= $(LINK_CIUL_LIB)
+MMAKE_LIB_DEPS	:= $(CIUL_LIB_DEPEND)
+
+include $(TOP)/src/tests/onload/onload_test.mk
@@ -1,4 +1,6 @@
-SUBDIRS	:= wire_order tproxy_preload woda_preload
+SUBDIRS	:= wire_order tproxy_preload woda_preload slow_reader neigh_bench \
+	   cp_revalidate oof_bench syn_flood accept_scale spin_adapt \
+	   filter_storm flow_plan ps_demux udp_filter_bench
 OTHER_SUBDIRS	:= titchy_proxy thttp hwtimestamping
 
 all:
@@ -0,0 +1,302 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* neigh_bench
+ *
+ * Benchmark for the user-level address resolution (ARP) table.  Builds a
+ * private table sized as the driver would size it, fills it with a
+ * synthetic set of neighbours in one subnet, and times cicp_mac_get()
+ * lookups: first on a quiet table, then while another thread updates it
+ * the way the driver does (changing MAC addresses under the row's version
+ * lock, and replacing neighbours with new ones), and then again once the
+ * table has been churned.  "absent" times lookups for entries that are not
+ * in the table, which are what deleted rows slow down.
+ *
+ *   $ neigh_bench -n 20000
+ *   table: 20000 neighbours in 32768 rows (2048 buckets), 0 not inserted
+ *   buckets: 79 full, longest run of full buckets 2, 0 rows deleted
+ *   #phase       lookups    mean_ns   p50_ns   p99_ns  p999_ns   max_ns ...
+ *   quiet        2000000       76.1       76       95      113    12185 ...
+ *   absent       2000000       62.8       62       88      205    28589 ...
+ *   updating     2000000      137.9       75      120      285  4016736 ...
+ *   updates: 5887442
+ *   table: 20000 neighbours in 32768 rows (2048 buckets), 0 not inserted
+ *   buckets: 871 full, longest run of full buckets 8, 4520 rows deleted
+ *   churned      2000000       76.4       75      105      148    66096 ...
+ *   absent       2000000       62.6       62      113      173   302214 ...
+ *
+ * "retry" counts lookups that saw a row mid-update and had to look again,
+ * and "miss" those that found no entry because it was being replaced.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <ci/internal/ip.h>
+#include <ci/internal/cplane_ops.h>
+#include "test_util.h"
+
+
+#define IFINDEX  2
+
+
+static int             cfg_neighbours = 20000;
+static int             cfg_lookups = 2000000;
+static const char*     cfg_subnet = "10.0.0.0";
+
+static cicp_mac_mib_t* mact;
+static ci_ip_addr_t*   neigh_ip;
+static ci_uint32       next_ip;
+static volatile int    stop;
+static ci_uint64       n_updates;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  neigh_bench [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <neighbours>  - number of table entries\n");
+  fprintf(stderr, "  -l <lookups>     - lookups timed in each phase\n");
+  fprintf(stderr, "  -s <addr>        - first neighbour address\n");
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+static cicp_mac_mib_t* mac_mib_alloc(int neighbours)
+{
+  int rows_ln2 = ci_log2_ge(neighbours, 5);
+  int rows = 1 << rows_ln2;
+  cicp_mac_mib_t* t = NULL;
+  int i;
+
+  /* As cicp_mac_mib_ctor() */
+  TRY(-posix_memalign((void**) &t, CI_PAGE_SIZE, CICP_MAC_MIB_SIZE(t, rows)));
+  t->rows_ln2 = rows_ln2;
+  t->tags_ofs = CICP_MAC_MIB_TAGS_OFS(t, rows);
+  memset(cicp_mac_row_tag(t, 0), CICP_MAC_TAG_EMPTY, rows);
+  t->deleted_rows = 0;
+  t->deleted_max = rows >> CICP_MAC_DELETED_COMPACT_LN2;
+  for( i = 0; i < rows; ++i ) {
+    cicp_mac_row_t* row = &t->ipmac[i];
+    memset(row, 0, sizeof(*row));
+    row->version = CI_VERLOCK_INIT_VALID;
+    cicp_mac_row_free(row);
+  }
+  /* This is ipmac[CICP_MAC_MIB_ROW_MOSTLY_VALID], but the compiler would
+   * see that index as out of bounds. */
+  memset(&t->mostly_valid_row, 0, sizeof(t->mostly_valid_row));
+  t->mostly_valid_row.version = CI_VERLOCK_INIT_VALID;
+  return t;
+}
+
+
+static void mac_set(ci_mac_addr_t* mac, int i, unsigned gen)
+{
+  (*mac)[0] = 0x02;
+  (*mac)[1] = gen;
+  (*mac)[2] = i >> 24;
+  (*mac)[3] = i >> 16;
+  (*mac)[4] = i >> 8;
+  (*mac)[5] = i;
+}
+
+
+/* As the driver adds an entry: find it a row, fill it in, then publish. */
+static int neigh_add(int i, unsigned gen)
+{
+  cicp_mac_rowid_t rowid;
+  cicp_mac_row_t* row;
+
+  rowid = _cicp_mac_find_ipunaloc(mact, IFINDEX, neigh_ip[i]);
+  if( rowid == CICP_MAC_ROWID_BAD )
+    return 0;
+  row = &mact->ipmac[rowid];
+  row->ifindex = IFINDEX;
+  row->need_update = 0;
+  row->rc = 0;
+  mac_set(&row->mac_addr, i, gen);
+  CI_IP_ADDR_SET(&row->ip_addr, &neigh_ip[i]);
+  cicp_mac_row_allocate(row);
+  return 1;
+}
+
+
+static void neigh_del(int i)
+{
+  cicp_mac_rowid_t rowid = _cicp_mac_find_ipaloc(mact, IFINDEX, neigh_ip[i]);
+  if( rowid != CICP_MAC_ROWID_BAD )
+    cicp_mac_row_free(&mact->ipmac[rowid]);
+}
+
+
+static void* updater(void* arg)
+{
+  unsigned seed = 1, gen = 0;
+  while( ! stop ) {
+    int i = rand_r(&seed) % cfg_neighbours;
+    ci_verlock_value_t ver;
+    cicp_mac_rowid_t rowid = cicpos_mac_find_ip(mact, IFINDEX, neigh_ip[i],
+                                                &ver);
+    if( rowid == CICP_MAC_ROWID_BAD )
+      continue;
+    if( (++gen & 7) == 0 ) {
+      /* The neighbour goes, and a new one takes its place. */
+      neigh_del(i);
+      neigh_ip[i] = htonl(next_ip++);
+      neigh_add(i, gen);
+    }
+    else {
+      cicp_mac_row_t* row = &mact->ipmac[rowid];
+      CI_VERLOCK_WRITE(row->version, mac_set(&row->mac_addr, i, gen));
+    }
+    ++n_updates;
+  }
+  return NULL;
+}
+
+
+/* Time lookups of random neighbours, or of the same addresses on another
+ * interface, which are not in the table and so go through every bucket
+ * that lookups for them may.
+ */
+static void run_lookups(const char* phase, int absent, uint64_t* cycles)
+{
+  unsigned seed = 2;
+  ci_uint64 t0, t1, sum = 0;
+  unsigned long retries = 0, misses = 0;
+  double ns = 1e6 / ci_cpu_khz;
+  int n, rc;
+
+  for( n = 0; n < cfg_lookups; ++n ) {
+    int i = rand_r(&seed) % cfg_neighbours;
+    cicp_mac_verinfo_t handle;
+    ci_mac_addr_t mac;
+    ci_frc64(&t0);
+    while( (rc = cicp_mac_get(mact, IFINDEX + absent, neigh_ip[i], &mac,
+                              &handle)) == -EAGAIN )
+      ++retries;
+    ci_frc64(&t1);
+    if( rc == -EDESTADDRREQ )
+      ++misses;
+    cycles[n] = t1 - t0;
+    sum += t1 - t0;
+  }
+
+  qsort(cycles, cfg_lookups, sizeof(cycles[0]), cmp_u64);
+  printf("%-9s %10d %10.1f %8.0f %8.0f %8.0f %8.0f %8lu %8lu\n", phase,
+         cfg_lookups, sum * ns / cfg_lookups,
+         sorted_quantile(cycles, cfg_lookups, 500) * ns,
+         sorted_quantile(cycles, cfg_lookups, 990) * ns,
+         sorted_quantile(cycles, cfg_lookups, 999) * ns,
+         cycles[cfg_lookups - 1] * ns, retries, misses);
+}
+
+
+static void table_stats(int failed)
+{
+  int buckets = cicp_mac_mib_buckets(mact);
+  int b, s, full = 0, deleted = 0, run = 0, max_run = 0;
+
+  for( b = 0; b < buckets; ++b ) {
+    const cicp_mac_bucket_t* bucket = cicp_mac_bucket(mact, b);
+    int empty = 0;
+    for( s = 0; s < CICP_MAC_BUCKET_ROWS; ++s ) {
+      empty += bucket->tag[s] == CICP_MAC_TAG_EMPTY;
+      deleted += bucket->tag[s] == CICP_MAC_TAG_DELETED;
+    }
+    if( ! empty ) {
+      ++full;
+      if( ++run > max_run )
+        max_run = run;
+    }
+    else
+      run = 0;
+  }
+  printf("table: %d neighbours in %d rows (%d buckets), %d not inserted\n",
+         cfg_neighbours, cicp_mac_mib_rows(mact), buckets, failed);
+  printf("buckets: %d full, longest run of full buckets %d, %d rows "
+         "deleted\n", full, max_run, deleted);
+  if( deleted != (int) mact->deleted_rows )
+    printf("FAIL: table counts %u rows deleted\n", mact->deleted_rows);
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct in_addr base;
+  pthread_t thread;
+  uint64_t* cycles;
+  unsigned khz;
+  int c, i, failed = 0;
+
+  while( (c = getopt(argc, argv, "n:l:s:")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_neighbours = atoi(optarg);
+      break;
+    case 'l':
+      cfg_lookups = atoi(optarg);
+      break;
+    case 's':
+      cfg_subnet = optarg;
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_neighbours < 1 || cfg_lookups < 1 ||
+      inet_aton(cfg_subnet, &base) == 0 )
+    usage();
+  TRY(ci_get_cpu_khz(&khz));
+
+  mact = mac_mib_alloc(cfg_neighbours);
+  neigh_ip = calloc(cfg_neighbours, sizeof(*neigh_ip));
+  cycles = calloc(cfg_lookups, sizeof(*cycles));
+  for( i = 0; i < cfg_neighbours; ++i ) {
+    neigh_ip[i] = htonl(ntohl(base.s_addr) + 1 + i);
+    failed += ! neigh_add(i, 0);
+  }
+  next_ip = ntohl(base.s_addr) + 1 + cfg_neighbours;
+  table_stats(failed);
+
+  printf("#%-8s %10s %10s %8s %8s %8s %8s %8s %8s\n", "phase", "lookups",
+         "mean_ns", "p50_ns", "p99_ns", "p999_ns", "max_ns", "retry", "miss");
+  run_lookups("quiet", 0, cycles);
+  run_lookups("absent", 1, cycles);
+
+  TRY(-pthread_create(&thread, NULL, updater, NULL));
+  run_lookups("updating", 0, cycles);
+  stop = 1;
+  pthread_join(thread, NULL);
+  printf("updates: %llu\n", (unsigned long long) n_updates);
+
+  /* The updater has replaced many neighbours, but lookups for entries that
+   * are not there should still stop about as soon as they did. */
+  table_stats(failed);
+  run_lookups("churned", 0, cycles);
+  run_lookups("absent", 1, cycles);
+
+  free(cycles);
+  free(neigh_ip);
+  free(mact);
+  return 0;
+}
@@ -0,0 +1,10 @@
+# Common part of the mmake.mk of each test tool below this directory.  The
+# tool's mmake.mk sets TARGETS and any libraries, and then includes this.
+
+MMAKE_INCLUDE	+= -I$(TOP)/src/tests/onload
+MMAKE_LIBS	+= -lpthread
+
+all: $(TARGETS)
+
+clean:
+	@$(MakeClean)
@@ -0,0 +1,12 @@
+TARGETS	:= oof_bench
+
+# The filter manager is kernel code, but is built here against the user-level
+# onload_kernel_compat.h in this directory and the stubs in oof_bench.c.
+IMPORT	:= ../../../lib/efthrm/oof_filters.c
+
+MMAKE_LIBS	:= $(LINK_CITOOLS_LIB)
+MMAKE_LIB_DEPS	:= $(CITOOLS_LIB_DEPEND)
+
+include $(TOP)/src/tests/onload/onload_test.mk
+
+oof_bench: oof_bench.o oof_filters.o
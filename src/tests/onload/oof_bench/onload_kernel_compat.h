@@ -0,0 +1,63 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* User-level stand-in for the driver's onload_kernel_compat.h, so that
+ * oof_filters.c can be built into oof_bench.  oof_bench is single
+ * threaded, so the locks need only record whether they are held, which is
+ * what the filter manager asserts.
+ */
+
+#ifndef __ONLOAD_KERNEL_COMPAT_H__
+#define __ONLOAD_KERNEL_COMPAT_H__
+
+#include <ci/internal/transport_config_opt.h>
+#include <ci/tools.h>
+#include <netinet/in.h>
+#include <linux/capability.h>
+#include <unistd.h>
+#include <errno.h>
+
+
+typedef struct { int locked; } spinlock_t;
+
+#define spin_lock_init(l)     ((l)->locked = 0)
+#define spin_lock_bh(l)       do{ ci_assert(! (l)->locked);             \
+                                  (l)->locked = 1; }while(0)
+#define spin_unlock_bh(l)     do{ ci_assert((l)->locked);               \
+                                  (l)->locked = 0; }while(0)
+#define spin_is_locked(l)     ((l)->locked)
+
+
+struct mutex { int locked; };
+
+#define mutex_init(m)         ((m)->locked = 0)
+#define mutex_destroy(m)      ci_assert(! (m)->locked)
+#define mutex_lock(m)         do{ ci_assert(! (m)->locked);             \
+                                  (m)->locked = 1; }while(0)
+#define mutex_unlock(m)       do{ ci_assert((m)->locked);               \
+                                  (m)->locked = 0; }while(0)
+#define mutex_is_locked(m)    ((m)->locked)
+
+
+#define in_atomic()           0
+#define in_interrupt()        0
+
+#define capable(cap)          1
+#define ci_getgid()           getgid()
+
+#define BUG_ON(x)             ci_assert(! (x))
+
+
+#endif  /* __ONLOAD_KERNEL_COMPAT_H__ */
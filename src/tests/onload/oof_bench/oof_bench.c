@@ -0,0 +1,436 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* oof_bench
+ *
+ * Benchmark for the filter manager (oof_filters.c), which is built into
+ * this program at user level.  The stacks, software filter tables and
+ * hardware filters it calls out to are replaced by stubs that just count
+ * filters, so what is timed is the manager's own bookkeeping.
+ *
+ * Each test adds many sockets and then deletes them again:
+ *
+ *   listen   wild sockets, each on its own port
+ *   connect  full-match sockets, each on its own local port
+ *   accept   full-match sockets sharing one listening socket's filter
+ *   reuse    wild sockets all bound to one port, spread over many stacks
+ *            (-s sockets per stack)
+ *
+ *   $ oof_bench -n 100000
+ *   #test        sockets   add_ns   del_ns  sw_left  hw_left
+ *   listen        100000     2544     1271        0        0
+ *   connect       100000     1365      350        0        0
+ *   accept        100000       53       50        0        0
+ *   reuse         100000     1070     1025        0        0
+ *
+ * "sw_left" and "hw_left" are the software and hardware filters still
+ * installed after the deletes, and should be zero.  filter_storm times
+ * the calls into the driver that set these filters.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <ci/tools.h>
+#include <ci/internal/transport_config_opt.h>
+#include <onload/oof_hw_filter.h>
+#include <onload/oof_socket.h>
+#include <onload/oof_interface.h>
+#include <onload/debug.h>
+#include "test_util.h"
+#include "oo_hw_filter.h"
+
+
+#define IFINDEX  2
+#define HWPORT   0
+#define LOCAL_ADDR_MAX  50
+
+
+static int             cfg_sockets = 100000;
+static int             cfg_socks_per_stack = 1;
+static const char*     cfg_test;
+
+
+/* What the manager needs from the rest of the driver. */
+int oo_debug_bits = __OO_DEBUGERR__;
+int scalable_filter_gid = -1;
+
+
+/**********************************************************************
+ * Stand-ins for stacks, endpoints and filters.
+ */
+
+struct tcp_helper_resource_s {
+  int id;
+};
+
+struct bench_sock {
+  struct oof_socket             skf;
+  struct tcp_helper_resource_s* stack;
+  int                           id;
+};
+
+static struct oof_manager*           fm;
+static struct tcp_helper_resource_s* stacks;
+static struct bench_sock*            socks;
+static long                          sw_filters;
+static long                          hw_filters;
+
+
+#define skf_to_bs(skf)  CI_CONTAINER(struct bench_sock, skf, (skf))
+
+
+struct tcp_helper_resource_s* oof_cb_socket_stack(struct oof_socket* skf)
+{
+  return skf_to_bs(skf)->stack;
+}
+
+struct tcp_helper_cluster_s*
+oof_cb_stack_thc(struct tcp_helper_resource_s* skf_stack)
+{
+  return NULL;
+}
+
+const char* oof_cb_thc_name(struct tcp_helper_cluster_s* thc)
+{
+  return "";
+}
+
+int oof_cb_socket_id(struct oof_socket* skf)
+{
+  return skf_to_bs(skf)->id;
+}
+
+int oof_cb_stack_id(struct tcp_helper_resource_s* stack)
+{
+  return stack == NULL ? -1 : stack->id;
+}
+
+void oof_cb_callback_set_filter(struct oof_socket* skf)
+{
+}
+
+int oof_cb_sw_filter_insert(struct oof_socket* skf, unsigned laddr, int lport,
+                            unsigned raddr, int rport, int protocol,
+                            int stack_locked)
+{
+  ++sw_filters;
+  return 0;
+}
+
+void oof_cb_sw_filter_remove(struct oof_socket* skf, unsigned laddr, int lport,
+                             unsigned raddr, int rport, int protocol,
+                             int stack_locked)
+{
+  --sw_filters;
+}
+
+void oof_dl_filter_set(struct oo_hw_filter* filter, int stack_id, int protocol,
+                       unsigned saddr, int sport, unsigned daddr, int dport)
+{
+}
+
+void oof_dl_filter_del(struct oo_hw_filter* filter)
+{
+}
+
+int oof_cb_get_hwport_mask(int ifindex, unsigned* hwport_mask)
+{
+  *hwport_mask = 1u << HWPORT;
+  return 0;
+}
+
+int oof_cb_get_vlan_id(int ifindex, unsigned short* vlan_id)
+{
+  *vlan_id = 0;
+  return 0;
+}
+
+int oof_cb_get_mac(int ifindex, unsigned char out_mac[6])
+{
+  memset(out_mac, 0, 6);
+  return 0;
+}
+
+void oof_cb_defer_work(void* owner_private)
+{
+  /* Run by the caller once it has finished changing the control plane. */
+}
+
+
+void oo_hw_filter_init2(struct oo_hw_filter* oofilter,
+                        struct tcp_helper_resource_s* trs,
+                        struct tcp_helper_cluster_s* thc)
+{
+  int i;
+  oofilter->trs = trs;
+  oofilter->thc = thc;
+  oofilter->dlfilter_handle = 0;
+  for( i = 0; i < CI_CFG_MAX_REGISTER_INTERFACES; ++i )
+    oofilter->filter_id[i] = -1;
+}
+
+void oo_hw_filter_init(struct oo_hw_filter* oofilter)
+{
+  oo_hw_filter_init2(oofilter, NULL, NULL);
+}
+
+void oo_hw_filter_clear_hwports(struct oo_hw_filter* oofilter,
+                                unsigned hwport_mask, int redirect)
+{
+  int i;
+  for( i = 0; i < CI_CFG_MAX_REGISTER_INTERFACES; ++i )
+    if( (hwport_mask & (1u << i)) && oofilter->filter_id[i] >= 0 ) {
+      oofilter->filter_id[i] = -1;
+      --hw_filters;
+    }
+}
+
+void oo_hw_filter_clear(struct oo_hw_filter* oofilter)
+{
+  oo_hw_filter_clear_hwports(oofilter, -1, 0);
+  oofilter->trs = NULL;
+  oofilter->thc = NULL;
+}
+
+int oo_hw_filter_add_hwports(struct oo_hw_filter* oofilter,
+                             const struct oo_hw_filter_spec* oo_filter_spec,
+                             unsigned set_vlan_mask, unsigned hwport_mask,
+                             unsigned drop_hwport_mask, unsigned src_flags)
+{
+  int i;
+  for( i = 0; i < CI_CFG_MAX_REGISTER_INTERFACES; ++i )
+    if( (hwport_mask & (1u << i)) && oofilter->filter_id[i] < 0 ) {
+      oofilter->filter_id[i] = i;
+      ++hw_filters;
+    }
+  return 0;
+}
+
+int oo_hw_filter_set(struct oo_hw_filter* oofilter,
+                     const struct oo_hw_filter_spec* oo_filter_spec,
+                     unsigned set_vlan_mask, unsigned hwport_mask,
+                     unsigned drop_hwport_mask, unsigned src_flags)
+{
+  return oo_hw_filter_add_hwports(oofilter, oo_filter_spec, set_vlan_mask,
+                                  hwport_mask, drop_hwport_mask, src_flags);
+}
+
+int oo_hw_filter_update(struct oo_hw_filter* oofilter,
+                        struct tcp_helper_resource_s* new_stack,
+                        const struct oo_hw_filter_spec* oo_filter_spec,
+                        unsigned set_vlan_mask, unsigned hwport_mask,
+                        unsigned drop_hwport_mask, unsigned src_flags)
+{
+  if( new_stack != NULL )
+    oofilter->trs = new_stack;
+  oo_hw_filter_clear_hwports(oofilter, ~hwport_mask, 0);
+  return oo_hw_filter_add_hwports(oofilter, oo_filter_spec, set_vlan_mask,
+                                  hwport_mask, drop_hwport_mask, src_flags);
+}
+
+void oo_hw_filter_transfer(struct oo_hw_filter* oofilter_old,
+                           struct oo_hw_filter* oofilter_new,
+                           unsigned hwport_mask)
+{
+  int i;
+  for( i = 0; i < CI_CFG_MAX_REGISTER_INTERFACES; ++i )
+    if( (hwport_mask & (1u << i)) && oofilter_old->filter_id[i] >= 0 ) {
+      oofilter_new->filter_id[i] = oofilter_old->filter_id[i];
+      oofilter_old->filter_id[i] = -1;
+    }
+}
+
+unsigned oo_hw_filter_hwports(struct oo_hw_filter* oofilter)
+{
+  unsigned hwports = 0;
+  int i;
+  for( i = 0; i < CI_CFG_MAX_REGISTER_INTERFACES; ++i )
+    if( oofilter->filter_id[i] >= 0 )
+      hwports |= 1u << i;
+  return hwports;
+}
+
+
+/**********************************************************************
+ * The tests.
+ */
+
+static unsigned laddr, raddr;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  oof_bench [options] [test]\n");
+  fprintf(stderr, "\ntests:\n");
+  fprintf(stderr, "  listen connect accept reuse (default: all)\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <sockets>     - number of sockets in each test\n");
+  fprintf(stderr, "  -s <sockets>     - sockets per stack in 'reuse'\n");
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+/* Spread sockets over both protocols so that more of them than there are
+ * port numbers can each have a port of their own.
+ */
+static int sock_protocol(int i)
+{
+  return (i & 1) ? IPPROTO_UDP : IPPROTO_TCP;
+}
+
+static int sock_port(int i)
+{
+  return htons(1024 + i / 2);
+}
+
+
+static void add_listen(int i)
+{
+  TRY(oof_socket_add(fm, &socks[i].skf, 0, sock_protocol(i), 0,
+                     sock_port(i), 0, 0, NULL));
+}
+
+static void add_connect(int i)
+{
+  TRY(oof_socket_add(fm, &socks[i].skf, 0, sock_protocol(i), laddr,
+                     sock_port(i), raddr, htons(80), NULL));
+}
+
+static void add_accept(int i)
+{
+  TRY(oof_socket_add(fm, &socks[i].skf, 0, IPPROTO_TCP, laddr, htons(80),
+                     htonl(ntohl(raddr) + i / 50000), htons(1024 + i % 50000),
+                     NULL));
+}
+
+static void add_reuse(int i)
+{
+  TRY(oof_socket_add(fm, &socks[i].skf, 0, IPPROTO_UDP, 0, htons(5000),
+                     0, 0, NULL));
+}
+
+
+/* The sockets are added and deleted twice, and only the second round is
+ * timed, so that memory the manager allocates for the first is not charged
+ * to whichever test runs first.
+ */
+static void run_test(const char* name, void (*add)(int),
+                     int stacks_n, int listener)
+{
+  struct bench_sock listen_sock;
+  ci_uint64 t0, t1, t2;
+  double ns = 1e6 / ci_cpu_khz;
+  int i, round;
+
+  if( cfg_test != NULL && strcmp(cfg_test, name) )
+    return;
+
+  if( listener ) {
+    oof_socket_ctor(&listen_sock.skf);
+    listen_sock.stack = &stacks[0];
+    listen_sock.id = cfg_sockets;
+    TRY(oof_socket_add(fm, &listen_sock.skf, 0, IPPROTO_TCP, 0, htons(80),
+                       0, 0, NULL));
+  }
+
+  for( round = 0; round < 2; ++round ) {
+    for( i = 0; i < cfg_sockets; ++i ) {
+      oof_socket_ctor(&socks[i].skf);
+      socks[i].stack = &stacks[i / (cfg_sockets / stacks_n)];
+      socks[i].id = i;
+    }
+    ci_frc64(&t0);
+    for( i = 0; i < cfg_sockets; ++i )
+      add(i);
+    ci_frc64(&t1);
+    for( i = 0; i < cfg_sockets; ++i )
+      oof_socket_del(fm, &socks[i].skf);
+    ci_frc64(&t2);
+    for( i = 0; i < cfg_sockets; ++i )
+      oof_socket_dtor(&socks[i].skf);
+  }
+
+  if( listener )
+    oof_socket_del(fm, &listen_sock.skf);
+
+  printf("%-9s %10d %8.0f %8.0f %8ld %8ld\n", name, cfg_sockets,
+         (t1 - t0) * ns / cfg_sockets, (t2 - t1) * ns / cfg_sockets,
+         sw_filters, hw_filters);
+}
+
+
+int main(int argc, char* argv[])
+{
+  unsigned khz;
+  int c, i;
+
+  while( (c = getopt(argc, argv, "n:s:")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_sockets = atoi(optarg);
+      break;
+    case 's':
+      cfg_socks_per_stack = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind < argc )
+    cfg_test = argv[optind++];
+  if( optind != argc || cfg_sockets < 1 || cfg_sockets > 131072 ||
+      cfg_socks_per_stack < 1 || cfg_socks_per_stack > cfg_sockets )
+    usage();
+  TRY(ci_get_cpu_khz(&khz));
+
+  stacks = calloc(cfg_sockets, sizeof(*stacks));
+  socks = calloc(cfg_sockets, sizeof(*socks));
+  for( i = 0; i < cfg_sockets; ++i )
+    stacks[i].id = i;
+
+  /* One interface with one local address, as the driver would set up. */
+  laddr = inet_addr("192.168.0.1");
+  raddr = inet_addr("192.168.1.1");
+  fm = oof_manager_alloc(LOCAL_ADDR_MAX, NULL);
+  if( fm == NULL ) {
+    fprintf(stderr, "ERROR: oof_manager_alloc failed\n");
+    exit(1);
+  }
+  oof_hwport_up_down(HWPORT, 1, 0, 0, 1);
+  oof_manager_addr_add(fm, laddr, IFINDEX);
+  oof_do_deferred_work(fm);
+
+  printf("#%-8s %10s %8s %8s %8s %8s\n", "test", "sockets", "add_ns",
+         "del_ns", "sw_left", "hw_left");
+  run_test("listen", add_listen, 1, 0);
+  run_test("connect", add_connect, 1, 0);
+  run_test("accept", add_accept, 1, 1);
+  run_test("reuse", add_reuse, cfg_sockets / cfg_socks_per_stack, 0);
+
+  oof_manager_addr_del(fm, laddr, IFINDEX);
+  oof_do_deferred_work(fm);
+  oof_manager_free(fm);
+  free(socks);
+  free(stacks);
+  return 0;
+}
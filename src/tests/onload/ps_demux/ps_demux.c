@@ -0,0 +1,281 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* ps_demux
+ *
+ * Test of packed-stream demultiplexing with a synthetic packed stream.
+ * We lay out frames in memory as the adapter would, each behind its
+ * ef_packed_stream_packet metadata, dispatch them with
+ * ef_packed_stream_demux_dispatch() and check which flow each one reached
+ * and the per-flow counters.  No adapter is needed.
+ *
+ * The frames cover exact and wildcard flows, VLAN tags, fragments,
+ * non-IPv4 frames, IP options, bad header lengths and truncated captures.
+ *
+ *   $ ps_demux
+ *   PASS
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <etherfabric/vi.h>
+#include <etherfabric/packedstream.h>
+
+
+#define PS_ALIGN     64
+#define PS_BUF_SIZE  (64 * 1024)
+#define MAX_FLOWS    4
+
+#define HOST_A       0x0a000001  /* 10.0.0.1 */
+#define HOST_B       0x0a000002  /* 10.0.0.2 */
+#define HOST_C       0x0a000009  /* 10.0.0.9 */
+
+#define DEFAULT      -1
+
+
+/* The flows, in the order they are added.  Flow ids are their indexes.
+ * Addresses and ports are in host order here. */
+static const ef_packed_stream_flow_key flows[MAX_FLOWS] = {
+  /* exact UDP A:1000 -> B:2000 */
+  { HOST_A, HOST_B, 1000, 2000, IPPROTO_UDP },
+  /* TCP to B:80 */
+  { 0, HOST_B, 0, 80, IPPROTO_TCP },
+  /* any UDP to B */
+  { 0, HOST_B, 0, 0, IPPROTO_UDP },
+  /* anything from C */
+  { HOST_C, 0, 0, 0, 0 },
+};
+
+
+struct frame {
+  const char* name;
+  unsigned    ethertype;
+  int         vlan;
+  int         version;
+  int         ihl;        /* in 32-bit words */
+  int         frag;       /* fragment offset, in 8-byte units */
+  int         protocol;
+  uint32_t    saddr, daddr;
+  uint16_t    sport, dport;
+  int         cap_len;    /* 0 for the whole frame */
+  int         expect;     /* flow id, or DEFAULT */
+};
+
+#define UDP_AB(sport)                                                   \
+  0x0800, 0, 4, 5, 0, IPPROTO_UDP, HOST_A, HOST_B, (sport), 2000
+
+static const struct frame frames[] = {
+  { "exact flow", UDP_AB(1000), 0, 0 },
+  { "exact flow, source port differs", UDP_AB(1001), 0, 2 },
+  { "exact flow with VLAN tag",
+    0x0800, 1, 4, 5, 0, IPPROTO_UDP, HOST_A, HOST_B, 1000, 2000, 0, 0 },
+  { "exact flow with IP options",
+    0x0800, 0, 4, 6, 0, IPPROTO_UDP, HOST_A, HOST_B, 1000, 2000, 0, 0 },
+  { "later fragment has no ports",
+    0x0800, 0, 4, 5, 8, IPPROTO_UDP, HOST_A, HOST_B, 1000, 2000, 0, 2 },
+  { "TCP wildcard",
+    0x0800, 0, 4, 5, 0, IPPROTO_TCP, HOST_A, HOST_B, 5000, 80, 0, 1 },
+  { "TCP to another port",
+    0x0800, 0, 4, 5, 0, IPPROTO_TCP, HOST_A, HOST_B, 5000, 81, 0, DEFAULT },
+  { "any protocol wildcard",
+    0x0800, 0, 4, 5, 0, IPPROTO_ICMP, HOST_C, HOST_B, 0, 0, 0, 3 },
+  { "not IP",
+    0x0806, 0, 4, 5, 0, IPPROTO_UDP, HOST_A, HOST_B, 1000, 2000, 0, DEFAULT },
+  { "not IPv4",
+    0x0800, 0, 6, 5, 0, IPPROTO_UDP, HOST_A, HOST_B, 1000, 2000, 0, DEFAULT },
+  /* The ports would be read from the addresses, which would match flow 2. */
+  { "header length too small",
+    0x0800, 0, 4, 4, 0, IPPROTO_UDP, HOST_A, HOST_B, 1000, 2000, 0, DEFAULT },
+  { "header length zero",
+    0x0800, 0, 4, 0, 0, IPPROTO_UDP, HOST_A, HOST_B, 1000, 2000, 0, DEFAULT },
+  { "truncated before addresses",
+    0x0800, 0, 4, 5, 0, IPPROTO_UDP, HOST_A, HOST_B, 1000, 2000, 30, DEFAULT },
+  { "truncated before ports",
+    0x0800, 0, 4, 5, 0, IPPROTO_UDP, HOST_A, HOST_B, 1000, 2000, 36, 2 },
+};
+#define N_FRAMES  (sizeof(frames) / sizeof(frames[0]))
+
+
+static int got[N_FRAMES];
+static int n_got;
+
+
+static void on_pkt(void* arg, int flow_id, ef_packed_stream_packet* ps_pkt)
+{
+  if( n_got < (int) N_FRAMES )
+    got[n_got] = flow_id;
+  ++n_got;
+}
+
+
+/* Write [f] into [p] as an Ethernet frame, and return its length. */
+static int build_frame(uint8_t* p, const struct frame* f)
+{
+  int off = 14, ihl_bytes, l4, i;
+
+  memset(p, 0, 128);
+  if( f->vlan ) {
+    p[12] = 0x81;
+    p[13] = 0x00;
+    p[15] = 5;
+    off += 4;
+  }
+  p[off - 2] = f->ethertype >> 8;
+  p[off - 1] = f->ethertype & 0xff;
+  p[off] = f->version << 4 | f->ihl;
+  p[off + 6] = f->frag >> 8;
+  p[off + 7] = f->frag & 0xff;
+  p[off + 8] = 64;
+  p[off + 9] = f->protocol;
+  for( i = 0; i < 4; ++i ) {
+    p[off + 12 + i] = f->saddr >> (24 - 8 * i);
+    p[off + 16 + i] = f->daddr >> (24 - 8 * i);
+  }
+  /* With a bad header length the ports follow the addresses. */
+  ihl_bytes = f->ihl * 4;
+  l4 = off + (ihl_bytes < 20 ? 20 : ihl_bytes);
+  p[l4] = f->sport >> 8;
+  p[l4 + 1] = f->sport & 0xff;
+  p[l4 + 2] = f->dport >> 8;
+  p[l4 + 3] = f->dport & 0xff;
+  return l4 + 8 + 18;
+}
+
+
+/* Lay out the frames in [buf] as a packed stream, and return the end of
+ * the stream. */
+static ef_packed_stream_packet* build_stream(char* buf, unsigned* bytes)
+{
+  ef_packed_stream_packet* ps_pkt = (void*) buf;
+  int i, len;
+
+  for( i = 0; i < (int) N_FRAMES; ++i ) {
+    memset(ps_pkt, 0, sizeof(*ps_pkt));
+    ps_pkt->ps_pkt_start_offset = sizeof(*ps_pkt);
+    len = build_frame(ef_packed_stream_packet_payload(ps_pkt), &frames[i]);
+    ps_pkt->ps_orig_len = len;
+    ps_pkt->ps_cap_len = frames[i].cap_len ? frames[i].cap_len : len;
+    ps_pkt->ps_next_offset =
+      (sizeof(*ps_pkt) + len + PS_ALIGN - 1) & ~(PS_ALIGN - 1);
+    bytes[frames[i].expect + 1] += ps_pkt->ps_cap_len;
+    ps_pkt = ef_packed_stream_packet_next(ps_pkt);
+  }
+  return ps_pkt;
+}
+
+
+static void key_to_be(ef_packed_stream_flow_key* key)
+{
+  key->psfk_saddr_be32 = htonl(key->psfk_saddr_be32);
+  key->psfk_daddr_be32 = htonl(key->psfk_daddr_be32);
+  key->psfk_sport_be16 = htons(key->psfk_sport_be16);
+  key->psfk_dport_be16 = htons(key->psfk_dport_be16);
+}
+
+
+int main(int argc, char* argv[])
+{
+  unsigned exp_bytes[MAX_FLOWS + 1] = { 0 };
+  uint64_t exp_pkts[MAX_FLOWS + 1] = { 0 };
+  ef_packed_stream_flow_key keys[MAX_FLOWS], extra;
+  ef_packed_stream_demux demux;
+  ef_packed_stream_packet* end;
+  uint64_t n_pkts, n_bytes;
+  char* buf;
+  void* mem;
+  int i, rc, n_fail = 0;
+
+  if( posix_memalign((void**) &buf, PS_ALIGN, PS_BUF_SIZE) != 0 ||
+      posix_memalign(&mem, 8,
+                     ef_packed_stream_demux_calc_bytes(MAX_FLOWS)) != 0 ) {
+    printf("FAIL: out of memory\n");
+    return 1;
+  }
+  memset(buf, 0, PS_BUF_SIZE);
+  end = build_stream(buf, exp_bytes);
+
+  if( ef_packed_stream_demux_init(&demux, mem, MAX_FLOWS, on_pkt, NULL)
+      != 0 ) {
+    printf("FAIL: ef_packed_stream_demux_init\n");
+    return 1;
+  }
+  for( i = 0; i < MAX_FLOWS; ++i ) {
+    keys[i] = flows[i];
+    key_to_be(&keys[i]);
+    if( (rc = ef_packed_stream_demux_add(&demux, &keys[i], on_pkt, NULL))
+        != i ) {
+      printf("FAIL: flow %d added as %d\n", i, rc);
+      return 1;
+    }
+  }
+  if( (rc = ef_packed_stream_demux_add(&demux, &keys[0], on_pkt, NULL))
+      != -EEXIST ) {
+    printf("FAIL: duplicate flow gave %d, expected %d\n", rc, -EEXIST);
+    ++n_fail;
+  }
+  extra = flows[0];
+  extra.psfk_dport_be16 = 2001;
+  key_to_be(&extra);
+  if( (rc = ef_packed_stream_demux_add(&demux, &extra, on_pkt, NULL))
+      != -ENOSPC ) {
+    printf("FAIL: flow beyond max gave %d, expected %d\n", rc, -ENOSPC);
+    ++n_fail;
+  }
+
+  if( ef_packed_stream_demux_dispatch(&demux, (void*) buf, N_FRAMES)
+      != end ) {
+    printf("FAIL: dispatch did not return the end of the stream\n");
+    ++n_fail;
+  }
+  if( n_got != (int) N_FRAMES ) {
+    printf("FAIL: %d packets dispatched, expected %d\n", n_got,
+           (int) N_FRAMES);
+    return 1;
+  }
+  for( i = 0; i < (int) N_FRAMES; ++i ) {
+    ++exp_pkts[frames[i].expect + 1];
+    if( got[i] != frames[i].expect ) {
+      printf("FAIL: %s: flow %d, expected %d\n", frames[i].name, got[i],
+             frames[i].expect);
+      ++n_fail;
+    }
+  }
+  for( i = DEFAULT; i < MAX_FLOWS; ++i ) {
+    ef_packed_stream_demux_get_stats(&demux, i, &n_pkts, &n_bytes);
+    if( n_pkts != exp_pkts[i + 1] || n_bytes != exp_bytes[i + 1] ) {
+      printf("FAIL: flow %d counted %llu packets %llu bytes, expected "
+             "%llu %u\n", i, (unsigned long long) n_pkts,
+             (unsigned long long) n_bytes,
+             (unsigned long long) exp_pkts[i + 1], exp_bytes[i + 1]);
+      ++n_fail;
+    }
+  }
+
+  free(mem);
+  free(buf);
+  if( n_fail ) {
+    printf("FAIL: %d checks\n", n_fail);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,336 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* slow_reader
+ *
+ * Stress test for packet buffer memory pressure.  Opens several TCP
+ * connections to itself and streams timestamped messages over each.  One
+ * receiver reads slowly, so its receive queue grows until the stack runs
+ * short of packet buffers.  The others read as fast as they can, and we
+ * report their throughput and latency: with per-socket quotas the slow
+ * reader should be penalised rather than everyone else.
+ *
+ * The slow connection's sender runs flat out.  The others are paced (-r)
+ * so that their latency reflects the stack rather than their own queues.
+ *
+ * Run it in a single stack with loopback acceleration enabled, and with a
+ * packet buffer limit small enough to reach:
+ *
+ *   EF_TCP_CLIENT_LOOPBACK=1 EF_TCP_SERVER_LOOPBACK=1 EF_MAX_PACKETS=8192 \
+ *   EF_RX_PKT_QUOTA=512 onload ./slow_reader
+ *
+ * and compare the results with EF_RX_PKT_QUOTA=0.
+ *
+ * Under Onload it then checks the stack's counters.  With a quota, the
+ * stack must have entered memory pressure, and dropped or reclaimed
+ * buffers of sockets over the quota.  Without one, the quota counters must
+ * not move.  It prints PASS or FAIL.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <ci/internal/ip.h>
+#include <onload/extensions.h>
+#include "test_util.h"
+
+
+#define MAX_CONNS    64
+#define MSG_MAX      65536
+
+
+struct conn {
+  pthread_t tx_thread;
+  pthread_t rx_thread;
+  int       tx_sock;
+  int       rx_sock;
+  int       slow;
+  uint64_t  rx_bytes;
+  uint64_t  rx_msgs;
+  uint64_t  lat_sum;
+  uint64_t  lat_max;
+  uint64_t  lat_hist[LAT_HIST_BUCKETS];
+};
+
+
+static int             cfg_conns = 4;
+static int             cfg_msg_size = 1024;
+static int             cfg_slow_usec = 10000;
+static int             cfg_seconds = 10;
+static int             cfg_rate = 10000;
+static const char*     cfg_addr = "127.0.0.1";
+static int             cfg_port = 8123;
+
+static volatile int    stop;
+
+static ci_netif        ni;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  slow_reader [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <conns>  - number of connections (first is slow)\n");
+  fprintf(stderr, "  -s <bytes>  - message size\n");
+  fprintf(stderr, "  -u <usec>   - slow reader's sleep between reads\n");
+  fprintf(stderr, "  -t <secs>   - duration\n");
+  fprintf(stderr, "  -r <rate>   - messages/sec per fast connection "
+          "(0 for unlimited)\n");
+  fprintf(stderr, "  -a <addr>   - local address to connect to\n");
+  fprintf(stderr, "  -p <port>   - port\n");
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+static void* tx_thread(void* arg)
+{
+  struct conn* c = arg;
+  char* buf = calloc(1, cfg_msg_size);
+  uint64_t ts, next = now_ns();
+  uint64_t gap = (c->slow || cfg_rate == 0) ? 0 : 1000000000ull / cfg_rate;
+  int rc, n;
+
+  while( ! stop ) {
+    while( (ts = now_ns()) < next && ! stop )
+      ;
+    next += gap;
+    memcpy(buf, &ts, sizeof(ts));
+    for( n = 0; n < cfg_msg_size; n += rc )
+      if( (rc = send(c->tx_sock, buf + n, cfg_msg_size - n,
+                     MSG_NOSIGNAL)) <= 0 )
+        goto out;
+  }
+ out:
+  free(buf);
+  return NULL;
+}
+
+
+static void* rx_thread(void* arg)
+{
+  struct conn* c = arg;
+  char* buf = malloc(MSG_MAX);
+  uint64_t ts, lat;
+  int rc;
+
+  while( ! stop ) {
+    if( c->slow ) {
+      usleep(cfg_slow_usec);
+      if( (rc = recv(c->rx_sock, buf, cfg_msg_size, 0)) <= 0 )
+        break;
+      c->rx_bytes += rc;
+      continue;
+    }
+    if( (rc = recv(c->rx_sock, buf, cfg_msg_size, MSG_WAITALL)) <= 0 )
+      break;
+    c->rx_bytes += rc;
+    if( rc < cfg_msg_size )
+      continue;
+    memcpy(&ts, buf, sizeof(ts));
+    lat = now_ns() - ts;
+    ++c->rx_msgs;
+    c->lat_sum += lat;
+    if( lat > c->lat_max )
+      c->lat_max = lat;
+    lat_hist_add(c->lat_hist, lat);
+  }
+  free(buf);
+  return NULL;
+}
+
+
+static void connect_pair(int lsock, const struct sockaddr_in* sa,
+                         struct conn* c)
+{
+  int one = 1;
+
+  TRY(c->tx_sock = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(connect(c->tx_sock, (const struct sockaddr*) sa, sizeof(*sa)));
+  TRY(c->rx_sock = accept(lsock, NULL, NULL));
+  TRY(setsockopt(c->tx_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)));
+}
+
+
+/* Finds the stack of [sock], or returns 0 if it is not accelerated. */
+static int stack_attach(int sock)
+{
+  struct onload_stat stat;
+
+  if( onload_fd_stat(sock, &stat) <= 0 )
+    return 0;
+  free(stat.stack_name);
+  TRY(ci_netif_restore_id(&ni, stat.stack_id));
+  return 1;
+}
+
+
+/* Checks the counters moved by the run, from [before] to [after]. */
+static int check_stats(const ci_netif_stats* before,
+                       const ci_netif_stats* after)
+{
+  unsigned enter, drops, reclaimed;
+  int quota = NI_OPTS(&ni).rx_pkt_quota;
+
+  enter = after->memory_pressure_enter - before->memory_pressure_enter;
+  drops = after->rx_pkt_quota_drops - before->rx_pkt_quota_drops;
+  reclaimed = after->rx_pkt_quota_reclaimed - before->rx_pkt_quota_reclaimed;
+  printf("# EF_RX_PKT_QUOTA=%d memory_pressure_enter=%u "
+         "rx_pkt_quota_drops=%u rx_pkt_quota_reclaimed=%u\n",
+         quota, enter, drops, reclaimed);
+
+  if( quota == 0 ) {
+    if( drops != 0 || reclaimed != 0 ) {
+      printf("FAIL: quota counters moved without a quota\n");
+      return 0;
+    }
+  }
+  else if( enter == 0 ) {
+    printf("FAIL: memory pressure not reached; lower EF_MAX_PACKETS\n");
+    return 0;
+  }
+  else if( drops == 0 && reclaimed == 0 ) {
+    printf("FAIL: no buffers dropped or reclaimed over the quota\n");
+    return 0;
+  }
+  printf("PASS\n");
+  return 1;
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct conn* conns;
+  struct sockaddr_in sa;
+  uint64_t hist[LAT_HIST_BUCKETS];
+  uint64_t n_msgs = 0, bytes = 0, lat_sum = 0, lat_max = 0;
+  ci_netif_stats before;
+  int c, i, b, lsock, one = 1, onload, ok = 1;
+
+  while( (c = getopt(argc, argv, "n:s:u:t:r:a:p:")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_conns = atoi(optarg);
+      break;
+    case 's':
+      cfg_msg_size = atoi(optarg);
+      break;
+    case 'u':
+      cfg_slow_usec = atoi(optarg);
+      break;
+    case 't':
+      cfg_seconds = atoi(optarg);
+      break;
+    case 'r':
+      cfg_rate = atoi(optarg);
+      break;
+    case 'a':
+      cfg_addr = optarg;
+      break;
+    case 'p':
+      cfg_port = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_conns < 2 || cfg_conns > MAX_CONNS ||
+      cfg_msg_size < (int) sizeof(uint64_t) || cfg_msg_size > MSG_MAX )
+    usage();
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(cfg_port);
+  if( inet_aton(cfg_addr, &sa.sin_addr) == 0 )
+    usage();
+
+  TRY(lsock = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  TRY(bind(lsock, (struct sockaddr*) &sa, sizeof(sa)));
+  TRY(listen(lsock, cfg_conns));
+
+  conns = calloc(cfg_conns, sizeof(*conns));
+  for( i = 0; i < cfg_conns; ++i ) {
+    connect_pair(lsock, &sa, &conns[i]);
+    conns[i].slow = (i == 0);
+  }
+  if( (onload = stack_attach(conns[0].rx_sock)) )
+    before = ni.state->stats;
+  for( i = 0; i < cfg_conns; ++i ) {
+    TRY(-pthread_create(&conns[i].rx_thread, NULL, rx_thread, &conns[i]));
+    TRY(-pthread_create(&conns[i].tx_thread, NULL, tx_thread, &conns[i]));
+  }
+
+  sleep(cfg_seconds);
+  stop = 1;
+  for( i = 0; i < cfg_conns; ++i ) {
+    shutdown(conns[i].tx_sock, SHUT_RDWR);
+    shutdown(conns[i].rx_sock, SHUT_RDWR);
+    pthread_join(conns[i].tx_thread, NULL);
+    pthread_join(conns[i].rx_thread, NULL);
+  }
+
+  memset(hist, 0, sizeof(hist));
+  printf("#%-5s %12s %10s %10s %10s\n",
+         "conn", "MB/s", "mean_us", "p99_us", "max_us");
+  for( i = 0; i < cfg_conns; ++i ) {
+    struct conn* co = &conns[i];
+    if( co->slow ) {
+      printf("%-6s %12.2f %10s %10s %10s\n", "slow",
+             co->rx_bytes / 1e6 / cfg_seconds, "-", "-", "-");
+      continue;
+    }
+    printf("%-6d %12.2f %10.1f %10.1f %10.1f\n", i,
+           co->rx_bytes / 1e6 / cfg_seconds,
+           co->rx_msgs ? co->lat_sum / 1e3 / co->rx_msgs : 0.0,
+           lat_hist_percentile(co->lat_hist, co->rx_msgs, 99,
+                               co->lat_max) / 1e3,
+           co->lat_max / 1e3);
+    n_msgs += co->rx_msgs;
+    bytes += co->rx_bytes;
+    lat_sum += co->lat_sum;
+    if( co->lat_max > lat_max )
+      lat_max = co->lat_max;
+    for( b = 0; b < LAT_HIST_BUCKETS; ++b )
+      hist[b] += co->lat_hist[b];
+  }
+  printf("%-6s %12.2f %10.1f %10.1f %10.1f\n", "fast",
+         bytes / 1e6 / cfg_seconds, n_msgs ? lat_sum / 1e3 / n_msgs : 0.0,
+         lat_hist_percentile(hist, n_msgs, 99, lat_max) / 1e3, lat_max / 1e3);
+
+  if( onload )
+    ok = check_stats(&before, &ni.state->stats);
+  else
+    printf("# not accelerated: stack counters not checked\n");
+
+  for( i = 0; i < cfg_conns; ++i ) {
+    close(conns[i].tx_sock);
+    close(conns[i].rx_sock);
+  }
+  close(lsock);
+  free(conns);
+  return ok ? 0 : 1;
+}
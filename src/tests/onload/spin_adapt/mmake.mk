@@ -0,0 +1,5 @@
+TARGETS	:= spin_adapt
+
+MMAKE_LIBS	:= -lm
+
+include $(TOP)/src/tests/onload/onload_test.mk
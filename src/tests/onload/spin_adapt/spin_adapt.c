@@ -0,0 +1,305 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* spin_adapt
+ *
+ * Synthetic arrival patterns over loopback, for looking at how spinning
+ * policy trades receive latency against CPU.  A sender thread sends
+ * timestamped messages with gaps drawn from the chosen pattern, and a
+ * receiver thread waits for them with recv() or epoll_wait().  We report
+ * the latency from send to receive, and the CPU time used by the receiver
+ * as a share of the run.
+ *
+ * Patterns (-P):
+ *   fixed:<us>               a message every <us>
+ *   poisson:<us>             exponential gaps with mean <us>
+ *   burst:<n>:<us>:<idle_us> bursts of <n> messages <us> apart, separated
+ *                            by <idle_us>
+ *
+ * Compare the fixed and adaptive policies with, for example:
+ *
+ *   EF_TCP_CLIENT_LOOPBACK=1 EF_TCP_SERVER_LOOPBACK=1 EF_SPIN_USEC=100000 \
+ *     EF_TCP_RECV_SPIN=1 EF_UDP_RECV_SPIN=1 EF_EPOLL_SPIN=1 \
+ *     EF_SPIN_ADAPTIVE=1 onload ./spin_adapt -P burst:20:5:20000
+ *
+ * and use "onload_stackdump lots | grep spin_adapt" for its decisions.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "test_util.h"
+
+
+enum pattern { PAT_FIXED, PAT_POISSON, PAT_BURST };
+
+static const char*     cfg_pattern = "poisson:100";
+static int             cfg_tcp;
+static int             cfg_epoll;
+static int             cfg_seconds = 5;
+static int             cfg_port = 8126;
+
+static enum pattern    pat;
+static unsigned        pat_n = 1;
+static unsigned        pat_gap_us;
+static unsigned        pat_idle_us;
+
+static volatile int    stop;
+
+/* Messages carry their send time, and a sequence number so the receiver
+ * can tell when the sender has finished. */
+struct msg {
+  uint64_t send_ns;
+  uint64_t seq;
+};
+#define SEQ_END  ((uint64_t) -1)
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  spin_adapt [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -P <pattern> - fixed:<us>, poisson:<us> or "
+          "burst:<n>:<us>:<idle_us>\n");
+  fprintf(stderr, "  -t           - use TCP (default is UDP)\n");
+  fprintf(stderr, "  -e           - receive with epoll_wait()\n");
+  fprintf(stderr, "  -s <secs>    - duration of run\n");
+  fprintf(stderr, "  -p <port>    - port to use\n");
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+static void parse_pattern(const char* s)
+{
+  if( sscanf(s, "fixed:%u", &pat_gap_us) == 1 )
+    pat = PAT_FIXED;
+  else if( sscanf(s, "poisson:%u", &pat_gap_us) == 1 )
+    pat = PAT_POISSON;
+  else if( sscanf(s, "burst:%u:%u:%u", &pat_n, &pat_gap_us,
+                  &pat_idle_us) == 3 && pat_n > 0 )
+    pat = PAT_BURST;
+  else
+    usage();
+}
+
+
+/* Gap before message [seq], in nanoseconds. */
+static uint64_t next_gap_ns(uint64_t seq, unsigned* seed)
+{
+  double u;
+
+  switch( pat ) {
+  case PAT_POISSON:
+    u = (rand_r(seed) + 1.0) / ((double) RAND_MAX + 2.0);
+    return (uint64_t) (-log(u) * pat_gap_us * 1000);
+  case PAT_BURST:
+    if( seq % pat_n == 0 )
+      return (uint64_t) pat_idle_us * 1000;
+    /* fall through */
+  case PAT_FIXED:
+  default:
+    return (uint64_t) pat_gap_us * 1000;
+  }
+}
+
+
+/* Wait until [t] without sleeping, so that short gaps are honoured. */
+static void wait_until(uint64_t t)
+{
+  uint64_t now = now_ns();
+  if( t > now + 200000 ) {
+    struct timespec ts;
+    uint64_t d = t - now - 100000;
+    ts.tv_sec = d / 1000000000;
+    ts.tv_nsec = d % 1000000000;
+    nanosleep(&ts, NULL);
+  }
+  while( now_ns() < t )
+    ;
+}
+
+
+static void send_msg(int sock, uint64_t seq)
+{
+  struct msg m;
+  m.seq = seq;
+  m.send_ns = now_ns();
+  TRY(send(sock, &m, sizeof(m), 0));
+}
+
+
+static void* sender_main(void* arg)
+{
+  int sock = (int) (intptr_t) arg;
+  unsigned seed = 1;
+  uint64_t seq, t = now_ns();
+
+  for( seq = 0; ! stop; ++seq ) {
+    t += next_gap_ns(seq, &seed);
+    wait_until(t);
+    send_msg(sock, seq);
+  }
+  send_msg(sock, SEQ_END);
+  return NULL;
+}
+
+
+/* Read one whole message.  Returns 0 at the end of the run. */
+static int recv_msg(int sock, int epfd, struct msg* m)
+{
+  struct epoll_event ev;
+  size_t got = 0;
+  int rc;
+
+  while( got < sizeof(*m) ) {
+    if( epfd >= 0 )
+      TRY(epoll_wait(epfd, &ev, 1, -1));
+    rc = recv(sock, (char*) m + got, sizeof(*m) - got,
+              epfd >= 0 ? MSG_DONTWAIT : 0);
+    if( rc < 0 && errno == EAGAIN )
+      continue;
+    TRY(rc);
+    if( rc == 0 )
+      return 0;
+    got += rc;
+  }
+  return m->seq != SEQ_END;
+}
+
+
+static void run(int rx_sock, int tx_sock)
+{
+  size_t n = 0, max = 1024 * 1024;
+  uint64_t* lat = malloc(max * sizeof(*lat));
+  uint64_t t0, t1, cpu0, cpu1, sum = 0;
+  struct epoll_event ev;
+  pthread_t sender;
+  struct msg m;
+  int epfd = -1;
+
+  if( cfg_epoll ) {
+    TRY(epfd = epoll_create(1));
+    ev.events = EPOLLIN;
+    ev.data.fd = rx_sock;
+    TRY(epoll_ctl(epfd, EPOLL_CTL_ADD, rx_sock, &ev));
+  }
+
+  t0 = now_ns();
+  cpu0 = thread_cpu_ns();
+  TRY(pthread_create(&sender, NULL, sender_main, (void*) (intptr_t) tx_sock));
+  while( recv_msg(rx_sock, epfd, &m) ) {
+    uint64_t l = now_ns() - m.send_ns;
+    sum += l;
+    if( n < max )
+      lat[n] = l;
+    ++n;
+    if( ! stop && now_ns() - t0 >= (uint64_t) cfg_seconds * 1000000000 )
+      stop = 1;
+  }
+  cpu1 = thread_cpu_ns();
+  t1 = now_ns();
+  pthread_join(sender, NULL);
+
+  if( n == 0 ) {
+    printf("no messages received\n");
+    exit(1);
+  }
+  qsort(lat, n < max ? n : max, sizeof(*lat), cmp_u64);
+  printf("#%-9s %10s %10s %10s %10s %8s\n", "msgs", "mean_ns", "p50_ns",
+         "p99_ns", "max_ns", "rx_cpu%");
+  n = n < max ? n : max;
+  printf("%-10lu %10.0f %10lu %10lu %10lu %8.1f\n", (unsigned long) n,
+         (double) sum / n, (unsigned long) sorted_quantile(lat, n, 500),
+         (unsigned long) sorted_quantile(lat, n, 990),
+         (unsigned long) lat[n - 1],
+         (cpu1 - cpu0) * 100.0 / (t1 - t0));
+  free(lat);
+  if( epfd >= 0 )
+    close(epfd);
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct sockaddr_in sa;
+  int c, one = 1, lsock, rx_sock, tx_sock;
+
+  while( (c = getopt(argc, argv, "P:tes:p:")) != -1 )
+    switch( c ) {
+    case 'P':
+      cfg_pattern = optarg;
+      break;
+    case 't':
+      cfg_tcp = 1;
+      break;
+    case 'e':
+      cfg_epoll = 1;
+      break;
+    case 's':
+      cfg_seconds = atoi(optarg);
+      break;
+    case 'p':
+      cfg_port = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_seconds < 1 )
+    usage();
+  parse_pattern(cfg_pattern);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sa.sin_port = htons(cfg_port);
+
+  if( cfg_tcp ) {
+    TRY(lsock = socket(AF_INET, SOCK_STREAM, 0));
+    TRY(setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+    TRY(bind(lsock, (void*) &sa, sizeof(sa)));
+    TRY(listen(lsock, 1));
+    TRY(tx_sock = socket(AF_INET, SOCK_STREAM, 0));
+    TRY(connect(tx_sock, (void*) &sa, sizeof(sa)));
+    TRY(rx_sock = accept(lsock, NULL, NULL));
+    TRY(setsockopt(tx_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)));
+    close(lsock);
+  }
+  else {
+    TRY(rx_sock = socket(AF_INET, SOCK_DGRAM, 0));
+    TRY(bind(rx_sock, (void*) &sa, sizeof(sa)));
+    TRY(tx_sock = socket(AF_INET, SOCK_DGRAM, 0));
+    TRY(connect(tx_sock, (void*) &sa, sizeof(sa)));
+  }
+
+  run(rx_sock, tx_sock);
+  close(tx_sock);
+  close(rx_sock);
+  return 0;
+}
@@ -0,0 +1,3 @@
+TARGETS	:= syn_flood
+
+include $(TOP)/src/tests/onload/onload_test.mk
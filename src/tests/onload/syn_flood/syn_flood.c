@@ -0,0 +1,355 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* syn_flood
+ *
+ * SYN flood benchmark for listening sockets.  One thread sends SYNs from
+ * spoofed addresses (-S) through a raw socket, which nothing will ever
+ * complete, so each one costs the listener a synrecv unless it answers
+ * with a syncookie.  Meanwhile genuine clients connect() one after another
+ * and we report how long they take and how many fail, along with the
+ * listener's accept rate.
+ *
+ * By default the listener is in this process, on the loopback address:
+ *
+ *   syn_flood -r 200000
+ *
+ * Raw sockets are not accelerated, so over loopback the flood reaches the
+ * kernel stack.  To flood an Onload stack, run the listener under Onload
+ * and the flood from another host:
+ *
+ *   server$ EF_TCP_SYNCOOKIES_PRESSURE=50 onload ./syn_flood -L -p 8124
+ *   client$ ./syn_flood -e -a <server> -p 8124 -r 200000
+ *
+ * and compare with EF_TCP_SYNCOOKIES_PRESSURE=0.  onload_stackdump shows
+ * the listener's syncookie counters.  Needs CAP_NET_RAW to flood.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "test_util.h"
+
+
+struct syn_pkt {
+  struct iphdr  ip;
+  struct tcphdr tcp;
+  uint8_t       mss_opt[4];
+} __attribute__((packed));
+
+
+static int             cfg_rate = 100000;
+static int             cfg_seconds = 10;
+static int             cfg_probe_usec = 1000;
+static int             cfg_timeout_ms = 1000;
+static int             cfg_external;
+static int             cfg_listen_only;
+static int             cfg_backlog = 1024;
+static const char*     cfg_addr = "127.0.0.1";
+static const char*     cfg_spoof = "198.18.0.0";
+static int             cfg_port = 8124;
+
+static volatile int    stop;
+static struct sockaddr_in target;
+
+static volatile uint64_t syns_sent;
+static volatile uint64_t accepts;
+static uint64_t          probes_ok, probes_failed;
+static uint64_t          lat_max;
+static uint64_t          lat_hist[LAT_HIST_BUCKETS];
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  syn_flood [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -r <rate>   - SYNs/sec to flood with (0 for unlimited)\n");
+  fprintf(stderr, "  -t <secs>   - duration\n");
+  fprintf(stderr, "  -i <usec>   - gap between genuine connects\n");
+  fprintf(stderr, "  -T <msec>   - genuine connect timeout\n");
+  fprintf(stderr, "  -a <addr>   - address of listener\n");
+  fprintf(stderr, "  -p <port>   - port of listener\n");
+  fprintf(stderr, "  -S <addr>   - base of /16 to spoof SYNs from\n");
+  fprintf(stderr, "  -b <n>      - listen backlog\n");
+  fprintf(stderr, "  -e          - flood an external listener\n");
+  fprintf(stderr, "  -L          - be the listener only\n");
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+static uint16_t csum_fold(uint32_t sum)
+{
+  while( sum >> 16 )
+    sum = (sum & 0xffff) + (sum >> 16);
+  return ~sum;
+}
+
+
+static uint32_t csum_add(uint32_t sum, const void* p, int len)
+{
+  const uint16_t* w = p;
+  for( ; len > 1; len -= 2 )
+    sum += *w++;
+  return sum;
+}
+
+
+static void syn_fill(struct syn_pkt* p, uint32_t saddr, uint16_t sport,
+                     uint32_t seq)
+{
+  uint32_t sum;
+  uint16_t tcp_len = htons(sizeof(p->tcp) + sizeof(p->mss_opt));
+
+  p->ip.saddr = saddr;
+  p->ip.check = 0;
+  p->tcp.source = sport;
+  p->tcp.seq = seq;
+  p->tcp.check = 0;
+
+  sum = csum_add(0, &p->ip.saddr, 8);
+  sum += htons(IPPROTO_TCP) + tcp_len;
+  sum = csum_add(sum, &p->tcp, sizeof(p->tcp) + sizeof(p->mss_opt));
+  p->tcp.check = csum_fold(sum);
+  p->ip.check = csum_fold(csum_add(0, &p->ip, sizeof(p->ip)));
+}
+
+
+static void* flood_thread(void* arg)
+{
+  struct syn_pkt p;
+  uint32_t spoof_base = ntohl(inet_addr(cfg_spoof)) & 0xffff0000;
+  uint64_t next = now_ns();
+  uint64_t gap = cfg_rate == 0 ? 0 : 1000000000ull / cfg_rate;
+  unsigned seed = getpid();
+  uint32_t r;
+  int sock;
+
+  TRY(sock = socket(AF_INET, SOCK_RAW, IPPROTO_RAW));
+
+  memset(&p, 0, sizeof(p));
+  p.ip.version = 4;
+  p.ip.ihl = sizeof(p.ip) / 4;
+  p.ip.tot_len = htons(sizeof(p));
+  p.ip.ttl = 64;
+  p.ip.protocol = IPPROTO_TCP;
+  p.ip.daddr = target.sin_addr.s_addr;
+  p.tcp.dest = target.sin_port;
+  p.tcp.doff = (sizeof(p.tcp) + sizeof(p.mss_opt)) / 4;
+  p.tcp.syn = 1;
+  p.tcp.window = htons(65535);
+  p.mss_opt[0] = 2;
+  p.mss_opt[1] = 4;
+  p.mss_opt[2] = 1460 >> 8;
+  p.mss_opt[3] = 1460 & 0xff;
+
+  while( ! stop ) {
+    if( gap ) {
+      while( now_ns() < next && ! stop )
+        ;
+      next += gap;
+    }
+    r = rand_r(&seed);
+    syn_fill(&p, htonl(spoof_base | (r & 0xffff)),
+             htons(1024 + (r >> 16) % 64000), rand_r(&seed));
+    if( sendto(sock, &p, sizeof(p), 0, (void*) &target,
+               sizeof(target)) == sizeof(p) )
+      ++syns_sent;
+  }
+  close(sock);
+  return NULL;
+}
+
+
+static void* accept_thread(void* arg)
+{
+  int lsock = (int) (intptr_t) arg;
+  int sock;
+
+  while( ! stop )
+    if( (sock = accept(lsock, NULL, NULL)) >= 0 ) {
+      ++accepts;
+      close(sock);
+    }
+  return NULL;
+}
+
+
+/* Make one genuine connection, and record how long it took. */
+static void probe(void)
+{
+  struct pollfd pfd;
+  uint64_t t0, lat;
+  socklen_t len = sizeof(int);
+  int sock, err = 0;
+
+  TRY(sock = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(fcntl(sock, F_SETFL, O_NONBLOCK));
+  t0 = now_ns();
+  if( connect(sock, (void*) &target, sizeof(target)) < 0 ) {
+    if( errno != EINPROGRESS ) {
+      err = errno;
+    }
+    else {
+      pfd.fd = sock;
+      pfd.events = POLLOUT;
+      if( poll(&pfd, 1, cfg_timeout_ms) != 1 )
+        err = ETIMEDOUT;
+      else
+        TRY(getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len));
+    }
+  }
+  lat = now_ns() - t0;
+  close(sock);
+
+  if( err ) {
+    ++probes_failed;
+    return;
+  }
+  ++probes_ok;
+  if( lat > lat_max )
+    lat_max = lat;
+  lat_hist_add(lat_hist, lat);
+}
+
+
+int main(int argc, char* argv[])
+{
+  pthread_t flood_tid, accept_tid;
+  uint64_t start, end, last, t;
+  uint64_t last_syns = 0, last_accepts = 0, last_ok = 0, last_failed = 0;
+  int c, lsock = -1, one = 1;
+
+  while( (c = getopt(argc, argv, "r:t:i:T:a:p:S:b:eL")) != -1 )
+    switch( c ) {
+    case 'r':
+      cfg_rate = atoi(optarg);
+      break;
+    case 't':
+      cfg_seconds = atoi(optarg);
+      break;
+    case 'i':
+      cfg_probe_usec = atoi(optarg);
+      break;
+    case 'T':
+      cfg_timeout_ms = atoi(optarg);
+      break;
+    case 'a':
+      cfg_addr = optarg;
+      break;
+    case 'p':
+      cfg_port = atoi(optarg);
+      break;
+    case 'S':
+      cfg_spoof = optarg;
+      break;
+    case 'b':
+      cfg_backlog = atoi(optarg);
+      break;
+    case 'e':
+      cfg_external = 1;
+      break;
+    case 'L':
+      cfg_listen_only = 1;
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc || cfg_rate < 0 || cfg_seconds < 1 ||
+      (cfg_external && cfg_listen_only) )
+    usage();
+
+  target.sin_family = AF_INET;
+  target.sin_addr.s_addr = inet_addr(cfg_addr);
+  target.sin_port = htons(cfg_port);
+
+  if( ! cfg_external ) {
+    TRY(lsock = socket(AF_INET, SOCK_STREAM, 0));
+    TRY(setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+    if( cfg_listen_only )
+      target.sin_addr.s_addr = INADDR_ANY;
+    TRY(bind(lsock, (void*) &target, sizeof(target)));
+    TRY(listen(lsock, cfg_backlog));
+    TRY(pthread_create(&accept_tid, NULL, accept_thread,
+                       (void*) (intptr_t) lsock));
+  }
+  if( ! cfg_listen_only )
+    TRY(pthread_create(&flood_tid, NULL, flood_thread, NULL));
+
+  printf("#%-4s %10s %10s %8s %8s %8s %8s\n", "secs", "syns/s", "accepts/s",
+         "ok", "failed", "p50_us", "p99_us");
+  start = last = now_ns();
+  end = start + (uint64_t) cfg_seconds * 1000000000;
+  while( (t = now_ns()) < end ) {
+    if( cfg_listen_only )
+      usleep(10000);
+    else {
+      probe();
+      usleep(cfg_probe_usec);
+    }
+    if( (t = now_ns()) - last < 1000000000 )
+      continue;
+    printf("%-5.0f %10.0f %10.0f %8lu %8lu %8.0f %8.0f\n",
+           (t - start) / 1e9, (syns_sent - last_syns) * 1e9 / (t - last),
+           (accepts - last_accepts) * 1e9 / (t - last),
+           (unsigned long) (probes_ok - last_ok),
+           (unsigned long) (probes_failed - last_failed),
+           lat_hist_percentile(lat_hist, probes_ok, 50, lat_max) / 1e3,
+           lat_hist_percentile(lat_hist, probes_ok, 99, lat_max) / 1e3);
+    fflush(stdout);
+    last = t;
+    last_syns = syns_sent;
+    last_accepts = accepts;
+    last_ok = probes_ok;
+    last_failed = probes_failed;
+  }
+  stop = 1;
+
+  if( ! cfg_listen_only )
+    pthread_join(flood_tid, NULL);
+  if( ! cfg_external ) {
+    /* Wake the accept thread with one more connection. */
+    if( ! cfg_listen_only )
+      probe();
+    else
+      shutdown(lsock, SHUT_RDWR);
+    pthread_join(accept_tid, NULL);
+    close(lsock);
+  }
+
+  if( ! cfg_listen_only )
+    printf("# total: syns=%lu ok=%lu failed=%lu p50=%.0fus p99=%.0fus "
+           "max=%.0fus\n", (unsigned long) syns_sent,
+           (unsigned long) probes_ok, (unsigned long) probes_failed,
+           lat_hist_percentile(lat_hist, probes_ok, 50, lat_max) / 1e3,
+           lat_hist_percentile(lat_hist, probes_ok, 99, lat_max) / 1e3,
+           lat_max / 1e3);
+  return 0;
+}
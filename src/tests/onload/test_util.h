@@ -0,0 +1,116 @@
+/*
+** Copyright 2005-2016  Solarflare Communications Inc.
+**                      7505 Irvine Center Drive, Irvine, CA 92618, USA
+** Copyright 2002-2005  Level 5 Networks Inc.
+**
+** This program is free software; you can redistribute it and/or modify it
+** under the terms of version 2 of the GNU General Public License as
+** published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* Helpers shared by the test and benchmark tools below this directory.
+ * Their mmake.mk includes onload_test.mk, which puts this directory on the
+ * include path.
+ */
+
+#ifndef __ONLOAD_TEST_UTIL_H__
+#define __ONLOAD_TEST_UTIL_H__
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+    if( __rc < 0 ) {                                                    \
+      fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                   \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);         \
+      fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                   \
+              __rc, errno, strerror(errno));                            \
+      exit(1);                                                          \
+    }                                                                   \
+  } while( 0 )
+
+
+static inline uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/* CPU time used by the calling thread. */
+static inline uint64_t thread_cpu_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**********************************************************************
+ * Latency statistics
+ */
+
+/* For sorting samples with qsort(). */
+static inline int cmp_u64(const void* a, const void* b)
+{
+  uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+  return x < y ? -1 : x > y;
+}
+
+
+/* The sample at the [per_mille] point of [n] sorted samples. */
+static inline uint64_t sorted_quantile(const uint64_t* v, uint64_t n,
+                                       unsigned per_mille)
+{
+  uint64_t i = n * per_mille / 1000;
+  return v[i < n ? i : n - 1];
+}
+
+
+/* Where there are too many samples to keep, a histogram with buckets of
+ * doubling width.  Bucket b holds samples less than 2^(b+1), and the last
+ * bucket holds everything larger.
+ */
+#define LAT_HIST_BUCKETS  32
+
+static inline void lat_hist_add(uint64_t* hist, uint64_t lat)
+{
+  int b;
+  for( b = 0; b < LAT_HIST_BUCKETS - 1 && (1ull << (b + 1)) <= lat; ++b )
+    ;
+  ++hist[b];
+}
+
+
+/* Upper bound of the histogram bucket containing the [pct] percentile of
+ * [n] samples, or [max] (the largest sample) if that is smaller.
+ */
+static inline uint64_t lat_hist_percentile(const uint64_t* hist, uint64_t n,
+                                           int pct, uint64_t max)
+{
+  uint64_t sum = 0;
+  int b;
+
+  for( b = 0; b < LAT_HIST_BUCKETS; ++b )
+    if( (sum += hist[b]) * 100 >= n * pct )
+      break;
+  return b < LAT_HIST_BUCKETS - 1 && (1ull << (b + 1)) < max ?
+    1ull << (b + 1) : max;
+}
+
+
+#endif  /* __ONLOAD_TEST_UTIL_H__ */
@@ -0,0 +1,7 @@
+TARGETS	:= udp_filter_bench
+
+MMAKE_INCLUDE	+= -I$(TOP)/src/lib/transport/ip
+MMAKE_LIBS	:= $(LINK_CIIP_LIB) $(LINK_CIUL_LIB) $(LINK_CITOOLS_LIB)
+MMAKE_LIB_DEPS	:= $(CIIP_LIB_DEPEND) $(CIUL_LIB_DEPEND) $(CITOOLS_LIB_DEPEND)
+
+include $(TOP)/src/tests/onload/onload_test.mk
@@ -2199,6 +2199,206 @@ static void stack_segments(ci_netif* ni)
     ci_log("%d: bad pkt=%d", NI_ID(ni), pkt_id);
 }
 
+#define PKT_BENCH_IDS  (1 << 16)
+
+/* Time the translation of packet ids to packet buffers, which is what the
+ * TLB footprint of the packet memory costs us.  The "chained" pass makes
+ * each lookup depend on the one before, so measures latency rather than
+ * throughput.
+ */
+static void stack_pkt_bench(ci_netif* ni)
+{
+  int n_pkts = ni->packets->n_pkts_allocated;
+  int iters = arg_u[0] ? arg_u[0] : 1000000;
+  unsigned khz = IPTIMER_STATE(ni)->khz;
+  volatile unsigned zero_v = 0;
+  unsigned i, id, zero = zero_v, sink = 0;
+  ci_uint64 start, end;
+  int* ids;
+
+  if( n_pkts == 0 ) {
+    ci_log("%d: no packet buffers allocated", NI_ID(ni));
+    return;
+  }
+  if( (ids = malloc(PKT_BENCH_IDS * sizeof(ids[0]))) == NULL ) {
+    ci_log("%d: out of memory", NI_ID(ni));
+    return;
+  }
+  for( i = 0; i < PKT_BENCH_IDS; ++i )
+    ids[i] = rand() % n_pkts;
+
+  /* Map all of the sets first, so that we time the lookups alone. */
+  for( i = 0; i < ni->packets->sets_n; ++i ) {
+    (void) __PKT(ni, i << CI_CFG_PKTS_PER_SET_S);
+    ci_log("%d: pkt_set[%d]: node=%d page=%s", NI_ID(ni), i,
+           (int) ni->packets->set[i].numa_node,
+           ni->packets->set[i].page_shift >= 30 ? "1G" :
+           ni->packets->set[i].page_shift >= 21 ? "2M" : "4K");
+  }
+
+  ci_frc64(&start);
+  for( i = 0, id = 0; i < iters; ++i ) {
+    sink += __PKT(ni, id)->pay_len;
+    if( ++id == n_pkts )
+      id = 0;
+  }
+  ci_frc64(&end);
+  ci_log("%d: pkt_bench: sequential  %8.2f ns/pkt", NI_ID(ni),
+         (end - start) * 1e6 / khz / iters);
+
+  ci_frc64(&start);
+  for( i = 0; i < iters; ++i )
+    sink += __PKT(ni, ids[i & (PKT_BENCH_IDS - 1)])->pay_len;
+  ci_frc64(&end);
+  ci_log("%d: pkt_bench: random      %8.2f ns/pkt", NI_ID(ni),
+         (end - start) * 1e6 / khz / iters);
+
+  ci_frc64(&start);
+  for( i = 0, id = ids[0]; i < iters; ++i )
+    id = ids[(i + (__PKT(ni, id)->pay_len & zero)) & (PKT_BENCH_IDS - 1)];
+  ci_frc64(&end);
+  ci_log("%d: pkt_bench: chained     %8.2f ns/pkt", NI_ID(ni),
+         (end - start) * 1e6 / khz / iters);
+
+  zero_v = sink + id;
+  free(ids);
+}
+
+#define ROUTE_BENCH_ADDRS  (1 << 16)
+
+static int route_bench_cmp(const void* a, const void* b)
+{
+  const cicp_fwd_row_t* ra = a;
+  const cicp_fwd_row_t* rb = b;
+  return (int) rb->destnet_ipset - (int) ra->destnet_ipset;
+}
+
+/* Time route lookups with and without the route index, in a private table
+ * of the given number of routes with a spread of prefix lengths much like
+ * an Internet routing table's.  The two are cross-checked first.
+ */
+static void stack_route_bench(ci_netif* ni)
+{
+  const cicp_fwdinfo_t* live = CICP_MIBS(CICP_HANDLE(ni))->user.fwdinfo_utable;
+  const cicp_fwd_index_t* live_idx = cicp_fwd_index(live);
+  int n_routes = arg_u[0] ? arg_u[0] : 10000;
+  unsigned khz = IPTIMER_STATE(ni)->khz;
+  int i, len, iters, nodes_max, mismatches = 0;
+  const cicp_fwd_row_t* row;
+  const cicp_fwd_row_t* want;
+  cicp_fwdinfo_t* fwdt;
+  cicp_fwd_index_t* idx;
+  ci_uint64 start, end;
+  ci_ip_addr_t* addrs;
+  size_t index_ofs;
+  unsigned ip, sink = 0;
+
+  if( live_idx != NULL )
+    ci_log("%d: route_bench: live table: rows_max=%d index=%s nodes=%d/%d",
+           NI_ID(ni), (int) live->rows_max,
+           live_idx->valid ? "valid" : "invalid",
+           (int) live_idx->nodes_used, (int) live_idx->nodes_max);
+  else
+    ci_log("%d: route_bench: live table: rows_max=%d not indexed", NI_ID(ni),
+           (int) live->rows_max);
+
+  if( n_routes < 2 || n_routes > CICP_FWD_INDEX_ROWS_MAX ) {
+    ci_log("%d: route_bench: between 2 and %d routes", NI_ID(ni),
+           CICP_FWD_INDEX_ROWS_MAX);
+    return;
+  }
+  nodes_max = CICP_FWD_INDEX_NODES(n_routes);
+  index_ofs = CI_ROUND_UP(sizeof(*fwdt) + (n_routes - 1) * sizeof(*row),
+                          CI_CACHE_LINE_SIZE);
+  fwdt = calloc(1, index_ofs + CICP_FWD_INDEX_SIZE(nodes_max));
+  addrs = malloc(ROUTE_BENCH_ADDRS * sizeof(addrs[0]));
+  if( fwdt == NULL || addrs == NULL ) {
+    ci_log("%d: out of memory", NI_ID(ni));
+    free(fwdt);
+    free(addrs);
+    return;
+  }
+  fwdt->rows_max = n_routes;
+  fwdt->index_ofs = index_ofs;
+  idx = cicp_fwd_index(fwdt);
+  idx->nodes_max = nodes_max;
+
+  /* Mostly /24s, then shorter prefixes, a few host routes and a default
+   * route last.
+   */
+  for( i = 0; i < n_routes; ++i ) {
+    len = rand() % 100;
+    len = len < 55 ? 24 : len < 85 ? 16 + rand() % 8 :
+          len < 95 ? 8 + rand() % 8 : 25 + rand() % 8;
+    if( i == n_routes - 1 )
+      len = 0;
+    ip = (((unsigned) rand() << 16) ^ rand()) & ci_ip_prefix2mask(len);
+    fwdt->path[i].destnet_ip = CI_BSWAP_BE32(ip);
+    fwdt->path[i].destnet_ipset = len;
+    fwdt->path[i].dest_ifindex = 1;
+  }
+  qsort(fwdt->path, n_routes, sizeof(fwdt->path[0]), route_bench_cmp);
+
+  ci_frc64(&start);
+  cicp_fwd_index_build(fwdt);
+  ci_frc64(&end);
+  ci_log("%d: route_bench: %d routes: index=%s nodes=%d/%d build=%.1f us "
+         "size=%d KiB", NI_ID(ni), n_routes, idx->valid ? "valid" : "invalid",
+         (int) idx->nodes_used, nodes_max, (end - start) * 1e3 / khz,
+         (int) (CICP_FWD_INDEX_SIZE(idx->nodes_used) >> 10));
+
+  /* Half of the addresses are in a random route, and half are anywhere. */
+  for( i = 0; i < ROUTE_BENCH_ADDRS; ++i ) {
+    ip = ((unsigned) rand() << 16) ^ rand();
+    if( i & 1 ) {
+      row = &fwdt->path[rand() % n_routes];
+      ip = CI_BSWAP_BE32(row->destnet_ip) |
+           (ip & ~ci_ip_prefix2mask(row->destnet_ipset));
+    }
+    addrs[i] = CI_BSWAP_BE32(ip);
+  }
+
+  for( i = 0; i < ROUTE_BENCH_ADDRS; i += 7 ) {
+    row = _cicp_fwd_find_ip(fwdt, addrs[i], CI_IFID_BAD);
+    idx->valid = 0;
+    want = _cicp_fwd_find_ip(fwdt, addrs[i], CI_IFID_BAD);
+    idx->valid = 1;
+    if( row != want && ++mismatches <= 10 )
+      ci_log("%d: route_bench: "CI_IP_PRINTF_FORMAT" index=%d scan=%d",
+             NI_ID(ni), CI_IP_PRINTF_ARGS(&addrs[i]),
+             row ? (int) (row - fwdt->path) : -1,
+             want ? (int) (want - fwdt->path) : -1);
+  }
+  ci_log("%d: route_bench: cross-check %s", NI_ID(ni),
+         mismatches ? "FAILED" : "passed");
+
+  iters = 1000000;
+  ci_frc64(&start);
+  for( i = 0; i < iters; ++i )
+    sink += _cicp_fwd_find_ip(fwdt, addrs[i & (ROUTE_BENCH_ADDRS - 1)],
+                              CI_IFID_BAD)->metric;
+  ci_frc64(&end);
+  ci_log("%d: route_bench: indexed %10.2f ns/lookup %8.2f M/s", NI_ID(ni),
+         (end - start) * 1e6 / khz / iters,
+         iters * (khz / 1e6) / (end - start));
+
+  /* The scan is much slower, so do fewer lookups. */
+  idx->valid = 0;
+  iters = CI_MAX(1000000 / n_routes, 100);
+  ci_frc64(&start);
+  for( i = 0; i < iters; ++i )
+    sink += _cicp_fwd_find_ip(fwdt, addrs[i & (ROUTE_BENCH_ADDRS - 1)],
+                              CI_IFID_BAD)->metric;
+  ci_frc64(&end);
+  ci_log("%d: route_bench: scan    %10.2f ns/lookup %8.2f M/s", NI_ID(ni),
+         (end - start) * 1e6 / khz / iters,
+         iters * (khz / 1e6) / (end - start));
+
+  (void) sink;
+  free(fwdt);
+  free(addrs);
+}
+
 static void stack_ev(ci_netif* ni)
 {
   int rc = ef_eventq_put(ef_vi_resource_id(&ni->nic_hw[0].vi), 
@@ -2263,6 +2463,228 @@ static void stack_watch_more_stats(ci_netif* ni)
               ni, more_stats_getter);
 }
 
+static int lat_hist_sock(citp_waitable* w)
+{
+  return CI_TCP_STATE_IS_SOCKET(w->state) && w->state != CI_TCP_CLOSED &&
+         OO_SP_NOT_NULL(w->lat_hist);
+}
+
+static void lat_hist_sock_header(ci_netif* ni, citp_waitable* w)
+{
+  ci_log("------------------------------------------------------------");
+  ci_log("%d:%d", NI_ID(ni), W_FMT(w));
+  citp_waitable_print(w);
+}
+
+static void stack_lat_hist(ci_netif* ni)
+{
+  int id;
+
+  if( ! NI_OPTS(ni).lat_hist ) {
+    ci_log("%d: latency histograms not enabled (EF_LAT_HIST=1)", NI_ID(ni));
+    return;
+  }
+  for( id = 0; id < (int) ni->state->n_ep_bufs; ++id ) {
+    citp_waitable* w = &ID_TO_WAITABLE_OBJ(ni, id)->waitable;
+    if( ! lat_hist_sock(w) )
+      continue;
+    lat_hist_sock_header(ni, w);
+    ci_lat_hist_dump(ni, ci_lat_hist_get(ni, w), ci_cfg_verbose, "",
+                     ci_log_dump_fn, NULL);
+  }
+}
+
+/* Histogram of the samples in [c] that are not in [p].  Stages that have
+ * been reset since [p] was taken are reported in full.  The maximum over
+ * the interval is not known, so it is bounded by the highest bucket used.
+ */
+static void lat_hist_delta(ci_lat_hist* d, const ci_lat_hist* c,
+                           const ci_lat_hist* p)
+{
+  const ci_lat_hist_stage *cs, *ps;
+  ci_lat_hist_stage* ds;
+  int s, i;
+
+  for( s = 0; s < CI_LAT_HIST_N_STAGES; ++s ) {
+    cs = &c->stage[s];
+    ps = &p->stage[s];
+    ds = &d->stage[s];
+    if( cs->n < ps->n ) {
+      *ds = *cs;
+      continue;
+    }
+    ds->n = cs->n - ps->n;
+    ds->sum = cs->sum - ps->sum;
+    ds->max = 0;
+    for( i = 0; i < CI_LAT_HIST_N_BUCKETS; ++i ) {
+      ds->bucket[i] = cs->bucket[i] - ps->bucket[i];
+      if( ds->bucket[i] )
+        ds->max = i < CI_LAT_HIST_N_BUCKETS - 1 ?
+          ci_lat_hist_bucket_lo(i + 1) - 1 : cs->max;
+    }
+    ds->max = CI_MIN(ds->max, cs->max);
+  }
+}
+
+static void stack_watch_lat_hist(ci_netif* ni)
+{
+  ci_lat_hist* prev = calloc(ni->state->max_ep_bufs, sizeof(*prev));
+  unsigned time_msec = 0, target_msec = 0;
+  struct timeval start, now;
+  ci_lat_hist cur, delta;
+  citp_waitable* w;
+  int id, s;
+
+  if( ! NI_OPTS(ni).lat_hist ) {
+    ci_log("%d: latency histograms not enabled (EF_LAT_HIST=1)", NI_ID(ni));
+    return;
+  }
+  CI_TEST(prev);
+  for( id = 0; id < (int) ni->state->n_ep_bufs; ++id ) {
+    w = &ID_TO_WAITABLE_OBJ(ni, id)->waitable;
+    if( lat_hist_sock(w) )
+      prev[id] = *ci_lat_hist_get(ni, w);
+  }
+  gettimeofday(&start, 0);
+
+  while( 1 ) {
+    target_msec += cfg_watch_msec;
+    ci_sleep(target_msec - time_msec);
+    gettimeofday(&now, 0);
+    time_msec = tv_delta(&now, &start);
+    ci_log("==================== %d: %.02f ====================",
+           NI_ID(ni), (double) time_msec / 1000);
+    for( id = 0; id < (int) ni->state->n_ep_bufs; ++id ) {
+      w = &ID_TO_WAITABLE_OBJ(ni, id)->waitable;
+      if( ! lat_hist_sock(w) ) {
+        memset(&prev[id], 0, sizeof(prev[id]));
+        continue;
+      }
+      cur = *ci_lat_hist_get(ni, w);
+      lat_hist_delta(&delta, &cur, &prev[id]);
+      prev[id] = cur;
+      for( s = 0; s < CI_LAT_HIST_N_STAGES; ++s )
+        if( delta.stage[s].n )
+          break;
+      if( s == CI_LAT_HIST_N_STAGES )
+        continue;
+      lat_hist_sock_header(ni, w);
+      ci_lat_hist_dump(ni, &delta, ci_cfg_verbose, "", ci_log_dump_fn, NULL);
+    }
+  }
+}
+
+static void stack_lock_profile(ci_netif* ni)
+{
+  const ci_netif_lock_prof* lp = &ni->state->lock_prof;
+  unsigned site;
+
+  if( lp->sample_n == 0 ) {
+    ci_log("%d: lock profile not enabled (EF_LOCK_PROFILE=N)", NI_ID(ni));
+    return;
+  }
+  ci_log("%d: stack lock profile: holds sampled 1 in %u", NI_ID(ni),
+         lp->sample_n);
+  for( site = 0; site < CI_NETIF_LOCK_N_SITES; ++site ) {
+    if( lp->hold[site].n == 0 && lp->wait[site].n == 0 )
+      continue;
+    ci_log("  %s:", ci_netif_lock_site_name(site));
+    if( lp->hold[site].n )
+      ci_lat_hist_stage_dump(ni, &lp->hold[site], "hold", ci_cfg_verbose,
+                             "  ", ci_log_dump_fn, NULL);
+    if( lp->wait[site].n )
+      ci_lat_hist_stage_dump(ni, &lp->wait[site], "waited_on",
+                             ci_cfg_verbose, "  ", ci_log_dump_fn, NULL);
+  }
+}
+
+static void stack_wake_latency(ci_netif* ni)
+{
+  const ci_lat_hist_stage* st = &ni->state->wake_lat;
+
+  if( st->n == 0 ) {
+    ci_log("%d: no threads woken by interrupts", NI_ID(ni));
+    return;
+  }
+  ci_log("%d: interrupt to woken thread returning from sleep:", NI_ID(ni));
+  ci_lat_hist_stage_dump(ni, st, "wake", ci_cfg_verbose, "",
+                         ci_log_dump_fn, NULL);
+}
+
+
+#if CI_CFG_TRACE
+static const char* trace_freeze_reason(unsigned reason)
+{
+  switch( reason ) {
+  case CI_TRACE_FREEZE_POLL:          return "poll";
+  case CI_TRACE_FREEZE_LOCK_WAIT:     return "lock_wait";
+  case CI_TRACE_FREEZE_MEM_PRESSURE:  return "memory_pressure";
+  default:                            return "?";
+  }
+}
+
+static void stack_trace(ci_netif* ni)
+{
+  const ci_netif_trace* t = &ni->state->trace;
+  ci_trace_rec* recs;
+  ci_uint32 head, seq;
+  ci_uint64 first = 0, prev = 0;
+  unsigned khz = IPTIMER_STATE(ni)->khz;
+  int n = 0;
+
+  if( ni->trace_rec == NULL ||
+      (! t->enabled && ! t->frozen && t->head == 0) ) {
+    ci_log("%d: flight recorder not enabled (EF_TRACE=0)", NI_ID(ni));
+    return;
+  }
+
+  /* Take a copy so that records are not overwritten while we decode.
+   * Records that are being written (or were overwritten since [head] was
+   * read) have the wrong sequence number and are skipped.
+   */
+  recs = malloc(sizeof(recs[0]) * CI_CFG_TRACE_LEN);
+  if( recs == NULL ) {
+    ci_log("%d: out of memory", NI_ID(ni));
+    return;
+  }
+  head = t->head;
+  ci_rmb();
+  memcpy(recs, ni->trace_rec, sizeof(recs[0]) * CI_CFG_TRACE_LEN);
+
+  ci_log("%d: flight recorder: %s head=%u", NI_ID(ni),
+         t->frozen ? "frozen" : t->enabled ? "running" : "stopped", head);
+  if( t->frozen )
+    ci_log("  frozen by %s", trace_freeze_reason(t->frozen));
+  ci_log("  %12s %10s %-12s %6s %10s %10s %10s",
+         "usec", "delta", "event", "sock", "arg0", "arg1", "arg2");
+
+  seq = head > CI_CFG_TRACE_LEN ? head - CI_CFG_TRACE_LEN : 0;
+  for( ; seq != head; ++seq ) {
+    const ci_trace_rec* r = &recs[seq & (CI_CFG_TRACE_LEN - 1)];
+    if( r->seq != seq + 1 )
+      continue;
+    if( n++ == 0 )
+      first = prev = r->frc;
+    ci_log("  %12llu %10llu %-12s %6d %10u %10u %10u",
+           (unsigned long long) ((r->frc - first) * 1000 / khz),
+           (unsigned long long) ((r->frc - prev) * 1000 / khz),
+           ci_netif_trace_type_str(r->type), (int) r->sock,
+           r->a[0], r->a[1], r->a[2]);
+    prev = r->frc;
+  }
+  ci_log("  %d records", n);
+  free(recs);
+}
+
+static void stack_trace_unfreeze(ci_netif* ni)
+{
+  ci_netif_trace* t = &ni->state->trace;
+  t->frozen = 0;
+  ci_wmb();
+  t->enabled = NI_OPTS(ni).trace && ni->trace_rec != NULL;
+}
+#endif
+
 
 static void stack_set_opt(ci_netif* ni)
 {
@@ -2465,6 +2887,14 @@ static const stack_op_t stack_ops[] = {
   STACK_OP(ev,                 "post a h/w event to stack"),
   STACK_OP(watch_stats,        "show running statistics"),
   STACK_OP(watch_more_stats,   "show more statistics"),
+  STACK_OP(lat_hist,           "show per-socket latency histograms"),
+  STACK_OP(watch_lat_hist,     "show running per-socket latency histograms"),
+  STACK_OP(lock_profile,       "show stack lock hold and wait profile"),
+  STACK_OP(wake_latency,       "show interrupt to thread wakeup latency"),
+#if CI_CFG_TRACE
+  STACK_OP(trace,              "decode the flight recorder (EF_TRACE)"),
+  STACK_OP(trace_unfreeze,     "restart a frozen flight recorder"),
+#endif
   STACK_OP_AU(leak_pkts,       "drain allocation of packet buffers",
                                  "<pkt-id>"),
   STACK_OP_AU(alloc_pkts,      "allocate more pkt buffers", "<num>"),
@@ -2476,6 +2906,8 @@ static const stack_op_t stack_ops[] = {
   STACK_OP_AU(txpkt,           "show content of transmit packet", "<pkt-id>"),
   STACK_OP_AU(rxpkt,           "show content of receive packet", "<pkt-id>"),
   STACK_OP_AU(segments,        "show segments in packet", "<pkt-id>"),
+  STACK_OP_AU(pkt_bench,       "time lookups of packet buffers by id",
+              "<iterations>"),
   STACK_OP_AU(ul_poll,         "set user level polling cycles option "
                                  "(overwrites SO_BUSY_POLL values)",
                                  "<cycles>"),
@@ -2497,6 +2929,8 @@ static const stack_op_t stack_ops[] = {
   STACK_OP_A(cicp_user_find_home,"invoke cicp_user_find_home", "<ip>", 1,
              FL_ARG_S),
   STACK_OP(hwport_to_base_ifindex,"dump hwport_to_base_ifindex table"),
+  STACK_OP_AU(route_bench,     "time route lookups in a table of <n> routes",
+              "<n>"),
 };
 #define N_STACK_OPS	(sizeof(stack_ops) / sizeof(stack_ops[0]))
 
@@ -46,10 +46,14 @@ FTL_DECLARE(STRUCT_NETIF_DBG_MAX)
 FTL_DECLARE(STRUCT_NETIF_THRD_INFO)
 FTL_DECLARE(STRUCT_EF_VI_STATS)
 FTL_DECLARE(STRUCT_SOCKET_CACHE)
+FTL_DECLARE(STRUCT_LAT_HIST_STAGE)
+FTL_DECLARE(STRUCT_NETIF_LOCK_PROF)
 FTL_DECLARE(STRUCT_NETIF_STATE)
 FTL_DECLARE(STRUCT_USER_PTR)
 FTL_DECLARE(UNION_SLEEP_SEQ)
+FTL_DECLARE(STRUCT_SPIN_ADAPT)
 FTL_DECLARE(STRUCT_WAITABLE)
+FTL_DECLARE(STRUCT_LAT_HIST)
 FTL_DECLARE(STRUCT_ETHER_HDR)
 FTL_DECLARE(STRUCT_IP4_HDR)
 FTL_DECLARE(STRUCT_IP4_PSEUDO_HDR)
@@ -75,6 +79,7 @@ FTL_DECLARE(STRUCT_IP_SOCK_STATS)
 FTL_DECLARE(STRUCT_TCP_COMMON)
 FTL_DECLARE(STRUCT_TCP)
 FTL_DECLARE(STRUCT_TCP_SOCKET_LISTEN_STATS)
+FTL_DECLARE(STRUCT_TCP_ACCEPTQ_SHARD)
 FTL_DECLARE(STRUCT_TCP_LISTEN)
 FTL_DECLARE(STRUCT_WAITABLE_OBJ)
 FTL_DECLARE(STRUCT_FILTER_TABLE_ENTRY)
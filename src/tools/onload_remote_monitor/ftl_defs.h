@@ -392,6 +392,7 @@ typedef struct {
   FTL_TFIELD_INT(ctx, ef_vi_rxq_state, ci_uint32, bytes_acc)            \
   FTL_TFIELD_INT(ctx, ef_vi_rxq_state, ci_uint16, rx_ps_pkt_count)      \
   FTL_TFIELD_INT(ctx, ef_vi_rxq_state, ci_uint16, rx_ps_credit_avail)   \
+  FTL_TFIELD_INT(ctx, ef_vi_rxq_state, ci_uint16, rx_ps_credit_batch)   \
   FTL_TSTRUCT_END(ctx)
 
 #define STRUCT_EF_VI_STATE(ctx)                                 \
@@ -902,6 +903,7 @@ typedef struct {
                            nic, CI_CFG_MAX_INTERFACES)                  \
   FTL_TFIELD_INT(ctx, ci_netif_state, ci_int32, nic_n)                  \
   FTL_TFIELD_INT(ctx, ci_netif_state, ci_uint64, evq_last_prime)        \
+  FTL_TFIELD_INT(ctx, ci_netif_state, ci_iptime_t, periodic_rearm_ticks) \
   FTL_TFIELD_STRUCT(ctx, ci_netif_state, cicp_ns_mmap_info_t, control_mmap) \
   FTL_TFIELD_INT(ctx, ci_netif_state, ci_uint32, stack_id)              \
   FTL_TFIELD_ARRAYOFINT(ctx, ci_netif_state, char, pretty_name,         \
@@ -951,6 +953,8 @@ typedef struct {
   )                                                                     \
   FTL_TFIELD_INT(ctx, ci_netif_state, ci_int32, free_eps_head)          \
   FTL_TFIELD_INT(ctx, ci_netif_state, ci_int32, deferred_free_eps_head) \
+  FTL_TFIELD_INT(ctx, ci_netif_state, ci_int32, lat_hist_free_head)    \
+  FTL_TFIELD_INT(ctx, ci_netif_state, ci_uint32, n_lat_hist_bufs)       \
   FTL_TFIELD_INT(ctx, ci_netif_state, ci_uint32, max_ep_bufs)           \
   FTL_TFIELD_INT(ctx, ci_netif_state, ci_uint32, n_ep_bufs)             \
   FTL_TFIELD_ARRAYOFSTRUCT(ctx, ci_netif_state, ci_ni_dllist_t,         \
@@ -1008,6 +1012,8 @@ typedef struct {
   )                                                                     \
   FTL_TFIELD_INT(ctx, ci_netif_state, ci_int32, creation_numa_node)     \
   FTL_TFIELD_INT(ctx, ci_netif_state, ci_int32, load_numa_node)         \
+  FTL_TFIELD_INT(ctx, ci_netif_state, ci_int32, mem_numa_node)          \
+  FTL_TFIELD_INT(ctx, ci_netif_state, ci_int32, state_numa_node)        \
   FTL_TFIELD_INT(ctx, ci_netif_state, ci_uint32, packet_alloc_numa_nodes)\
   FTL_TFIELD_INT(ctx, ci_netif_state, ci_uint32, sock_alloc_numa_nodes) \
   FTL_TFIELD_INT(ctx, ci_netif_state, ci_uint32, interrupt_numa_nodes)  \
@@ -1015,6 +1021,8 @@ typedef struct {
     FTL_TFIELD_STRUCT(ctx, ci_netif_state, ci_socket_cache_t, active_cache)   \
     FTL_TFIELD_INT(ctx, ci_netif_state, ci_uint32, active_cache_avail_stack)  \
   )                                                                     \
+  FTL_TFIELD_STRUCT(ctx, ci_netif_state, ci_netif_lock_prof, lock_prof) \
+  FTL_TFIELD_STRUCT(ctx, ci_netif_state, ci_lat_hist_stage, wake_lat)   \
   FTL_TSTRUCT_END(ctx)
 
 
@@ -1046,12 +1054,20 @@ typedef struct {
 
 
 
+#define STRUCT_SPIN_ADAPT(ctx)                                          \
+    FTL_TSTRUCT_BEGIN(ctx, ci_spin_adapt, )                             \
+    FTL_TFIELD_INT(ctx, ci_spin_adapt, ci_uint32, avg)                  \
+    FTL_TFIELD_INT(ctx, ci_spin_adapt, ci_uint32, dev)                  \
+    FTL_TFIELD_INT(ctx, ci_spin_adapt, ci_uint32, n_blocked)            \
+    FTL_TSTRUCT_END(ctx)
+
 #define STRUCT_WAITABLE(ctx)					     	      \
     FTL_TSTRUCT_BEGIN(ctx, citp_waitable, )                                   \
     FTL_TFIELD_INT(ctx, citp_waitable, ci_int32, bufid)                       \
     FTL_TFIELD_INT(ctx, citp_waitable, ci_uint32, state)                      \
     FTL_TFIELD_STRUCT(ctx, citp_waitable, ci_sleep_seq_t, sleep_seq)    \
     FTL_TFIELD_INT(ctx, citp_waitable, ci_uint64, spin_cycles)          \
+    FTL_TFIELD_STRUCT(ctx, citp_waitable, ci_spin_adapt, spin_adapt)    \
     FTL_TFIELD_INT(ctx, citp_waitable, ci_uint32, wake_request)         \
     FTL_TFIELD_INT(ctx, citp_waitable, ci_uint32, sb_flags)                   \
     FTL_TFIELD_INT(ctx, citp_waitable, ci_uint32, sb_aflags)                  \
@@ -1066,6 +1082,36 @@ typedef struct {
     FTL_TFIELD_INT(ctx, citp_waitable, ci_int32, sigown)                \
     FTL_TFIELD_INT(ctx, citp_waitable, ci_uint32, moved_to_stack_id)    \
     FTL_TFIELD_INT(ctx, citp_waitable, ci_int32, moved_to_sock_id)      \
+    FTL_TFIELD_INT(ctx, citp_waitable, ci_int32, lat_hist)              \
+    FTL_TSTRUCT_END(ctx)
+
+#define STRUCT_LAT_HIST_STAGE(ctx)                                      \
+    FTL_TSTRUCT_BEGIN(ctx, ci_lat_hist_stage, )                         \
+    FTL_TFIELD_INT(ctx, ci_lat_hist_stage, ci_uint64, n)                \
+    FTL_TFIELD_INT(ctx, ci_lat_hist_stage, ci_uint64, sum)              \
+    FTL_TFIELD_INT(ctx, ci_lat_hist_stage, ci_uint64, max)              \
+    FTL_TFIELD_ARRAYOFINT(ctx, ci_lat_hist_stage, ci_uint32, bucket,    \
+                          CI_LAT_HIST_N_BUCKETS)                        \
+    FTL_TSTRUCT_END(ctx)
+
+#define STRUCT_LAT_HIST(ctx)                                            \
+    FTL_TSTRUCT_BEGIN(ctx, ci_lat_hist, )                               \
+    FTL_TFIELD_INT(ctx, ci_lat_hist, ci_int32, owner)                   \
+    FTL_TFIELD_ARRAYOFSTRUCT(ctx, ci_lat_hist, ci_lat_hist_stage,       \
+                             stage, CI_LAT_HIST_N_STAGES)               \
+    FTL_TSTRUCT_END(ctx)
+
+#define STRUCT_NETIF_LOCK_PROF(ctx)                                     \
+    FTL_TSTRUCT_BEGIN(ctx, ci_netif_lock_prof, )                        \
+    FTL_TFIELD_INT(ctx, ci_netif_lock_prof, ci_uint64, grant_frc)       \
+    FTL_TFIELD_INT(ctx, ci_netif_lock_prof, ci_uint32, sample_n)        \
+    FTL_TFIELD_INT(ctx, ci_netif_lock_prof, ci_uint32, sample_i)        \
+    FTL_TFIELD_INT(ctx, ci_netif_lock_prof, ci_uint32, site)            \
+    FTL_TFIELD_INT(ctx, ci_netif_lock_prof, ci_uint32, section)         \
+    FTL_TFIELD_ARRAYOFSTRUCT(ctx, ci_netif_lock_prof, ci_lat_hist_stage,\
+                             hold, CI_NETIF_LOCK_N_SITES)               \
+    FTL_TFIELD_ARRAYOFSTRUCT(ctx, ci_netif_lock_prof, ci_lat_hist_stage,\
+                             wait, CI_NETIF_LOCK_N_SITES)               \
     FTL_TSTRUCT_END(ctx)
 
 #define STRUCT_ETHER_HDR(ctx)						      \
@@ -1129,6 +1175,8 @@ typedef struct {
     FTL_TSTRUCT_BEGIN(ctx, ci_ip_cached_hdrs, )                               \
     FTL_TFIELD_STRUCT(ctx, ci_ip_cached_hdrs, cicp_mac_verinfo_t,             \
 		      mac_integrity)					      \
+    FTL_TFIELD_STRUCT(ctx, ci_ip_cached_hdrs, cicp_mac_verinfo_t,             \
+		      fwd_integrity)					      \
     FTL_TFIELD_INT(ctx, ci_ip_cached_hdrs, ci_ip_addr_t, ip_saddr_be32) \
     FTL_TFIELD_INT(ctx, ci_ip_cached_hdrs, ci_uint16, dport_be16)       \
     FTL_TFIELD_INT(ctx, ci_ip_cached_hdrs, ci_int8, status)       \
@@ -1289,6 +1337,7 @@ typedef struct oo_sock_cplane oo_sock_cplane_t;
   FTL_TFIELD_INT(ctx, ci_udp_socket_stats, ci_uint32, n_tx_msg_confirm) \
   FTL_TFIELD_INT(ctx, ci_udp_socket_stats, ci_uint32, n_tx_os_late)     \
   FTL_TFIELD_INT(ctx, ci_udp_socket_stats, ci_uint32, n_tx_unconnect_late) \
+  FTL_TFIELD_INT(ctx, ci_udp_socket_stats, ci_uint32, n_rx_filter_drop) \
   FTL_TSTRUCT_END(ctx)
 
 typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
@@ -1346,6 +1395,7 @@ typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
   FTL_TFIELD_INT(ctx, ci_udp_state, ci_uint32, tx_async_q_level)        \
   FTL_TFIELD_INT(ctx, ci_udp_state, ci_uint32, tx_count)                \
   FTL_TFIELD_STRUCT(ctx, ci_udp_state, ci_udp_socket_stats, stats)      \
+  FTL_TFIELD_INT(ctx, ci_udp_state, ci_uint32, rx_filter_len)          \
   FTL_TSTRUCT_END(ctx)
 
 #define STRUCT_IP_SOCK_STATS_COUNT(ctx) \
@@ -1570,23 +1620,35 @@ typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
 		   n_syncookie_ack_hash_rej)			              \
     FTL_TFIELD_INT(ctx, ci_tcp_socket_listen_stats, ci_uint32,                \
 		   n_syncookie_ack_answ)			              \
+    FTL_TFIELD_INT(ctx, ci_tcp_socket_listen_stats, ci_uint32,                \
+		   n_syncookie_pressure)			              \
     ON_CI_CFG_FD_CACHING(						      \
       FTL_TFIELD_INT(ctx, ci_tcp_socket_listen_stats, ci_uint32,              \
   		   n_sockcache_hit)				              \
     ) \
     FTL_TSTRUCT_END(ctx)
 
+#define STRUCT_TCP_ACCEPTQ_SHARD(ctx) \
+    FTL_TSTRUCT_BEGIN(ctx, ci_tcp_acceptq_shard, )                            \
+    FTL_TFIELD_INT(ctx, ci_tcp_acceptq_shard, ci_int32, put)                  \
+    FTL_TFIELD_INT(ctx, ci_tcp_acceptq_shard, ci_int32, get)                  \
+    FTL_TFIELD_INT(ctx, ci_tcp_acceptq_shard, ci_uint32, n_out)               \
+    FTL_TFIELD_INT(ctx, ci_tcp_acceptq_shard, ci_uint32, lock)                \
+    FTL_TSTRUCT_END(ctx)
+
 #define STRUCT_TCP_LISTEN(ctx) \
     FTL_TSTRUCT_BEGIN(ctx, ci_tcp_socket_listen, )                            \
     FTL_TFIELD_STRUCT(ctx, ci_tcp_socket_listen, ci_sock_cmn, s)              \
     FTL_TFIELD_STRUCT(ctx, ci_tcp_socket_listen, ci_tcp_socket_cmn, c)        \
     FTL_TFIELD_INT(ctx, ci_tcp_socket_listen, ci_uint32, acceptq_max)         \
-    FTL_TFIELD_INT(ctx, ci_tcp_socket_listen, ci_int32, acceptq_put)          \
     FTL_TFIELD_INT(ctx, ci_tcp_socket_listen, ci_uint32, acceptq_n_in)        \
-    FTL_TFIELD_INT(ctx, ci_tcp_socket_listen, ci_int32, acceptq_get)          \
-    FTL_TFIELD_INT(ctx, ci_tcp_socket_listen, ci_uint32, acceptq_n_out)       \
+    FTL_TFIELD_INT(ctx, ci_tcp_socket_listen, ci_uint32, acceptq_n_shards)    \
+    FTL_TFIELD_INT(ctx, ci_tcp_socket_listen, ci_uint32, acceptq_put_rr)      \
+    FTL_TFIELD_ARRAYOFSTRUCT(ctx, ci_tcp_socket_listen, ci_tcp_acceptq_shard, \
+			     acceptq, CI_CFG_TCP_ACCEPTQ_SHARDS_MAX)          \
     FTL_TFIELD_INT(ctx, ci_tcp_socket_listen, ci_int32, n_listenq)            \
     FTL_TFIELD_INT(ctx, ci_tcp_socket_listen, ci_int32, n_listenq_new)        \
+    FTL_TFIELD_INT(ctx, ci_tcp_socket_listen, ci_int32, syncookie_pressure)   \
     FTL_TFIELD_ARRAYOFSTRUCT(ctx, ci_tcp_socket_listen, ci_ni_dllist_t,       \
 			     listenq, CI_CFG_TCP_SYNACK_RETRANS_MAX + 1)      \
     FTL_TFIELD_INT(ctx, ci_tcp_socket_listen, ci_int32, bucket)               \
@@ -17,7 +17,8 @@
 *//*! \file
 ** <L5_PRIVATE L5_SOURCE>
 ** \author  as
-**  \brief  Dump state of all Onload stacks in json format to stdout.
+**  \brief  Dump state of all Onload stacks in json format to stdout, or
+**          serve counters from them on a local socket.
 **   \date  2014/12/01
 **    \cop  (c) Level 5 Networks Limited.
 ** </L5_PRIVATE>
@@ -40,6 +41,7 @@
 #include <onload/ioctl.h>
 #include <onload/driveraccess.h>
 #include <onload/debug_intf.h>
+#include <onload/ul.h>
 
 #include "ftl_defs.h"
 #include <jansson.h>
@@ -47,6 +49,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #define TRY(x)                                                  \
   do {                                                          \
@@ -76,8 +89,12 @@
 /**********************************************************/
 
 struct orm_stack {
-  ci_netif os_ni;
-  int      os_id;
+  ci_netif   os_ni;
+  int        os_id;
+  /* Used by the exporter (see orm_export_sample()). */
+  ci_uint64* os_prev;
+  int        os_have_prev;
+  int        os_seen;
 };
 
 static struct orm_stack** orm_stacks = NULL;
@@ -87,16 +104,42 @@ static int n_orm_stacks = 0;
 static int orm_map_stack(unsigned stack_id)
 {
   int rc;
-  orm_stacks = realloc(orm_stacks, (n_orm_stacks + 1) * sizeof(*orm_stacks));
-  TEST(orm_stacks);
   struct orm_stack* orm_stack = calloc(1, sizeof(*orm_stack));
   TEST(orm_stack);
-  orm_stacks[n_orm_stacks++] = orm_stack;
   orm_stack->os_id = stack_id;
-  if( (rc = ci_netif_restore_id(&orm_stack->os_ni, stack_id)) != 0 )
+  if( (rc = ci_netif_restore_id(&orm_stack->os_ni, stack_id)) != 0 ) {
     fprintf(stderr, "%s: Fail: ci_netif_restore_id(%d)=%d\n", __func__,
             stack_id, rc);
-  return rc;
+    free(orm_stack);
+    return rc;
+  }
+  orm_stacks = realloc(orm_stacks, (n_orm_stacks + 1) * sizeof(*orm_stacks));
+  TEST(orm_stacks);
+  orm_stacks[n_orm_stacks++] = orm_stack;
+  return 0;
+}
+
+
+static void orm_unmap_stack(int i)
+{
+  struct orm_stack* orm_stack = orm_stacks[i];
+  int fd = ci_netif_get_driver_handle(&orm_stack->os_ni);
+
+  ci_netif_dtor(&orm_stack->os_ni);
+  ef_onload_driver_close(fd);
+  free(orm_stack->os_prev);
+  free(orm_stack);
+  orm_stacks[i] = orm_stacks[--n_orm_stacks];
+}
+
+
+static struct orm_stack* orm_find_stack(int stack_id)
+{
+  int i;
+  for( i = 0; i < n_orm_stacks; ++i )
+    if( orm_stacks[i]->os_id == stack_id )
+      return orm_stacks[i];
+  return NULL;
 }
 
 
@@ -219,19 +262,24 @@ struct orm_oo_stat {
   const char* oos_name;
   unsigned    oos_offset;
   unsigned    oos_size;
+  int         oos_gauge;   /* a value rather than a count */
 };
 
+#define ORM_OO_STAT_GAUGE_count  0
+#define ORM_OO_STAT_GAUGE_val    1
+
 
 #undef stat_initialiser
-#define stat_initialiser(type, field, name)             \
+#define stat_initialiser(type, field, name, kind)       \
   { .oos_name = (name),                                 \
     .oos_offset = CI_MEMBER_OFFSET(type, field),        \
     .oos_size = CI_MEMBER_SIZE(type, field),            \
+    .oos_gauge = ORM_OO_STAT_GAUGE_##kind,              \
   }
 
 #undef  OO_STAT
 #define OO_STAT(desc, type, name, kind)                 \
-  stat_initialiser(ci_netif_stats, name, #name),
+  stat_initialiser(ci_netif_stats, name, #name, kind),
 
 static struct orm_oo_stat orm_oo_stats[] = {
 #include <ci/internal/stats_def.h>
@@ -770,6 +818,8 @@ static void orm_waitable_dump(ci_netif* ni, const char* sock_type)
                (w->state & CI_TCP_STATE_TCP) ) {
         dump_buf_cat("\"%d\": {", W_FMT(w));
         orm_dump_struct("ci_tcp_state", &wo->tcp);
+        if( OO_SP_NOT_NULL(w->lat_hist) )
+          orm_dump_struct("ci_lat_hist", ci_lat_hist_get(ni, w));
         dump_buf_cleanup();
         dump_buf_cat("}, ");
       }
@@ -778,6 +828,8 @@ static void orm_waitable_dump(ci_netif* ni, const char* sock_type)
                (w->state == CI_TCP_STATE_UDP) ) {
         dump_buf_cat("\"%d\": {", W_FMT(w));
         orm_dump_struct("ci_udp_state", &wo->udp);
+        if( OO_SP_NOT_NULL(w->lat_hist) )
+          orm_dump_struct("ci_lat_hist", ci_lat_hist_get(ni, w));
         dump_buf_cleanup();
         dump_buf_cat("}, ");
       }
@@ -816,6 +868,652 @@ static int orm_shared_state_dump(ci_netif* ni)
 }
 
 
+/**********************************************************/
+/* Exporter */
+/**********************************************************/
+
+/* With --listen or --port orm_json stays running.  Stacks are mapped once
+ * and the mappings are kept until the stack goes away.  At each interval
+ * the selected fields of every stack's ci_netif_state are sampled, and
+ * served on a local socket either as Prometheus text (one exposition per
+ * connection) or as line-delimited JSON (one line of deltas per interval
+ * to every connected client).  Sockets are only read and written when
+ * they are ready, so a slow client does not hold up sampling.
+ *
+ * Fields are selected by dotted path (e.g. "stats", "stats_cumulative.tcp"
+ * or "lock_prof.wait.1.n").  The selection is resolved against the FTL
+ * descriptions once at start of day into a flat table of offsets, so each
+ * sample is just a walk over that table.
+ */
+
+#define ORM_EXPORT_MAX_CLIENTS  64
+
+/* A Prometheus client has this long to send its request, and then the
+ * rest of ORM_EXPORT_CLIENT_MS to take the response.
+ */
+#define ORM_EXPORT_REQUEST_MS   1000
+#define ORM_EXPORT_CLIENT_MS    5000
+
+enum orm_export_format {
+  ORM_EXPORT_JSON,
+  ORM_EXPORT_PROMETHEUS,
+};
+
+struct orm_metric {
+  char*       om_name;
+  const char* om_type;   /* Prometheus metric type */
+  unsigned    om_offset;
+  unsigned    om_size;
+};
+
+/* A Prometheus client.  The response is a snapshot taken when the request
+ * has been read.
+ */
+struct orm_scrape {
+  int       osc_fd;
+  ci_uint64 osc_start_ms;
+  char      osc_req[1024];
+  size_t    osc_req_len;
+  char*     osc_resp;    /* NULL until the request has been read */
+  size_t    osc_resp_len;
+  size_t    osc_resp_sent;
+};
+
+static struct orm_metric* orm_metrics = NULL;
+static int n_orm_metrics = 0;
+
+static const char** orm_selectors = NULL;
+static int n_orm_selectors = 0;
+
+static enum orm_export_format cfg_format = ORM_EXPORT_JSON;
+static unsigned cfg_interval_ms = 1000;
+static const char* cfg_listen = NULL;
+static int cfg_port = 0;
+
+static int orm_clients[ORM_EXPORT_MAX_CLIENTS];
+static int n_orm_clients = 0;
+
+static struct orm_scrape orm_scrapes[ORM_EXPORT_MAX_CLIENTS];
+static int n_orm_scrapes = 0;
+
+
+static int orm_path_selected(const char* path)
+{
+  int i;
+  size_t len;
+  for( i = 0; i < n_orm_selectors; ++i ) {
+    len = strlen(orm_selectors[i]);
+    if( ! strncmp(path, orm_selectors[i], len) &&
+        (path[len] == '\0' || path[len] == '.') )
+      return 1;
+  }
+  return 0;
+}
+
+
+/* The Prometheus type of field [of] of [os]. */
+static const char* orm_metric_type(const struct orm_oo_struct* os,
+                                   const struct orm_oo_field* of)
+{
+  static const char count_suffix[] = "_stats_count";
+  const struct orm_oo_stat* oos;
+  size_t len = strlen(os->os_struct_name);
+
+  if( ! strcmp(os->os_struct_name, "ci_netif_stats") ) {
+    for( oos = orm_oo_stats; oos < orm_oo_stats + N_ORM_OO_STATS; ++oos )
+      if( ! strcmp(oos->oos_name, of->of_name) )
+        return oos->oos_gauge ? "gauge" : "counter";
+  }
+  else if( len >= sizeof(count_suffix) - 1 &&
+           ! strcmp(os->os_struct_name + len - (sizeof(count_suffix) - 1),
+                    count_suffix) ) {
+    return "counter";
+  }
+  else if( ! strcmp(os->os_struct_name, "ci_lat_hist_stage") ) {
+    return strcmp(of->of_name, "max") ? "counter" : "gauge";
+  }
+  return "untyped";
+}
+
+
+static void orm_metric_add(const char* path, const char* type,
+                           unsigned offset, unsigned size)
+{
+  struct orm_metric* om;
+  orm_metrics = realloc(orm_metrics, (n_orm_metrics + 1) *
+                        sizeof(*orm_metrics));
+  TEST(orm_metrics);
+  om = &orm_metrics[n_orm_metrics++];
+  TEST(om->om_name = strdup(path));
+  om->om_type = type;
+  om->om_offset = offset;
+  om->om_size = size;
+}
+
+
+static void orm_metrics_compile(const struct orm_oo_struct* os,
+                                const char* prefix, unsigned base)
+{
+  char path[256];
+  unsigned i;
+  int j;
+
+  for( j = 0; j < os->os_n_fields; ++j ) {
+    const struct orm_oo_field* of = os->os_fields[j];
+    if( prefix[0] )
+      snprintf(path, sizeof(path), "%s.%s", prefix, of->of_name);
+    else
+      snprintf(path, sizeof(path), "%s", of->of_name);
+
+    switch( of->of_type ) {
+    case ORM_OO_FIELD_TYPE_INT:
+      if( orm_path_selected(path) )
+        orm_metric_add(path, orm_metric_type(os, of), base + of->of_offset,
+                       of->u.i.of_size);
+      break;
+    case ORM_OO_FIELD_TYPE_STRUCT:
+      orm_metrics_compile(of->u.s.of_struct, path, base + of->of_offset);
+      break;
+    case ORM_OO_FIELD_TYPE_ARRAY_INT:
+      for( i = 0; i < of->u.ai.of_array_len; ++i ) {
+        char elem[sizeof(path) + 16];
+        snprintf(elem, sizeof(elem), "%s.%u", path, i);
+        if( orm_path_selected(elem) )
+          orm_metric_add(elem, orm_metric_type(os, of),
+                         base + of->of_offset + i * of->u.ai.of_size,
+                         of->u.ai.of_size);
+      }
+      break;
+    case ORM_OO_FIELD_TYPE_ARRAY_STRUCT:
+      for( i = 0; i < of->u.as.of_array_len; ++i ) {
+        char elem[sizeof(path) + 16];
+        snprintf(elem, sizeof(elem), "%s.%u", path, i);
+        orm_metrics_compile(of->u.as.of_struct, elem, base + of->of_offset +
+                            i * of->u.as.of_struct->os_size);
+      }
+      break;
+    case ORM_OO_FIELD_TYPE_BITFIELD:
+      /* Only the config options have these, and they are not counters. */
+      break;
+    }
+  }
+}
+
+
+static void orm_metrics_init(void)
+{
+  int i;
+
+  for( i = 0; i < n_orm_oo_structs_index; ++i )
+    if( ! strcmp(orm_oo_structs[i]->os_struct_name, "ci_netif_state") )
+      break;
+  TEST(i < n_orm_oo_structs_index);
+  orm_metrics_compile(orm_oo_structs[i], "", 0);
+  if( n_orm_metrics == 0 ) {
+    fprintf(stderr, "orm_json: no fields match the selection\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+
+static ci_uint64 orm_metric_read(const struct orm_metric* om,
+                                 const ci_netif_state* ns)
+{
+  const char* p = (const char*) ns + om->om_offset;
+  switch( om->om_size ) {
+  case sizeof(ci_uint8):   return *(const volatile ci_uint8*) p;
+  case sizeof(ci_uint16):  return *(const volatile ci_uint16*) p;
+  case sizeof(ci_uint32):  return *(const volatile ci_uint32*) p;
+  default:                 return *(const volatile ci_uint64*) p;
+  }
+}
+
+
+/* Counters narrower than 64 bits wrap at their own width. */
+static ci_uint64 orm_metric_delta(const struct orm_metric* om,
+                                  ci_uint64 cur, ci_uint64 prev)
+{
+  if( om->om_size >= sizeof(ci_uint64) )
+    return cur - prev;
+  return (cur - prev) & ((1ull << (om->om_size * 8)) - 1);
+}
+
+
+/* Map new stacks and drop those that only we are still holding. */
+static void orm_update_stacks(oo_fd fd)
+{
+  ci_netif_info_t info;
+  struct orm_stack* orm_stack;
+  int i = 0;
+
+  for( i = 0; i < n_orm_stacks; ++i )
+    orm_stacks[i]->os_seen = 0;
+
+  memset(&info, 0, sizeof(info));
+  i = 0;
+  while( i >= 0 ) {
+    info.ni_index = i;
+    info.ni_orphan = 0;
+    info.ni_subop = CI_DBG_NETIF_INFO_GET_NEXT_NETIF;
+    if( oo_ioctl(fd, OO_IOC_DBG_GET_STACK_INFO, &info) != 0 )
+      break;
+    if( info.ni_exists ) {
+      if( (orm_stack = orm_find_stack(info.ni_index)) != NULL ) {
+        /* Our own mapping and fd account for two references. */
+        if( info.rs_ref_count > 2 )
+          orm_stack->os_seen = 1;
+      }
+      else if( orm_map_stack(info.ni_index) == 0 ) {
+        orm_stack = orm_stacks[n_orm_stacks - 1];
+        orm_stack->os_prev = calloc(n_orm_metrics, sizeof(ci_uint64));
+        TEST(orm_stack->os_prev);
+        orm_stack->os_seen = 1;
+      }
+    }
+    i = info.u.ni_next_ni.index;
+  }
+
+  for( i = n_orm_stacks - 1; i >= 0; --i )
+    if( ! orm_stacks[i]->os_seen )
+      orm_unmap_stack(i);
+}
+
+
+/* Appends a stack name to the dump_buf as a quoted string.  Anything but
+ * printable ASCII is replaced, and the JSON string writer escapes quotes
+ * and backslashes, which suits the Prometheus label syntax too.
+ */
+static void orm_export_stack_name(const ci_netif_state* ns)
+{
+  char name[CI_CFG_STACK_NAME_LEN + 1];
+  json_t* str;
+  char* quoted;
+  int i;
+
+  for( i = 0; i < CI_CFG_STACK_NAME_LEN && ns->name[i] != '\0'; ++i )
+    name[i] = isprint((unsigned char) ns->name[i]) ? ns->name[i] : '?';
+  name[i] = '\0';
+  TEST(str = json_string(name));
+  TEST(quoted = json_dumps(str, JSON_ENCODE_ANY));
+  dump_buf_cat("%s", quoted);
+  free(quoted);
+  json_decref(str);
+}
+
+
+static void orm_export_prometheus_name(const char* path)
+{
+  const char* c;
+  dump_buf_cat("onload_");
+  for( c = path; *c; ++c )
+    __dump_buf_cat(isalnum(*c) ? c : "_", 1);
+}
+
+
+/* Builds a Prometheus exposition of the current values in the dump_buf. */
+static void orm_export_prometheus(void)
+{
+  const struct orm_metric* om;
+  int i;
+
+  db.db_used = 0;
+  for( om = orm_metrics; om < orm_metrics + n_orm_metrics; ++om ) {
+    dump_buf_cat("# TYPE ");
+    orm_export_prometheus_name(om->om_name);
+    dump_buf_cat(" %s\n", om->om_type);
+    for( i = 0; i < n_orm_stacks; ++i ) {
+      ci_netif* ni = &orm_stacks[i]->os_ni;
+      orm_export_prometheus_name(om->om_name);
+      dump_buf_cat("{stack=\"%d\",stack_name=", orm_stacks[i]->os_id);
+      orm_export_stack_name(ni->state);
+      dump_buf_cat("} %llu\n",
+                   (unsigned long long) orm_metric_read(om, ni->state));
+    }
+  }
+  __dump_buf_cat("", 1);
+}
+
+
+/* Samples every stack, and builds a line of JSON in the dump_buf with the
+ * fields that changed over the interval.  Stacks mapped since the last
+ * sample only report at the next one.
+ */
+static void orm_export_sample(unsigned interval_ms)
+{
+  const struct orm_metric* om;
+  struct timespec now;
+  ci_uint64 v, d;
+  int i, m;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  db.db_used = 0;
+  dump_buf_cat("{\"time_ms\": %llu, \"interval_ms\": %u, \"stacks\": [",
+               (unsigned long long) now.tv_sec * 1000 +
+               now.tv_nsec / 1000000, interval_ms);
+  for( i = 0; i < n_orm_stacks; ++i ) {
+    struct orm_stack* orm_stack = orm_stacks[i];
+    ci_netif_state* ns = orm_stack->os_ni.state;
+    int have_prev = orm_stack->os_have_prev;
+
+    if( have_prev ) {
+      dump_buf_cat("{\"id\": %d, \"name\": ", orm_stack->os_id);
+      orm_export_stack_name(ns);
+      dump_buf_cat(", \"pid\": %d, \"delta\": {", ns->pid);
+    }
+    for( m = 0; m < n_orm_metrics; ++m ) {
+      om = &orm_metrics[m];
+      v = orm_metric_read(om, ns);
+      d = orm_metric_delta(om, v, orm_stack->os_prev[m]);
+      orm_stack->os_prev[m] = v;
+      if( have_prev && d != 0 )
+        dump_buf_cat("\"%s\": %llu, ", om->om_name, (unsigned long long) d);
+    }
+    orm_stack->os_have_prev = 1;
+    if( have_prev ) {
+      dump_buf_cleanup();
+      dump_buf_cat("}}, ");
+    }
+  }
+  dump_buf_cleanup();
+  dump_buf_cat("]}\n");
+  __dump_buf_cat("", 1);
+}
+
+
+static int orm_export_listen(void)
+{
+  int fd, one = 1;
+
+  if( cfg_listen != NULL ) {
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    TEST(strlen(cfg_listen) < sizeof(sa.sun_path));
+    strcpy(sa.sun_path, cfg_listen);
+    unlink(cfg_listen);
+    TRY(fd = socket(AF_UNIX, SOCK_STREAM, 0));
+    TRY(bind(fd, (struct sockaddr*) &sa, sizeof(sa)));
+  }
+  else {
+    /* Local only: this exposes stack internals. */
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(cfg_port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TRY(fd = socket(AF_INET, SOCK_STREAM, 0));
+    TRY(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+    TRY(bind(fd, (struct sockaddr*) &sa, sizeof(sa)));
+  }
+  TRY(listen(fd, 16));
+  TRY(fcntl(fd, F_SETFL, O_NONBLOCK));
+  return fd;
+}
+
+
+/* Returns false if [fd] could not take the whole buffer.  Clients that
+ * fall behind are dropped rather than holding up the others.
+ */
+static int orm_export_write(int fd, const char* buf, size_t len)
+{
+  return send(fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t) len;
+}
+
+
+static void orm_scrape_close(int i)
+{
+  close(orm_scrapes[i].osc_fd);
+  free(orm_scrapes[i].osc_resp);
+  orm_scrapes[i] = orm_scrapes[--n_orm_scrapes];
+}
+
+
+static ci_uint64 orm_scrape_deadline(const struct orm_scrape* sc)
+{
+  return sc->osc_start_ms + (sc->osc_resp == NULL ?
+                             ORM_EXPORT_REQUEST_MS : ORM_EXPORT_CLIENT_MS);
+}
+
+
+static void orm_scrape_respond(struct orm_scrape* sc)
+{
+  static const char http_hdr[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: text/plain; version=0.0.4\r\n\r\n";
+  size_t hdr_len = sizeof(http_hdr) - 1;
+
+  orm_export_prometheus();
+  sc->osc_resp_len = hdr_len + db.db_used - 1;
+  TEST(sc->osc_resp = malloc(sc->osc_resp_len));
+  memcpy(sc->osc_resp, http_hdr, hdr_len);
+  memcpy(sc->osc_resp + hdr_len, dump_buf_get(), db.db_used - 1);
+  sc->osc_resp_sent = 0;
+}
+
+
+/* Makes what progress it can with client [i] without blocking, and closes
+ * it when it is done or has run out of time.
+ */
+static void orm_scrape_service(int i, ci_uint64 now)
+{
+  struct orm_scrape* sc = &orm_scrapes[i];
+  size_t space;
+  ssize_t rc;
+
+  if( sc->osc_resp == NULL ) {
+    /* Whatever the request, the answer is the same.  It is read first so
+     * that closing does not reset the connection.
+     */
+    do {
+      space = sizeof(sc->osc_req) - 1 - sc->osc_req_len;
+      rc = recv(sc->osc_fd, sc->osc_req + sc->osc_req_len, space,
+                MSG_DONTWAIT);
+      if( rc > 0 )
+        sc->osc_req_len += rc;
+    } while( rc > 0 );
+    sc->osc_req[sc->osc_req_len] = '\0';
+    if( rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK ) {
+      orm_scrape_close(i);
+      return;
+    }
+    if( rc != 0 && strstr(sc->osc_req, "\r\n\r\n") == NULL &&
+        now < orm_scrape_deadline(sc) )
+      return;
+    orm_scrape_respond(sc);
+  }
+
+  while( sc->osc_resp_sent < sc->osc_resp_len ) {
+    rc = send(sc->osc_fd, sc->osc_resp + sc->osc_resp_sent,
+              sc->osc_resp_len - sc->osc_resp_sent,
+              MSG_NOSIGNAL | MSG_DONTWAIT);
+    if( rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+        now < orm_scrape_deadline(sc) )
+      return;
+    if( rc <= 0 )
+      break;
+    sc->osc_resp_sent += rc;
+  }
+  orm_scrape_close(i);
+}
+
+
+static void orm_export_accept(int lfd, ci_uint64 now)
+{
+  struct orm_scrape* sc;
+  int fd;
+
+  while( (fd = accept(lfd, NULL, NULL)) >= 0 ) {
+    if( cfg_format == ORM_EXPORT_PROMETHEUS &&
+        n_orm_scrapes < ORM_EXPORT_MAX_CLIENTS ) {
+      sc = &orm_scrapes[n_orm_scrapes++];
+      memset(sc, 0, sizeof(*sc));
+      sc->osc_fd = fd;
+      sc->osc_start_ms = now;
+    }
+    else if( cfg_format == ORM_EXPORT_JSON &&
+             n_orm_clients < ORM_EXPORT_MAX_CLIENTS ) {
+      orm_clients[n_orm_clients++] = fd;
+    }
+    else {
+      close(fd);
+    }
+  }
+}
+
+
+static void orm_export_broadcast(void)
+{
+  int i;
+  for( i = n_orm_clients - 1; i >= 0; --i )
+    if( ! orm_export_write(orm_clients[i], dump_buf_get(), db.db_used - 1) ) {
+      close(orm_clients[i]);
+      orm_clients[i] = orm_clients[--n_orm_clients];
+    }
+}
+
+
+static ci_uint64 orm_now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ci_uint64) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static void orm_export(void)
+{
+  struct pollfd pfds[1 + ORM_EXPORT_MAX_CLIENTS];
+  ci_uint64 now, last, next, wake;
+  oo_fd fd;
+  int rc, i, n;
+
+  if( (rc = oo_fd_open(&fd)) != 0 ) {
+    fprintf(stderr, "orm_json: oo_fd_open()=%d.  Onload drivers loaded?\n",
+            rc);
+    exit(EXIT_FAILURE);
+  }
+  orm_metrics_init();
+  signal(SIGPIPE, SIG_IGN);
+  pfds[0].fd = orm_export_listen();
+  pfds[0].events = POLLIN;
+
+  last = orm_now_ms();
+  orm_update_stacks(fd);
+  orm_export_sample(0);
+  next = last + cfg_interval_ms;
+
+  while( 1 ) {
+    now = orm_now_ms();
+    if( now >= next ) {
+      orm_update_stacks(fd);
+      orm_export_sample(now - last);
+      if( cfg_format == ORM_EXPORT_JSON )
+        orm_export_broadcast();
+      last = now;
+      next += cfg_interval_ms;
+      if( next <= now )
+        next = now + cfg_interval_ms;
+    }
+
+    wake = next;
+    n = n_orm_scrapes;
+    for( i = 0; i < n; ++i ) {
+      pfds[i + 1].fd = orm_scrapes[i].osc_fd;
+      pfds[i + 1].events = orm_scrapes[i].osc_resp ? POLLOUT : POLLIN;
+      pfds[i + 1].revents = 0;
+      if( orm_scrape_deadline(&orm_scrapes[i]) < wake )
+        wake = orm_scrape_deadline(&orm_scrapes[i]);
+    }
+    if( poll(pfds, 1 + n, wake > now ? wake - now : 0) < 0 )
+      continue;
+
+    now = orm_now_ms();
+    /* Closing a client moves the last one into its slot, so go backwards
+     * to visit each once.
+     */
+    for( i = n - 1; i >= 0; --i )
+      if( pfds[i + 1].revents || now >= orm_scrape_deadline(&orm_scrapes[i]) )
+        orm_scrape_service(i, now);
+    if( pfds[0].revents & POLLIN )
+      orm_export_accept(pfds[0].fd, now);
+  }
+}
+
+
+static void orm_usage(void)
+{
+  fprintf(stderr,
+    "usage:\n"
+    "  orm_json                 dump all stacks as json and exit\n"
+    "  orm_json [options] --listen=<path> | --port=<port>\n"
+    "                           serve stack counters on a local socket\n"
+    "options:\n"
+    "  --format=json            a line of json with the counters that\n"
+    "                           changed, every interval (default)\n"
+    "  --format=prometheus      prometheus text, once per connection\n"
+    "  --interval=<ms>          sample interval (default 1000)\n"
+    "  --field=<path>           ci_netif_state field(s) to export, e.g.\n"
+    "                           stats_cumulative.tcp (repeatable; default\n"
+    "                           stats and stats_cumulative)\n");
+  exit(EXIT_FAILURE);
+}
+
+
+static int orm_parse_args(int argc, char* argv[])
+{
+  static const struct option long_opts[] = {
+    { "listen",   required_argument, NULL, 'l' },
+    { "port",     required_argument, NULL, 'p' },
+    { "format",   required_argument, NULL, 'f' },
+    { "interval", required_argument, NULL, 'i' },
+    { "field",    required_argument, NULL, 'F' },
+    { NULL, 0, NULL, 0 },
+  };
+  int c;
+
+  while( (c = getopt_long(argc, argv, "", long_opts, NULL)) != -1 )
+    switch( c ) {
+    case 'l':
+      cfg_listen = optarg;
+      break;
+    case 'p':
+      cfg_port = atoi(optarg);
+      break;
+    case 'f':
+      if( ! strcmp(optarg, "json") )
+        cfg_format = ORM_EXPORT_JSON;
+      else if( ! strcmp(optarg, "prometheus") )
+        cfg_format = ORM_EXPORT_PROMETHEUS;
+      else
+        orm_usage();
+      break;
+    case 'i':
+      if( (cfg_interval_ms = atoi(optarg)) == 0 )
+        orm_usage();
+      break;
+    case 'F':
+      orm_selectors = realloc(orm_selectors, (n_orm_selectors + 1) *
+                              sizeof(*orm_selectors));
+      TEST(orm_selectors);
+      orm_selectors[n_orm_selectors++] = optarg;
+      break;
+    default:
+      orm_usage();
+    }
+  if( optind != argc )
+    orm_usage();
+
+  if( cfg_listen == NULL && cfg_port == 0 )
+    return 0;
+  if( n_orm_selectors == 0 ) {
+    static const char* default_selectors[] = { "stats", "stats_cumulative" };
+    orm_selectors = default_selectors;
+    n_orm_selectors = 2;
+  }
+  return 1;
+}
+
+
 /**********************************************************/
 /* Main */
 /**********************************************************/
@@ -844,6 +1542,14 @@ int main(int argc, char* argv[])
   json_t* root;
   json_error_t error;
 
+  if( orm_parse_args(argc, argv) ) {
+    oos_ftl_init();
+    oos_cfg_opts_contruct();
+    oos_ftl_construct();
+    orm_export();
+    return 0;
+  }
+
   if( orm_map_stacks() != 0 )
     exit(EXIT_FAILURE);
   if( n_orm_stacks == 0 )